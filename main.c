@@ -27,404 +27,795 @@
 #include <sys/stat.h>
 #include <fcntl.h>
 #include <locale.h>
+#include <stdint.h>
+#include <sys/wait.h>
+#include <dirent.h>
+#include <poll.h>
+#include <pthread.h>
+#include <zlib.h>
 
 #include "nxcreole_parser.h"
+#include "nxcreole_arena.h"
+#include "nxcreole_out.h"
+#include "nxcreole_text.h"
+#include "nxcreole_xhtml.h"
+#include "nxcreole_tee.h"
+#include "nxcreole_fuse.h"
+#include "nxcreole_markup.h"
+#include "nxcreole_template.h"
+#include "nxcreole_resolve.h"
+#include "nxcreole_cache.h"
+#include "nxcreole_linkdb.h"
+#include "nxcreole_zsink.h"
+#include "nxcreole_pool.h"
+#include "nxcreole_json.h"
+#include "nxcreole_toc.h"
 
 #define ERROR(msg, p) fprintf(stderr, "ERROR: " msg " %s\n", (p));
 
-static char* out;
+static nxcreole_arena arena; // reset for every document
+static nxcreole_block_cache* blocks; // shared by all renders if set (--block-cache)
 
-static char* unicode2utf8(const wchar_t* text, size_t length, char* b) {
-  while (length--) {
-    unsigned int c=(unsigned int)*text++;
-    if (c<0x80) *b++=(char)c;
-    else if (c<0x800) *b++=(char)(192+c/64), *b++=(char)(128+c%64);
-    else if (c-0xd800u<0x800) goto error;
-    else if (c<0x10000) *b++=(char)(224+c/4096), *b++=(char)(128+c/64%64), *b++=(char)(128+c%64);
-    else if (c<0x110000) *b++=(char)(240+c/262144), *b++=(char)(128+c/4096%64), *b++=(char)(128+c/64%64), *b++=(char)(128+c%64);
-    else goto error;
+static wchar_t* decode_input(const char* input) {
+  size_t text_len=mbstowcs(0, input, 0);
+  if (text_len==(size_t)-1) {
+    fprintf(stderr, "invalid input multi-byte string\n");
+    return 0;
   }
-  return b;
-  error:
-  fprintf(stderr, "invalid unicode code point\n");
-  return b;
+  nxcreole_arena_reset(&arena);
+  wchar_t* text=nxcreole_arena_alloc(&arena, (text_len+1)*sizeof(wchar_t));
+  if (!text) {
+    fprintf(stderr, "out of memory\n");
+    return 0;
+  }
+  if ((size_t)-1==mbstowcs(text, input, (size_t)text_len+1)) {
+    fprintf(stderr, "invalid input multi-byte string (2)\n");
+    return 0;
+  }
+  return text;
 }
 
-static void print_unicode(const wchar_t* text, size_t length) {
-/*
-  char buf[length*4], *end;
-  end=unicode2utf8(text, length, buf);
-  fwrite(buf, 1, end-buf, stdout);
-*/
-  out=unicode2utf8(text, length, out);
-}
+int render_xhtml(const char* input, nxcreole_out* xhtml_out) {
+  wchar_t* text=decode_input(input);
+  if (!text) return 0;
+
+  nxcreole_parse_ctx ctx;
+  nxcreole_xhtml_serializer xs;
+
+  nxcreole_init(&ctx, text);
+  nxcreole_xhtml_init(&ctx, &xs, xhtml_out);
+  nxcreole_use_arena(&ctx, &arena);
+  ctx.blocks=blocks;
+  nxcreole_xhtml_parse(&ctx);
 
-static void print_unicode_sz(const wchar_t* text) {
-  print_unicode(text, wcslen(text));
+  return 0;
 }
 
-static void print_unicode_html(const wchar_t* text, size_t length) {
-  while (length--) {
-    wchar_t c=*text++;
-    switch (c) {
-      case L'<':
-        print_unicode_sz(L"&lt;");
-        break;
-      case L'>':
-        print_unicode_sz(L"&gt;");
-        break;
-      case L'"':
-        print_unicode_sz(L"&quot;");
-        break;
-      case L'\'':
-        print_unicode_sz(L"&#39;");
-        break;
-      case L'&':
-        print_unicode_sz(L"&amp;");
-        break;
-      default:
-        print_unicode(&c, 1);
-        break;
-    }
+// TOC goes in place of <<<toc>>> or, if page has none, before page
+int render_xhtml_toc(const char* input, nxcreole_out* xhtml_out) {
+  wchar_t* text=decode_input(input);
+  if (!text) return 0;
+
+  nxcreole_parse_ctx ctx;
+  nxcreole_xhtml_serializer xs;
+  nxcreole_out page;
+  nxcreole_toc toc;
+  if (nxcreole_out_init(&page, strlen(input)*2, 0, 0)) return -1;
+  if (nxcreole_toc_init(&toc)) {
+    nxcreole_out_free(&page);
+    return -1;
   }
+
+  nxcreole_init(&ctx, text);
+  nxcreole_xhtml_init(&ctx, &xs, &page);
+  nxcreole_use_arena(&ctx, &arena);
+  ctx.blocks=blocks;
+  nxcreole_xhtml_use_toc(&ctx, &xs, &toc);
+  nxcreole_xhtml_parse(&ctx);
+  int res=nxcreole_toc_finish(&toc, &page) || page.error? -1:0;
+  if (!toc.placed) nxcreole_out_write(xhtml_out, toc.out.buf, toc.out.length);
+  nxcreole_out_write(xhtml_out, page.buf, page.length);
+
+  nxcreole_toc_free(&toc);
+  nxcreole_out_free(&page);
+  return res;
 }
 
-static void append_text(const wchar_t* s, size_t len) {
-  // fprintf(stderr, "append_text %d wchars\n", (int)len);
-  print_unicode_html(s, len);
+int render_markup(const char* input, const nxcreole_markup* markup, nxcreole_out* out) {
+  wchar_t* text=decode_input(input);
+  if (!text) return 0;
+
+  nxcreole_parse_ctx ctx;
+  nxcreole_markup_serializer ms;
+
+  nxcreole_init(&ctx, text);
+  nxcreole_markup_init(&ctx, &ms, markup, out);
+  nxcreole_use_arena(&ctx, &arena);
+  ctx.blocks=blocks;
+  nxcreole_parse(&ctx);
+
+  return 0;
 }
 
-static void append_table_open() {
-  print_unicode_sz(L"<table>");
+int render_text(const char* input, nxcreole_out* text_out) {
+  wchar_t* text=decode_input(input);
+  if (!text) return 0;
+
+  nxcreole_parse_ctx ctx;
+  nxcreole_text_serializer ts;
+
+  nxcreole_init(&ctx, text);
+  nxcreole_text_init(&ctx, &ts, text_out);
+  nxcreole_use_arena(&ctx, &arena);
+  ctx.blocks=blocks;
+  nxcreole_parse(&ctx);
+
+  return 0;
 }
 
-static void append_table_row_open() {
-  print_unicode_sz(L"<tr>");
+int render_json(const char* input, nxcreole_out* json_out) {
+  wchar_t* text=decode_input(input);
+  if (!text) return 0;
+
+  nxcreole_parse_ctx ctx;
+  nxcreole_json_serializer js;
+
+  nxcreole_init(&ctx, text);
+  nxcreole_json_init(&ctx, &js, json_out);
+  nxcreole_use_arena(&ctx, &arena);
+  ctx.blocks=blocks;
+  nxcreole_json_parse(&ctx);
+  nxcreole_json_finish(&js);
+
+  return 0;
 }
 
-static void append_table_head_cell_open(const wchar_t* s, size_t len) {
-  if (len==1 && *s==L'1') {
-    print_unicode_sz(L"<th>");
+static void report_backlinks(const nxcreole_linkdb* db, const char* name, nxcreole_out* out) {
+  int64_t id=nxcreole_linkdb_find(db, name);
+  if (id<0) return;
+  size_t i, count;
+  const nxcreole_linkdb_link* links=nxcreole_linkdb_links_to(db, (uint32_t)id, &count);
+  for (i=0; i<count; i++) {
+    if (i && links[i].source==links[i-1].source) continue; // both linked and shown as image
+    nxcreole_out_puts(out, nxcreole_linkdb_name(db, links[i].source));
+    nxcreole_out_puts(out, "\n");
   }
-  else {
-    print_unicode_sz(L"<th colspan=\"");
-    print_unicode(s, len);
-    print_unicode_sz(L"\">");
+}
+
+// pages no other page links to
+static void report_orphans(const nxcreole_linkdb* db, nxcreole_out* out) {
+  uint32_t i;
+  size_t j, count;
+  for (i=0; i<db->page_count; i++) {
+    uint32_t id=db->pages[i].name;
+    const nxcreole_linkdb_link* links=nxcreole_linkdb_links_to(db, id, &count);
+    for (j=0; j<count && (links[j].kind!=NXCREOLE_LINKDB_LINK || links[j].source==id); j++);
+    if (j<count) continue;
+    nxcreole_out_puts(out, nxcreole_linkdb_name(db, id));
+    nxcreole_out_puts(out, "\n");
   }
 }
 
-static void append_table_head_cell_close() {
-  print_unicode_sz(L"</th>");
+// links to pages that don't exist and images of files that don't exist: kind, target, source
+static void report_missing(const nxcreole_linkdb* db, nxcreole_out* out) {
+  uint32_t i;
+  for (i=0; i<db->link_count; i++) {
+    const nxcreole_linkdb_link* l=&db->backward[i];
+    uint32_t flags=db->flags[l->target];
+    if (l->kind==NXCREOLE_LINKDB_LINK? flags&NXCREOLE_LINKDB_PAGE : flags&(NXCREOLE_LINKDB_FILE|NXCREOLE_LINKDB_PAGE)) continue;
+    nxcreole_out_puts(out, l->kind==NXCREOLE_LINKDB_LINK? "link\t":"image\t");
+    nxcreole_out_puts(out, nxcreole_linkdb_name(db, l->target));
+    nxcreole_out_puts(out, "\t");
+    nxcreole_out_puts(out, nxcreole_linkdb_name(db, l->source));
+    nxcreole_out_puts(out, "\n");
+  }
 }
 
-static void append_table_cell_open(const wchar_t* s, size_t len) {
-  if (len==1 && *s==L'1') {
-    print_unicode_sz(L"<td>");
+static char* load_file(const char* filepath) {
+  struct stat st;
+  if (stat(filepath, &st)==-1) {
+    // ERROR("can't find file", filepath);
+    return 0;
   }
-  else {
-    print_unicode_sz(L"<td colspan=\"");
-    print_unicode(s, len);
-    print_unicode_sz(L"\">");
+  int fd=open(filepath, O_RDONLY);
+  if (fd==-1) {
+    ERROR("can't open file", filepath);
+    return 0;
+  }
+  char* text=malloc((size_t)(st.st_size+1));
+  if (st.st_size!=read(fd, text, (size_t)st.st_size)) {
+    ERROR("can't read file", filepath);
+    close(fd);
+    free(text);
+    return 0;
   }
+  close(fd);
+  text[st.st_size]='\0';
+  return text;
 }
 
-static void append_table_cell_close() {
-  print_unicode_sz(L"</td>");
+static int save_file(const char* filepath, const char* text) {
+  int fd=open(filepath, O_WRONLY|O_CREAT|O_TRUNC, 0644);
+  if (fd==-1) {
+    ERROR("can't open file", filepath);
+    return -1;
+  }
+  size_t length=strlen(text);
+  if (length!=write(fd, text, length)) {
+    ERROR("can't write file", filepath);
+    close(fd);
+    return -1;
+  }
+  close(fd);
+  return 0;
 }
 
-static void append_table_row_close() {
-  print_unicode_sz(L"</tr>");
-}
+static int run_test(int test_number, char* input, const char* expected_output) {
+  nxcreole_out xhtml_out;
+  if (nxcreole_out_init(&xhtml_out, strlen(input)*2, 0, 0)) return 0;
+  render_xhtml(input, &xhtml_out);
+  const char* buf=nxcreole_out_cstr(&xhtml_out);
 
-static void append_table_close() {
-  print_unicode_sz(L"</table>");
+  char fname[32];
+  sprintf(fname, "tests/%03d.html", test_number);
+  save_file(fname, buf);
+
+  int passed=!xhtml_out.error && expected_output && !strcmp(buf, expected_output);
+  printf("[%03d] %s\n", test_number, passed? "PASSED":"FAILED");
+  nxcreole_out_free(&xhtml_out);
+  return passed;
 }
 
-static void append_list_open(const wchar_t* s, size_t len) {
-  const wchar_t* r=L"?";
-  assert(len==1);
-  switch (*s) {
-    case L'*': r=L"<ul><li>"; break;
-    case L'-': r=L"<ul><li>"; break;
-    case L'#': r=L"<ol><li>"; break;
-    case L'>': r=L"<blockquote>"; break;
-    case L':': r=L"<div class=\"indent\">"; break;
-    case L'!': r=L"<div class=\"center\">"; break;
+// event tape sized while recorded, then rendered into exactly sized fixed buffer;
+// size must also agree with nxcreole_xhtml_size()
+static int run_sized_test(int test_number, char* input, const char* expected_output) {
+  wchar_t* text=decode_input(input);
+  if (!text) return 0;
+  nxcreole_xhtml_tape tape;
+  if (nxcreole_xhtml_tape_record(&tape, text)) {
+    nxcreole_xhtml_tape_free(&tape);
+    return 0;
+  }
+  char* buf=malloc(tape.size+1);
+  int passed=0;
+  if (buf) {
+    nxcreole_out xhtml_out;
+    nxcreole_out_init_fixed(&xhtml_out, buf, tape.size);
+    nxcreole_xhtml_tape_render(&tape, &xhtml_out);
+    nxcreole_out_cstr(&xhtml_out);
+    passed=!xhtml_out.error && xhtml_out.length==tape.size && nxcreole_xhtml_size(text)==tape.size
+           && !strcmp(buf, expected_output);
+    free(buf);
   }
-  print_unicode_sz(r);
+  printf("[%03d] SIZED %s\n", test_number, passed? "PASSED":"FAILED");
+  nxcreole_xhtml_tape_free(&tape);
+  return passed;
 }
 
-static void append_list_next_item(const wchar_t* s, size_t len) {
-  const wchar_t* r=0;
-  assert(len==1);
-  switch (*s) {
-    case L'*': r=L"</li>\n<li>"; break;
-    case L'-': r=L"</li>\n<li>"; break;
-    case L'#': r=L"</li>\n<li>"; break;
-    case L'>': r=0; break;
-    case L':': r=0; break;
-    case L'!': r=L"</div>\n<div class=\"center\">"; break;
-  }
-  if (r) print_unicode_sz(r);
+static int run_text_test(int test_number, char* input, const char* expected_output) {
+  nxcreole_out text_out;
+  if (nxcreole_out_init(&text_out, strlen(input), 0, 0)) return 0;
+  render_text(input, &text_out);
+  int passed=!strcmp(nxcreole_out_cstr(&text_out), expected_output);
+  printf("[%03d] TEXT %s\n", test_number, passed? "PASSED":"FAILED");
+  nxcreole_out_free(&text_out);
+  return passed;
 }
 
-static void append_list_blank_item(const wchar_t* s, size_t len) {
-  const wchar_t* r=0;
-  assert(len==1);
-  switch (*s) {
-    case L'*': r=L"&nbsp;"; break;
-    case L'-': r=L"&nbsp;"; break;
-    case L'#': r=L"&nbsp;"; break;
-    case L'>': r=L"<br/><br/>\n"; break;
-    case L':': r=L"<br/><br/>\n"; break;
-    case L'!': r=L"&nbsp;"; break;
+static int run_json_test(int test_number, char* input, const char* expected_output) {
+  nxcreole_out json_out;
+  if (nxcreole_out_init(&json_out, strlen(input)*2, 0, 0)) return 0;
+  render_json(input, &json_out);
+  int passed=!strcmp(nxcreole_out_cstr(&json_out), expected_output);
+  printf("[%03d] JSON %s\n", test_number, passed? "PASSED":"FAILED");
+  if (!passed) {
+    char fname[32];
+    sprintf(fname, "tests/%03d.json", test_number);
+    save_file(fname, nxcreole_out_cstr(&json_out));
   }
-  if (r) print_unicode_sz(r);
+  nxcreole_out_free(&json_out);
+  return passed;
 }
 
-static void append_list_close(const wchar_t* s, size_t len) {
-  const wchar_t* r=0;
-  assert(len==1);
-  switch (*s) {
-    case L'*': r=L"</li></ul>\n"; break;
-    case L'-': r=L"</li></ul>\n"; break;
-    case L'#': r=L"</li></ol>\n"; break;
-    case L'>': r=L"</blockquote>\n"; break;
-    case L':': r=L"</div>\n"; break;
-    case L'!': r=L"</div>\n"; break;
+// headings with ids and TOC in place of <<<toc>>>, then TOC fragment after "--- toc" line
+static int run_toc_test(int test_number, char* input, const char* expected_output) {
+  wchar_t* text=decode_input(input);
+  if (!text) return 0;
+  nxcreole_out xhtml_out;
+  nxcreole_toc toc;
+  if (nxcreole_out_init(&xhtml_out, strlen(input)*2, 0, 0)) return 0;
+  if (nxcreole_toc_init(&toc)) {
+    nxcreole_out_free(&xhtml_out);
+    return 0;
+  }
+  int res=nxcreole_render_xhtml_toc(text, &xhtml_out, &toc);
+  nxcreole_out_puts(&xhtml_out, "--- toc\n");
+  nxcreole_out_write(&xhtml_out, toc.out.buf, toc.out.length);
+  int passed=!res && !strcmp(nxcreole_out_cstr(&xhtml_out), expected_output);
+  printf("[%03d] TOC %s\n", test_number, passed? "PASSED":"FAILED");
+  if (!passed) {
+    char fname[32];
+    sprintf(fname, "tests/%03d.toc", test_number);
+    save_file(fname, nxcreole_out_cstr(&xhtml_out));
   }
-  if (r) print_unicode_sz(r);
+  nxcreole_toc_free(&toc);
+  nxcreole_out_free(&xhtml_out);
+  return passed;
 }
 
-static void append_paragraph_open() {
-  print_unicode_sz(L"<p>");
-}
+// renders XHTML and plain text in one pass; must match separate renderings
+static int run_tee_test(int test_number, char* input, const char* expected_xhtml, const char* expected_text) {
+  wchar_t* text=decode_input(input);
+  if (!text) return 0;
+  nxcreole_out xhtml_out, text_out;
+  if (nxcreole_out_init(&xhtml_out, strlen(input)*2, 0, 0)) return 0;
+  if (nxcreole_out_init(&text_out, strlen(input), 0, 0)) {
+    nxcreole_out_free(&xhtml_out);
+    return 0;
+  }
 
-static void append_paragraph_close() {
-  print_unicode_sz(L"</p>\n");
-}
+  nxcreole_parse_ctx ctx, xhtml_ctx, text_ctx;
+  nxcreole_xhtml_serializer xs;
+  nxcreole_text_serializer ts;
+  nxcreole_tee tee;
 
-static void append_heading_open(const wchar_t* s, size_t len) {
-  print_unicode_sz(L"<h");
-  print_unicode(s, len);
-  print_unicode_sz(L">");
+  nxcreole_init(&ctx, text);
+  nxcreole_init(&xhtml_ctx, text);
+  nxcreole_init(&text_ctx, text);
+  nxcreole_xhtml_init(&xhtml_ctx, &xs, &xhtml_out);
+  nxcreole_text_init(&text_ctx, &ts, &text_out);
+  nxcreole_tee_init(&ctx, &tee);
+  nxcreole_tee_add(&tee, &xhtml_ctx, NXCREOLE_ALL_EVENTS);
+  nxcreole_tee_add(&tee, &text_ctx, NXCREOLE_ALL_EVENTS);
+  nxcreole_use_arena(&ctx, &arena);
+  nxcreole_parse(&ctx);
+
+  int passed=!strcmp(nxcreole_out_cstr(&xhtml_out), expected_xhtml) && !strcmp(nxcreole_out_cstr(&text_out), expected_text);
+  printf("[%03d] TEE %s\n", test_number, passed? "PASSED":"FAILED");
+  nxcreole_out_free(&xhtml_out);
+  nxcreole_out_free(&text_out);
+  return passed;
 }
 
-static void append_heading_close(const wchar_t* s, size_t len) {
-  print_unicode_sz(L"</h");
-  print_unicode(s, len);
-  print_unicode_sz(L">\n");
+// fused events must render same as raw ones
+static int run_fused_test(int test_number, char* input, const char* expected_output) {
+  wchar_t* text=decode_input(input);
+  if (!text) return 0;
+  nxcreole_out xhtml_out;
+  if (nxcreole_out_init(&xhtml_out, strlen(input)*2, 0, 0)) return 0;
+  nxcreole_parse_ctx ctx, xhtml_ctx;
+  nxcreole_xhtml_serializer xs;
+  nxcreole_fuse fuse;
+  nxcreole_init(&ctx, text);
+  nxcreole_init(&xhtml_ctx, text);
+  nxcreole_xhtml_init(&xhtml_ctx, &xs, &xhtml_out);
+  nxcreole_fuse_init(&ctx, &fuse, &xhtml_ctx, NXCREOLE_FUSE_ALL);
+  nxcreole_parse(&ctx);
+  nxcreole_fuse_flush(&fuse);
+  int passed=!strcmp(nxcreole_out_cstr(&xhtml_out), expected_output);
+  printf("[%03d] FUSED %s\n", test_number, passed? "PASSED":"FAILED");
+  nxcreole_out_free(&xhtml_out);
+  return passed;
 }
 
-static void append_format_open(const wchar_t* s, size_t len) {
-  const wchar_t* r=0;
-  assert(len==1);
-  switch (*s) {
-    case L'*': r=L"<strong>"; break;
-    case L'/': r=L"<em>"; break;
-    case L'_': r=L"<span class=\"underline\">"; break;
-    case L'#': r=L"<code>"; break;
+// parser given line index must render same; index is checked against plain scan
+static int run_indexed_test(int test_number, char* input, const char* expected_output) {
+  wchar_t* text=decode_input(input);
+  if (!text) return 0;
+  nxcreole_line_index idx;
+  if (nxcreole_line_index_build(&idx, text)) return 0;
+  int passed=idx.length==wcslen(text);
+  size_t n=0;
+  const wchar_t* p=text;
+  for (;; n++) {
+    const wchar_t* q=p;
+    while (*q==L' ' || *q==L'\t') q++;
+    passed=passed && n<idx.count && idx.lines[n].start==(size_t)(p-text) && idx.lines[n].indent==(unsigned)(q-p)
+           && idx.lines[n].first==(*q==L'\n'? 0 : *q) && nxcreole_line_index_find(&idx, (size_t)(q-text))==n;
+    p=wcschr(p, L'\n');
+    if (!p) break;
+    p++;
   }
-  if (r) print_unicode_sz(r);
+  passed=passed && idx.count==n+1 && nxcreole_line_index_next_blank(&idx, idx.count)==idx.count;
+  nxcreole_out xhtml_out;
+  if (nxcreole_out_init(&xhtml_out, strlen(input)*2, 0, 0)) return 0;
+  nxcreole_parse_ctx ctx;
+  nxcreole_xhtml_serializer xs;
+  nxcreole_init(&ctx, text);
+  nxcreole_xhtml_init(&ctx, &xs, &xhtml_out);
+  ctx.lines=&idx;
+  nxcreole_xhtml_parse(&ctx);
+  passed=passed && !strcmp(nxcreole_out_cstr(&xhtml_out), expected_output);
+  // chunks split at blank lines from the index must render same as whole text
+  size_t start=0, b=0;
+  xhtml_out.length=0;
+  while (start<idx.length) {
+    b=nxcreole_line_index_next_blank(&idx, b+1);
+    size_t end=b<idx.count? idx.lines[b].start : idx.length;
+    nxcreole_init(&ctx, text);
+    nxcreole_xhtml_init(&ctx, &xs, &xhtml_out);
+    nxcreole_parse_range(&ctx, start, end, 0, 0, 0);
+    start=end;
+  }
+  passed=passed && !strcmp(nxcreole_out_cstr(&xhtml_out), expected_output);
+  printf("[%03d] INDEXED %s\n", test_number, passed? "PASSED":"FAILED");
+  nxcreole_out_free(&xhtml_out);
+  nxcreole_line_index_free(&idx);
+  return passed;
 }
 
-static void append_format_close(const wchar_t* s, size_t len) {
-  const wchar_t* r=0;
-  assert(len==1);
-  switch (*s) {
-    case L'*': r=L"</strong>"; break;
-    case L'/': r=L"</em>"; break;
-    case L'_': r=L"</span>"; break;
-    case L'#': r=L"</code>"; break;
+// rendered four times through shared block cache: first sighting, recorded, replayed as events
+// and written as stored XHTML; all must give expected output
+static int run_block_cache_test(nxcreole_block_cache* cache, int test_number, char* input, const char* expected_output) {
+  wchar_t* text=decode_input(input);
+  if (!text) return 0;
+  nxcreole_out xhtml_out;
+  if (nxcreole_out_init(&xhtml_out, strlen(input)*2, 0, 0)) return 0;
+  int i, passed=1;
+  for (i=0; i<4; i++) {
+    nxcreole_parse_ctx ctx;
+    nxcreole_xhtml_serializer xs;
+    xhtml_out.length=0;
+    nxcreole_init(&ctx, text);
+    nxcreole_xhtml_init(&ctx, &xs, &xhtml_out);
+    ctx.blocks=cache;
+    if (i==2) ctx.fragments=0;
+    nxcreole_xhtml_parse(&ctx);
+    passed=passed && !strcmp(nxcreole_out_cstr(&xhtml_out), expected_output);
   }
-  if (r) print_unicode_sz(r);
+  printf("[%03d] BLOCK CACHE %s\n", test_number, passed? "PASSED":"FAILED");
+  nxcreole_out_free(&xhtml_out);
+  return passed;
 }
 
-static void append_hr() {
-  print_unicode_sz(L"\n<hr/>\n");
+// compressed while rendering through small buffer (many flushes), must inflate to expected
+static int run_compressed_test(int test_number, char* input, int format, const char* expected_output) {
+  nxcreole_out compressed, xhtml_out;
+  nxcreole_zsink zs;
+  if (nxcreole_out_init(&compressed, 1024, 0, 0)) return 0;
+  if (nxcreole_zsink_init(&zs, format, Z_DEFAULT_COMPRESSION, nxcreole_out_sink, &compressed)
+      || nxcreole_out_init(&xhtml_out, 64, nxcreole_zsink_write, &zs)) {
+    nxcreole_out_free(&compressed);
+    return 0;
+  }
+  render_xhtml(input, &xhtml_out);
+  int passed=!nxcreole_out_flush(&xhtml_out) && !nxcreole_zsink_finish(&zs) && xhtml_out.total==strlen(expected_output);
+  nxcreole_out_free(&xhtml_out);
+
+  size_t length=strlen(expected_output);
+  char* buf=malloc(length+1);
+  z_stream z;
+  memset(&z, 0, sizeof(z));
+  if (buf && inflateInit2(&z, format==NXCREOLE_GZIP? MAX_WBITS+16 : MAX_WBITS)==Z_OK) {
+    z.next_in=(Bytef*)compressed.buf;
+    z.avail_in=(uInt)compressed.length;
+    z.next_out=(Bytef*)buf;
+    z.avail_out=(uInt)length+1; // room for one extra byte to catch longer output
+    passed=passed && inflate(&z, Z_FINISH)==Z_STREAM_END && z.total_out==length && !memcmp(buf, expected_output, length);
+    inflateEnd(&z);
+  }
+  else passed=0;
+  printf("[%03d] %s %s\n", test_number, format==NXCREOLE_GZIP? "GZIP":"DEFLATE", passed? "PASSED":"FAILED");
+  if (buf) free(buf);
+  nxcreole_out_free(&compressed);
+  return passed;
 }
 
-static void append_br() {
-  print_unicode_sz(L"<br/>\n");
+// markup serializer renders with given table (built-in one if config is 0)
+static int run_markup_test(int test_number, char* input, const char* config, const char* expected_output) {
+  nxcreole_markup markup;
+  int res=config? nxcreole_markup_load(&markup, config) : nxcreole_markup_compile(&markup, 0);
+  if (res) {
+    fprintf(stderr, "bad markup config at line %d\n", res);
+    return 0;
+  }
+  nxcreole_out markup_out;
+  if (nxcreole_out_init(&markup_out, strlen(input)*2, 0, 0)) {
+    nxcreole_markup_free(&markup);
+    return 0;
+  }
+  render_markup(input, &markup, &markup_out);
+  int passed=!strcmp(nxcreole_out_cstr(&markup_out), expected_output);
+  printf("[%03d] MARKUP%s %s\n", test_number, config? " CONFIG":"", passed? "PASSED":"FAILED");
+  if (!passed) save_file("tests/markup.html", nxcreole_out_cstr(&markup_out));
+  nxcreole_out_free(&markup_out);
+  nxcreole_markup_free(&markup);
+  return passed;
 }
 
-static void append_nowiki_block(const wchar_t* s, size_t len) {
-  print_unicode_sz(L"<pre>");
-  print_unicode_html(s, len);
-  print_unicode_sz(L"</pre>\n");
+static int fill_hole(void* data, const char* name, size_t name_length, nxcreole_out* out) {
+  nxcreole_out_puts(out, "<hole/>");
+  return 0;
 }
 
-static void append_nowiki_inline(const wchar_t* s, size_t len) {
-  print_unicode_sz(L"<span class=\"nowiki\">");
-  print_unicode_html(s, len);
-  print_unicode_sz(L"</span>");
+// compiled template must splice back into regular rendering by default
+static int run_template_test(int test_number, char* input, const char* expected_output) {
+  wchar_t* text=decode_input(input);
+  if (!text) return 0;
+  nxcreole_template tpl;
+  if (nxcreole_template_compile(&tpl, text)) return 0;
+  nxcreole_out spliced, filled;
+  nxcreole_out_init(&spliced, tpl.xhtml.length, 0, 0);
+  nxcreole_out_init(&filled, tpl.xhtml.length, 0, 0);
+  nxcreole_template_splice(&tpl, 0, 0, &spliced);
+  nxcreole_template_splice(&tpl, fill_hole, 0, &filled);
+
+  size_t i, expected_length=strlen(expected_output);
+  for (i=0; i<tpl.hole_count; i++) expected_length+=strlen("<hole/>")-tpl.holes[i].default_length;
+  int passed=!strcmp(nxcreole_out_cstr(&spliced), expected_output) && filled.length==expected_length
+             && !strstr(nxcreole_out_cstr(&filled), "&lt;&lt;&lt;Placeholder:");
+  printf("[%03d] TEMPLATE %s\n", test_number, passed? "PASSED":"FAILED");
+  nxcreole_out_free(&spliced);
+  nxcreole_out_free(&filled);
+  nxcreole_template_free(&tpl);
+  return passed;
 }
 
-static void append_image(const wchar_t* s, size_t len) {
-  const wchar_t* title=wcschr(s, L'|');
-  if (title-s>=len) title=0;
-  print_unicode_sz(L"<img src=\"");
-  print_unicode_html(s, title?title-s : len);
-  print_unicode_sz(L"\"");
-  if (title) {
-    print_unicode_sz(L" alt=\"");
-    print_unicode_html(title+1, len-(title-s)-1);
-    print_unicode_sz(L"\"");
+// test resolver: pages starting with "Missing" don't exist, local ones live under /wiki/
+static int resolve_links(void* data, nxcreole_link_target* targets, size_t count) {
+  size_t i;
+  for (i=0; i<count; i++) {
+    nxcreole_link_target* t=&targets[i];
+    t->missing=t->length>=7 && !wmemcmp(t->target, L"Missing", 7);
+    if (!wmemchr(t->target, L':', t->length)) {
+      wchar_t* url=nxcreole_arena_alloc(&arena, (t->length+6)*sizeof(wchar_t));
+      if (!url) return -1;
+      wmemcpy(url, L"/wiki/", 6);
+      wmemcpy(url+6, t->target, t->length);
+      t->url=url;
+      t->url_length=t->length+6;
+    }
   }
-  print_unicode_sz(L" />");
+  return 0;
 }
 
-static void append_link(const wchar_t* s, size_t len) {
-  const wchar_t* title=wcschr(s, L'|');
-  if (title-s>=len) title=0;
-  print_unicode_sz(L"<a href=\"");
-  print_unicode_html(s, title?title-s : len);
-  print_unicode_sz(L"\">");
-  if (title)
-    print_unicode_html(title+1, len-(title-s)-1);
-  else
-    print_unicode_html(s, len);
-  print_unicode_sz(L"</a>");
+static int run_resolved_test(int test_number, char* input, const char* expected_output) {
+  wchar_t* text=decode_input(input);
+  if (!text) return 0;
+  nxcreole_out xhtml_out;
+  if (nxcreole_out_init(&xhtml_out, strlen(input)*2, 0, 0)) return 0;
+  int passed=!nxcreole_render_xhtml_resolved(text, resolve_links, 0, &xhtml_out)
+             && !strcmp(nxcreole_out_cstr(&xhtml_out), expected_output);
+  printf("[%03d] RESOLVED %s\n", test_number, passed? "PASSED":"FAILED");
+  nxcreole_out_free(&xhtml_out);
+  return passed;
 }
 
-static void append_placeholder(const wchar_t* s, size_t len) {
-  print_unicode_sz(L"&lt;&lt;&lt;Placeholder:");
-  print_unicode_html(s, len);
-  print_unicode_sz(L"&gt;&gt;&gt;");
-}
+// page rendered by child process must be served from cache to parent
+static int run_cache_test(nxcreole_cache* cache, int test_number, char* input, const char* expected_output) {
+  pid_t pid=fork();
+  if (pid==-1) return 0;
+  if (!pid) {
+    wchar_t* text=decode_input(input);
+    nxcreole_out xhtml_out;
+    if (!text || nxcreole_out_init(&xhtml_out, strlen(input)*2, 0, 0)) _exit(EXIT_FAILURE);
+    nxcreole_render_xhtml_cached(cache, text, &xhtml_out);
+    _exit(strcmp(nxcreole_out_cstr(&xhtml_out), expected_output)? EXIT_FAILURE:EXIT_SUCCESS);
+  }
+  int status;
+  if (waitpid(pid, &status, 0)!=pid) return 0;
 
+  wchar_t* text=decode_input(input);
+  if (!text) return 0;
+  nxcreole_out xhtml_out;
+  if (nxcreole_out_init(&xhtml_out, strlen(input)*2, 0, 0)) return 0;
+  nxcreole_cache_stats before, after;
+  nxcreole_cache_get_stats(cache, &before);
+  nxcreole_render_xhtml_cached(cache, text, &xhtml_out);
+  nxcreole_cache_get_stats(cache, &after);
+  int passed=WIFEXITED(status) && WEXITSTATUS(status)==EXIT_SUCCESS && after.hits==before.hits+1
+             && !strcmp(nxcreole_out_cstr(&xhtml_out), expected_output);
+  printf("[%03d] CACHE %s\n", test_number, passed? "PASSED":"FAILED");
+  nxcreole_out_free(&xhtml_out);
+  return passed;
+}
 
-typedef void (*append0_sig)(void);
-typedef void (*append1_sig)(const wchar_t* s, size_t len);
+// range copies go to start of buffer, text is at its end, so that copies are below text
+static wchar_t range_buffer[64];
 
-static void append0(nxcreole_parse_ctx* ctx, nxcreole_fn_id_t fn) {
-  ((append0_sig)ctx->fn[fn])();
+static void* range_buffer_alloc(void* alloc_data, size_t size) {
+  return size<=32*sizeof(wchar_t)? range_buffer : 0;
 }
 
-static void append1(nxcreole_parse_ctx* ctx, nxcreole_fn_id_t fn, const wchar_t* s, size_t len) {
-  ((append1_sig)ctx->fn[fn])(s, len);
+static void range_buffer_dealloc(void* alloc_data, void* ptr) {
 }
 
-static void* fns[FN_COUNT]={
-    &append_text,
-    &append_table_open,
-    &append_table_row_open,
-    &append_table_head_cell_open,
-    &append_table_head_cell_close,
-    &append_table_cell_open,
-    &append_table_cell_close,
-    &append_table_row_close,
-    &append_table_close,
-    &append_list_open,
-    &append_list_next_item,
-    &append_list_blank_item,
-    &append_list_close,
-    &append_paragraph_open,
-    &append_paragraph_close,
-    &append_heading_open,
-    &append_heading_close,
-    &append_format_open,
-    &append_format_close,
-    &append_hr,
-    &append_br,
-    &append_nowiki_block,
-    &append_nowiki_inline,
-    &append_image,
-    &append_link,
-    &append_placeholder,
-};
-
-int render_xhtml(const char* input) {
-  size_t text_len=mbstowcs(0, input, 0);
-  if (text_len==(size_t)-1) {
-    fprintf(stderr, "invalid input multi-byte string\n");
-    return 0;
-  }
-  wchar_t* text=malloc((text_len+1)*sizeof(wchar_t));
-  if ((size_t)-1==mbstowcs(text, input, (size_t)text_len+1)) {
-    fprintf(stderr, "invalid input multi-byte string (2)\n");
-    free(text);
-    return 0;
-  }
-
+// after range, parsing goes on in whole text by the same ctx: scan memo left by range
+// ("no ]] till end", from a position below text) must not answer the scan for [[b]]
+static int run_range_memo_test() {
+  wchar_t* text=range_buffer+32;
+  wcscpy(text, L"[[a\n\n[[b]]\n");
+  nxcreole_out xhtml_out;
+  if (nxcreole_out_init(&xhtml_out, 256, 0, 0)) return 0;
   nxcreole_parse_ctx ctx;
-
+  nxcreole_xhtml_serializer xs;
   nxcreole_init(&ctx, text);
-  ctx.append0=append0;
-  ctx.append1=append1;
-  memcpy(ctx.fn, fns, sizeof(ctx.fn));
+  nxcreole_xhtml_init(&ctx, &xs, &xhtml_out);
+  ctx.alloc=range_buffer_alloc;
+  ctx.dealloc=range_buffer_dealloc;
+  int passed=!nxcreole_parse_range(&ctx, 0, 5, 0, 0, 0);
   nxcreole_parse(&ctx);
+  passed=passed && !strcmp(nxcreole_out_cstr(&xhtml_out), "<p>[[a</p>\n<p><a href=\"b\">b</a></p>\n");
+  printf("RANGE MEMOS %s\n", passed? "PASSED":"FAILED");
+  nxcreole_out_free(&xhtml_out);
+  return passed;
+}
 
-  free(text);
-  return 0;
+// text presented under key of another text of the same length (as if hashes collided) must miss
+static int run_cache_collision_test(nxcreole_cache* cache) {
+  static const wchar_t* a=L"collision a";
+  static const wchar_t* b=L"collision b";
+  nxcreole_cache_key key=nxcreole_cache_make_key(a, wcslen(a), NXCREOLE_CACHE_XHTML);
+  nxcreole_out out;
+  if (nxcreole_out_init(&out, 64, 0, 0)) return 0;
+  nxcreole_cache_put(cache, &key, a, "<p>collision a</p>\n", 19);
+  int passed=!nxcreole_cache_get(cache, &key, b, &out) && !out.length;
+  passed=passed && nxcreole_cache_get(cache, &key, a, &out) && !strcmp(nxcreole_out_cstr(&out), "<p>collision a</p>\n");
+  printf("CACHE COLLISION %s\n", passed? "PASSED":"FAILED");
+  nxcreole_out_free(&out);
+  return passed;
 }
 
-static char* load_file(const char* filepath) {
-  struct stat st;
-  if (stat(filepath, &st)==-1) {
-    // ERROR("can't find file", filepath);
-    return 0;
-  }
-  int fd=open(filepath, O_RDONLY);
-  if (fd==-1) {
-    ERROR("can't open file", filepath);
+// every section rendered alone, preceded by its index entry
+static int run_sections_test(int test_number, char* input, const char* expected_output) {
+  wchar_t* text=decode_input(input);
+  if (!text) return 0;
+  nxcreole_section_index idx;
+  if (nxcreole_section_index_build(&idx, text)) return 0;
+  nxcreole_out sections_out;
+  if (nxcreole_out_init(&sections_out, strlen(input)*4, 0, 0)) {
+    nxcreole_section_index_free(&idx);
     return 0;
   }
-  char* text=malloc((size_t)(st.st_size+1));
-  if (st.st_size!=read(fd, text, (size_t)st.st_size)) {
-    ERROR("can't read file", filepath);
-    close(fd);
-    free(text);
-    return 0;
+  size_t i;
+  for (i=0; i<idx.count; i++) {
+    const nxcreole_section* sec=&idx.sections[i];
+    char info[128];
+    sprintf(info, "--- %d [%zu:%zu] lists:%d tables:%d title:", sec->level, sec->start, sec->end,
+            sec->list_depth, sec->mediawiki_table_level);
+    nxcreole_out_puts(&sections_out, info);
+    nxcreole_out_wchars(&sections_out, text+sec->title_start, sec->title_length);
+    nxcreole_out_puts(&sections_out, "\n");
+    nxcreole_parse_ctx ctx;
+    nxcreole_xhtml_serializer xs;
+    nxcreole_init(&ctx, text);
+    nxcreole_xhtml_init(&ctx, &xs, &sections_out);
+    nxcreole_parse_section(&ctx, &idx, i);
+    nxcreole_out_puts(&sections_out, "\n");
   }
-  close(fd);
-  text[st.st_size]='\0';
-  return text;
+  int passed=!strcmp(nxcreole_out_cstr(&sections_out), expected_output);
+  printf("[%03d] SECTIONS %s\n", test_number, passed? "PASSED":"FAILED");
+  if (!passed) save_file("tests/sections.html", nxcreole_out_cstr(&sections_out));
+  nxcreole_out_free(&sections_out);
+  nxcreole_section_index_free(&idx);
+  return passed;
 }
 
-static int save_file(const char* filepath, const char* text) {
-  int fd=open(filepath, O_WRONLY|O_CREAT|O_TRUNC, 0644);
-  if (fd==-1) {
-    ERROR("can't open file", filepath);
-    return -1;
-  }
-  size_t length=strlen(text);
-  if (length!=write(fd, text, length)) {
-    ERROR("can't write file", filepath);
-    close(fd);
-    return -1;
+// scan budget runs out in the middle of test text, lists and formatting are capped too
+static int run_limited_test(int test_number, char* input, const char* expected_output) {
+  wchar_t* text=decode_input(input);
+  if (!text) return 0;
+  nxcreole_out xhtml_out;
+  if (nxcreole_out_init(&xhtml_out, strlen(input)*2, 0, 0)) return 0;
+  nxcreole_parse_ctx ctx;
+  nxcreole_xhtml_serializer xs;
+  nxcreole_init(&ctx, text);
+  nxcreole_xhtml_init(&ctx, &xs, &xhtml_out);
+  ctx.max_scan_chars=200;
+  ctx.max_nesting=3;
+  nxcreole_parse(&ctx);
+  int passed=ctx.limit_hit==NXCREOLE_LIMIT_SCAN && !strcmp(nxcreole_out_cstr(&xhtml_out), expected_output);
+  printf("[%03d] LIMITED %s\n", test_number, passed? "PASSED":"FAILED");
+  if (!passed) save_file("tests/limited.html", nxcreole_out_cstr(&xhtml_out));
+  nxcreole_out_free(&xhtml_out);
+  return passed;
+}
+
+// link index of tests/links; second build must reuse every page and give same answers
+static int run_linkdb_test(const char* expected_output) {
+  char path[64];
+  sprintf(path, "/tmp/nxcreole_links_%d.idx", (int)getpid());
+  static const char* pages[]={"Home", "About", "Docs/Intro", "logo.png", "Missing page", "http://cdn.example.com/a.png"};
+  nxcreole_linkdb_stats stats[2];
+  nxcreole_out out[2];
+  int i, j, passed=1;
+  unlink(path);
+  for (i=0; i<2; i++) {
+    nxcreole_linkdb db;
+    if (nxcreole_out_init(&out[i], 1024, 0, 0)) return 0;
+    if (nxcreole_linkdb_build("tests/links", path, 2, &stats[i]) || nxcreole_linkdb_open(&db, path)) {
+      perror(path);
+      passed=0;
+      continue;
+    }
+    for (j=0; j<(int)(sizeof(pages)/sizeof(pages[0])); j++) {
+      nxcreole_out_puts(&out[i], "backlinks ");
+      nxcreole_out_puts(&out[i], pages[j]);
+      nxcreole_out_puts(&out[i], ":\n");
+      report_backlinks(&db, pages[j], &out[i]);
+    }
+    nxcreole_out_puts(&out[i], "orphans:\n");
+    report_orphans(&db, &out[i]);
+    nxcreole_out_puts(&out[i], "missing:\n");
+    report_missing(&db, &out[i]);
+    nxcreole_linkdb_close(&db);
   }
-  close(fd);
-  return 0;
+  unlink(path);
+  passed=passed && stats[0].pages==4 && stats[0].parsed==4 && stats[1].reused==4 && !stats[1].parsed
+         && !strcmp(nxcreole_out_cstr(&out[0]), expected_output) && !strcmp(nxcreole_out_cstr(&out[1]), expected_output);
+  printf("[links] %s\n", passed? "PASSED":"FAILED");
+  if (!passed) save_file("tests/links.html", nxcreole_out_cstr(&out[0]));
+  nxcreole_out_free(&out[0]);
+  nxcreole_out_free(&out[1]);
+  return passed;
 }
 
-static int run_test(int test_number, char* input, const char* expected_output) {
-  size_t input_length=strlen(input);
-  char* buf=malloc(input_length*32+40000); // hope this will be large enough
-  out=buf;
-  render_xhtml(input);
-  *out='\0';
+#define POOL_TESTS 100
 
+// all tests rendered at once by render pool, waiting on its fd
+static int run_pool_test() {
+  nxcreole_pool pool;
+  nxcreole_pool_job jobs[POOL_TESTS];
+  char* expected[POOL_TESTS];
   char fname[32];
-  sprintf(fname, "tests/%03d.html", test_number);
-  save_file(fname, buf);
-
-  if (expected_output && !strcmp(buf, expected_output)) {
-    printf("[%03d] PASSED\n", test_number);
-    free(buf);
-    return 1;
+  int i, count, passed=1;
+  if (nxcreole_pool_start(&pool, 2)) return 0;
+  for (count=0; count<POOL_TESTS; count++) {
+    sprintf(fname, "tests/%03d.creole", count+1);
+    char* input=load_file(fname);
+    if (!input) break;
+    sprintf(fname, "tests/%03d.expected", count+1);
+    expected[count]=load_file(fname);
+    size_t length=mbstowcs(0, input, 0);
+    wchar_t* text=length==(size_t)-1? 0 : malloc((length+1)*sizeof(wchar_t));
+    if (text) mbstowcs(text, input, length+1);
+    free(input);
+    if (!text) {
+      if (expected[count]) free(expected[count]);
+      break;
+    }
+    jobs[count].text=text;
+    jobs[count].data=expected[count];
+    nxcreole_pool_submit(&pool, &jobs[count]);
   }
-  else {
-    printf("[%03d] FAILED\n", test_number);
-    free(buf);
-    return 0;
+  int left=count;
+  while (left) {
+    struct pollfd pfd={nxcreole_pool_fd(&pool), POLLIN, 0};
+    if (poll(&pfd, 1, 10000)!=1) {
+      passed=0;
+      break;
+    }
+    nxcreole_pool_job* job;
+    for (job=nxcreole_pool_collect(&pool); job; job=job->next, left--) {
+      const char* exp=job->data;
+      passed=passed && !job->out.error && (!exp || !strcmp(nxcreole_out_cstr(&job->out), exp));
+    }
+  }
+  nxcreole_pool_stop(&pool);
+  for (i=0; i<count; i++) {
+    nxcreole_out_free(&jobs[i].out); // stopped pool has finished every job
+    free((wchar_t*)jobs[i].text);
+    if (expected[i]) free(expected[i]);
   }
+  passed=passed && count && !left;
+  printf("[pool] %s\n", passed? "PASSED":"FAILED");
+  return passed;
 }
 
-static void run_tests() {
+static int run_tests() {
   char infile[32];
   char expfile[32];
   int i, total=0, passed=0;
+  nxcreole_cache cache;
+  if (nxcreole_cache_open(&cache, 0, 1024*1024, 65536)) {
+    perror("nxcreole_cache_open");
+    return 0;
+  }
+  nxcreole_block_cache block_cache;
+  if (nxcreole_block_cache_init(&block_cache, 1024*1024)) {
+    nxcreole_cache_close(&cache);
+    return 0;
+  }
   for (i=1; i<100; i++) {
     sprintf(infile, "tests/%03d.creole", i);
     sprintf(expfile, "tests/%03d.expected", i);
@@ -433,17 +824,363 @@ static void run_tests() {
     char* expected_output=load_file(expfile);
     passed+=run_test(i, input, expected_output);
     total++;
-    free(input);
+    if (expected_output) {
+      passed+=run_sized_test(i, input, expected_output);
+      total++;
+    }
+    if (expected_output) {
+      passed+=run_template_test(i, input, expected_output);
+      total++;
+    }
+    if (expected_output) {
+      passed+=run_fused_test(i, input, expected_output);
+      total++;
+    }
+    if (expected_output) {
+      passed+=run_indexed_test(i, input, expected_output);
+      total++;
+    }
+    if (expected_output) {
+      passed+=run_block_cache_test(&block_cache, i, input, expected_output);
+      total++;
+    }
+    if (expected_output) {
+      passed+=run_compressed_test(i, input, NXCREOLE_GZIP, expected_output);
+      passed+=run_compressed_test(i, input, NXCREOLE_DEFLATE, expected_output);
+      total+=2;
+    }
+    if (expected_output) {
+      passed+=run_markup_test(i, input, 0, expected_output);
+      total++;
+    }
+    sprintf(infile, "tests/%03d.markup", i);
+    sprintf(expfile, "tests/%03d.expected.markup", i);
+    char* markup_config=load_file(infile);
+    char* expected_markup=markup_config? load_file(expfile) : 0;
+    if (markup_config) {
+      passed+=expected_markup && run_markup_test(i, input, markup_config, expected_markup);
+      total++;
+      free(markup_config);
+      if (expected_markup) free(expected_markup);
+    }
+    if (expected_output) {
+      passed+=run_cache_test(&cache, i, input, expected_output);
+      total++;
+    }
+    sprintf(expfile, "tests/%03d.expected.sections", i);
+    char* expected_sections=load_file(expfile);
+    if (expected_sections) {
+      passed+=run_sections_test(i, input, expected_sections);
+      total++;
+      free(expected_sections);
+    }
+    sprintf(expfile, "tests/%03d.expected.limited", i);
+    char* expected_limited=load_file(expfile);
+    if (expected_limited) {
+      passed+=run_limited_test(i, input, expected_limited);
+      total++;
+      free(expected_limited);
+    }
+    sprintf(expfile, "tests/%03d.expected.resolved", i);
+    char* expected_resolved=load_file(expfile);
+    if (expected_resolved) {
+      passed+=run_resolved_test(i, input, expected_resolved);
+      total++;
+      free(expected_resolved);
+    }
+    sprintf(expfile, "tests/%03d.expected.json", i);
+    char* expected_json=load_file(expfile);
+    if (expected_json) {
+      passed+=run_json_test(i, input, expected_json);
+      total++;
+      free(expected_json);
+    }
+    sprintf(expfile, "tests/%03d.expected.toc", i);
+    char* expected_toc=load_file(expfile);
+    if (expected_toc) {
+      passed+=run_toc_test(i, input, expected_toc);
+      total++;
+      free(expected_toc);
+    }
+    sprintf(expfile, "tests/%03d.expected.txt", i);
+    char* expected_text=load_file(expfile);
+    if (expected_text) {
+      passed+=run_text_test(i, input, expected_text);
+      total++;
+      if (expected_output) {
+        passed+=run_tee_test(i, input, expected_output, expected_text);
+        total++;
+      }
+      free(expected_text);
+    }
     if (expected_output) free(expected_output);
+    free(input);
+  }
+  passed+=run_cache_collision_test(&cache);
+  total++;
+  passed+=run_range_memo_test();
+  total++;
+  nxcreole_cache_close(&cache);
+  // blocks repeated across tests and renders must have hit
+  passed+=block_cache.stats.hits>0 && block_cache.stats.fragment_hits>0 && block_cache.stats.stores>0;
+  total++;
+  printf("BLOCK CACHE %zu hits (%zu as XHTML), %zu misses, %zu stored, %zu uncacheable\n",
+         block_cache.stats.hits, block_cache.stats.fragment_hits, block_cache.stats.misses,
+         block_cache.stats.stores, block_cache.stats.uncacheable);
+  nxcreole_block_cache_free(&block_cache);
+  passed+=run_pool_test();
+  total++;
+  char* expected_links=load_file("tests/links.expected");
+  if (expected_links) {
+    passed+=run_linkdb_test(expected_links);
+    total++;
+    free(expected_links);
   }
   printf("\nPASSED %d OUT OF %d\n", passed, total);
+  return passed==total;
 }
 
-int main() {
-  if (!setlocale(LC_CTYPE, "en_US.UTF-8")) {
+typedef enum {
+  MODE_XHTML,
+  MODE_TEXT,
+  MODE_JSON,
+  MODE_MARKUP
+} render_mode_t;
+
+typedef struct {
+  render_mode_t mode;
+  const nxcreole_markup* markup;
+  int compress; // 0, NXCREOLE_GZIP or NXCREOLE_DEFLATE
+  const char* out_dir; // write every file to out_dir/name.html[.gz|.zz] instead of stdout
+  int toc; // XHTML with heading ids and table of contents
+} render_opts_t;
+
+// output file for input: name without .creole, suffix by mode and compression
+static int open_output(const char* filepath, const render_opts_t* opts) {
+  const char* name=strrchr(filepath, '/');
+  name=name? name+1 : filepath;
+  size_t length=strlen(name);
+  if (length>7 && !strcmp(name+length-7, ".creole")) length-=7;
+  char* path=malloc(strlen(opts->out_dir)+length+16);
+  if (!path) return -1;
+  sprintf(path, "%s/%.*s%s%s", opts->out_dir, (int)length, name,
+          opts->mode==MODE_TEXT? ".txt" : opts->mode==MODE_JSON? ".json":".html",
+          opts->compress==NXCREOLE_GZIP? ".gz" : opts->compress==NXCREOLE_DEFLATE? ".zz":"");
+  int fd=open(path, O_WRONLY|O_CREAT|O_TRUNC, 0644);
+  if (fd==-1) ERROR("can't open file", path);
+  free(path);
+  return fd;
+}
+
+static int render_file(const char* filepath, const render_opts_t* opts) {
+  char* input=load_file(filepath);
+  if (!input) {
+    ERROR("can't read file", filepath);
+    return -1;
+  }
+  int fd=opts->out_dir? open_output(filepath, opts) : STDOUT_FILENO;
+  if (fd==-1) {
+    free(input);
+    return -1;
+  }
+  // compressed: out -> zsink -> fd
+  nxcreole_zsink zs;
+  if (opts->compress && nxcreole_zsink_init(&zs, opts->compress, Z_BEST_COMPRESSION, nxcreole_fd_sink, &fd)) {
+    if (fd!=STDOUT_FILENO) close(fd);
+    free(input);
+    return -1;
+  }
+  nxcreole_out stdout_out;
+  if (nxcreole_out_init(&stdout_out, 65536, opts->compress? nxcreole_zsink_write : nxcreole_fd_sink,
+                        opts->compress? (void*)&zs : (void*)&fd)) {
+    if (opts->compress) nxcreole_zsink_free(&zs);
+    if (fd!=STDOUT_FILENO) close(fd);
+    free(input);
+    return -1;
+  }
+  if (opts->mode==MODE_TEXT) {
+    render_text(input, &stdout_out);
+  }
+  else if (opts->mode==MODE_JSON) {
+    render_json(input, &stdout_out);
+  }
+  else if (opts->mode==MODE_MARKUP) {
+    render_markup(input, opts->markup, &stdout_out);
+  }
+  else {
+    if (opts->toc) render_xhtml_toc(input, &stdout_out);
+    else render_xhtml(input, &stdout_out);
+  }
+  int res=nxcreole_out_flush(&stdout_out);
+  if (opts->compress && nxcreole_zsink_finish(&zs)) res=-1;
+  nxcreole_out_free(&stdout_out);
+  if (fd!=STDOUT_FILENO && close(fd)) res=-1;
+  if (res) ERROR("can't write output of", filepath);
+  free(input);
+  return res;
+}
+
+// every .creole file of directory (not recursive)
+static int render_dir(const char* dirpath, const render_opts_t* opts) {
+  DIR* d=opendir(dirpath);
+  if (!d) {
+    ERROR("can't open directory", dirpath);
+    return -1;
+  }
+  struct dirent* de;
+  int res=0;
+  while ((de=readdir(d))) {
+    size_t length=strlen(de->d_name);
+    if (de->d_name[0]=='.' || length<=7 || strcmp(de->d_name+length-7, ".creole")) continue;
+    char* path=malloc(strlen(dirpath)+length+2);
+    if (!path) {
+      res=-1;
+      break;
+    }
+    sprintf(path, "%s/%s", dirpath, de->d_name);
+    if (render_file(path, opts)) res=-1;
+    free(path);
+  }
+  closedir(d);
+  return res;
+}
+
+// link index commands; returns -1 on error
+static int build_links(const char* dir, const char* index, int threads) {
+  nxcreole_linkdb_stats stats;
+  if (nxcreole_linkdb_build(dir, index, threads, &stats)) {
+    perror(index);
+    return -1;
+  }
+  fprintf(stderr, "%zu pages (%zu parsed, %zu unchanged, %zu unreadable), %zu links\n",
+          stats.pages, stats.parsed, stats.reused, stats.failed, stats.links);
+  return 0;
+}
+
+static int report_links(const char* index, const char* command, const char* page) {
+  nxcreole_linkdb db;
+  if (nxcreole_linkdb_open(&db, index)) {
+    perror(index);
+    return -1;
+  }
+  int fd=STDOUT_FILENO;
+  nxcreole_out stdout_out;
+  if (nxcreole_out_init(&stdout_out, 65536, nxcreole_fd_sink, &fd)) {
+    nxcreole_linkdb_close(&db);
+    return -1;
+  }
+  if (page) report_backlinks(&db, page, &stdout_out);
+  else if (!strcmp(command, "--orphans")) report_orphans(&db, &stdout_out);
+  else report_missing(&db, &stdout_out);
+  int res=nxcreole_out_flush(&stdout_out);
+  nxcreole_out_free(&stdout_out);
+  nxcreole_linkdb_close(&db);
+  return res;
+}
+
+static void usage() {
+  fprintf(stderr, "usage: nxcreole [--xhtml|--text|--json|--markup config] [--toc] file ...\n"
+                  "       nxcreole              (run tests from tests/ directory)\n"
+                  "  --xhtml          render files as XHTML (default)\n"
+                  "  --text           render files as plain text\n"
+                  "  --json           render files as JSON syntax tree (see nxcreole_json.h)\n"
+                  "  --markup config  render files with tag templates from config file\n"
+                  "  --toc            give XHTML headings ids and put table of contents in place\n"
+                  "                   of <<<toc>>> placeholder (or before page if there is none)\n"
+                  "  --gzip, --deflate  compress output (gzip or zlib format) while rendering\n"
+                  "  --out dir        write every file to dir/name.html (.txt for --text,\n"
+                  "                   .json for --json), with .gz or .zz added when compressed;\n"
+                  "                   directories given as files render all .creole files in them\n"
+                  "  --block-cache size  reuse blocks repeated across files (cache of size bytes);\n"
+                  "                   statistics are reported to stderr\n"
+                  "       nxcreole [--threads n] --index dir index\n"
+                  "       nxcreole --backlinks index page | --orphans index | --missing index\n"
+                  "  --index          build or update link index of .creole files under dir\n"
+                  "                   (only changed files are reparsed)\n"
+                  "  --backlinks      pages linking to page or showing it as image\n"
+                  "  --orphans        pages no other page links to\n"
+                  "  --missing        links and images whose target doesn't exist:\n"
+                  "                   kind, target and source page separated by tabs\n");
+}
+
+int main(int argc, char** argv) {
+  if (!setlocale(LC_CTYPE, "en_US.UTF-8") && !setlocale(LC_CTYPE, "C.UTF-8")) {
     perror("setlocale");
     exit(EXIT_FAILURE);
   }
-  run_tests();
-  return 0;
+  int res=EXIT_SUCCESS;
+  if (argc<2) {
+    if (!run_tests()) res=EXIT_FAILURE;
+  }
+  else {
+    render_opts_t opts={MODE_XHTML, 0, 0, 0, 0};
+    nxcreole_markup markup;
+    nxcreole_block_cache block_cache;
+    int i, have_markup=0, threads=0;
+    for (i=1; i<argc; i++) {
+      if (!strcmp(argv[i], "--xhtml")) opts.mode=MODE_XHTML;
+      else if (!strcmp(argv[i], "--text")) opts.mode=MODE_TEXT;
+      else if (!strcmp(argv[i], "--json")) opts.mode=MODE_JSON;
+      else if (!strcmp(argv[i], "--toc")) opts.toc=1;
+      else if (!strcmp(argv[i], "--gzip")) opts.compress=NXCREOLE_GZIP;
+      else if (!strcmp(argv[i], "--deflate")) opts.compress=NXCREOLE_DEFLATE;
+      else if (!strcmp(argv[i], "--out") && i+1<argc) opts.out_dir=argv[++i];
+      else if (!strcmp(argv[i], "--markup") && i+1<argc) {
+        char* config=load_file(argv[++i]);
+        if (have_markup) nxcreole_markup_free(&markup);
+        int line=config? nxcreole_markup_load(&markup, config) : -1;
+        if (config) free(config);
+        have_markup=!line;
+        if (line>0) fprintf(stderr, "ERROR: bad markup template %s:%d\n", argv[i], line);
+        if (!have_markup) {
+          res=EXIT_FAILURE;
+          break;
+        }
+        opts.mode=MODE_MARKUP;
+        opts.markup=&markup;
+      }
+      else if (!strcmp(argv[i], "--block-cache") && i+1<argc) {
+        if (blocks) nxcreole_block_cache_free(blocks);
+        blocks=&block_cache;
+        if (nxcreole_block_cache_init(blocks, (size_t)strtoul(argv[++i], 0, 10))) {
+          blocks=0;
+          fprintf(stderr, "out of memory\n");
+          res=EXIT_FAILURE;
+          break;
+        }
+      }
+      else if (!strcmp(argv[i], "--threads") && i+1<argc) threads=atoi(argv[++i]);
+      else if (!strcmp(argv[i], "--index") && i+2<argc) {
+        if (build_links(argv[i+1], argv[i+2], threads)) res=EXIT_FAILURE;
+        i+=2;
+      }
+      else if (!strcmp(argv[i], "--backlinks") && i+2<argc) {
+        if (report_links(argv[i+1], argv[i], argv[i+2])) res=EXIT_FAILURE;
+        i+=2;
+      }
+      else if ((!strcmp(argv[i], "--orphans") || !strcmp(argv[i], "--missing")) && i+1<argc) {
+        if (report_links(argv[i+1], argv[i], 0)) res=EXIT_FAILURE;
+        i++;
+      }
+      else if (argv[i][0]=='-') {
+        usage();
+        res=EXIT_FAILURE;
+        break;
+      }
+      else {
+        struct stat st;
+        int is_dir=!stat(argv[i], &st) && S_ISDIR(st.st_mode);
+        if (is_dir? render_dir(argv[i], &opts) : render_file(argv[i], &opts)) res=EXIT_FAILURE;
+      }
+    }
+    if (have_markup) nxcreole_markup_free(&markup);
+    if (blocks) {
+      fprintf(stderr, "block cache: %zu hits (%zu as XHTML), %zu misses, %zu stored, %zu evicted, %zu uncacheable\n",
+              blocks->stats.hits, blocks->stats.fragment_hits, blocks->stats.misses, blocks->stats.stores,
+              blocks->stats.evictions, blocks->stats.uncacheable);
+      nxcreole_block_cache_free(blocks);
+    }
+  }
+  nxcreole_arena_destroy(&arena);
+  return res;
 }
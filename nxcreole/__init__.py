@@ -1,2 +1,5 @@
-from parser import CreoleParser, render_xhtml
-from nxcreole._ext import html_escape
+from parser import CreoleParser, render_xhtml, render_xhtml_async, Template, Markup
+from parser import enable_cache, disable_cache, cache_stats
+from nxcreole._ext import html_escape, extract_links, render_text, render_all, render_xhtml_utf8, xhtml_size, render_xhtml_resolved, render_xhtml_bounded
+from nxcreole._ext import render_xhtml_compressed, render_json, render_xhtml_toc
+from nxcreole._ext import sections, render_section, parse_events, markup_defaults
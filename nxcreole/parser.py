@@ -15,11 +15,25 @@
 # You should have received a copy of the GNU Lesser General Public
 # License along with NXCREOLE. If not, see <http://www.gnu.org/licenses/>.
 
+import os
 import StringIO
 import nxcreole._ext
 
 
 html_escape=nxcreole._ext.html_escape
+extract_links=nxcreole._ext.extract_links
+render_text=nxcreole._ext.render_text
+render_all=nxcreole._ext.render_all
+render_xhtml_utf8=nxcreole._ext.render_xhtml_utf8
+xhtml_size=nxcreole._ext.xhtml_size
+render_xhtml_resolved=nxcreole._ext.render_xhtml_resolved
+render_xhtml_bounded=nxcreole._ext.render_xhtml_bounded
+render_xhtml_compressed=nxcreole._ext.render_xhtml_compressed
+render_json=nxcreole._ext.render_json
+markup_defaults=nxcreole._ext.markup_defaults
+sections=nxcreole._ext.sections
+render_section=nxcreole._ext.render_section
+parse_events=nxcreole._ext.parse_events
 
 
 class CreoleParser(object):
@@ -39,11 +53,16 @@ class CreoleParser(object):
     """
     self.out=out
 
-  def parse(self, text):
+  def parse(self, text, stats=False, fuse=False):
     """
     Parse provided wiki text. append_* methods will be called to generate output.
+    If stats is True returns dict of parse statistics (event counts per append_* method,
+    delimiter scans, nesting depths, time spent in parser and in callbacks).
+    If fuse is True adjacent append_text calls are merged into one, and runs of raw calls
+    are replaced by composite methods (append_table_cell_next, append_table_head_cell_next,
+    append_table_row_next, append_list_close_run) where serializer defines them.
     """
-    return nxcreole._ext.parse(self, text)
+    return nxcreole._ext.parse(self, text, stats, fuse)
 
   def append_text(self, s):
     self.out.write(html_escape(s))
@@ -175,12 +194,175 @@ class CreoleParser(object):
   def append_placeholder(self, s):
     self.out.write(html_escape(u'<<<Placeholder:'+s+u'>>>'))
 
+  # composite methods, called only by parse(text, fuse=True)
+
+  def append_table_cell_next(self, colspan):
+    if colspan!='1':
+      self.out.write(u'</td><td colspan="'+colspan+'">')
+    else:
+      self.out.write(u'</td><td>')
+
+  def append_table_head_cell_next(self, colspan):
+    if colspan!='1':
+      self.out.write(u'</th><th colspan="'+colspan+'">')
+    else:
+      self.out.write(u'</th><th>')
+
+  def append_table_row_next(self):
+    self.out.write(u'</tr><tr>')
+
+  def append_list_close_run(self, s):
+    self.out.write(u''.join({
+      '*':u'</li></ul>\n',
+      '-':u'</li></ul>\n',
+      '#':u'</li></ol>\n',
+      '>':u'</blockquote>\n',
+      ':':u'</div>\n',
+      '!':u'</div>\n',
+      }.get(c) for c in s))
+
+
+_cache_enabled=False
+
+def enable_cache(capacity=64*1024*1024, max_entry_size=256*1024, name=None):
+  """
+  Make render_xhtml() go through render cache in shared memory. Anonymous cache
+  (name is None) is shared with processes forked afterwards, so call it in prefork
+  server master; named cache (eg, '/nxcreole') is shared by all processes opening it.
+  """
+  global _cache_enabled
+  nxcreole._ext.cache_open(name, capacity, max_entry_size)
+  _cache_enabled=True
+
+def disable_cache():
+  global _cache_enabled
+  _cache_enabled=False
+  nxcreole._ext.cache_close()
+
+cache_stats=nxcreole._ext.cache_stats
+
 
 def render_xhtml(text):
   """
   Shortcut method to process wiki text and return serialized XHTML string.
   """
+  if _cache_enabled:
+    return nxcreole._ext.render_xhtml_cached(text).decode('utf-8')
   out=StringIO.StringIO()
   parser=CreoleParser(out)
-  parser.parse(text)
+  parser.parse(text, fuse=True)
   return out.getvalue()
+
+
+_async_jobs={} # job id -> (future, loop)
+_async_loops=set() # loops watching render pool fd
+_async_pid=os.getpid() # process the two above belong to
+_async_fd=None # pool fd the loops watch
+
+def _asyncio():
+  try:
+    import asyncio
+  except ImportError:
+    import trollius as asyncio # Python 2 port
+  return asyncio
+
+def _async_collect(loop):
+  for job_id, xhtml in nxcreole._ext.render_collect():
+    future, future_loop=_async_jobs.pop(job_id, (None, None))
+    if future is None or future.cancelled():
+      continue
+    if xhtml is None:
+      setter, value=future.set_exception, MemoryError('render_xhtml_async(): out of memory')
+    else:
+      setter, value=future.set_result, xhtml
+    if future_loop is loop:
+      setter(value)
+    else:
+      future_loop.call_soon_threadsafe(setter, value)
+      # its reader won't fire for jobs collected here, so let it check for itself
+      future_loop.call_soon_threadsafe(_async_release, future_loop)
+  _async_release(loop)
+
+def _async_release(loop):
+  # stop watching pool fd once loop has no jobs in flight
+  if loop in _async_loops and not any(l is loop for _, l in _async_jobs.itervalues()):
+    loop.remove_reader(nxcreole._ext.render_fd())
+    _async_loops.discard(loop)
+
+def render_xhtml_async(text, loop=None):
+  """
+  Render XHTML in native thread pool, without GIL; returns future of event loop
+  (asyncio, or trollius on Python 2) that completes with the same string as render_xhtml(),
+  so event loop never blocks on big documents:
+
+    xhtml=await render_xhtml_async(text)
+
+  Completion is signalled through pipe watched by loop.add_reader(). Pool has one thread
+  per CPU unless nxcreole._ext.pool_start(threads) is called first.
+  """
+  global _async_pid, _async_fd
+  if _async_pid!=os.getpid(): # forked: child gets new pool, parent's jobs never finish here
+    for l in _async_loops:
+      l.remove_reader(_async_fd)
+    _async_jobs.clear()
+    _async_loops.clear()
+    _async_pid=os.getpid()
+  if loop is None:
+    loop=_asyncio().get_event_loop()
+  future=loop.create_future() if hasattr(loop, 'create_future') else _asyncio().Future(loop=loop)
+  _async_jobs[nxcreole._ext.render_submit(text)]=(future, loop)
+  if loop not in _async_loops:
+    _async_fd=nxcreole._ext.render_fd()
+    loop.add_reader(_async_fd, _async_collect, loop)
+    _async_loops.add(loop)
+  return future
+
+
+class Template(object):
+  """
+  Wiki text compiled into XHTML with holes in place of <<<placeholders>>>.
+  Parsing is done once; splice() can then be called any number of times. Usage:
+
+    tpl=Template(text)
+    html=tpl.splice({u'TOC': toc_html, u'widget': widget_html})
+
+  Values are UTF-8 encoded XHTML strings inserted as is; placeholders missing from
+  the map are rendered the default way. Result is UTF-8 encoded string.
+  """
+
+  def __init__(self, text):
+    self.fragments, self.names, self.defaults=nxcreole._ext.compile_template(text)
+
+  def splice(self, values):
+    parts=[self.fragments[0]]
+    for name, default, fragment in zip(self.names, self.defaults, self.fragments[1:]):
+      parts.append(values.get(name, default))
+      parts.append(fragment)
+    return ''.join(parts)
+
+
+class Markup(object):
+  """
+  Table of tag templates for rendering wiki text with own markup instead of
+  built-in XHTML, at C speed. Usage:
+
+    markup=Markup({'format_open.*': u'<b>', 'format_close.*': u'</b>',
+                   'link': u'<a class="wiki" href="/wiki/{target}">{title}</a>'})
+    html=markup.render(text)
+
+  Keys are listed in markup_defaults(); templates not given keep built-in markup.
+  Alternatively config text of "key = template" lines can be passed as config.
+  render() returns UTF-8 encoded string.
+  """
+
+  def __init__(self, templates=None, config=None):
+    if config is not None:
+      if isinstance(config, unicode):
+        config=config.encode('utf-8')
+      self._markup=nxcreole._ext.markup_load(config)
+    else:
+      self._markup=nxcreole._ext.markup_compile(dict((str(key), value.encode('utf-8') if isinstance(value, unicode) else value)
+                                                     for key, value in (templates or {}).iteritems()))
+
+  def render(self, text):
+    return nxcreole._ext.render_markup(text, self._markup)
@@ -0,0 +1,101 @@
+/*
+ * Copyright (c) 2014 Yaroslav Stavnichiy <yarosla@gmail.com>
+ *
+ * This file is part of NXCREOLE.
+ *
+ * NXCREOLE is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License
+ * as published by the Free Software Foundation, either version 3
+ * of the License, or (at your option) any later version.
+ *
+ * NXCREOLE is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with NXCREOLE. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <wchar.h>
+#include <string.h>
+#include <stdlib.h>
+
+#include "nxcreole_parser.h"
+#include "nxcreole_arena.h"
+
+#define ARENA_ALIGN 16
+#define ALIGN_UP(n) (((n)+(ARENA_ALIGN-1))&~(size_t)(ARENA_ALIGN-1))
+
+void nxcreole_arena_init(nxcreole_arena* arena, size_t block_size) {
+  memset(arena, 0, sizeof(nxcreole_arena));
+  arena->block_size=block_size;
+}
+
+static nxcreole_arena_block* new_block(nxcreole_arena* arena, size_t size) {
+  nxcreole_arena_block* b=malloc(sizeof(nxcreole_arena_block)+size);
+  if (!b) return 0;
+  b->size=size;
+  b->used=0;
+  b->next=arena->head;
+  arena->head=b;
+  arena->total_size+=size;
+  return b;
+}
+
+void* nxcreole_arena_alloc(nxcreole_arena* arena, size_t size) {
+  nxcreole_arena_block* b=arena->head;
+  size=ALIGN_UP(size);
+  if (!b || b->size-b->used<size) {
+    // grow geometrically so number of blocks stays logarithmic
+    size_t block_size=arena->block_size? arena->block_size : NXCREOLE_ARENA_BLOCK_SIZE;
+    if (block_size<arena->total_size) block_size=arena->total_size;
+    if (block_size<size) block_size=size;
+    if (!(b=new_block(arena, block_size))) return 0;
+  }
+  void* p=b->data+b->used;
+  b->used+=size;
+  return p;
+}
+
+static void free_blocks(nxcreole_arena* arena) {
+  nxcreole_arena_block* b=arena->head;
+  while (b) {
+    nxcreole_arena_block* next=b->next;
+    free(b);
+    b=next;
+  }
+  arena->head=0;
+  arena->total_size=0;
+}
+
+void nxcreole_arena_reset(nxcreole_arena* arena) {
+  if (arena->head && arena->head->next) {
+    // previous document did not fit into single block => replace all blocks with one
+    // large enough for it, so next document of the same size needs no allocations
+    size_t total_size=arena->total_size;
+    free_blocks(arena);
+    new_block(arena, total_size);
+  }
+  else if (arena->head) {
+    arena->head->used=0;
+  }
+}
+
+void nxcreole_arena_destroy(nxcreole_arena* arena) {
+  free_blocks(arena);
+}
+
+static void* arena_alloc_hook(void* alloc_data, size_t size) {
+  return nxcreole_arena_alloc((nxcreole_arena*)alloc_data, size);
+}
+
+static void arena_dealloc_hook(void* alloc_data, void* ptr) {
+  // arena memory is released by nxcreole_arena_reset()
+}
+
+void nxcreole_use_arena(nxcreole_parse_ctx* ctx, nxcreole_arena* arena) {
+  ctx->alloc=arena_alloc_hook;
+  ctx->dealloc=arena_dealloc_hook;
+  ctx->alloc_data=arena;
+}
@@ -0,0 +1,50 @@
+/*
+ * Copyright (c) 2014 Yaroslav Stavnichiy <yarosla@gmail.com>
+ *
+ * This file is part of NXCREOLE.
+ *
+ * NXCREOLE is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License
+ * as published by the Free Software Foundation, either version 3
+ * of the License, or (at your option) any later version.
+ *
+ * NXCREOLE is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with NXCREOLE. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*
+ * Bump-pointer arena for transient allocations made while parsing/rendering.
+ *
+ * Allocations are never freed individually; nxcreole_arena_reset() releases all
+ * of them at once between documents. Once arena has grown to fit a document
+ * no more system allocations are made for documents of similar size.
+ * Zero-initialized nxcreole_arena is ready to use.
+ */
+
+#define NXCREOLE_ARENA_BLOCK_SIZE 65536
+
+typedef struct nxcreole_arena_block {
+  struct nxcreole_arena_block* next;
+  size_t size;
+  size_t used;
+  char data[];
+} nxcreole_arena_block;
+
+typedef struct nxcreole_arena {
+  nxcreole_arena_block* head; // block being filled; older blocks follow
+  size_t block_size; // minimum size of new block (0 = NXCREOLE_ARENA_BLOCK_SIZE)
+  size_t total_size; // sum of sizes of all blocks
+} nxcreole_arena;
+
+void nxcreole_arena_init(nxcreole_arena* arena, size_t block_size);
+void* nxcreole_arena_alloc(nxcreole_arena* arena, size_t size);
+void nxcreole_arena_reset(nxcreole_arena* arena);
+void nxcreole_arena_destroy(nxcreole_arena* arena);
+
+// make parser take its transient buffers from arena
+void nxcreole_use_arena(nxcreole_parse_ctx* ctx, nxcreole_arena* arena);
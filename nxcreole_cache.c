@@ -0,0 +1,281 @@
+/*
+ * Copyright (c) 2014 Yaroslav Stavnichiy <yarosla@gmail.com>
+ *
+ * This file is part of NXCREOLE.
+ *
+ * NXCREOLE is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License
+ * as published by the Free Software Foundation, either version 3
+ * of the License, or (at your option) any later version.
+ *
+ * NXCREOLE is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with NXCREOLE. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <stdint.h>
+#include <wchar.h>
+#include <string.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <sched.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "nxcreole_parser.h"
+#include "nxcreole_out.h"
+#include "nxcreole_xhtml.h"
+#include "nxcreole_cache.h"
+
+#define CACHE_MAGIC 0x4e584352454f4c32ull // "NXCREOL2"
+#define MIN_ENTRY_SIZE 256
+#define ALIGNMENT 64
+#define ALIGN(n) (((n)+ALIGNMENT-1)&~(size_t)(ALIGNMENT-1))
+#define OPEN_WAIT_ROUNDS 10000 // how long to wait for other process to initialize named cache
+
+typedef struct nxcreole_cache_header {
+  uint64_t magic; // set last, when header is complete
+  uint64_t map_size;
+  uint64_t set_count;
+  uint64_t entry_size;
+  uint64_t clock; // access counter for LRU
+  nxcreole_cache_stats stats;
+} nxcreole_cache_header;
+
+typedef struct nxcreole_cache_entry {
+  uint32_t seq; // odd while entry is being written
+  uint32_t lock; // in first entry of a set only: set is being written
+  uint64_t last_used; // clock value; 0 for empty entry
+  nxcreole_cache_key key;
+  uint64_t length;
+} nxcreole_cache_entry;
+
+#define LOAD(p) __atomic_load_n((p), __ATOMIC_ACQUIRE)
+#define STORE(p, v) __atomic_store_n((p), (v), __ATOMIC_RELEASE)
+#define COUNT(cache, stat) __atomic_fetch_add(&(cache)->header->stats.stat, 1, __ATOMIC_RELAXED)
+
+static size_t layout(size_t set_count, size_t entry_size, size_t* entries_offset, size_t* data_offset) {
+  size_t entry_count=set_count*NXCREOLE_CACHE_WAYS;
+  *entries_offset=ALIGN(sizeof(nxcreole_cache_header));
+  *data_offset=ALIGN(*entries_offset+entry_count*sizeof(nxcreole_cache_entry));
+  return *data_offset+entry_count*entry_size;
+}
+
+static void attach(nxcreole_cache* cache, void* base, size_t map_size) {
+  size_t entries_offset, data_offset;
+  cache->base=base;
+  cache->map_size=map_size;
+  cache->header=base;
+  layout((size_t)cache->header->set_count, (size_t)cache->header->entry_size, &entries_offset, &data_offset);
+  cache->entries=(nxcreole_cache_entry*)((char*)base+entries_offset);
+  cache->data=(char*)base+data_offset;
+}
+
+int nxcreole_cache_open(nxcreole_cache* cache, const char* name, size_t capacity, size_t max_entry_size) {
+  size_t entries_offset, data_offset;
+  memset(cache, 0, sizeof(nxcreole_cache));
+  if (max_entry_size<MIN_ENTRY_SIZE) max_entry_size=MIN_ENTRY_SIZE;
+  max_entry_size=ALIGN(max_entry_size);
+  size_t set_count=capacity/(max_entry_size*NXCREOLE_CACHE_WAYS);
+  if (!set_count) set_count=1;
+  size_t map_size=layout(set_count, max_entry_size, &entries_offset, &data_offset);
+
+  int fd=-1, created=1;
+  if (name) {
+    fd=shm_open(name, O_RDWR|O_CREAT|O_EXCL, 0600);
+    if (fd==-1 && errno==EEXIST) {
+      created=0;
+      fd=shm_open(name, O_RDWR, 0600);
+    }
+    if (fd==-1) return -1;
+    if (created) {
+      if (ftruncate(fd, (off_t)map_size)) goto error;
+    }
+    else { // wait for creator to size and initialize it
+      struct stat st;
+      int i;
+      for (i=0; ; i++) {
+        if (fstat(fd, &st)) goto error;
+        if (st.st_size>=(off_t)sizeof(nxcreole_cache_header)) {
+          nxcreole_cache_header* header=mmap(0, sizeof(nxcreole_cache_header), PROT_READ, MAP_SHARED, fd, 0);
+          if (header==MAP_FAILED) goto error;
+          int ready=LOAD(&header->magic)==CACHE_MAGIC;
+          if (ready) map_size=(size_t)header->map_size;
+          munmap(header, sizeof(nxcreole_cache_header));
+          if (ready) break;
+        }
+        if (i==OPEN_WAIT_ROUNDS) {
+          errno=ETIMEDOUT;
+          goto error;
+        }
+        sched_yield();
+      }
+    }
+  }
+  void* base=mmap(0, map_size, PROT_READ|PROT_WRITE, fd==-1? MAP_SHARED|MAP_ANONYMOUS : MAP_SHARED, fd, 0);
+  if (base==MAP_FAILED) goto error;
+  if (fd!=-1) close(fd);
+  if (created) { // fresh mapping is zero-filled
+    nxcreole_cache_header* header=base;
+    header->map_size=map_size;
+    header->set_count=set_count;
+    header->entry_size=max_entry_size;
+    STORE(&header->magic, CACHE_MAGIC);
+  }
+  attach(cache, base, map_size);
+  return 0;
+
+  error:
+  if (fd!=-1) {
+    int e=errno;
+    close(fd);
+    if (created) shm_unlink(name);
+    errno=e;
+  }
+  return -1;
+}
+
+void nxcreole_cache_close(nxcreole_cache* cache) {
+  if (cache->base) munmap(cache->base, cache->map_size);
+  memset(cache, 0, sizeof(nxcreole_cache));
+}
+
+int nxcreole_cache_unlink(const char* name) {
+  return shm_unlink(name);
+}
+
+nxcreole_cache_key nxcreole_cache_make_key(const wchar_t* text, size_t length, unsigned config) {
+  // FNV-1a over two characters at a time
+  uint64_t h=14695981039346656037ull;
+  const wchar_t* end=text+length;
+  for (; text+1<end; text+=2) h=(h^((uint64_t)(uint32_t)text[0]<<32^(uint32_t)text[1]))*1099511628211ull;
+  if (text<end) h=(h^(uint32_t)*text)*1099511628211ull;
+  nxcreole_cache_key key;
+  key.hash=h;
+  key.info=(uint64_t)length<<8|(config&0xff);
+  return key;
+}
+
+static nxcreole_cache_entry* find_set(nxcreole_cache* cache, const nxcreole_cache_key* key) {
+  return cache->entries+(size_t)(key->hash%cache->header->set_count)*NXCREOLE_CACHE_WAYS;
+}
+
+// entry block: source text, then output
+static char* entry_data(nxcreole_cache* cache, nxcreole_cache_entry* e) {
+  return cache->data+(size_t)(e-cache->entries)*(size_t)cache->header->entry_size;
+}
+
+static size_t text_size(const nxcreole_cache_key* key) {
+  return (size_t)(key->info>>8)*sizeof(wchar_t);
+}
+
+int nxcreole_cache_get(nxcreole_cache* cache, const nxcreole_cache_key* key, const wchar_t* text, nxcreole_out* out) {
+  nxcreole_cache_entry* e=find_set(cache, key);
+  size_t source=text_size(key);
+  int i;
+  for (i=0; i<NXCREOLE_CACHE_WAYS; i++, e++) {
+    uint32_t seq=LOAD(&e->seq);
+    if (seq&1) continue;
+    if (e->key.hash!=key->hash || e->key.info!=key->info) continue;
+    size_t length=(size_t)e->length;
+    if (source>cache->header->entry_size || length>cache->header->entry_size-source) continue; // torn read
+    const char* data=entry_data(cache, e);
+    if (memcmp(data, text, source)) continue; // hash collision (or torn read)
+    data+=source;
+    char* copy=0;
+    size_t start=out->length;
+    if (out->sink) { // can't take output back from sink
+      if (!(copy=malloc(length? length:1))) break;
+      memcpy(copy, data, length);
+    }
+    else {
+      nxcreole_out_write(out, data, length);
+    }
+    __atomic_thread_fence(__ATOMIC_ACQUIRE);
+    if (__atomic_load_n(&e->seq, __ATOMIC_RELAXED)!=seq) { // entry changed while copying
+      if (copy) free(copy);
+      else if (!out->error) out->length=start, out->total-=length;
+      break;
+    }
+    if (copy) {
+      nxcreole_out_write(out, copy, length);
+      free(copy);
+    }
+    __atomic_store_n(&e->last_used, __atomic_add_fetch(&cache->header->clock, 1, __ATOMIC_RELAXED), __ATOMIC_RELAXED);
+    COUNT(cache, hits);
+    return 1;
+  }
+  COUNT(cache, misses);
+  return 0;
+}
+
+void nxcreole_cache_put(nxcreole_cache* cache, const nxcreole_cache_key* key, const wchar_t* text, const char* data, size_t length) {
+  size_t source=text_size(key);
+  if (source>cache->header->entry_size || length>cache->header->entry_size-source) {
+    COUNT(cache, skipped);
+    return;
+  }
+  nxcreole_cache_entry* set=find_set(cache, key);
+  if (__atomic_exchange_n(&set->lock, 1, __ATOMIC_ACQUIRE)) { // somebody is writing
+    COUNT(cache, skipped);
+    return;
+  }
+  // same key, else empty, else least recently used
+  nxcreole_cache_entry* victim=set;
+  int i;
+  for (i=0; i<NXCREOLE_CACHE_WAYS; i++) {
+    nxcreole_cache_entry* e=set+i;
+    if (e->key.hash==key->hash && e->key.info==key->info && e->last_used) {
+      victim=e;
+      break;
+    }
+    if (e->last_used<victim->last_used) victim=e;
+  }
+  if (victim->last_used && (victim->key.hash!=key->hash || victim->key.info!=key->info)) COUNT(cache, evictions);
+  uint32_t seq=victim->seq;
+  __atomic_store_n(&victim->seq, seq+1, __ATOMIC_RELAXED);
+  __atomic_thread_fence(__ATOMIC_RELEASE);
+  victim->key=*key;
+  victim->length=length;
+  memcpy(entry_data(cache, victim), text, source);
+  memcpy(entry_data(cache, victim)+source, data, length);
+  victim->last_used=__atomic_add_fetch(&cache->header->clock, 1, __ATOMIC_RELAXED);
+  STORE(&victim->seq, seq+2);
+  STORE(&set->lock, 0);
+  COUNT(cache, stores);
+}
+
+void nxcreole_cache_get_stats(nxcreole_cache* cache, nxcreole_cache_stats* stats) {
+  stats->hits=LOAD(&cache->header->stats.hits);
+  stats->misses=LOAD(&cache->header->stats.misses);
+  stats->stores=LOAD(&cache->header->stats.stores);
+  stats->evictions=LOAD(&cache->header->stats.evictions);
+  stats->skipped=LOAD(&cache->header->stats.skipped);
+}
+
+void nxcreole_render_xhtml_cached(nxcreole_cache* cache, const wchar_t* text, nxcreole_out* out) {
+  size_t length=wcslen(text);
+  nxcreole_cache_key key=nxcreole_cache_make_key(text, length, NXCREOLE_CACHE_XHTML);
+  if (nxcreole_cache_get(cache, &key, text, out)) return;
+  if (!out->sink) { // rendered output stays in out's buffer
+    size_t start=out->length;
+    nxcreole_render_xhtml(text, out);
+    if (!out->error) nxcreole_cache_put(cache, &key, text, out->buf+start, out->length-start);
+    return;
+  }
+  nxcreole_out tmp;
+  if (nxcreole_out_init(&tmp, length*2, 0, 0)) {
+    nxcreole_render_xhtml(text, out);
+    return;
+  }
+  nxcreole_render_xhtml(text, &tmp);
+  if (!tmp.error) nxcreole_cache_put(cache, &key, text, tmp.buf, tmp.length);
+  nxcreole_out_write(out, tmp.buf, tmp.length);
+  nxcreole_out_free(&tmp);
+}
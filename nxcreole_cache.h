@@ -0,0 +1,78 @@
+/*
+ * Copyright (c) 2014 Yaroslav Stavnichiy <yarosla@gmail.com>
+ *
+ * This file is part of NXCREOLE.
+ *
+ * NXCREOLE is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License
+ * as published by the Free Software Foundation, either version 3
+ * of the License, or (at your option) any later version.
+ *
+ * NXCREOLE is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with NXCREOLE. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*
+ * Render cache in shared memory, for prefork servers. Entries are keyed by 64-bit hash
+ * of source text plus its length and serializer configuration, and hold source text
+ * and rendered UTF-8. Source is compared on lookup, so text whose hash collides with
+ * another one's (hash is not keyed, collisions can be made) is never served its output.
+ *
+ * Cache is set-associative: key selects set of NXCREOLE_CACHE_WAYS entries, least
+ * recently used entry of the set is evicted. Every entry has fixed size block
+ * (max_entry_size); entries whose source (wchar_t) and output don't fit in it together
+ * are not cached. Reads are lock-free (entries are
+ * guarded by sequence counters, torn reads are detected and count as misses);
+ * writers only try-lock the set and skip storing if it is busy, so nobody ever waits.
+ *
+ * Anonymous cache (name is 0) is shared with processes forked after it is opened.
+ * Named cache is a POSIX shared memory object, shared by all processes opening it;
+ * capacity and entry size are taken from whoever created it first.
+ *
+ * Include <stdint.h> before this header.
+ */
+
+#define NXCREOLE_CACHE_WAYS 8
+
+// serializer configurations (part of the key)
+#define NXCREOLE_CACHE_XHTML 1
+#define NXCREOLE_CACHE_TEXT 2
+
+typedef struct nxcreole_cache_key {
+  uint64_t hash;
+  uint64_t info; // text length and configuration
+} nxcreole_cache_key;
+
+typedef struct nxcreole_cache_stats {
+  uint64_t hits;
+  uint64_t misses;
+  uint64_t stores;
+  uint64_t evictions;
+  uint64_t skipped; // stores skipped because of size or busy set
+} nxcreole_cache_stats;
+
+typedef struct nxcreole_cache {
+  void* base; // mapping (process-local)
+  size_t map_size;
+  struct nxcreole_cache_header* header;
+  struct nxcreole_cache_entry* entries;
+  char* data;
+} nxcreole_cache;
+
+int nxcreole_cache_open(nxcreole_cache* cache, const char* name, size_t capacity, size_t max_entry_size); // returns -1 on error (errno set)
+void nxcreole_cache_close(nxcreole_cache* cache); // unmaps; named object stays until nxcreole_cache_unlink()
+int nxcreole_cache_unlink(const char* name);
+
+nxcreole_cache_key nxcreole_cache_make_key(const wchar_t* text, size_t length, unsigned config);
+// text is source the key was made of
+int nxcreole_cache_get(nxcreole_cache* cache, const nxcreole_cache_key* key, const wchar_t* text, nxcreole_out* out); // appends entry to out and returns 1 on hit
+void nxcreole_cache_put(nxcreole_cache* cache, const nxcreole_cache_key* key, const wchar_t* text, const char* data, size_t length);
+void nxcreole_cache_get_stats(nxcreole_cache* cache, nxcreole_cache_stats* stats);
+
+// nxcreole_render_xhtml() through cache
+void nxcreole_render_xhtml_cached(nxcreole_cache* cache, const wchar_t* text, nxcreole_out* out);
@@ -18,11 +18,30 @@
  */
 
 #include <assert.h>
+#include <stdint.h>
+#include <errno.h>
 #include <stdio.h>
 #include <wchar.h>
+#include <string.h>
 #include <Python.h>
+#include <zlib.h>
+#include <pthread.h>
+#include <unistd.h>
 
 #include "nxcreole_parser.h"
+#include "nxcreole_out.h"
+#include "nxcreole_text.h"
+#include "nxcreole_xhtml.h"
+#include "nxcreole_tee.h"
+#include "nxcreole_fuse.h"
+#include "nxcreole_markup.h"
+#include "nxcreole_template.h"
+#include "nxcreole_resolve.h"
+#include "nxcreole_cache.h"
+#include "nxcreole_zsink.h"
+#include "nxcreole_json.h"
+#include "nxcreole_pool.h"
+#include "nxcreole_toc.h"
 
 const char* fn_names[]={
   "append_text",
@@ -51,6 +70,10 @@ const char* fn_names[]={
   "append_image",
   "append_link",
   "append_placeholder",
+  "append_table_cell_next",
+  "append_table_head_cell_next",
+  "append_table_row_next",
+  "append_list_close_run",
 };
 
 static void append0(nxcreole_parse_ctx* ctx, nxcreole_fn_id_t fn_id) {
@@ -88,19 +111,106 @@ static int init_fns(PyObject* serializer, nxcreole_parse_ctx* ctx) {
   return 0;
 }
 
+// depth at which name is defined: 0 for an instance attribute, 1 + index in type's MRO
+// for a class attribute, -1 if not found
+static Py_ssize_t defined_at(PyObject* o, const char* name) {
+  PyObject** dict=_PyObject_GetDictPtr(o);
+  PyObject* mro=Py_TYPE(o)->tp_mro;
+  Py_ssize_t i;
+  if (dict && *dict && PyDict_GetItemString(*dict, name)) return 0;
+  if (!mro) return -1;
+  for (i=0; i<PyTuple_GET_SIZE(mro); i++) {
+    PyObject* cls=PyTuple_GET_ITEM(mro, i);
+    if (PyType_Check(cls) && PyDict_GetItemString(((PyTypeObject*)cls)->tp_dict, name)) return i+1;
+  }
+  return -1;
+}
+
+// composite replaces raw methods; it is safe to use only if it is defined at least as deep
+// in the class hierarchy as each of them, else a subclass overriding a raw method only
+// (and inheriting the composite) would see its override bypassed
+static int composite_overrides(PyObject* serializer, nxcreole_fn_id_t composite, nxcreole_fn_id_t raw0, nxcreole_fn_id_t raw1) {
+  Py_ssize_t at=defined_at(serializer, fn_names[composite]);
+  Py_ssize_t raw0_at=defined_at(serializer, fn_names[raw0]);
+  Py_ssize_t raw1_at=defined_at(serializer, fn_names[raw1]);
+  if (at<0) return 0;
+  return (raw0_at<0 || at<=raw0_at) && (raw1_at<0 || at<=raw1_at);
+}
+
+// composite methods are optional; returns NXCREOLE_FUSE_* options for those defined
+static unsigned init_fused_fns(PyObject* serializer, nxcreole_parse_ctx* ctx) {
+  int i;
+  int overrides[FN_FUSED_COUNT-FN_COUNT];
+  overrides[FN_APPEND_TABLE_CELL_NEXT-FN_COUNT]=composite_overrides(serializer, FN_APPEND_TABLE_CELL_NEXT, FN_APPEND_TABLE_CELL_CLOSE, FN_APPEND_TABLE_CELL_OPEN);
+  overrides[FN_APPEND_TABLE_HEAD_CELL_NEXT-FN_COUNT]=composite_overrides(serializer, FN_APPEND_TABLE_HEAD_CELL_NEXT, FN_APPEND_TABLE_HEAD_CELL_CLOSE, FN_APPEND_TABLE_HEAD_CELL_OPEN);
+  overrides[FN_APPEND_TABLE_ROW_NEXT-FN_COUNT]=composite_overrides(serializer, FN_APPEND_TABLE_ROW_NEXT, FN_APPEND_TABLE_ROW_CLOSE, FN_APPEND_TABLE_ROW_OPEN);
+  overrides[FN_APPEND_LIST_CLOSE_RUN-FN_COUNT]=composite_overrides(serializer, FN_APPEND_LIST_CLOSE_RUN, FN_APPEND_LIST_CLOSE, FN_APPEND_LIST_CLOSE);
+  for (i=FN_COUNT; i<FN_FUSED_COUNT; i++) {
+    ctx->fn[i]=overrides[i-FN_COUNT]? PyObject_GetAttrString(serializer, fn_names[i]) : 0;
+    if (ctx->fn[i] && !PyCallable_Check(ctx->fn[i])) {
+      Py_DECREF(ctx->fn[i]);
+      ctx->fn[i]=0;
+    }
+  }
+  PyErr_Clear();
+  return NXCREOLE_FUSE_TEXT
+         | (ctx->fn[FN_APPEND_TABLE_CELL_NEXT] && ctx->fn[FN_APPEND_TABLE_HEAD_CELL_NEXT]? NXCREOLE_FUSE_CELLS : 0)
+         | (ctx->fn[FN_APPEND_TABLE_ROW_NEXT]? NXCREOLE_FUSE_ROWS : 0)
+         | (ctx->fn[FN_APPEND_LIST_CLOSE_RUN]? NXCREOLE_FUSE_LISTS : 0);
+}
+
 static void finalize_fns(nxcreole_parse_ctx* ctx) {
   int i;
-  for (i=0; i<FN_COUNT; i++) {
+  for (i=0; i<FN_FUSED_COUNT; i++) {
     if (ctx->fn[i]) Py_DECREF(ctx->fn[i]);
   }
 }
 
+#ifdef NXCREOLE_STATS
+static int set_stat(PyObject* dict, const char* name, PyObject* value) {
+  if (!value) return -1;
+  int res=PyDict_SetItemString(dict, name, value);
+  Py_DECREF(value);
+  return res;
+}
+
+static PyObject* stats_to_dict(const nxcreole_stats* stats) {
+  PyObject* events=PyDict_New();
+  PyObject* dict=PyDict_New();
+  int i;
+  if (!events || !dict) goto error;
+  for (i=0; i<FN_COUNT; i++) {
+    if (set_stat(events, fn_names[i], PyInt_FromSize_t(stats->events[i]))) goto error;
+  }
+  if (PyDict_SetItemString(dict, "events", events)
+      || set_stat(dict, "bytes_scanned", PyInt_FromSize_t(stats->bytes_scanned))
+      || set_stat(dict, "text_flushes", PyInt_FromSize_t(stats->text_flushes))
+      || set_stat(dict, "full_buffer_flushes", PyInt_FromSize_t(stats->full_buffer_flushes))
+      || set_stat(dict, "delimiter_scans", PyInt_FromSize_t(stats->delimiter_scans))
+      || set_stat(dict, "delimiter_scan_hits", PyInt_FromSize_t(stats->delimiter_scan_hits))
+      || set_stat(dict, "delimiter_scan_chars", PyInt_FromSize_t(stats->delimiter_scan_chars))
+      || set_stat(dict, "max_list_depth", PyInt_FromLong(stats->max_list_depth))
+      || set_stat(dict, "max_format_depth", PyInt_FromLong(stats->max_format_depth))
+      || set_stat(dict, "parse_time", PyFloat_FromDouble(stats->parse_time))
+      || set_stat(dict, "callback_time", PyFloat_FromDouble(stats->callback_time))) goto error;
+  Py_DECREF(events);
+  return dict;
+
+  error:
+  Py_XDECREF(events);
+  Py_XDECREF(dict);
+  return NULL;
+}
+#endif
+
 static PyObject* parse(PyObject *ignored, PyObject *args)
 {
   PyObject* serializer;
   PyObject* text;
+  PyObject* want_stats=NULL;
+  PyObject* want_fuse=NULL;
 
-  if (!PyArg_UnpackTuple(args, "parse", 2, 2, &serializer, &text)
+  if (!PyArg_UnpackTuple(args, "parse", 2, 4, &serializer, &text, &want_stats, &want_fuse)
       || /*!PyObject_Check(serializer) ||*/ !PyUnicode_Check(text)) {
     PyErr_SetString(PyExc_TypeError, "parse() expects object and unicode string as arguments");
     return NULL;
@@ -111,16 +221,779 @@ static PyObject* parse(PyObject *ignored, PyObject *args)
   nxcreole_init(&ctx, text_ptr);
   ctx.append0=append0;
   ctx.append1=append1;
-  if (init_fns(serializer, &ctx)) return NULL;
+#ifdef NXCREOLE_STATS
+  nxcreole_stats stats;
+  if (want_stats && PyObject_IsTrue(want_stats)) {
+    memset(&stats, 0, sizeof(stats));
+    ctx.stats=&stats;
+  }
+#else
+  if (want_stats && PyObject_IsTrue(want_stats)) {
+    PyErr_SetString(PyExc_NotImplementedError, "parse statistics not compiled in (define NXCREOLE_STATS)");
+    return NULL;
+  }
+#endif
+  if (init_fns(serializer, &ctx)) {
+    finalize_fns(&ctx);
+    return NULL;
+  }
 
-  nxcreole_parse(&ctx);
+  if (want_fuse && PyObject_IsTrue(want_fuse)) { // parser ctx feeds fuse, fuse feeds serializer's ctx
+    nxcreole_parse_ctx fuse_ctx=ctx;
+    nxcreole_fuse fuse;
+    nxcreole_fuse_init(&fuse_ctx, &fuse, &ctx, init_fused_fns(serializer, &ctx));
+    nxcreole_parse(&fuse_ctx);
+    nxcreole_fuse_flush(&fuse);
+  }
+  else {
+    nxcreole_parse(&ctx);
+  }
 
   // deinit
   finalize_fns(&ctx);
 
+#ifdef NXCREOLE_STATS
+  if (ctx.stats) return stats_to_dict(&stats);
+#endif
+  Py_RETURN_NONE;
+}
+
+typedef struct {
+  PyObject* list;
+  int error;
+} events_result_t;
+
+static void record_event(nxcreole_parse_ctx* ctx, nxcreole_fn_id_t fn, PyObject* payload) {
+  events_result_t* res=ctx->data;
+  PyObject* item=payload? Py_BuildValue("(sOnn)", fn_names[fn], payload, (Py_ssize_t)ctx->span_start, (Py_ssize_t)ctx->span_end) : NULL;
+  if (!item || PyList_Append(res->list, item)) res->error=1;
+  Py_XDECREF(item);
+  Py_XDECREF(payload);
+}
+
+static void record_event0(nxcreole_parse_ctx* ctx, nxcreole_fn_id_t fn) {
+  if (((events_result_t*)ctx->data)->error) return;
+  Py_INCREF(Py_None);
+  record_event(ctx, fn, Py_None);
+}
+
+static void record_event1(nxcreole_parse_ctx* ctx, nxcreole_fn_id_t fn, const wchar_t* s, size_t len) {
+  if (((events_result_t*)ctx->data)->error) return;
+  record_event(ctx, fn, PyUnicode_FromWideChar(s, len));
+}
+
+static PyObject* parse_events(PyObject *ignored, PyObject *args) {
+  PyObject* text;
+  if (!PyArg_UnpackTuple(args, "parse_events", 1, 1, &text)
+      || !PyUnicode_Check(text)) {
+    PyErr_SetString(PyExc_TypeError, "parse_events() expects unicode string as argument");
+    return NULL;
+  }
+
+  events_result_t res={PyList_New(0), 0};
+  if (!res.list) return NULL;
+  nxcreole_parse_ctx ctx;
+  nxcreole_init(&ctx, (const wchar_t*)PyUnicode_AS_UNICODE(text));
+  ctx.append0=record_event0;
+  ctx.append1=record_event1;
+  ctx.data=&res;
+  nxcreole_parse_spans(&ctx);
+  if (res.error) {
+    Py_DECREF(res.list);
+    return NULL;
+  }
+  return res.list;
+}
+
+typedef struct {
+  PyObject* list;
+  int error;
+} links_result_t;
+
+static void collect_link(void* data, nxcreole_fn_id_t fn, const wchar_t* s, size_t len, size_t offset) {
+  links_result_t* res=data;
+  if (res->error) return;
+  const char* kind=fn==FN_APPEND_LINK? "link" : fn==FN_APPEND_IMAGE? "image" : "placeholder";
+  PyObject* item=Py_BuildValue("(su#n)", kind, (Py_UNICODE*)s, (Py_ssize_t)len, (Py_ssize_t)offset);
+  if (!item || PyList_Append(res->list, item)) res->error=1;
+  Py_XDECREF(item);
+}
+
+static PyObject* extract_links(PyObject *ignored, PyObject *args) {
+  PyObject* text;
+  if (!PyArg_UnpackTuple(args, "extract_links", 1, 1, &text)
+      || !PyUnicode_Check(text)) {
+    PyErr_SetString(PyExc_TypeError, "extract_links() expects unicode string as argument");
+    return NULL;
+  }
+
+  links_result_t res={PyList_New(0), 0};
+  if (!res.list) return NULL;
+  nxcreole_scan_links((const wchar_t*)PyUnicode_AS_UNICODE(text), collect_link, &res);
+  if (res.error) {
+    Py_DECREF(res.list);
+    return NULL;
+  }
+  return res.list;
+}
+
+static PyObject* render_text(PyObject *ignored, PyObject *args) {
+  PyObject* text;
+  if (!PyArg_UnpackTuple(args, "render_text", 1, 1, &text)
+      || !PyUnicode_Check(text)) {
+    PyErr_SetString(PyExc_TypeError, "render_text() expects unicode string as argument");
+    return NULL;
+  }
+
+  nxcreole_out out;
+  if (nxcreole_out_init(&out, (size_t)PyUnicode_GET_SIZE(text), 0, 0)) return PyErr_NoMemory();
+  nxcreole_render_text((const wchar_t*)PyUnicode_AS_UNICODE(text), &out);
+  PyObject* result=out.error? PyErr_NoMemory() : PyString_FromStringAndSize(out.buf, (Py_ssize_t)out.length);
+  nxcreole_out_free(&out);
+  return result;
+}
+
+static PyObject* render_json(PyObject *ignored, PyObject *args) {
+  PyObject* text;
+  if (!PyArg_UnpackTuple(args, "render_json", 1, 1, &text)
+      || !PyUnicode_Check(text)) {
+    PyErr_SetString(PyExc_TypeError, "render_json() expects unicode string as argument");
+    return NULL;
+  }
+
+  nxcreole_out out;
+  if (nxcreole_out_init(&out, (size_t)PyUnicode_GET_SIZE(text)*2, 0, 0)) return PyErr_NoMemory();
+  const wchar_t* text_ptr=(const wchar_t*)PyUnicode_AS_UNICODE(text);
+  Py_BEGIN_ALLOW_THREADS // text is kept alive by caller's reference
+  nxcreole_render_json(text_ptr, &out);
+  Py_END_ALLOW_THREADS
+  PyObject* result=out.error? PyErr_NoMemory() : PyString_FromStringAndSize(out.buf, (Py_ssize_t)out.length);
+  nxcreole_out_free(&out);
+  return result;
+}
+
+static PyObject* render_xhtml_toc(PyObject *ignored, PyObject *args) {
+  PyObject* text;
+  if (!PyArg_UnpackTuple(args, "render_xhtml_toc", 1, 1, &text)
+      || !PyUnicode_Check(text)) {
+    PyErr_SetString(PyExc_TypeError, "render_xhtml_toc() expects unicode string as argument");
+    return NULL;
+  }
+
+  nxcreole_out out;
+  nxcreole_toc toc;
+  if (nxcreole_out_init(&out, (size_t)PyUnicode_GET_SIZE(text)*2, 0, 0)) return PyErr_NoMemory();
+  if (nxcreole_toc_init(&toc)) {
+    nxcreole_out_free(&out);
+    return PyErr_NoMemory();
+  }
+  const wchar_t* text_ptr=(const wchar_t*)PyUnicode_AS_UNICODE(text);
+  int res;
+  Py_BEGIN_ALLOW_THREADS // text is kept alive by caller's reference
+  res=nxcreole_render_xhtml_toc(text_ptr, &out, &toc);
+  Py_END_ALLOW_THREADS
+  PyObject* result=NULL;
+  if (res) PyErr_NoMemory();
+  else {
+    PyObject* xhtml=PyString_FromStringAndSize(out.buf, (Py_ssize_t)out.length);
+    PyObject* toc_xhtml=xhtml? PyString_FromStringAndSize(toc.out.buf, (Py_ssize_t)toc.out.length) : NULL;
+    if (toc_xhtml) result=Py_BuildValue("(NN)", xhtml, toc_xhtml);
+    else Py_XDECREF(xhtml);
+  }
+  nxcreole_toc_free(&toc);
+  nxcreole_out_free(&out);
+  return result;
+}
+
+static PyObject* xhtml_size(PyObject *ignored, PyObject *args) {
+  PyObject* text;
+  if (!PyArg_UnpackTuple(args, "xhtml_size", 1, 1, &text)
+      || !PyUnicode_Check(text)) {
+    PyErr_SetString(PyExc_TypeError, "xhtml_size() expects unicode string as argument");
+    return NULL;
+  }
+  return PyInt_FromSize_t(nxcreole_xhtml_size((const wchar_t*)PyUnicode_AS_UNICODE(text)));
+}
+
+static PyObject* render_xhtml_utf8(PyObject *ignored, PyObject *args) {
+  PyObject* text;
+  if (!PyArg_UnpackTuple(args, "render_xhtml_utf8", 1, 1, &text)
+      || !PyUnicode_Check(text)) {
+    PyErr_SetString(PyExc_TypeError, "render_xhtml_utf8() expects unicode string as argument");
+    return NULL;
+  }
+
+  // one parse gives events and exact size, so result string is allocated once and never resized
+  const wchar_t* text_ptr=(const wchar_t*)PyUnicode_AS_UNICODE(text);
+  nxcreole_xhtml_tape tape;
+  int res;
+  Py_BEGIN_ALLOW_THREADS // text is kept alive by caller's reference
+  res=nxcreole_xhtml_tape_record(&tape, text_ptr);
+  Py_END_ALLOW_THREADS
+  if (res) {
+    nxcreole_xhtml_tape_free(&tape);
+    return PyErr_NoMemory();
+  }
+  PyObject* result=PyString_FromStringAndSize(NULL, (Py_ssize_t)tape.size);
+  if (result) {
+    nxcreole_out out;
+    nxcreole_out_init_fixed(&out, PyString_AS_STRING(result), tape.size);
+    nxcreole_xhtml_tape_render(&tape, &out);
+    if (out.error || out.total!=tape.size) {
+      Py_DECREF(result);
+      result=NULL;
+      PyErr_SetString(PyExc_SystemError, "render_xhtml_utf8(): output size differs from computed one");
+    }
+  }
+  nxcreole_xhtml_tape_free(&tape);
+  return result;
+}
+
+static PyObject* render_all(PyObject *ignored, PyObject *args) {
+  PyObject* text;
+  if (!PyArg_UnpackTuple(args, "render_all", 1, 1, &text)
+      || !PyUnicode_Check(text)) {
+    PyErr_SetString(PyExc_TypeError, "render_all() expects unicode string as argument");
+    return NULL;
+  }
+
+  const wchar_t* text_ptr=(const wchar_t*)PyUnicode_AS_UNICODE(text);
+  size_t text_len=(size_t)PyUnicode_GET_SIZE(text);
+  nxcreole_out xhtml_out, text_out;
+  if (nxcreole_out_init(&xhtml_out, text_len*2, 0, 0)) return PyErr_NoMemory();
+  if (nxcreole_out_init(&text_out, text_len, 0, 0)) {
+    nxcreole_out_free(&xhtml_out);
+    return PyErr_NoMemory();
+  }
+  links_result_t links={PyList_New(0), 0};
+  PyObject* result=NULL;
+  if (!links.list) goto end;
+
+  nxcreole_parse_ctx ctx, xhtml_ctx, text_ctx, links_ctx;
+  nxcreole_xhtml_serializer xs;
+  nxcreole_text_serializer ts;
+  nxcreole_tee tee;
+  nxcreole_init(&ctx, text_ptr);
+  nxcreole_init(&xhtml_ctx, text_ptr);
+  nxcreole_init(&text_ctx, text_ptr);
+  nxcreole_init(&links_ctx, text_ptr);
+  nxcreole_xhtml_init(&xhtml_ctx, &xs, &xhtml_out);
+  nxcreole_text_init(&text_ctx, &ts, &text_out);
+  nxcreole_links_init(&links_ctx, collect_link, &links);
+  nxcreole_tee_init(&ctx, &tee);
+  nxcreole_tee_add(&tee, &xhtml_ctx, NXCREOLE_ALL_EVENTS);
+  nxcreole_tee_add(&tee, &text_ctx, NXCREOLE_ALL_EVENTS);
+  nxcreole_tee_add(&tee, &links_ctx, NXCREOLE_EVENT(FN_APPEND_LINK)|NXCREOLE_EVENT(FN_APPEND_IMAGE)|NXCREOLE_EVENT(FN_APPEND_PLACEHOLDER));
+  nxcreole_parse(&ctx);
+
+  if (links.error) goto end;
+  if (xhtml_out.error || text_out.error) {
+    PyErr_NoMemory();
+    goto end;
+  }
+  PyObject* xhtml=PyString_FromStringAndSize(xhtml_out.buf, (Py_ssize_t)xhtml_out.length);
+  PyObject* plain=xhtml? PyString_FromStringAndSize(text_out.buf, (Py_ssize_t)text_out.length) : NULL;
+  if (plain) result=Py_BuildValue("(NNO)", xhtml, plain, links.list);
+  else Py_XDECREF(xhtml);
+
+  end:
+  Py_XDECREF(links.list);
+  nxcreole_out_free(&xhtml_out);
+  nxcreole_out_free(&text_out);
+  return result;
+}
+
+static PyObject* compile_template(PyObject *ignored, PyObject *args) {
+  PyObject* text;
+  if (!PyArg_UnpackTuple(args, "compile_template", 1, 1, &text)
+      || !PyUnicode_Check(text)) {
+    PyErr_SetString(PyExc_TypeError, "compile_template() expects unicode string as argument");
+    return NULL;
+  }
+
+  nxcreole_template tpl;
+  if (nxcreole_template_compile(&tpl, (const wchar_t*)PyUnicode_AS_UNICODE(text))) return PyErr_NoMemory();
+  PyObject* fragments=PyList_New(tpl.hole_count+1);
+  PyObject* names=PyList_New(tpl.hole_count);
+  PyObject* defaults=PyList_New(tpl.hole_count);
+  PyObject* result=NULL;
+  size_t pos=0, i;
+  if (!fragments || !names || !defaults) goto end;
+  for (i=0; i<=tpl.hole_count; i++) {
+    size_t end=i<tpl.hole_count? tpl.holes[i].offset : tpl.xhtml.length;
+    PyObject* fragment=PyString_FromStringAndSize(tpl.xhtml.buf+pos, (Py_ssize_t)(end-pos));
+    if (!fragment) goto end;
+    PyList_SET_ITEM(fragments, i, fragment);
+    pos=end;
+    if (i==tpl.hole_count) break;
+    const nxcreole_template_hole* hole=&tpl.holes[i];
+    PyObject* name=PyUnicode_DecodeUTF8(tpl.strings.buf+hole->name_offset, (Py_ssize_t)hole->name_length, NULL);
+    if (!name) goto end;
+    PyList_SET_ITEM(names, i, name);
+    PyObject* def=PyString_FromStringAndSize(tpl.strings.buf+hole->default_offset, (Py_ssize_t)hole->default_length);
+    if (!def) goto end;
+    PyList_SET_ITEM(defaults, i, def);
+  }
+  result=PyTuple_Pack(3, fragments, names, defaults);
+
+  end:
+  Py_XDECREF(fragments);
+  Py_XDECREF(names);
+  Py_XDECREF(defaults);
+  nxcreole_template_free(&tpl);
+  return result;
+}
+
+typedef struct {
+  PyObject* resolver;
+  PyObject* keep; // unicode objects that resolved URLs point into
+} resolve_data_t;
+
+static int call_resolver(void* data, nxcreole_link_target* targets, size_t count) {
+  resolve_data_t* rd=data;
+  PyObject* list=PyList_New(count);
+  PyObject* res=NULL;
+  size_t i;
+  if (!list) return -1;
+  for (i=0; i<count; i++) {
+    PyObject* item=Py_BuildValue("(su#)", targets[i].fn==FN_APPEND_IMAGE? "image" : "link",
+                                 (Py_UNICODE*)targets[i].target, (int)targets[i].length);
+    if (!item) goto error;
+    PyList_SET_ITEM(list, i, item);
+  }
+  res=PyObject_CallFunctionObjArgs(rd->resolver, list, NULL);
+  if (!res) goto error;
+  if (!PySequence_Check(res) || PySequence_Size(res)!=(Py_ssize_t)count) {
+    PyErr_SetString(PyExc_TypeError, "resolver must return sequence of the same length as its argument");
+    goto error;
+  }
+  for (i=0; i<count; i++) {
+    PyObject* value=PySequence_GetItem(res, i);
+    PyObject* exists;
+    PyObject* url;
+    if (!value) goto error;
+    if (value==Py_None) {
+      Py_DECREF(value);
+      continue;
+    }
+    if (!PyArg_ParseTuple(value, "OO", &exists, &url)) {
+      Py_DECREF(value);
+      goto error;
+    }
+    targets[i].missing=!PyObject_IsTrue(exists);
+    if (url!=Py_None) {
+      PyObject* u=PyUnicode_FromObject(url);
+      if (!u || PyList_Append(rd->keep, u)) {
+        Py_XDECREF(u);
+        Py_DECREF(value);
+        goto error;
+      }
+      Py_DECREF(u);
+      targets[i].url=(const wchar_t*)PyUnicode_AS_UNICODE(u);
+      targets[i].url_length=(size_t)PyUnicode_GET_SIZE(u);
+    }
+    Py_DECREF(value);
+  }
+  Py_DECREF(list);
+  Py_DECREF(res);
+  return 0;
+
+  error:
+  Py_DECREF(list);
+  Py_XDECREF(res);
+  return -1;
+}
+
+static PyObject* render_xhtml_resolved(PyObject *ignored, PyObject *args) {
+  PyObject* text;
+  resolve_data_t rd;
+  if (!PyArg_UnpackTuple(args, "render_xhtml_resolved", 2, 2, &text, &rd.resolver)
+      || !PyUnicode_Check(text) || !PyCallable_Check(rd.resolver)) {
+    PyErr_SetString(PyExc_TypeError, "render_xhtml_resolved() expects unicode string and callable as arguments");
+    return NULL;
+  }
+
+  nxcreole_out out;
+  if (!(rd.keep=PyList_New(0))) return NULL;
+  if (nxcreole_out_init(&out, (size_t)PyUnicode_GET_SIZE(text)*2, 0, 0)) {
+    Py_DECREF(rd.keep);
+    return PyErr_NoMemory();
+  }
+  PyObject* result=NULL;
+  if (nxcreole_render_xhtml_resolved((const wchar_t*)PyUnicode_AS_UNICODE(text), call_resolver, &rd, &out)) {
+    if (!PyErr_Occurred()) PyErr_NoMemory();
+  }
+  else {
+    result=PyString_FromStringAndSize(out.buf, (Py_ssize_t)out.length);
+  }
+  nxcreole_out_free(&out);
+  Py_DECREF(rd.keep);
+  return result;
+}
+
+static nxcreole_cache cache; // shared by all renders of this process (and its forks)
+
+static PyObject* cache_open(PyObject *ignored, PyObject *args) {
+  const char* name;
+  Py_ssize_t capacity, max_entry_size;
+  if (!PyArg_ParseTuple(args, "znn:cache_open", &name, &capacity, &max_entry_size)) return NULL;
+  if (capacity<=0 || max_entry_size<=0) {
+    PyErr_SetString(PyExc_ValueError, "cache_open() expects positive capacity and entry size");
+    return NULL;
+  }
+  if (cache.base) nxcreole_cache_close(&cache);
+  if (nxcreole_cache_open(&cache, name, (size_t)capacity, (size_t)max_entry_size)) return PyErr_SetFromErrno(PyExc_OSError);
   Py_RETURN_NONE;
 }
 
+static PyObject* cache_close(PyObject *ignored, PyObject *args) {
+  if (cache.base) nxcreole_cache_close(&cache);
+  Py_RETURN_NONE;
+}
+
+static PyObject* cache_stats(PyObject *ignored, PyObject *args) {
+  if (!cache.base) Py_RETURN_NONE;
+  nxcreole_cache_stats stats;
+  nxcreole_cache_get_stats(&cache, &stats);
+  return Py_BuildValue("{s:K,s:K,s:K,s:K,s:K}", "hits", (unsigned PY_LONG_LONG)stats.hits,
+                       "misses", (unsigned PY_LONG_LONG)stats.misses, "stores", (unsigned PY_LONG_LONG)stats.stores,
+                       "evictions", (unsigned PY_LONG_LONG)stats.evictions, "skipped", (unsigned PY_LONG_LONG)stats.skipped);
+}
+
+static PyObject* render_xhtml_cached(PyObject *ignored, PyObject *args) {
+  PyObject* text;
+  if (!PyArg_UnpackTuple(args, "render_xhtml_cached", 1, 1, &text)
+      || !PyUnicode_Check(text)) {
+    PyErr_SetString(PyExc_TypeError, "render_xhtml_cached() expects unicode string as argument");
+    return NULL;
+  }
+  if (!cache.base) {
+    PyErr_SetString(PyExc_RuntimeError, "render_xhtml_cached(): cache is not open");
+    return NULL;
+  }
+
+  nxcreole_out out;
+  if (nxcreole_out_init(&out, (size_t)PyUnicode_GET_SIZE(text)*2, 0, 0)) return PyErr_NoMemory();
+  nxcreole_render_xhtml_cached(&cache, (const wchar_t*)PyUnicode_AS_UNICODE(text), &out);
+  PyObject* result=out.error? PyErr_NoMemory() : PyString_FromStringAndSize(out.buf, (Py_ssize_t)out.length);
+  nxcreole_out_free(&out);
+  return result;
+}
+
+static PyObject* sections(PyObject *ignored, PyObject *args) {
+  PyObject* text;
+  if (!PyArg_UnpackTuple(args, "sections", 1, 1, &text)
+      || !PyUnicode_Check(text)) {
+    PyErr_SetString(PyExc_TypeError, "sections() expects unicode string as argument");
+    return NULL;
+  }
+
+  const wchar_t* text_ptr=(const wchar_t*)PyUnicode_AS_UNICODE(text);
+  nxcreole_section_index idx;
+  if (nxcreole_section_index_build(&idx, text_ptr)) return PyErr_NoMemory();
+  static Py_UNICODE no_lists[1]; // u# of NULL would give None; lists are not allocated until needed
+  PyObject* list=PyList_New(idx.count);
+  size_t i;
+  for (i=0; list && i<idx.count; i++) {
+    const nxcreole_section* sec=&idx.sections[i];
+    PyObject* item=Py_BuildValue("(iu#nnu#i)", sec->level,
+                                 (Py_UNICODE*)text_ptr+sec->title_start, (int)sec->title_length,
+                                 (Py_ssize_t)sec->start, (Py_ssize_t)sec->end,
+                                 idx.lists? (Py_UNICODE*)idx.lists+sec->lists_start : no_lists, sec->list_depth,
+                                 sec->mediawiki_table_level);
+    if (!item) {
+      Py_CLEAR(list);
+      break;
+    }
+    PyList_SET_ITEM(list, i, item);
+  }
+  nxcreole_section_index_free(&idx);
+  return list;
+}
+
+static PyObject* render_section(PyObject *ignored, PyObject *args) {
+  PyObject* text;
+  int level, mediawiki_table_level;
+  PyObject* title;
+  Py_ssize_t start, end;
+  const Py_UNICODE* lists;
+  int list_depth;
+  if (!PyArg_ParseTuple(args, "U(iUnnu#i):render_section", &text, &level, &title, &start, &end,
+                        &lists, &list_depth, &mediawiki_table_level)) return NULL;
+  if (start<0 || end<start || end>PyUnicode_GET_SIZE(text)) {
+    PyErr_SetString(PyExc_ValueError, "render_section(): section range is out of text");
+    return NULL;
+  }
+  // every enclosing mediawiki table takes at least "{|\n" before section start
+  if (mediawiki_table_level<0 || mediawiki_table_level>start/3) {
+    PyErr_SetString(PyExc_ValueError, "render_section(): mediawiki table level is out of range");
+    return NULL;
+  }
+
+  nxcreole_out out;
+  if (nxcreole_out_init(&out, (size_t)(end-start)*2, 0, 0)) return PyErr_NoMemory();
+  nxcreole_parse_ctx ctx;
+  nxcreole_xhtml_serializer xs;
+  nxcreole_init(&ctx, (const wchar_t*)PyUnicode_AS_UNICODE(text));
+  nxcreole_xhtml_init(&ctx, &xs, &out);
+  int res=nxcreole_parse_range(&ctx, (size_t)start, (size_t)end, (const wchar_t*)lists, list_depth, mediawiki_table_level);
+  PyObject* result=res || out.error? PyErr_NoMemory() : PyString_FromStringAndSize(out.buf, (Py_ssize_t)out.length);
+  nxcreole_out_free(&out);
+  return result;
+}
+
+#define MARKUP_CAPSULE "nxcreole._ext.markup"
+
+static void free_markup(PyObject* capsule) {
+  nxcreole_markup* markup=PyCapsule_GetPointer(capsule, MARKUP_CAPSULE);
+  nxcreole_markup_free(markup);
+  PyMem_Free(markup);
+}
+
+// wraps compiled markup into capsule
+static PyObject* markup_capsule(nxcreole_markup* markup) {
+  PyObject* capsule=PyCapsule_New(markup, MARKUP_CAPSULE, free_markup);
+  if (!capsule) {
+    nxcreole_markup_free(markup);
+    PyMem_Free(markup);
+  }
+  return capsule;
+}
+
+static PyObject* markup_compile(PyObject *ignored, PyObject *args) {
+  PyObject* dict;
+  if (!PyArg_ParseTuple(args, "O!:markup_compile", &PyDict_Type, &dict)) return NULL;
+  const char* templates[NXCREOLE_MARKUP_COUNT];
+  memset(templates, 0, sizeof(templates));
+  PyObject *key, *value;
+  Py_ssize_t pos=0;
+  while (PyDict_Next(dict, &pos, &key, &value)) { // str keys and values, UTF-8 encoded
+    int id=PyString_Check(key)? nxcreole_markup_key(PyString_AS_STRING(key), (size_t)PyString_GET_SIZE(key)) : -1;
+    if (id<0) {
+      PyErr_SetString(PyExc_KeyError, "markup_compile(): unknown markup key");
+      return NULL;
+    }
+    if (!PyString_Check(value)) {
+      PyErr_SetString(PyExc_TypeError, "markup_compile(): templates must be UTF-8 encoded strings");
+      return NULL;
+    }
+    templates[id]=PyString_AS_STRING(value);
+  }
+  nxcreole_markup* markup=PyMem_Malloc(sizeof(nxcreole_markup));
+  if (!markup) return PyErr_NoMemory();
+  int res=nxcreole_markup_compile(markup, templates);
+  if (res) {
+    PyMem_Free(markup);
+    if (res<0) return PyErr_NoMemory();
+    PyErr_Format(PyExc_ValueError, "markup_compile(): bad template for %s", nxcreole_markup_key_name((nxcreole_markup_id_t)(res-1)));
+    return NULL;
+  }
+  return markup_capsule(markup);
+}
+
+static PyObject* markup_load(PyObject *ignored, PyObject *args) {
+  const char* config;
+  if (!PyArg_ParseTuple(args, "s:markup_load", &config)) return NULL;
+  nxcreole_markup* markup=PyMem_Malloc(sizeof(nxcreole_markup));
+  if (!markup) return PyErr_NoMemory();
+  int res=nxcreole_markup_load(markup, config);
+  if (res) {
+    PyMem_Free(markup);
+    if (res<0) return PyErr_NoMemory();
+    PyErr_Format(PyExc_ValueError, "markup_load(): bad config line %d", res);
+    return NULL;
+  }
+  return markup_capsule(markup);
+}
+
+static PyObject* markup_defaults(PyObject *ignored, PyObject *args) {
+  PyObject* dict=PyDict_New();
+  int i;
+  for (i=0; dict && i<NXCREOLE_MARKUP_COUNT; i++) {
+    PyObject* value=PyString_FromString(nxcreole_markup_default((nxcreole_markup_id_t)i));
+    if (!value || PyDict_SetItemString(dict, nxcreole_markup_key_name((nxcreole_markup_id_t)i), value)) {
+      Py_XDECREF(value);
+      Py_DECREF(dict);
+      return NULL;
+    }
+    Py_DECREF(value);
+  }
+  return dict;
+}
+
+static PyObject* render_markup(PyObject *ignored, PyObject *args) {
+  PyObject* text;
+  PyObject* capsule;
+  if (!PyArg_ParseTuple(args, "UO:render_markup", &text, &capsule)) return NULL;
+  nxcreole_markup* markup=PyCapsule_GetPointer(capsule, MARKUP_CAPSULE);
+  if (!markup) return NULL;
+
+  nxcreole_out out;
+  if (nxcreole_out_init(&out, (size_t)PyUnicode_GET_SIZE(text)*2, 0, 0)) return PyErr_NoMemory();
+  nxcreole_render_markup((const wchar_t*)PyUnicode_AS_UNICODE(text), markup, &out);
+  PyObject* result=out.error? PyErr_NoMemory() : PyString_FromStringAndSize(out.buf, (Py_ssize_t)out.length);
+  nxcreole_out_free(&out);
+  return result;
+}
+
+static const char* limit_names[]={0, "nesting", "scan", "events", "output"};
+
+static PyObject* render_xhtml_bounded(PyObject *ignored, PyObject *args, PyObject *kwargs) {
+  static char* kwlist[]={"text", "max_scan_chars", "max_events", "max_output", "max_nesting", 0};
+  PyObject* text;
+  Py_ssize_t max_scan_chars=0, max_events=0, max_output=0;
+  int max_nesting=0;
+  if (!PyArg_ParseTupleAndKeywords(args, kwargs, "U|nnni:render_xhtml_bounded", kwlist, &text,
+                                   &max_scan_chars, &max_events, &max_output, &max_nesting)) return NULL;
+  if (max_scan_chars<0 || max_events<0 || max_output<0 || max_nesting<0 || max_nesting>SHRT_MAX) {
+    PyErr_SetString(PyExc_ValueError, "render_xhtml_bounded(): limits must be non-negative");
+    return NULL;
+  }
+
+  nxcreole_out out;
+  if (nxcreole_out_init(&out, (size_t)PyUnicode_GET_SIZE(text)*2, 0, 0)) return PyErr_NoMemory();
+  nxcreole_parse_ctx ctx;
+  nxcreole_xhtml_serializer xs;
+  nxcreole_init(&ctx, (const wchar_t*)PyUnicode_AS_UNICODE(text));
+  nxcreole_xhtml_init(&ctx, &xs, &out);
+  ctx.max_scan_chars=(size_t)max_scan_chars;
+  ctx.max_events=(size_t)max_events;
+  ctx.max_output=(size_t)max_output;
+  ctx.output_size=&out.total;
+  ctx.max_nesting=(short)max_nesting;
+  nxcreole_xhtml_parse(&ctx);
+  PyObject* result=NULL;
+  if (out.error) PyErr_NoMemory();
+  else {
+    PyObject* xhtml=PyString_FromStringAndSize(out.buf, (Py_ssize_t)out.length);
+    if (xhtml) result=Py_BuildValue("(Nz)", xhtml, limit_names[ctx.limit_hit]);
+  }
+  nxcreole_out_free(&out);
+  return result;
+}
+
+static nxcreole_pool pool; // started by pool_start() or first render_submit()
+static pid_t pool_pid; // process that started it
+static long last_job_id;
+
+typedef struct {
+  nxcreole_pool_job job; // job.data is text (reference held till collected)
+  long id;
+} pool_job_t;
+
+static int start_pool(int threads) {
+  if (nxcreole_pool_start(&pool, threads)) {
+    PyErr_SetFromErrno(PyExc_OSError);
+    return -1;
+  }
+  pool_pid=getpid();
+  return 0;
+}
+
+// pool inherited through fork() has no worker threads, so in child it is dropped and
+// started anew on demand; its jobs and pipe belong to parent (job memory is leaked, as
+// lists may have been in the middle of update)
+static int pool_running(void) {
+  if (pool.threads && pool_pid!=getpid()) {
+    close(pool.pipe[0]);
+    close(pool.pipe[1]);
+    memset(&pool, 0, sizeof(nxcreole_pool));
+  }
+  return pool.threads!=0;
+}
+
+static PyObject* pool_start(PyObject *ignored, PyObject *args) {
+  int threads=0;
+  if (!PyArg_ParseTuple(args, "|i:pool_start", &threads)) return NULL;
+  if (pool_running()) {
+    PyErr_SetString(PyExc_RuntimeError, "pool_start(): render pool is running already");
+    return NULL;
+  }
+  if (start_pool(threads)) return NULL;
+  Py_RETURN_NONE;
+}
+
+static PyObject* render_submit(PyObject *ignored, PyObject *args) {
+  PyObject* text;
+  if (!PyArg_ParseTuple(args, "U:render_submit", &text)) return NULL;
+  if (!pool_running() && start_pool(0)) return NULL;
+  pool_job_t* j=malloc(sizeof(pool_job_t));
+  if (!j) return PyErr_NoMemory();
+  Py_INCREF(text);
+  j->job.text=(const wchar_t*)PyUnicode_AS_UNICODE(text);
+  j->job.data=text;
+  j->id=++last_job_id;
+  nxcreole_pool_submit(&pool, &j->job);
+  return PyInt_FromLong(j->id);
+}
+
+static PyObject* render_fd(PyObject *ignored, PyObject *args) {
+  if (!pool_running() && start_pool(0)) return NULL;
+  return PyInt_FromLong(nxcreole_pool_fd(&pool));
+}
+
+static PyObject* render_collect(PyObject *ignored, PyObject *args) {
+  PyObject* list=PyList_New(0);
+  nxcreole_pool_job* job=pool_running()? nxcreole_pool_collect(&pool) : 0;
+  while (job) {
+    pool_job_t* j=(pool_job_t*)job;
+    job=job->next;
+    if (list) {
+      PyObject* xhtml=j->job.out.error? (Py_INCREF(Py_None), Py_None) :
+                      PyUnicode_DecodeUTF8(j->job.out.buf, (Py_ssize_t)j->job.out.length, NULL);
+      PyObject* item=xhtml? Py_BuildValue("(lN)", j->id, xhtml) : NULL;
+      if (!item || PyList_Append(list, item)) Py_CLEAR(list); // jobs are freed anyway
+      Py_XDECREF(item);
+    }
+    Py_DECREF((PyObject*)j->job.data);
+    nxcreole_out_free(&j->job.out);
+    free(j);
+  }
+  return list;
+}
+
+#define COMPRESS_BUF_SIZE 65536
+
+static PyObject* render_xhtml_compressed(PyObject *ignored, PyObject *args, PyObject *kwargs) {
+  static char* kwlist[]={"text", "format", "level", "fd", 0};
+  PyObject* text;
+  const char* format_name="gzip";
+  int level=Z_DEFAULT_COMPRESSION, fd=-1;
+  if (!PyArg_ParseTupleAndKeywords(args, kwargs, "U|sii:render_xhtml_compressed", kwlist, &text,
+                                   &format_name, &level, &fd)) return NULL;
+  int format=!strcmp(format_name, "gzip")? NXCREOLE_GZIP : !strcmp(format_name, "deflate")? NXCREOLE_DEFLATE : 0;
+  if (!format || level<Z_DEFAULT_COMPRESSION || level>Z_BEST_COMPRESSION) {
+    PyErr_SetString(PyExc_ValueError, "render_xhtml_compressed(): format must be 'gzip' or 'deflate', level -1..9");
+    return NULL;
+  }
+
+  // xhtml_out -> zsink -> compressed (in memory) or fd
+  nxcreole_out compressed, xhtml_out;
+  nxcreole_zsink zs;
+  if (fd<0 && nxcreole_out_init(&compressed, (size_t)PyUnicode_GET_SIZE(text)/2, 0, 0)) return PyErr_NoMemory();
+  if (nxcreole_zsink_init(&zs, format, level, fd<0? nxcreole_out_sink : nxcreole_fd_sink, fd<0? (void*)&compressed : (void*)&fd)
+      || nxcreole_out_init(&xhtml_out, COMPRESS_BUF_SIZE, nxcreole_zsink_write, &zs)) {
+    nxcreole_zsink_free(&zs);
+    if (fd<0) nxcreole_out_free(&compressed);
+    return PyErr_NoMemory();
+  }
+  const wchar_t* text_ptr=(const wchar_t*)PyUnicode_AS_UNICODE(text);
+  int failed;
+  Py_BEGIN_ALLOW_THREADS // text is kept alive by caller's reference
+  nxcreole_render_xhtml(text_ptr, &xhtml_out);
+  failed=nxcreole_out_flush(&xhtml_out);
+  failed=nxcreole_zsink_finish(&zs) || failed;
+  Py_END_ALLOW_THREADS
+  nxcreole_out_free(&xhtml_out);
+  if (fd>=0) {
+    if (failed) return PyErr_SetFromErrno(PyExc_IOError);
+    Py_RETURN_NONE;
+  }
+  PyObject* result=failed? PyErr_NoMemory() : PyString_FromStringAndSize(compressed.buf, (Py_ssize_t)compressed.length);
+  nxcreole_out_free(&compressed);
+  return result;
+}
+
 static PyObject* html_escape(PyObject *ignored, PyObject *args) {
   PyObject* text;
   if (!PyArg_UnpackTuple(args, "html_escape", 1, 1, &text)
@@ -178,8 +1051,34 @@ static PyObject* html_escape(PyObject *ignored, PyObject *args) {
 
 static PyMethodDef nxcreole_ext_methods[] =
 {
-  {"parse", parse, METH_VARARGS, "Parse wiki text."},
+  {"parse", parse, METH_VARARGS, "Parse wiki text. Returns dict of parse statistics if third argument is true."},
   {"html_escape", html_escape, METH_VARARGS, "Escape HTML characters."},
+  {"render_text", render_text, METH_VARARGS, "Render wiki text as UTF-8 encoded plain text."},
+  {"render_json", render_json, METH_VARARGS, "Render wiki text as UTF-8 encoded JSON syntax tree (see nxcreole_json.h)."},
+  {"render_xhtml_utf8", render_xhtml_utf8, METH_VARARGS, "Render wiki text as UTF-8 encoded XHTML; text is parsed once and result string is allocated at its exact size."},
+  {"render_xhtml_toc", render_xhtml_toc, METH_VARARGS, "Render wiki text as UTF-8 encoded XHTML with heading ids, parsing it once. Returns (xhtml with TOC in place of <<<toc>>>, TOC)."},
+  {"xhtml_size", xhtml_size, METH_VARARGS, "Return exact size in bytes of UTF-8 encoded XHTML for wiki text."},
+  {"compile_template", compile_template, METH_VARARGS, "Render wiki text as (fragments, placeholder names, default placeholder renderings) of UTF-8 encoded XHTML."},
+  {"render_xhtml_resolved", render_xhtml_resolved, METH_VARARGS, "Render wiki text as UTF-8 encoded XHTML resolving all link and image targets by single resolver call."},
+  {"cache_open", cache_open, METH_VARARGS, "Open shared render cache: cache_open(name or None, capacity, max_entry_size)."},
+  {"cache_close", cache_close, METH_NOARGS, "Close shared render cache."},
+  {"cache_stats", cache_stats, METH_NOARGS, "Return dict of shared render cache counters or None if cache is not open."},
+  {"render_xhtml_cached", render_xhtml_cached, METH_VARARGS, "Render wiki text as UTF-8 encoded XHTML through shared render cache."},
+  {"render_xhtml_bounded", (PyCFunction)render_xhtml_bounded, METH_VARARGS|METH_KEYWORDS, "Render wiki text as UTF-8 encoded XHTML within work limits. Returns (xhtml, name of limit hit or None)."},
+  {"render_xhtml_compressed", (PyCFunction)render_xhtml_compressed, METH_VARARGS|METH_KEYWORDS, "Render wiki text as XHTML compressed while rendering: render_xhtml_compressed(text, format='gzip' or 'deflate', level=-1, fd=-1). Returns compressed string, or None if written to file descriptor fd."},
+  {"pool_start", pool_start, METH_VARARGS, "Start native render pool with given number of threads (default: one per CPU); otherwise started by first render_submit()."},
+  {"render_submit", render_submit, METH_VARARGS, "Queue wiki text for rendering as XHTML in native thread pool (without GIL). Returns job id."},
+  {"render_fd", render_fd, METH_NOARGS, "Return file descriptor that is readable when rendered jobs can be collected."},
+  {"render_collect", render_collect, METH_NOARGS, "Return list of (job id, XHTML or None on failure) for all finished jobs."},
+  {"markup_compile", markup_compile, METH_VARARGS, "Compile dict of markup templates (UTF-8 encoded) into markup table for render_markup()."},
+  {"markup_load", markup_load, METH_VARARGS, "Compile markup config (lines of key = template) into markup table for render_markup()."},
+  {"markup_defaults", markup_defaults, METH_NOARGS, "Return dict of built-in markup templates."},
+  {"render_markup", render_markup, METH_VARARGS, "Render wiki text as UTF-8 encoded markup using markup table."},
+  {"sections", sections, METH_VARARGS, "Return section index: list of (level, title, start, end, lists, tables) for every heading."},
+  {"render_section", render_section, METH_VARARGS, "Render single section (item of sections() list) as UTF-8 encoded XHTML."},
+  {"parse_events", parse_events, METH_VARARGS, "Return list of (method name, payload or None, span start, span end) for all parser events."},
+  {"render_all", render_all, METH_VARARGS, "Parse once, return (xhtml, text, links) as rendered by render_xhtml(), render_text() and extract_links()."},
+  {"extract_links", extract_links, METH_VARARGS, "Return list of (kind, target, offset) for links, images and placeholders."},
   {NULL, NULL, 0, NULL}
 };
 
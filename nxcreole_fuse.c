@@ -0,0 +1,140 @@
+/*
+ * Copyright (c) 2014 Yaroslav Stavnichiy <yarosla@gmail.com>
+ *
+ * This file is part of NXCREOLE.
+ *
+ * NXCREOLE is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License
+ * as published by the Free Software Foundation, either version 3
+ * of the License, or (at your option) any later version.
+ *
+ * NXCREOLE is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with NXCREOLE. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <wchar.h>
+#include <string.h>
+
+#include "nxcreole_parser.h"
+#include "nxcreole_fuse.h"
+
+static void emit0(nxcreole_fuse* fuse, nxcreole_fn_id_t fn, size_t span_start, size_t span_end) {
+  nxcreole_parse_ctx* child=fuse->child;
+  child->span_start=span_start;
+  child->span_end=span_end;
+  child->append0(child, fn);
+}
+
+static void emit1(nxcreole_fuse* fuse, nxcreole_fn_id_t fn, const wchar_t* s, size_t len, size_t span_start, size_t span_end) {
+  nxcreole_parse_ctx* child=fuse->child;
+  child->span_start=span_start;
+  child->span_end=span_end;
+  child->append1(child, fn, s, len);
+}
+
+// pass pending event on as is
+static void flush_pending(nxcreole_fuse* fuse) {
+  nxcreole_fn_id_t fn=fuse->pending;
+  fuse->pending=FN_FUSED_COUNT;
+  switch (fn) {
+    case FN_FUSED_COUNT:
+      break;
+    case FN_APPEND_TEXT:
+      emit1(fuse, fn, fuse->text, fuse->length, fuse->span_start, fuse->span_end);
+      break;
+    case FN_APPEND_LIST_CLOSE:
+      emit1(fuse, fuse->length==1? FN_APPEND_LIST_CLOSE : FN_APPEND_LIST_CLOSE_RUN, fuse->text, fuse->length,
+            fuse->span_start, fuse->span_end);
+      break;
+    default:
+      emit0(fuse, fn, fuse->span_start, fuse->span_end);
+      break;
+  }
+}
+
+static void hold(nxcreole_fuse* fuse, nxcreole_parse_ctx* ctx, nxcreole_fn_id_t fn) {
+  fuse->pending=fn;
+  fuse->span_start=ctx->span_start;
+  fuse->span_end=ctx->span_end;
+  fuse->length=0;
+}
+
+static void append0(nxcreole_parse_ctx* ctx, nxcreole_fn_id_t fn) {
+  nxcreole_fuse* fuse=ctx->data;
+  if (fn==FN_APPEND_TABLE_ROW_OPEN && fuse->pending==FN_APPEND_TABLE_ROW_CLOSE) {
+    fuse->pending=FN_FUSED_COUNT;
+    emit0(fuse, FN_APPEND_TABLE_ROW_NEXT, fuse->span_start, ctx->span_end);
+    return;
+  }
+  flush_pending(fuse);
+  switch (fn) {
+    case FN_APPEND_TABLE_CELL_CLOSE:
+    case FN_APPEND_TABLE_HEAD_CELL_CLOSE:
+      if (!(fuse->options & NXCREOLE_FUSE_CELLS)) break;
+      hold(fuse, ctx, fn);
+      return;
+    case FN_APPEND_TABLE_ROW_CLOSE:
+      if (!(fuse->options & NXCREOLE_FUSE_ROWS)) break;
+      hold(fuse, ctx, fn);
+      return;
+    default:
+      break;
+  }
+  emit0(fuse, fn, ctx->span_start, ctx->span_end);
+}
+
+static void append1(nxcreole_parse_ctx* ctx, nxcreole_fn_id_t fn, const wchar_t* s, size_t len) {
+  nxcreole_fuse* fuse=ctx->data;
+  switch (fn) {
+    case FN_APPEND_TEXT:
+      if (!(fuse->options & NXCREOLE_FUSE_TEXT)) break;
+      if (fuse->pending!=FN_APPEND_TEXT || fuse->length+len>NXCREOLE_FUSE_TEXT_SIZE) {
+        flush_pending(fuse);
+        if (len>=NXCREOLE_FUSE_TEXT_SIZE) break; // too long to be worth copying
+        hold(fuse, ctx, fn);
+      }
+      wmemcpy(fuse->text+fuse->length, s, len);
+      fuse->length+=len;
+      fuse->span_end=ctx->span_end;
+      return;
+    case FN_APPEND_LIST_CLOSE:
+      if (!(fuse->options & NXCREOLE_FUSE_LISTS)) break;
+      if (fuse->pending!=FN_APPEND_LIST_CLOSE || fuse->length>=NXCREOLE_FUSE_TEXT_SIZE) {
+        flush_pending(fuse);
+        hold(fuse, ctx, fn);
+      }
+      fuse->text[fuse->length++]=*s;
+      fuse->span_end=ctx->span_end;
+      return;
+    case FN_APPEND_TABLE_CELL_OPEN:
+    case FN_APPEND_TABLE_HEAD_CELL_OPEN:
+      if (fuse->pending!=(fn==FN_APPEND_TABLE_CELL_OPEN? FN_APPEND_TABLE_CELL_CLOSE : FN_APPEND_TABLE_HEAD_CELL_CLOSE)) break;
+      fuse->pending=FN_FUSED_COUNT;
+      emit1(fuse, fn==FN_APPEND_TABLE_CELL_OPEN? FN_APPEND_TABLE_CELL_NEXT : FN_APPEND_TABLE_HEAD_CELL_NEXT, s, len,
+            fuse->span_start, ctx->span_end);
+      return;
+    default:
+      break;
+  }
+  flush_pending(fuse);
+  emit1(fuse, fn, s, len, ctx->span_start, ctx->span_end);
+}
+
+void nxcreole_fuse_init(nxcreole_parse_ctx* ctx, nxcreole_fuse* fuse, nxcreole_parse_ctx* child, unsigned options) {
+  fuse->child=child;
+  fuse->options=options;
+  fuse->pending=FN_FUSED_COUNT;
+  fuse->length=0;
+  ctx->append0=append0;
+  ctx->append1=append1;
+  ctx->data=fuse;
+}
+
+void nxcreole_fuse_flush(nxcreole_fuse* fuse) {
+  flush_pending(fuse);
+}
@@ -0,0 +1,54 @@
+/*
+ * Copyright (c) 2014 Yaroslav Stavnichiy <yarosla@gmail.com>
+ *
+ * This file is part of NXCREOLE.
+ *
+ * NXCREOLE is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License
+ * as published by the Free Software Foundation, either version 3
+ * of the License, or (at your option) any later version.
+ *
+ * NXCREOLE is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with NXCREOLE. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*
+ * Event fusion layer. Sits between parser and serializer and cuts number of
+ * callbacks: adjacent text events are merged into one (parser splits text
+ * at every inline construct and at its buffer size) and common structural
+ * sequences are collapsed into single composite events (see FN_APPEND_TABLE_CELL_NEXT
+ * and following in nxcreole_parser.h). Serializer gets only composites it asks for;
+ * without options it sees exactly the raw event stream.
+ *
+ * Merged text is copied into fuse's own buffer, so it never allocates.
+ * Call nxcreole_fuse_flush() after nxcreole_parse() to pass on what is still pending.
+ */
+
+#define NXCREOLE_FUSE_TEXT 1 // merge adjacent FN_APPEND_TEXT events
+#define NXCREOLE_FUSE_CELLS 2 // emit FN_APPEND_TABLE_CELL_NEXT, FN_APPEND_TABLE_HEAD_CELL_NEXT
+#define NXCREOLE_FUSE_ROWS 4 // emit FN_APPEND_TABLE_ROW_NEXT
+#define NXCREOLE_FUSE_LISTS 8 // emit FN_APPEND_LIST_CLOSE_RUN
+#define NXCREOLE_FUSE_ALL 15
+
+#define NXCREOLE_FUSE_TEXT_SIZE 4096
+
+typedef struct nxcreole_fuse {
+  nxcreole_parse_ctx* child;
+  unsigned options;
+  nxcreole_fn_id_t pending; // event held back to see what follows; FN_FUSED_COUNT if none
+  size_t span_start, span_end; // source range of pending event
+  size_t length; // of pending text or list close run
+  wchar_t text[NXCREOLE_FUSE_TEXT_SIZE]; // pending text or list kinds (innermost first)
+} nxcreole_fuse;
+
+// set up ctx (initialized by nxcreole_init) to pass fused events to child;
+// child must be initialized by nxcreole_init with the same text and set up by its serializer
+void nxcreole_fuse_init(nxcreole_parse_ctx* ctx, nxcreole_fuse* fuse, nxcreole_parse_ctx* child, unsigned options);
+
+// pass pending event on; call after nxcreole_parse()
+void nxcreole_fuse_flush(nxcreole_fuse* fuse);
@@ -0,0 +1,250 @@
+/*
+ * Copyright (c) 2014 Yaroslav Stavnichiy <yarosla@gmail.com>
+ *
+ * This file is part of NXCREOLE.
+ *
+ * NXCREOLE is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License
+ * as published by the Free Software Foundation, either version 3
+ * of the License, or (at your option) any later version.
+ *
+ * NXCREOLE is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with NXCREOLE. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <assert.h>
+#include <stdio.h>
+#include <wchar.h>
+#include <string.h>
+#include <stdlib.h>
+#include <stddef.h>
+#ifdef NXCREOLE_STATS
+#include <time.h>
+#endif
+
+#include "nxcreole_parser.h"
+#include "nxcreole_out.h"
+#include "nxcreole_json.h"
+
+// characters below 128 written as \uXXXX (0), as is (1) or with two-character escape
+static const char escape_table[128]={
+  0, 0, 0, 0, 0, 0, 0, 0, 0, 't', 'n', 0, 0, 'r', 0, 0,
+  0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+  1, 1, '"', 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, '/',
+  1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1,
+  1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1,
+  1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, '\\', 1, 1, 1,
+  1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1,
+  1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1,
+};
+
+// string contents: escapes ", \, control characters, U+2028/U+2029 and / after <
+static void write_escaped(nxcreole_out* out, const wchar_t* s, size_t len) {
+  static const char hex[]="0123456789abcdef";
+  const wchar_t* start=s;
+  const wchar_t* p=s;
+  const wchar_t* end=s+len;
+  for (; p<end; p++) {
+    unsigned int c=(unsigned int)*p;
+    char e;
+    if (c<128) {
+      e=escape_table[c];
+      if (e==1 || (e=='/' && (p==start || p[-1]!=L'<'))) continue;
+    }
+    else if (c-0x2028u<2) e=0;
+    else continue;
+    nxcreole_out_wchars(out, s, p-s);
+    s=p+1;
+    char esc[7]={'\\', e};
+    if (!e) {
+      esc[1]='u';
+      esc[2]=hex[(c>>12)&15];
+      esc[3]=hex[(c>>8)&15];
+      esc[4]=hex[(c>>4)&15];
+      esc[5]=hex[c&15];
+    }
+    nxcreole_out_write(out, esc, e? 2:6);
+  }
+  nxcreole_out_wchars(out, s, end-s);
+}
+
+#define WRITE_LITERAL(js, s) nxcreole_out_write((js)->out, (s), sizeof(s)-1)
+#define WRITE_NODE(js, s) write_node((js), (s), sizeof(s)-1)
+
+// node starting with separator: ends open text string; no separator for first node of document
+// (inside element there always is previous sibling, element name)
+static inline void write_node(nxcreole_json_serializer* js, const char* s, size_t len) {
+  if (js->in_text) {
+    nxcreole_out_write(js->out, "\"", 1);
+    js->in_text=0;
+  }
+  else if (js->first) {
+    s++, len--;
+    js->first=0;
+  }
+  nxcreole_out_write(js->out, s, len);
+}
+
+static inline void close_node(nxcreole_json_serializer* js) {
+  if (js->in_text) {
+    nxcreole_out_write(js->out, "\"]", 2);
+    js->in_text=0;
+  }
+  else nxcreole_out_write(js->out, "]", 1);
+}
+
+static void append_text(nxcreole_json_serializer* js, const wchar_t* s, size_t len) {
+  if (!len) return;
+  if (!js->in_text) {
+    WRITE_NODE(js, ",\"");
+    js->in_text=1;
+  }
+  write_escaped(js->out, s, len);
+}
+
+// colspan comes from parser as digits
+static void append_cell_open(nxcreole_json_serializer* js, const wchar_t* s, size_t len) {
+  if (len==1 && *s==L'1') return;
+  WRITE_LITERAL(js, ",{\"colspan\":");
+  nxcreole_out_wchars(js->out, s, len);
+  nxcreole_out_write(js->out, "}", 1);
+}
+
+static void append_heading_open(nxcreole_json_serializer* js, const wchar_t* s, size_t len) {
+  WRITE_NODE(js, ",[\"h");
+  nxcreole_out_wchars(js->out, s, len);
+  nxcreole_out_write(js->out, "\"", 1);
+}
+
+// target|title parts as two attributes
+static void append_parts(nxcreole_json_serializer* js, const char* second, size_t second_len,
+                         const wchar_t* s, size_t len) {
+  const wchar_t* title=wmemchr(s, L'|', len);
+  write_escaped(js->out, s, title? (size_t)(title-s) : len);
+  if (title) {
+    nxcreole_out_write(js->out, second, second_len);
+    write_escaped(js->out, title+1, len-(title-s)-1);
+  }
+  WRITE_LITERAL(js, "\"}]");
+}
+
+static inline void inline_append0(nxcreole_json_serializer* js, nxcreole_fn_id_t fn) {
+  switch (fn) {
+    case FN_APPEND_TABLE_OPEN: WRITE_NODE(js, ",[\"table\""); break;
+    case FN_APPEND_TABLE_ROW_OPEN: WRITE_NODE(js, ",[\"tr\""); break;
+    case FN_APPEND_PARAGRAPH_OPEN: WRITE_NODE(js, ",[\"p\""); break;
+    case FN_APPEND_TABLE_HEAD_CELL_CLOSE:
+    case FN_APPEND_TABLE_CELL_CLOSE:
+    case FN_APPEND_TABLE_ROW_CLOSE:
+    case FN_APPEND_TABLE_CLOSE:
+    case FN_APPEND_PARAGRAPH_CLOSE:
+      close_node(js);
+      break;
+    case FN_APPEND_HR: WRITE_NODE(js, ",[\"hr\"]"); break;
+    case FN_APPEND_BR: WRITE_NODE(js, ",[\"br\"]"); break;
+    default: break;
+  }
+}
+
+static inline void inline_append1(nxcreole_json_serializer* js, nxcreole_fn_id_t fn, const wchar_t* s, size_t len) {
+  switch (fn) {
+    case FN_APPEND_TEXT: append_text(js, s, len); break;
+    case FN_APPEND_TABLE_HEAD_CELL_OPEN:
+      WRITE_NODE(js, ",[\"th\"");
+      append_cell_open(js, s, len);
+      break;
+    case FN_APPEND_TABLE_CELL_OPEN:
+      WRITE_NODE(js, ",[\"td\"");
+      append_cell_open(js, s, len);
+      break;
+    case FN_APPEND_LIST_OPEN:
+      WRITE_NODE(js, ",[\"list\",{\"k\":\"");
+      write_escaped(js->out, s, len);
+      WRITE_LITERAL(js, "\"},[\"li\"");
+      break;
+    case FN_APPEND_LIST_NEXT_ITEM:
+      close_node(js);
+      WRITE_LITERAL(js, ",[\"li\"");
+      break;
+    case FN_APPEND_LIST_BLANK_ITEM: WRITE_NODE(js, ",[\"blank\"]"); break;
+    case FN_APPEND_LIST_CLOSE: // item, then list
+      close_node(js);
+      nxcreole_out_write(js->out, "]", 1);
+      break;
+    case FN_APPEND_HEADING_OPEN: append_heading_open(js, s, len); break;
+    case FN_APPEND_FORMAT_OPEN:
+      WRITE_NODE(js, ",[\"fmt\",{\"k\":\"");
+      write_escaped(js->out, s, len);
+      WRITE_LITERAL(js, "\"}");
+      break;
+    case FN_APPEND_HEADING_CLOSE:
+    case FN_APPEND_FORMAT_CLOSE:
+      close_node(js);
+      break;
+    case FN_APPEND_NOWIKI_BLOCK:
+      WRITE_NODE(js, ",[\"pre\",\"");
+      write_escaped(js->out, s, len);
+      WRITE_LITERAL(js, "\"]");
+      break;
+    case FN_APPEND_NOWIKI_INLINE:
+      WRITE_NODE(js, ",[\"nowiki\",\"");
+      write_escaped(js->out, s, len);
+      WRITE_LITERAL(js, "\"]");
+      break;
+    case FN_APPEND_IMAGE:
+      WRITE_NODE(js, ",[\"img\",{\"src\":\"");
+      append_parts(js, "\",\"alt\":\"", 9, s, len);
+      break;
+    case FN_APPEND_LINK:
+      WRITE_NODE(js, ",[\"link\",{\"target\":\"");
+      append_parts(js, "\",\"title\":\"", 11, s, len);
+      break;
+    case FN_APPEND_PLACEHOLDER:
+      WRITE_NODE(js, ",[\"ph\",\"");
+      write_escaped(js->out, s, len);
+      WRITE_LITERAL(js, "\"]");
+      break;
+    default: break;
+  }
+}
+
+static void append0(nxcreole_parse_ctx* ctx, nxcreole_fn_id_t fn) {
+  inline_append0(ctx->data, fn);
+}
+
+static void append1(nxcreole_parse_ctx* ctx, nxcreole_fn_id_t fn, const wchar_t* s, size_t len) {
+  inline_append1(ctx->data, fn, s, len);
+}
+
+void nxcreole_json_init(nxcreole_parse_ctx* ctx, nxcreole_json_serializer* js, nxcreole_out* out) {
+  memset(js, 0, sizeof(nxcreole_json_serializer));
+  js->out=out;
+  js->first=1;
+  ctx->append0=append0;
+  ctx->append1=append1;
+  ctx->data=js;
+  nxcreole_out_write(out, "[", 1);
+}
+
+void nxcreole_json_finish(nxcreole_json_serializer* js) {
+  close_node(js);
+}
+
+#define NXCREOLE_PARSE_FN nxcreole_json_parse
+#define NXCREOLE_APPEND0(ctx, fn) inline_append0((nxcreole_json_serializer*)(ctx)->data, (fn))
+#define NXCREOLE_APPEND1(ctx, fn, s, length) inline_append1((nxcreole_json_serializer*)(ctx)->data, (fn), (s), (length))
+#include "nxcreole_parser_impl.h"
+
+void nxcreole_render_json(const wchar_t* text, nxcreole_out* out) {
+  nxcreole_parse_ctx ctx;
+  nxcreole_json_serializer js;
+  nxcreole_init(&ctx, text);
+  nxcreole_json_init(&ctx, &js, out);
+  nxcreole_json_parse(&ctx);
+  nxcreole_json_finish(&js);
+}
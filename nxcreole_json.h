@@ -0,0 +1,54 @@
+/*
+ * Copyright (c) 2014 Yaroslav Stavnichiy <yarosla@gmail.com>
+ *
+ * This file is part of NXCREOLE.
+ *
+ * NXCREOLE is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License
+ * as published by the Free Software Foundation, either version 3
+ * of the License, or (at your option) any later version.
+ *
+ * NXCREOLE is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with NXCREOLE. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*
+ * JSON AST serializer, for client-side rendering. Output is UTF-8, array of block nodes
+ * in JsonML layout: text is a string (adjacent text events make one string), element is
+ * array of name, optional attribute object and children:
+ *
+ *   ["p",...]                           paragraph
+ *   ["h2",...]                          heading, level in name
+ *   ["list",{"k":"*"},["li",...],...]   list of kind * - # > : ! (nested lists are children
+ *                                       of items); ["blank"] marks blank item
+ *   ["table",["tr",["th",...],["td",{"colspan":2},...]]]   colspan only if not 1
+ *   ["fmt",{"k":"*"},...]               bold *, italic /, underline _, monospace #
+ *   ["link",{"target":"...","title":"..."}]   title only if given after |
+ *   ["img",{"src":"...","alt":"..."}]         alt only if given after |
+ *   ["nowiki","..."], ["pre","..."], ["ph","..."] (placeholder)
+ *   ["hr"], ["br"]
+ *
+ * Strings are escaped for embedding into <script> as well (U+2028, U+2029, "</").
+ */
+
+typedef struct nxcreole_json_serializer {
+  nxcreole_out* out;
+  unsigned first:1; // nothing written yet after opening [ of document
+  unsigned in_text:1; // text string is open
+} nxcreole_json_serializer;
+
+// set up ctx (initialized by nxcreole_init) to serialize into out; writes opening [
+void nxcreole_json_init(nxcreole_parse_ctx* ctx, nxcreole_json_serializer* js, nxcreole_out* out);
+// writes closing ] after parse
+void nxcreole_json_finish(nxcreole_json_serializer* js);
+
+// nxcreole_parse() specialized for this serializer (see nxcreole_xhtml_parse())
+void nxcreole_json_parse(nxcreole_parse_ctx* ctx);
+
+// shortcut: parse text and append JSON AST to out
+void nxcreole_render_json(const wchar_t* text, nxcreole_out* out);
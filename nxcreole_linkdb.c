@@ -0,0 +1,598 @@
+/*
+ * Copyright (c) 2014 Yaroslav Stavnichiy <yarosla@gmail.com>
+ *
+ * This file is part of NXCREOLE.
+ *
+ * NXCREOLE is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License
+ * as published by the Free Software Foundation, either version 3
+ * of the License, or (at your option) any later version.
+ *
+ * NXCREOLE is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with NXCREOLE. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <stdint.h>
+#include <stdio.h>
+#include <wchar.h>
+#include <string.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <dirent.h>
+#include <pthread.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "nxcreole_parser.h"
+#include "nxcreole_out.h"
+#include "nxcreole_resolve.h"
+#include "nxcreole_linkdb.h"
+
+#define LINKDB_MAGIC 0x3142444b4e494c4eULL // "NLINKDB1"
+#define LINKDB_VERSION 1
+#define PAGE_SUFFIX ".creole"
+#define PAGE_SUFFIX_LENGTH 7
+#define MIN_ENTRIES 256
+#define MIN_NAMES 1024
+#define TARGETS_BUF_SIZE 256
+
+#define ALIGN(n) (((n)+7)&~(uint64_t)7)
+
+typedef struct nxcreole_linkdb_header {
+  uint64_t magic;
+  uint64_t file_size;
+  uint32_t version;
+  uint32_t name_count;
+  uint32_t page_count;
+  uint32_t link_count;
+  uint64_t name_offsets_at, names_at, names_size, flags_at, pages_at, forward_at, backward_at;
+} nxcreole_linkdb_header;
+
+static int in_file(const nxcreole_linkdb_header* h, uint64_t at, uint64_t count, uint64_t size) {
+  return at<=h->file_size && count<=(h->file_size-at)/size;
+}
+
+int nxcreole_linkdb_open(nxcreole_linkdb* db, const char* path) {
+  memset(db, 0, sizeof(nxcreole_linkdb));
+  int fd=open(path, O_RDONLY);
+  if (fd==-1) return -1;
+  struct stat st;
+  if (fstat(fd, &st)) {
+    close(fd);
+    return -1;
+  }
+  if (st.st_size<(off_t)sizeof(nxcreole_linkdb_header)) {
+    close(fd);
+    errno=EINVAL;
+    return -1;
+  }
+  void* base=mmap(0, (size_t)st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+  close(fd);
+  if (base==MAP_FAILED) return -1;
+  const nxcreole_linkdb_header* h=base;
+  if (h->magic!=LINKDB_MAGIC || h->version!=LINKDB_VERSION || h->file_size!=(uint64_t)st.st_size
+      || !in_file(h, h->name_offsets_at, h->name_count, sizeof(uint32_t))
+      || !in_file(h, h->names_at, h->names_size, 1) || (h->name_count && !h->names_size)
+      || (h->names_size && ((const char*)base)[h->names_at+h->names_size-1])
+      || !in_file(h, h->flags_at, h->name_count, sizeof(uint32_t))
+      || !in_file(h, h->pages_at, h->page_count, sizeof(nxcreole_linkdb_page))
+      || !in_file(h, h->forward_at, h->link_count, sizeof(nxcreole_linkdb_link))
+      || !in_file(h, h->backward_at, h->link_count, sizeof(nxcreole_linkdb_link))) {
+    munmap(base, (size_t)st.st_size);
+    errno=EINVAL;
+    return -1;
+  }
+  const char* b=base;
+  db->base=base;
+  db->map_size=(size_t)st.st_size;
+  db->header=h;
+  db->name_offsets=(const uint32_t*)(b+h->name_offsets_at);
+  db->names=b+h->names_at;
+  db->flags=(const uint32_t*)(b+h->flags_at);
+  db->pages=(const nxcreole_linkdb_page*)(b+h->pages_at);
+  db->forward=(const nxcreole_linkdb_link*)(b+h->forward_at);
+  db->backward=(const nxcreole_linkdb_link*)(b+h->backward_at);
+  db->name_count=h->name_count;
+  db->page_count=h->page_count;
+  db->link_count=h->link_count;
+  uint32_t i;
+  for (i=0; i<db->name_count; i++) { // every name must be inside names (checked once, not per query)
+    if (db->name_offsets[i]>=h->names_size) {
+      nxcreole_linkdb_close(db);
+      errno=EINVAL;
+      return -1;
+    }
+  }
+  return 0;
+}
+
+void nxcreole_linkdb_close(nxcreole_linkdb* db) {
+  if (db->base) munmap(db->base, db->map_size);
+  memset(db, 0, sizeof(nxcreole_linkdb));
+}
+
+const char* nxcreole_linkdb_name(const nxcreole_linkdb* db, uint32_t id) {
+  return id<db->name_count? db->names+db->name_offsets[id] : 0;
+}
+
+int64_t nxcreole_linkdb_find(const nxcreole_linkdb* db, const char* name) {
+  uint32_t lo=0, hi=db->name_count;
+  while (lo<hi) {
+    uint32_t mid=lo+(hi-lo)/2;
+    int c=strcmp(db->names+db->name_offsets[mid], name);
+    if (!c) return mid;
+    if (c<0) lo=mid+1;
+    else hi=mid;
+  }
+  return -1;
+}
+
+// range of records with given source (by_target=0) or target (by_target=1)
+static const nxcreole_linkdb_link* find_links(const nxcreole_linkdb_link* links, uint32_t count, int by_target, uint32_t id, size_t* n) {
+  uint32_t lo=0, hi=count;
+  while (lo<hi) {
+    uint32_t mid=lo+(hi-lo)/2;
+    if ((by_target? links[mid].target : links[mid].source)<id) lo=mid+1;
+    else hi=mid;
+  }
+  uint32_t end=lo;
+  while (end<count && (by_target? links[end].target : links[end].source)==id) end++;
+  *n=end-lo;
+  return links+lo;
+}
+
+const nxcreole_linkdb_link* nxcreole_linkdb_links_from(const nxcreole_linkdb* db, uint32_t id, size_t* count) {
+  return find_links(db->forward, db->link_count, 0, id, count);
+}
+
+const nxcreole_linkdb_link* nxcreole_linkdb_links_to(const nxcreole_linkdb* db, uint32_t id, size_t* count) {
+  return find_links(db->backward, db->link_count, 1, id, count);
+}
+
+static const nxcreole_linkdb_page* find_page(const nxcreole_linkdb* db, const char* name) {
+  int64_t id=nxcreole_linkdb_find(db, name);
+  if (id<0) return 0;
+  uint32_t lo=0, hi=db->page_count;
+  while (lo<hi) {
+    uint32_t mid=lo+(hi-lo)/2;
+    if (db->pages[mid].name==(uint32_t)id) return &db->pages[mid];
+    if (db->pages[mid].name<(uint32_t)id) lo=mid+1;
+    else hi=mid;
+  }
+  return 0;
+}
+
+/*
+ * Building. Directory walk lists all files; worker threads take pages from shared
+ * counter and produce target list of each page: kind byte, UTF-8 target, NUL, ...
+ * Then all names are sorted into ids, and link records are sorted both ways.
+ */
+
+typedef struct entry_t {
+  char* name; // path relative to dir; .creole suffix cut off for pages
+  int page;
+  int64_t size, mtime;
+  nxcreole_out targets;
+  int failed;
+  int reused;
+} entry_t;
+
+typedef struct build_t {
+  const char* dir;
+  entry_t* entries;
+  size_t count, capacity;
+  const nxcreole_linkdb* old;
+  pthread_mutex_t lock;
+  size_t next; // next entry to process
+  int error; // errno of fatal error
+} build_t;
+
+static char* join_path(const char* a, const char* b) {
+  size_t la=strlen(a), lb=strlen(b);
+  char* p=malloc(la+lb+2);
+  if (!p) return 0;
+  memcpy(p, a, la);
+  p[la]='/';
+  memcpy(p+la+1, b, lb+1);
+  return p;
+}
+
+static int add_entry(build_t* b, const char* rel, const struct stat* st) {
+  if (b->count==b->capacity) {
+    size_t capacity=b->capacity? b->capacity*2 : MIN_ENTRIES;
+    entry_t* entries=realloc(b->entries, capacity*sizeof(entry_t));
+    if (!entries) return -1;
+    b->entries=entries;
+    b->capacity=capacity;
+  }
+  entry_t* e=&b->entries[b->count];
+  memset(e, 0, sizeof(entry_t));
+  size_t length=strlen(rel);
+  e->page=length>PAGE_SUFFIX_LENGTH && !strcmp(rel+length-PAGE_SUFFIX_LENGTH, PAGE_SUFFIX);
+  if (e->page) length-=PAGE_SUFFIX_LENGTH;
+  e->name=malloc(length+1);
+  if (!e->name) return -1;
+  memcpy(e->name, rel, length);
+  e->name[length]='\0';
+  e->size=(int64_t)st->st_size;
+  e->mtime=(int64_t)st->st_mtim.tv_sec*1000000000+st->st_mtim.tv_nsec;
+  b->count++;
+  return 0;
+}
+
+// rel is 0 for top directory; hidden entries and symlinks are skipped
+static int walk(build_t* b, const char* rel) {
+  char* path=rel? join_path(b->dir, rel) : strdup(b->dir);
+  if (!path) return -1;
+  DIR* d=opendir(path);
+  if (!d) {
+    free(path);
+    return -1;
+  }
+  struct dirent* de;
+  int res=0;
+  while (!res && (de=readdir(d))) {
+    if (de->d_name[0]=='.') continue;
+    char* child=join_path(path, de->d_name);
+    char* child_rel=rel? join_path(rel, de->d_name) : strdup(de->d_name);
+    struct stat st;
+    if (!child || !child_rel) res=-1;
+    else if (lstat(child, &st)) res=-1;
+    else if (S_ISDIR(st.st_mode)) res=walk(b, child_rel);
+    else if (S_ISREG(st.st_mode)) res=add_entry(b, child_rel, &st);
+    if (child) free(child);
+    if (child_rel) free(child_rel);
+  }
+  closedir(d);
+  free(path);
+  return res;
+}
+
+static void add_target(void* data, nxcreole_fn_id_t fn, const wchar_t* s, size_t length) {
+  nxcreole_out* out=data;
+  const wchar_t* hash=wmemchr(s, L'#', length);
+  if (hash) length=hash-s;
+  while (length && (*s==L' ' || *s==L'\t')) s++, length--;
+  while (length && (s[length-1]==L' ' || s[length-1]==L'\t')) length--;
+  if (!length) return;
+  nxcreole_out_write(out, fn==FN_APPEND_IMAGE? "\2" : "\1", 1);
+  nxcreole_out_wchars(out, s, length);
+  nxcreole_out_write(out, "", 1);
+}
+
+static int parse_page(build_t* b, entry_t* e) {
+  char* rel=malloc(strlen(e->name)+PAGE_SUFFIX_LENGTH+1);
+  if (!rel) return -1;
+  strcpy(rel, e->name);
+  strcat(rel, PAGE_SUFFIX);
+  char* path=join_path(b->dir, rel);
+  free(rel);
+  if (!path) return -1;
+  int fd=open(path, O_RDONLY);
+  free(path);
+  if (fd==-1) {
+    e->failed=1;
+    return 0;
+  }
+  char* input=malloc((size_t)e->size+1);
+  if (!input) {
+    close(fd);
+    return -1;
+  }
+  ssize_t n=read(fd, input, (size_t)e->size);
+  close(fd);
+  wchar_t* text=0;
+  size_t text_len=(size_t)-1;
+  if (n==(ssize_t)e->size) {
+    input[n]='\0';
+    text_len=mbstowcs(0, input, 0);
+  }
+  if (text_len!=(size_t)-1) {
+    text=malloc((text_len+1)*sizeof(wchar_t));
+    if (!text) {
+      free(input);
+      return -1;
+    }
+    mbstowcs(text, input, text_len+1);
+  }
+  free(input);
+  if (!text) {
+    e->failed=1;
+    return 0;
+  }
+  nxcreole_link_table table;
+  if (nxcreole_link_table_collect(&table, text)) {
+    free(text);
+    return -1;
+  }
+  size_t i;
+  for (i=0; i<table.count; i++) {
+    const nxcreole_link_target* t=&table.targets[i];
+    if (nxcreole_is_url(t->target, t->length)) continue; // external links and images are not indexed
+    add_target(&e->targets, t->fn, t->target, t->length);
+  }
+  nxcreole_link_table_free(&table);
+  free(text);
+  return e->targets.error? -1:0;
+}
+
+// links of unchanged page are taken from old index
+static int reuse_page(build_t* b, entry_t* e) {
+  if (!b->old) return 0;
+  const nxcreole_linkdb_page* p=find_page(b->old, e->name);
+  if (!p || p->size!=e->size || p->mtime!=e->mtime) return 0;
+  size_t i, count;
+  const nxcreole_linkdb_link* links=nxcreole_linkdb_links_from(b->old, p->name, &count);
+  for (i=0; i<count; i++) {
+    nxcreole_out_write(&e->targets, links[i].kind==NXCREOLE_LINKDB_IMAGE? "\2" : "\1", 1);
+    const char* target=nxcreole_linkdb_name(b->old, links[i].target);
+    nxcreole_out_write(&e->targets, target, strlen(target)+1);
+  }
+  e->reused=1;
+  return 1;
+}
+
+static void* worker(void* arg) {
+  build_t* b=arg;
+  for (;;) {
+    pthread_mutex_lock(&b->lock);
+    while (b->next<b->count && !b->entries[b->next].page) b->next++;
+    size_t i=b->next++;
+    int stop=i>=b->count || b->error;
+    pthread_mutex_unlock(&b->lock);
+    if (stop) break;
+    entry_t* e=&b->entries[i];
+    if (nxcreole_out_init(&e->targets, TARGETS_BUF_SIZE, 0, 0) || (!reuse_page(b, e) && parse_page(b, e))) {
+      pthread_mutex_lock(&b->lock);
+      b->error=ENOMEM;
+      pthread_mutex_unlock(&b->lock);
+      break;
+    }
+  }
+  return 0;
+}
+
+static int run_workers(build_t* b, int threads) {
+  if (threads<=0) threads=(int)sysconf(_SC_NPROCESSORS_ONLN);
+  if (threads<1) threads=1;
+  pthread_t* tids=malloc(threads*sizeof(pthread_t));
+  if (!tids) return -1;
+  int i, started=0;
+  for (i=0; i<threads; i++) {
+    if (pthread_create(&tids[i], 0, worker, b)) break;
+    started++;
+  }
+  if (!started) worker(b); // no threads available; do it here
+  for (i=0; i<started; i++) pthread_join(tids[i], 0);
+  free(tids);
+  if (b->error) {
+    errno=b->error;
+    return -1;
+  }
+  return 0;
+}
+
+static int cmp_str(const void* a, const void* b) {
+  return strcmp(*(const char* const*)a, *(const char* const*)b);
+}
+
+static int cmp_forward(const void* a, const void* b) {
+  const nxcreole_linkdb_link* x=a;
+  const nxcreole_linkdb_link* y=b;
+  if (x->source!=y->source) return x->source<y->source? -1:1;
+  if (x->target!=y->target) return x->target<y->target? -1:1;
+  return x->kind<y->kind? -1 : x->kind>y->kind;
+}
+
+static int cmp_backward(const void* a, const void* b) {
+  const nxcreole_linkdb_link* x=a;
+  const nxcreole_linkdb_link* y=b;
+  if (x->target!=y->target) return x->target<y->target? -1:1;
+  if (x->source!=y->source) return x->source<y->source? -1:1;
+  return x->kind<y->kind? -1 : x->kind>y->kind;
+}
+
+static int cmp_page(const void* a, const void* b) {
+  const nxcreole_linkdb_page* x=a;
+  const nxcreole_linkdb_page* y=b;
+  return x->name<y->name? -1 : x->name>y->name;
+}
+
+static uint32_t name_id(char** names, size_t count, const char* name) {
+  char** p=bsearch(&name, names, count, sizeof(char*), cmp_str);
+  return (uint32_t)(p-names);
+}
+
+static int write_padding(FILE* f, size_t length) {
+  static const char zeros[8];
+  size_t pad=ALIGN(length)-length;
+  return pad && fwrite(zeros, 1, pad, f)!=pad? -1:0;
+}
+
+static int write_section(FILE* f, const void* data, size_t length) {
+  if (length && fwrite(data, 1, length, f)!=length) return -1;
+  return write_padding(f, length);
+}
+
+// sorted names, pages and links written under temporary name, renamed over path
+static int write_index(build_t* b, const char* path, nxcreole_linkdb_stats* stats) {
+  size_t i, name_count=0, name_capacity=b->count+MIN_NAMES, page_count=0, link_count=0;
+  errno=0;
+  char** names=malloc(name_capacity*sizeof(char*));
+  if (!names) return -1;
+  for (i=0; i<b->count; i++) {
+    entry_t* e=&b->entries[i];
+    names[name_count++]=e->name;
+    if (!e->page) continue;
+    page_count++;
+    const char* t=e->targets.buf;
+    const char* end=t+e->targets.length;
+    for (; t<end; t+=strlen(t)+1, link_count++) {
+      if (name_count==name_capacity) {
+        name_capacity*=2;
+        char** n=realloc(names, name_capacity*sizeof(char*));
+        if (!n) {
+          free(names);
+          return -1;
+        }
+        names=n;
+      }
+      names[name_count++]=(char*)t+1; // past kind byte
+    }
+  }
+  qsort(names, name_count, sizeof(char*), cmp_str);
+  size_t unique=0, names_size=0;
+  for (i=0; i<name_count; i++) {
+    if (unique && !strcmp(names[unique-1], names[i])) continue;
+    names[unique++]=names[i];
+    names_size+=strlen(names[i])+1;
+  }
+  name_count=unique;
+
+  uint32_t* name_offsets=malloc((name_count+1)*sizeof(uint32_t));
+  uint32_t* flags=calloc(name_count+1, sizeof(uint32_t));
+  nxcreole_linkdb_page* pages=malloc((page_count+1)*sizeof(nxcreole_linkdb_page));
+  nxcreole_linkdb_link* forward=malloc((link_count+1)*sizeof(nxcreole_linkdb_link));
+  nxcreole_linkdb_link* backward=malloc((link_count+1)*sizeof(nxcreole_linkdb_link));
+  char* tmp_path=malloc(strlen(path)+8);
+  int res=-1;
+  FILE* f=0;
+  if (!name_offsets || !flags || !pages || !forward || !backward || !tmp_path) goto done;
+  if (names_size>UINT32_MAX || link_count>UINT32_MAX) {
+    errno=EFBIG;
+    goto done;
+  }
+  uint32_t offset=0;
+  for (i=0; i<name_count; i++) {
+    name_offsets[i]=offset;
+    offset+=(uint32_t)strlen(names[i])+1;
+  }
+  page_count=link_count=0;
+  for (i=0; i<b->count; i++) {
+    entry_t* e=&b->entries[i];
+    uint32_t id=name_id(names, name_count, e->name);
+    flags[id]|=e->page? NXCREOLE_LINKDB_PAGE : NXCREOLE_LINKDB_FILE;
+    if (!e->page) continue;
+    nxcreole_linkdb_page* p=&pages[page_count++];
+    p->name=id;
+    p->reserved=0;
+    p->size=e->size;
+    p->mtime=e->mtime;
+    if (stats) {
+      if (e->reused) stats->reused++;
+      else stats->parsed++;
+      if (e->failed) stats->failed++;
+    }
+    const char* t=e->targets.buf;
+    const char* end=t+e->targets.length;
+    for (; t<end; t+=strlen(t)+1) {
+      nxcreole_linkdb_link* l=&forward[link_count++];
+      l->source=id;
+      l->target=name_id(names, name_count, t+1);
+      l->kind=*t==2? NXCREOLE_LINKDB_IMAGE : NXCREOLE_LINKDB_LINK;
+    }
+  }
+  qsort(pages, page_count, sizeof(nxcreole_linkdb_page), cmp_page);
+  qsort(forward, link_count, sizeof(nxcreole_linkdb_link), cmp_forward);
+  unique=0;
+  for (i=0; i<link_count; i++) { // same target may come from different spellings (eg. fragments)
+    if (unique && !cmp_forward(&forward[unique-1], &forward[i])) continue;
+    forward[unique++]=forward[i];
+  }
+  link_count=unique;
+  memcpy(backward, forward, link_count*sizeof(nxcreole_linkdb_link));
+  qsort(backward, link_count, sizeof(nxcreole_linkdb_link), cmp_backward);
+  if (stats) {
+    stats->pages=page_count;
+    stats->links=link_count;
+  }
+
+  nxcreole_linkdb_header h;
+  memset(&h, 0, sizeof(h));
+  h.magic=LINKDB_MAGIC;
+  h.version=LINKDB_VERSION;
+  h.name_count=(uint32_t)name_count;
+  h.page_count=(uint32_t)page_count;
+  h.link_count=(uint32_t)link_count;
+  h.names_size=names_size;
+  h.name_offsets_at=ALIGN(sizeof(h));
+  h.names_at=h.name_offsets_at+ALIGN(name_count*sizeof(uint32_t));
+  h.flags_at=h.names_at+ALIGN(names_size);
+  h.pages_at=h.flags_at+ALIGN(name_count*sizeof(uint32_t));
+  h.forward_at=h.pages_at+ALIGN(page_count*sizeof(nxcreole_linkdb_page));
+  h.backward_at=h.forward_at+ALIGN(link_count*sizeof(nxcreole_linkdb_link));
+  h.file_size=h.backward_at+ALIGN(link_count*sizeof(nxcreole_linkdb_link));
+
+  sprintf(tmp_path, "%s.XXXXXX", path);
+  int fd=mkstemp(tmp_path);
+  if (fd==-1) goto done;
+  f=fdopen(fd, "wb");
+  if (!f) {
+    close(fd);
+    unlink(tmp_path);
+    goto done;
+  }
+  int failed=write_section(f, &h, sizeof(h)) || write_section(f, name_offsets, name_count*sizeof(uint32_t));
+  for (i=0; !failed && i<name_count; i++) {
+    failed=fwrite(names[i], 1, strlen(names[i])+1, f)!=strlen(names[i])+1;
+  }
+  failed=failed || write_padding(f, names_size)
+         || write_section(f, flags, name_count*sizeof(uint32_t))
+         || write_section(f, pages, page_count*sizeof(nxcreole_linkdb_page))
+         || write_section(f, forward, link_count*sizeof(nxcreole_linkdb_link))
+         || write_section(f, backward, link_count*sizeof(nxcreole_linkdb_link));
+  failed=fclose(f) || failed;
+  if (!failed) {
+    chmod(tmp_path, 0644);
+    failed=rename(tmp_path, path);
+  }
+  if (failed) {
+    int e=errno;
+    unlink(tmp_path);
+    errno=e;
+  }
+  else res=0;
+
+  done:
+  if (res && !errno) errno=ENOMEM;
+  free(names);
+  if (name_offsets) free(name_offsets);
+  if (flags) free(flags);
+  if (pages) free(pages);
+  if (forward) free(forward);
+  if (backward) free(backward);
+  if (tmp_path) free(tmp_path);
+  return res;
+}
+
+int nxcreole_linkdb_build(const char* dir, const char* path, int threads, nxcreole_linkdb_stats* stats) {
+  build_t b;
+  nxcreole_linkdb old;
+  memset(&b, 0, sizeof(b));
+  b.dir=dir;
+  if (stats) memset(stats, 0, sizeof(nxcreole_linkdb_stats));
+  if (!nxcreole_linkdb_open(&old, path)) b.old=&old; // otherwise build from scratch
+  pthread_mutex_init(&b.lock, 0);
+  errno=0;
+  int res=walk(&b, 0);
+  if (!res) res=run_workers(&b, threads);
+  if (!res) res=write_index(&b, path, stats);
+  int e=errno;
+  size_t i;
+  for (i=0; i<b.count; i++) {
+    free(b.entries[i].name);
+    if (b.entries[i].page) nxcreole_out_free(&b.entries[i].targets);
+  }
+  if (b.entries) free(b.entries);
+  pthread_mutex_destroy(&b.lock);
+  if (b.old) nxcreole_linkdb_close(&old);
+  errno=e;
+  return res;
+}
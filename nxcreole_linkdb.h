@@ -0,0 +1,94 @@
+/*
+ * Copyright (c) 2014 Yaroslav Stavnichiy <yarosla@gmail.com>
+ *
+ * This file is part of NXCREOLE.
+ *
+ * NXCREOLE is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License
+ * as published by the Free Software Foundation, either version 3
+ * of the License, or (at your option) any later version.
+ *
+ * NXCREOLE is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with NXCREOLE. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*
+ * Corpus link index: which pages link to which pages and images, in both directions,
+ * for backlinks, orphan pages and missing targets across whole wiki.
+ *
+ * nxcreole_linkdb_build() walks directory tree of .creole files (page name is path
+ * relative to the directory without .creole suffix) with a pool of threads, and
+ * collects [[link]] and {{image}} targets by parser's own rules (nxcreole_link_table_collect()):
+ * URLs are skipped, #fragment is cut off. Image target is file path relative to the
+ * directory. Files are decoded by current LC_CTYPE locale (UTF-8 expected). Given existing index, it reparses only pages whose size or mtime changed
+ * and takes links of the rest from the old index.
+ *
+ * Index file is used in place through read-only mmap: header, then sorted table
+ * of all names (pages, other files and targets; name id is its rank), their flags,
+ * page table, and link records sorted by source and by target. Every query is
+ * a binary search. File is written under temporary name and renamed over old one,
+ * so readers never see partial index. Byte order is native.
+ *
+ * Include <stdint.h> before this header.
+ */
+
+#define NXCREOLE_LINKDB_PAGE 1 // name is .creole page in directory
+#define NXCREOLE_LINKDB_FILE 2 // name is other file in directory
+
+#define NXCREOLE_LINKDB_LINK 1
+#define NXCREOLE_LINKDB_IMAGE 2
+
+typedef struct nxcreole_linkdb_link {
+  uint32_t source; // name ids
+  uint32_t target;
+  uint32_t kind; // NXCREOLE_LINKDB_LINK or NXCREOLE_LINKDB_IMAGE
+} nxcreole_linkdb_link;
+
+typedef struct nxcreole_linkdb_page {
+  uint32_t name;
+  uint32_t reserved;
+  int64_t size; // of source file, for incremental updates
+  int64_t mtime; // nanoseconds
+} nxcreole_linkdb_page;
+
+typedef struct nxcreole_linkdb {
+  void* base;
+  size_t map_size;
+  const struct nxcreole_linkdb_header* header;
+  const uint32_t* name_offsets; // into names
+  const char* names; // NUL-terminated UTF-8
+  const uint32_t* flags; // per name id
+  const nxcreole_linkdb_page* pages; // sorted by name id
+  const nxcreole_linkdb_link* forward; // sorted by source, target, kind
+  const nxcreole_linkdb_link* backward; // sorted by target, source, kind
+  uint32_t name_count;
+  uint32_t page_count;
+  uint32_t link_count;
+} nxcreole_linkdb;
+
+typedef struct nxcreole_linkdb_stats {
+  size_t pages; // in index
+  size_t parsed;
+  size_t reused; // unchanged since previous index
+  size_t failed; // unreadable or not UTF-8; indexed without links
+  size_t links;
+} nxcreole_linkdb_stats;
+
+// returns -1 on error (errno set); bad or truncated file is EINVAL
+int nxcreole_linkdb_open(nxcreole_linkdb* db, const char* path);
+void nxcreole_linkdb_close(nxcreole_linkdb* db);
+
+// (re)builds index file at path from dir; threads<=0 means one per online CPU;
+// returns -1 on error (errno set)
+int nxcreole_linkdb_build(const char* dir, const char* path, int threads, nxcreole_linkdb_stats* stats);
+
+int64_t nxcreole_linkdb_find(const nxcreole_linkdb* db, const char* name); // name id or -1
+const char* nxcreole_linkdb_name(const nxcreole_linkdb* db, uint32_t id);
+// links of page id (forward) or to id (backward); sets *count
+const nxcreole_linkdb_link* nxcreole_linkdb_links_from(const nxcreole_linkdb* db, uint32_t id, size_t* count);
+const nxcreole_linkdb_link* nxcreole_linkdb_links_to(const nxcreole_linkdb* db, uint32_t id, size_t* count);
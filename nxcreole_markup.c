@@ -0,0 +1,399 @@
+/*
+ * Copyright (c) 2014 Yaroslav Stavnichiy <yarosla@gmail.com>
+ *
+ * This file is part of NXCREOLE.
+ *
+ * NXCREOLE is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License
+ * as published by the Free Software Foundation, either version 3
+ * of the License, or (at your option) any later version.
+ *
+ * NXCREOLE is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with NXCREOLE. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <wchar.h>
+#include <string.h>
+#include <stdlib.h>
+
+#include "nxcreole_parser.h"
+#include "nxcreole_out.h"
+#include "nxcreole_markup.h"
+
+#define MIN_FRAGMENTS 128
+
+typedef enum {
+  HOLE_NONE,
+  HOLE_TEXT, // payload, escaped
+  HOLE_RAW, // payload as is
+  HOLE_TARGET,
+  HOLE_TITLE
+} hole_t;
+
+static const struct {
+  const char* key;
+  const char* template;
+} entries[NXCREOLE_MARKUP_COUNT]={
+  {"table_open", "<table>"},
+  {"table_row_open", "<tr>"},
+  {"table_head_cell_open", "<th>"},
+  {"table_head_cell_open_colspan", "<th colspan=\"{colspan}\">"},
+  {"table_head_cell_close", "</th>"},
+  {"table_cell_open", "<td>"},
+  {"table_cell_open_colspan", "<td colspan=\"{colspan}\">"},
+  {"table_cell_close", "</td>"},
+  {"table_row_close", "</tr>"},
+  {"table_close", "</table>"},
+  {"list_open.*", "<ul><li>"},
+  {"list_open.-", "<ul><li>"},
+  {"list_open.#", "<ol><li>"},
+  {"list_open.>", "<blockquote>"},
+  {"list_open.:", "<div class=\"indent\">"},
+  {"list_open.!", "<div class=\"center\">"},
+  {"list_next_item.*", "</li>\n<li>"},
+  {"list_next_item.-", "</li>\n<li>"},
+  {"list_next_item.#", "</li>\n<li>"},
+  {"list_next_item.>", ""},
+  {"list_next_item.:", ""},
+  {"list_next_item.!", "</div>\n<div class=\"center\">"},
+  {"list_blank_item.*", "&nbsp;"},
+  {"list_blank_item.-", "&nbsp;"},
+  {"list_blank_item.#", "&nbsp;"},
+  {"list_blank_item.>", "<br/><br/>\n"},
+  {"list_blank_item.:", "<br/><br/>\n"},
+  {"list_blank_item.!", "&nbsp;"},
+  {"list_close.*", "</li></ul>\n"},
+  {"list_close.-", "</li></ul>\n"},
+  {"list_close.#", "</li></ol>\n"},
+  {"list_close.>", "</blockquote>\n"},
+  {"list_close.:", "</div>\n"},
+  {"list_close.!", "</div>\n"},
+  {"paragraph_open", "<p>"},
+  {"paragraph_close", "</p>\n"},
+  {"heading_open", "<h{level}>"},
+  {"heading_close", "</h{level}>\n"},
+  {"format_open.*", "<strong>"},
+  {"format_open./", "<em>"},
+  {"format_open._", "<span class=\"underline\">"},
+  {"format_open.#", "<code>"},
+  {"format_close.*", "</strong>"},
+  {"format_close./", "</em>"},
+  {"format_close._", "</span>"},
+  {"format_close.#", "</code>"},
+  {"hr", "\n<hr/>\n"},
+  {"br", "<br/>\n"},
+  {"nowiki_block", "<pre>{text}</pre>\n"},
+  {"nowiki_inline", "<span class=\"nowiki\">{text}</span>"},
+  {"image", "<img src=\"{target}\" />"},
+  {"image_alt", "<img src=\"{target}\" alt=\"{title}\" />"},
+  {"link", "<a href=\"{target}\">{title}</a>"},
+  {"placeholder", "&lt;&lt;&lt;Placeholder:{name}&gt;&gt;&gt;"},
+};
+
+static const struct {
+  const char* name;
+  hole_t hole;
+} holes[]={
+  {"text", HOLE_TEXT},
+  {"name", HOLE_TEXT},
+  {"level", HOLE_RAW},
+  {"colspan", HOLE_RAW},
+  {"target", HOLE_TARGET},
+  {"title", HOLE_TITLE},
+};
+
+int nxcreole_markup_key(const char* key, size_t length) {
+  int i;
+  for (i=0; i<NXCREOLE_MARKUP_COUNT; i++) {
+    if (!strncmp(entries[i].key, key, length) && !entries[i].key[length]) return i;
+  }
+  return -1;
+}
+
+const char* nxcreole_markup_key_name(nxcreole_markup_id_t id) {
+  return entries[id].key;
+}
+
+const char* nxcreole_markup_default(nxcreole_markup_id_t id) {
+  return entries[id].template;
+}
+
+static hole_t find_hole(const char* name, size_t length) {
+  int i;
+  for (i=0; i<(int)(sizeof(holes)/sizeof(holes[0])); i++) {
+    if (!strncmp(holes[i].name, name, length) && !holes[i].name[length]) return holes[i].hole;
+  }
+  return HOLE_NONE;
+}
+
+// fragment of literal bytes that follow previous one, then hole
+static int add_fragment(nxcreole_markup* markup, size_t offset, hole_t hole) {
+  if (markup->fragment_count==markup->fragment_capacity) {
+    size_t capacity=markup->fragment_capacity? markup->fragment_capacity*2 : MIN_FRAGMENTS;
+    nxcreole_markup_fragment* fragments=realloc(markup->fragments, capacity*sizeof(nxcreole_markup_fragment));
+    if (!fragments) return -1;
+    markup->fragments=fragments;
+    markup->fragment_capacity=capacity;
+  }
+  nxcreole_markup_fragment* f=&markup->fragments[markup->fragment_count++];
+  f->offset=offset;
+  f->length=markup->bytes.length-offset;
+  f->hole=hole;
+  return 0;
+}
+
+// returns -1 if out of memory, 1 if template is bad
+static int compile_entry(nxcreole_markup* markup, const char* t) {
+  size_t offset=markup->bytes.length;
+  const char* p;
+  while ((p=strchr(t, '{'))) {
+    nxcreole_out_write(&markup->bytes, t, (size_t)(p-t)+1);
+    if (p[1]=='{') { // literal brace
+      t=p+2;
+      continue;
+    }
+    markup->bytes.length--; // brace goes into hole
+    const char* end=strchr(p, '}');
+    hole_t hole=end? find_hole(p+1, (size_t)(end-p-1)) : HOLE_NONE;
+    if (!hole) return 1;
+    if (add_fragment(markup, offset, hole)) return -1;
+    offset=markup->bytes.length;
+    t=end+1;
+  }
+  nxcreole_out_puts(&markup->bytes, t);
+  return add_fragment(markup, offset, HOLE_NONE);
+}
+
+int nxcreole_markup_compile(nxcreole_markup* markup, const char* const* templates) {
+  memset(markup, 0, sizeof(nxcreole_markup));
+  if (nxcreole_out_init(&markup->bytes, 1024, 0, 0)) return -1;
+  int i;
+  for (i=0; i<NXCREOLE_MARKUP_COUNT; i++) {
+    markup->entries[i]=markup->fragment_count;
+    int res=compile_entry(markup, templates && templates[i]? templates[i] : entries[i].template);
+    if (res || markup->bytes.error) {
+      nxcreole_markup_free(markup);
+      return res>0? i+1 : -1;
+    }
+  }
+  markup->entries[NXCREOLE_MARKUP_COUNT]=markup->fragment_count;
+  return 0;
+}
+
+// copies template unescaping it; returns 0 if out of memory
+static char* unescape(const char* s, size_t length) {
+  char* result=malloc(length+1);
+  if (!result) return 0;
+  char* d=result;
+  const char* end=s+length;
+  for (; s<end; s++) {
+    if (*s=='\\' && s+1<end) {
+      switch (*++s) {
+        case 'n': *d++='\n'; break;
+        case 't': *d++='\t'; break;
+        default: *d++=*s; break;
+      }
+    }
+    else {
+      *d++=*s;
+    }
+  }
+  *d='\0';
+  return result;
+}
+
+int nxcreole_markup_load(nxcreole_markup* markup, const char* config) {
+  char* templates[NXCREOLE_MARKUP_COUNT];
+  int lines[NXCREOLE_MARKUP_COUNT];
+  memset(templates, 0, sizeof(templates));
+  const char* p=config;
+  int i, line=0, res=0;
+  while (*p && !res) {
+    line++;
+    const char* eol=strchr(p, '\n');
+    if (!eol) eol=p+strlen(p);
+    while (p<eol && (*p==' ' || *p=='\t')) p++;
+    const char* end=eol;
+    while (end>p && (end[-1]==' ' || end[-1]=='\t' || end[-1]=='\r')) end--;
+    if (p<end && *p!='#') {
+      const char* key=p;
+      while (p<end && *p!='=' && *p!=' ' && *p!='\t') p++;
+      int id=nxcreole_markup_key(key, (size_t)(p-key));
+      while (p<end && (*p==' ' || *p=='\t')) p++;
+      if (id<0 || p==end || *p!='=') {
+        res=line;
+        break;
+      }
+      p++;
+      while (p<end && (*p==' ' || *p=='\t')) p++;
+      if (templates[id]) free(templates[id]);
+      if (!(templates[id]=unescape(p, (size_t)(end-p)))) res=-1;
+      lines[id]=line;
+    }
+    p=*eol? eol+1 : eol;
+  }
+  if (!res) {
+    res=nxcreole_markup_compile(markup, (const char* const*)templates);
+    if (res>0) res=lines[res-1]; // bad template is always one of loaded ones
+  }
+  for (i=0; i<NXCREOLE_MARKUP_COUNT; i++) {
+    if (templates[i]) free(templates[i]);
+  }
+  return res;
+}
+
+void nxcreole_markup_free(nxcreole_markup* markup) {
+  nxcreole_out_free(&markup->bytes);
+  if (markup->fragments) free(markup->fragments);
+  markup->fragments=0;
+  markup->fragment_count=markup->fragment_capacity=0;
+}
+
+static void emit(nxcreole_markup_serializer* ms, int id, const wchar_t* s, size_t len) {
+  const nxcreole_markup* markup=ms->markup;
+  const nxcreole_markup_fragment* f=markup->fragments+markup->entries[id];
+  const nxcreole_markup_fragment* end=markup->fragments+markup->entries[id+1];
+  const wchar_t* title;
+  for (; f<end; f++) {
+    if (f->length) nxcreole_out_write(ms->out, markup->bytes.buf+f->offset, f->length);
+    switch (f->hole) {
+      case HOLE_TEXT:
+        nxcreole_out_html(ms->out, s, len);
+        break;
+      case HOLE_RAW:
+        nxcreole_out_wchars(ms->out, s, len);
+        break;
+      case HOLE_TARGET:
+        title=wmemchr(s, L'|', len);
+        nxcreole_out_html(ms->out, s, title? (size_t)(title-s) : len);
+        break;
+      case HOLE_TITLE:
+        title=wmemchr(s, L'|', len);
+        if (title) nxcreole_out_html(ms->out, title+1, len-(size_t)(title-s)-1);
+        else nxcreole_out_html(ms->out, s, len);
+        break;
+    }
+  }
+}
+
+// entry for list or format kind; -1 if kind is unknown
+static int kind_entry(int base, const wchar_t* kinds, const wchar_t* s, size_t len) {
+  const wchar_t* k=len==1 && *s? wcschr(kinds, *s) : 0;
+  return k? base+(int)(k-kinds) : -1;
+}
+
+static const int entries0[FN_FUSED_COUNT]={
+  [FN_APPEND_TABLE_OPEN]=NXCREOLE_MARKUP_TABLE_OPEN,
+  [FN_APPEND_TABLE_ROW_OPEN]=NXCREOLE_MARKUP_TABLE_ROW_OPEN,
+  [FN_APPEND_TABLE_HEAD_CELL_CLOSE]=NXCREOLE_MARKUP_TABLE_HEAD_CELL_CLOSE,
+  [FN_APPEND_TABLE_CELL_CLOSE]=NXCREOLE_MARKUP_TABLE_CELL_CLOSE,
+  [FN_APPEND_TABLE_ROW_CLOSE]=NXCREOLE_MARKUP_TABLE_ROW_CLOSE,
+  [FN_APPEND_TABLE_CLOSE]=NXCREOLE_MARKUP_TABLE_CLOSE,
+  [FN_APPEND_PARAGRAPH_OPEN]=NXCREOLE_MARKUP_PARAGRAPH_OPEN,
+  [FN_APPEND_PARAGRAPH_CLOSE]=NXCREOLE_MARKUP_PARAGRAPH_CLOSE,
+  [FN_APPEND_HR]=NXCREOLE_MARKUP_HR,
+  [FN_APPEND_BR]=NXCREOLE_MARKUP_BR,
+};
+
+static void append0(nxcreole_parse_ctx* ctx, nxcreole_fn_id_t fn) {
+  nxcreole_markup_serializer* ms=ctx->data;
+  if (fn==FN_APPEND_TABLE_ROW_NEXT) {
+    emit(ms, NXCREOLE_MARKUP_TABLE_ROW_CLOSE, 0, 0);
+    emit(ms, NXCREOLE_MARKUP_TABLE_ROW_OPEN, 0, 0);
+  }
+  else {
+    emit(ms, entries0[fn], 0, 0);
+  }
+}
+
+static void append1(nxcreole_parse_ctx* ctx, nxcreole_fn_id_t fn, const wchar_t* s, size_t len) {
+  nxcreole_markup_serializer* ms=ctx->data;
+  int id=-1, colspan=!(len==1 && *s==L'1');
+  size_t i;
+  switch (fn) {
+    case FN_APPEND_TEXT:
+      nxcreole_out_html(ms->out, s, len);
+      return;
+    case FN_APPEND_TABLE_HEAD_CELL_NEXT:
+      emit(ms, NXCREOLE_MARKUP_TABLE_HEAD_CELL_CLOSE, 0, 0);
+      // fall through
+    case FN_APPEND_TABLE_HEAD_CELL_OPEN:
+      id=colspan? NXCREOLE_MARKUP_TABLE_HEAD_CELL_OPEN_COLSPAN : NXCREOLE_MARKUP_TABLE_HEAD_CELL_OPEN;
+      break;
+    case FN_APPEND_TABLE_CELL_NEXT:
+      emit(ms, NXCREOLE_MARKUP_TABLE_CELL_CLOSE, 0, 0);
+      // fall through
+    case FN_APPEND_TABLE_CELL_OPEN:
+      id=colspan? NXCREOLE_MARKUP_TABLE_CELL_OPEN_COLSPAN : NXCREOLE_MARKUP_TABLE_CELL_OPEN;
+      break;
+    case FN_APPEND_LIST_OPEN:
+      id=kind_entry(NXCREOLE_MARKUP_LIST_OPEN, NXCREOLE_MARKUP_LIST_KINDS, s, len);
+      break;
+    case FN_APPEND_LIST_NEXT_ITEM:
+      id=kind_entry(NXCREOLE_MARKUP_LIST_NEXT_ITEM, NXCREOLE_MARKUP_LIST_KINDS, s, len);
+      break;
+    case FN_APPEND_LIST_BLANK_ITEM:
+      id=kind_entry(NXCREOLE_MARKUP_LIST_BLANK_ITEM, NXCREOLE_MARKUP_LIST_KINDS, s, len);
+      break;
+    case FN_APPEND_LIST_CLOSE:
+      id=kind_entry(NXCREOLE_MARKUP_LIST_CLOSE, NXCREOLE_MARKUP_LIST_KINDS, s, len);
+      break;
+    case FN_APPEND_LIST_CLOSE_RUN:
+      for (i=0; i<len; i++) {
+        id=kind_entry(NXCREOLE_MARKUP_LIST_CLOSE, NXCREOLE_MARKUP_LIST_KINDS, s+i, 1);
+        if (id>=0) emit(ms, id, 0, 0);
+      }
+      return;
+    case FN_APPEND_HEADING_OPEN:
+      id=NXCREOLE_MARKUP_HEADING_OPEN;
+      break;
+    case FN_APPEND_HEADING_CLOSE:
+      id=NXCREOLE_MARKUP_HEADING_CLOSE;
+      break;
+    case FN_APPEND_FORMAT_OPEN:
+      id=kind_entry(NXCREOLE_MARKUP_FORMAT_OPEN, NXCREOLE_MARKUP_FORMAT_KINDS, s, len);
+      break;
+    case FN_APPEND_FORMAT_CLOSE:
+      id=kind_entry(NXCREOLE_MARKUP_FORMAT_CLOSE, NXCREOLE_MARKUP_FORMAT_KINDS, s, len);
+      break;
+    case FN_APPEND_NOWIKI_BLOCK:
+      id=NXCREOLE_MARKUP_NOWIKI_BLOCK;
+      break;
+    case FN_APPEND_NOWIKI_INLINE:
+      id=NXCREOLE_MARKUP_NOWIKI_INLINE;
+      break;
+    case FN_APPEND_IMAGE:
+      id=wmemchr(s, L'|', len)? NXCREOLE_MARKUP_IMAGE_ALT : NXCREOLE_MARKUP_IMAGE;
+      break;
+    case FN_APPEND_LINK:
+      id=NXCREOLE_MARKUP_LINK;
+      break;
+    case FN_APPEND_PLACEHOLDER:
+      id=NXCREOLE_MARKUP_PLACEHOLDER;
+      break;
+    default:
+      break;
+  }
+  if (id>=0) emit(ms, id, s, len);
+}
+
+void nxcreole_markup_init(nxcreole_parse_ctx* ctx, nxcreole_markup_serializer* ms, const nxcreole_markup* markup, nxcreole_out* out) {
+  ms->out=out;
+  ms->markup=markup;
+  ctx->append0=append0;
+  ctx->append1=append1;
+  ctx->data=ms;
+}
+
+void nxcreole_render_markup(const wchar_t* text, const nxcreole_markup* markup, nxcreole_out* out) {
+  nxcreole_parse_ctx ctx;
+  nxcreole_markup_serializer ms;
+  nxcreole_init(&ctx, text);
+  nxcreole_markup_init(&ctx, &ms, markup, out);
+  nxcreole_parse(&ctx);
+}
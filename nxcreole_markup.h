@@ -0,0 +1,106 @@
+/*
+ * Copyright (c) 2014 Yaroslav Stavnichiy <yarosla@gmail.com>
+ *
+ * This file is part of NXCREOLE.
+ *
+ * NXCREOLE is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License
+ * as published by the Free Software Foundation, either version 3
+ * of the License, or (at your option) any later version.
+ *
+ * NXCREOLE is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with NXCREOLE. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*
+ * Markup serializer driven by a table of tag templates, one for every event
+ * and every list and format kind. Table can be loaded at run time (eg. to use
+ * own tags and class names); entries not given keep built-in XHTML markup,
+ * so serializer with default table renders exactly as nxcreole_xhtml.
+ *
+ * Templates are UTF-8 text with holes for payload:
+ *   {text} or {name}      payload, HTML-escaped (nowiki text, placeholder name)
+ *   {level} or {colspan}  payload as is (heading level, cell colspan)
+ *   {target}              link/image target, HTML-escaped
+ *   {title}               link title (target if untitled) or image alt, HTML-escaped
+ *   {{                    literal {
+ * Each template is compiled once into UTF-8 fragments between holes, so
+ * emitting a tag is a single write per fragment.
+ */
+
+#define NXCREOLE_MARKUP_LIST_KINDS L"*-#>:!"
+#define NXCREOLE_MARKUP_FORMAT_KINDS L"*/_#"
+
+typedef enum {
+  NXCREOLE_MARKUP_TABLE_OPEN,
+  NXCREOLE_MARKUP_TABLE_ROW_OPEN,
+  NXCREOLE_MARKUP_TABLE_HEAD_CELL_OPEN,
+  NXCREOLE_MARKUP_TABLE_HEAD_CELL_OPEN_COLSPAN, // cell spanning several columns
+  NXCREOLE_MARKUP_TABLE_HEAD_CELL_CLOSE,
+  NXCREOLE_MARKUP_TABLE_CELL_OPEN,
+  NXCREOLE_MARKUP_TABLE_CELL_OPEN_COLSPAN,
+  NXCREOLE_MARKUP_TABLE_CELL_CLOSE,
+  NXCREOLE_MARKUP_TABLE_ROW_CLOSE,
+  NXCREOLE_MARKUP_TABLE_CLOSE,
+  NXCREOLE_MARKUP_LIST_OPEN, // one entry per list kind, in NXCREOLE_MARKUP_LIST_KINDS order
+  NXCREOLE_MARKUP_LIST_NEXT_ITEM=NXCREOLE_MARKUP_LIST_OPEN+6,
+  NXCREOLE_MARKUP_LIST_BLANK_ITEM=NXCREOLE_MARKUP_LIST_NEXT_ITEM+6,
+  NXCREOLE_MARKUP_LIST_CLOSE=NXCREOLE_MARKUP_LIST_BLANK_ITEM+6,
+  NXCREOLE_MARKUP_PARAGRAPH_OPEN=NXCREOLE_MARKUP_LIST_CLOSE+6,
+  NXCREOLE_MARKUP_PARAGRAPH_CLOSE,
+  NXCREOLE_MARKUP_HEADING_OPEN,
+  NXCREOLE_MARKUP_HEADING_CLOSE,
+  NXCREOLE_MARKUP_FORMAT_OPEN, // one entry per format kind, in NXCREOLE_MARKUP_FORMAT_KINDS order
+  NXCREOLE_MARKUP_FORMAT_CLOSE=NXCREOLE_MARKUP_FORMAT_OPEN+4,
+  NXCREOLE_MARKUP_HR=NXCREOLE_MARKUP_FORMAT_CLOSE+4,
+  NXCREOLE_MARKUP_BR,
+  NXCREOLE_MARKUP_NOWIKI_BLOCK,
+  NXCREOLE_MARKUP_NOWIKI_INLINE,
+  NXCREOLE_MARKUP_IMAGE,
+  NXCREOLE_MARKUP_IMAGE_ALT, // image with alt text
+  NXCREOLE_MARKUP_LINK,
+  NXCREOLE_MARKUP_PLACEHOLDER,
+  NXCREOLE_MARKUP_COUNT
+} nxcreole_markup_id_t;
+
+typedef struct nxcreole_markup_fragment {
+  size_t offset, length; // UTF-8 bytes in markup's bytes
+  int hole; // what follows fragment (0 if nothing)
+} nxcreole_markup_fragment;
+
+typedef struct nxcreole_markup {
+  nxcreole_out bytes; // all fragments
+  nxcreole_markup_fragment* fragments;
+  size_t fragment_count;
+  size_t fragment_capacity;
+  size_t entries[NXCREOLE_MARKUP_COUNT+1]; // first fragment of every entry
+} nxcreole_markup;
+
+typedef struct nxcreole_markup_serializer {
+  nxcreole_out* out;
+  const nxcreole_markup* markup;
+} nxcreole_markup_serializer;
+
+// entry id by its key (eg. "table_open", "list_open.*", "format_close./"); -1 if unknown
+int nxcreole_markup_key(const char* key, size_t length);
+const char* nxcreole_markup_key_name(nxcreole_markup_id_t id);
+const char* nxcreole_markup_default(nxcreole_markup_id_t id);
+
+// templates has NXCREOLE_MARKUP_COUNT entries, 0 for default (templates itself may be 0);
+// returns -1 if out of memory, or id+1 of entry with bad template
+int nxcreole_markup_compile(nxcreole_markup* markup, const char* const* templates);
+// config is lines of "key = template" (# starts comment line, \n \t \\ escapes in template);
+// returns -1 if out of memory, or number of bad line
+int nxcreole_markup_load(nxcreole_markup* markup, const char* config);
+void nxcreole_markup_free(nxcreole_markup* markup);
+
+// set up ctx (initialized by nxcreole_init) to serialize into out
+void nxcreole_markup_init(nxcreole_parse_ctx* ctx, nxcreole_markup_serializer* ms, const nxcreole_markup* markup, nxcreole_out* out);
+
+// shortcut: parse text and append markup to out
+void nxcreole_render_markup(const wchar_t* text, const nxcreole_markup* markup, nxcreole_out* out);
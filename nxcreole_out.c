@@ -0,0 +1,226 @@
+/*
+ * Copyright (c) 2014 Yaroslav Stavnichiy <yarosla@gmail.com>
+ *
+ * This file is part of NXCREOLE.
+ *
+ * NXCREOLE is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License
+ * as published by the Free Software Foundation, either version 3
+ * of the License, or (at your option) any later version.
+ *
+ * NXCREOLE is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with NXCREOLE. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <wchar.h>
+#include <string.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+#include "nxcreole_out.h"
+
+#define MIN_OUT_SIZE 64
+#define MAX_UTF8_CHAR 4
+
+int nxcreole_out_init(nxcreole_out* out, size_t size, nxcreole_sink_fn sink, void* sink_data) {
+  memset(out, 0, sizeof(nxcreole_out));
+  if (size<MIN_OUT_SIZE) size=MIN_OUT_SIZE;
+  out->buf=malloc(size+1); // +1 for NUL terminator
+  if (!out->buf) {
+    out->error=1;
+    return -1;
+  }
+  out->size=size;
+  out->sink=sink;
+  out->sink_data=sink_data;
+  return 0;
+}
+
+void nxcreole_out_init_fixed(nxcreole_out* out, char* buf, size_t size) {
+  memset(out, 0, sizeof(nxcreole_out));
+  out->buf=buf;
+  out->size=size;
+  out->fixed=1;
+}
+
+void nxcreole_out_init_counter(nxcreole_out* out) {
+  memset(out, 0, sizeof(nxcreole_out));
+  out->counting=1;
+}
+
+void nxcreole_out_free(nxcreole_out* out) {
+  if (out->buf && !out->fixed) free(out->buf);
+  out->buf=0;
+  out->length=out->size=0;
+}
+
+int nxcreole_out_flush(nxcreole_out* out) {
+  if (out->sink && out->length && !out->error) {
+    if (out->sink(out->sink_data, out->buf, out->length)) out->error=1;
+  }
+  if (out->sink) out->length=0;
+  return out->error? -1:0;
+}
+
+const char* nxcreole_out_cstr(nxcreole_out* out) {
+  if (!out->buf) return "";
+  out->buf[out->length]='\0';
+  return out->buf;
+}
+
+// makes room for at least length bytes; returns 0 if output is dropped
+static int reserve(nxcreole_out* out, size_t length) {
+  if (out->error) return 0;
+  if (out->size-out->length>=length) return 1;
+  if (out->sink) {
+    if (nxcreole_out_flush(out)) return 0;
+    if (out->size>=length) return 1;
+  }
+  if (out->fixed) {
+    out->error=1;
+    return 0;
+  }
+  size_t size=out->size*2;
+  if (size<out->length+length) size=out->length+length;
+  char* buf=realloc(out->buf, size+1);
+  if (!buf) {
+    out->error=1;
+    return 0;
+  }
+  out->buf=buf;
+  out->size=size;
+  return 1;
+}
+
+void nxcreole_out_write(nxcreole_out* out, const char* s, size_t length) {
+  if (out->counting) {
+    out->total+=length;
+    return;
+  }
+  if (!reserve(out, length)) return;
+  memcpy(out->buf+out->length, s, length);
+  out->length+=length;
+  out->total+=length;
+}
+
+void nxcreole_out_puts(nxcreole_out* out, const char* s) {
+  nxcreole_out_write(out, s, strlen(s));
+}
+
+static char* encode_utf8(unsigned int c, char* b) {
+  if (c<0x80) *b++=(char)c;
+  else if (c<0x800) *b++=(char)(192+c/64), *b++=(char)(128+c%64);
+  else if (c-0xd800u<0x800) *b++='?'; // lone surrogate
+  else if (c<0x10000) *b++=(char)(224+c/4096), *b++=(char)(128+c/64%64), *b++=(char)(128+c%64);
+  else if (c<0x110000) *b++=(char)(240+c/262144), *b++=(char)(128+c/4096%64), *b++=(char)(128+c/64%64), *b++=(char)(128+c%64);
+  else *b++='?'; // invalid code point
+  return b;
+}
+
+// number of bytes encode_utf8() produces for s
+static size_t utf8_length(const wchar_t* s, size_t length) {
+  size_t n=length;
+  while (length--) {
+    unsigned int c=(unsigned int)*s++;
+    if (c<0x80) continue;
+    if (c<0x800) n+=1;
+    else if (c-0xd800u<0x800) ; // '?'
+    else if (c<0x10000) n+=2;
+    else if (c<0x110000) n+=3;
+  }
+  return n;
+}
+
+size_t nxcreole_out_wchars_size(const wchar_t* s, size_t length) {
+  return utf8_length(s, length);
+}
+
+size_t nxcreole_out_html_size(const wchar_t* s, size_t length) {
+  size_t n=utf8_length(s, length);
+  const wchar_t* end=s+length;
+  for (; s<end; s++) {
+    switch (*s) {
+      case L'<': case L'>': n+=3; break; // &lt; &gt;
+      case L'"': n+=5; break; // &quot;
+      case L'\'': case L'&': n+=4; break; // &#39; &amp;
+    }
+  }
+  return n;
+}
+
+void nxcreole_out_wchars(nxcreole_out* out, const wchar_t* s, size_t length) {
+  if (out->counting) {
+    out->total+=utf8_length(s, length);
+    return;
+  }
+  while (length) {
+    // encode as many chars as surely fit, at least one
+    size_t room=out->size-out->length;
+    size_t n=room/MAX_UTF8_CHAR;
+    if (!n) {
+      if (out->fixed) { // tail of fixed buffer: can't grow, so go char by char
+        char tmp[MAX_UTF8_CHAR];
+        nxcreole_out_write(out, tmp, (size_t)(encode_utf8((unsigned int)*s++, tmp)-tmp));
+        length--;
+        if (out->error) return;
+        continue;
+      }
+      if (!reserve(out, length<64? length*MAX_UTF8_CHAR : 64*MAX_UTF8_CHAR)) return;
+      continue;
+    }
+    if (n>length) n=length;
+    length-=n;
+    char* start=out->buf+out->length;
+    char* b=start;
+    while (n--) {
+      unsigned int c=(unsigned int)*s++;
+      if (c<0x80) *b++=(char)c;
+      else b=encode_utf8(c, b);
+    }
+    out->length+=b-start;
+    out->total+=b-start;
+  }
+}
+
+void nxcreole_out_html(nxcreole_out* out, const wchar_t* s, size_t length) {
+  const wchar_t* p=s;
+  const wchar_t* end=s+length;
+  for (; p<end; p++) {
+    const char* r;
+    switch (*p) {
+      case L'<': r="&lt;"; break;
+      case L'>': r="&gt;"; break;
+      case L'"': r="&quot;"; break;
+      case L'\'': r="&#39;"; break;
+      case L'&': r="&amp;"; break;
+      default: continue;
+    }
+    // write unescaped run, then entity
+    nxcreole_out_wchars(out, s, p-s);
+    nxcreole_out_puts(out, r);
+    s=p+1;
+  }
+  nxcreole_out_wchars(out, s, end-s);
+}
+
+int nxcreole_fd_sink(void* sink_data, const char* data, size_t length) {
+  int fd=*(int*)sink_data;
+  while (length) {
+    ssize_t n=write(fd, data, length);
+    if (n<=0) return -1;
+    data+=n;
+    length-=n;
+  }
+  return 0;
+}
+
+int nxcreole_out_sink(void* sink_data, const char* data, size_t length) {
+  nxcreole_out* out=sink_data;
+  nxcreole_out_write(out, data, length);
+  return out->error? -1:0;
+}
@@ -0,0 +1,59 @@
+/*
+ * Copyright (c) 2014 Yaroslav Stavnichiy <yarosla@gmail.com>
+ *
+ * This file is part of NXCREOLE.
+ *
+ * NXCREOLE is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License
+ * as published by the Free Software Foundation, either version 3
+ * of the License, or (at your option) any later version.
+ *
+ * NXCREOLE is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with NXCREOLE. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*
+ * UTF-8 output buffer used by built-in serializers.
+ *
+ * Without sink the buffer grows as needed and holds whole output.
+ * With sink it is flushed to sink every time it fills up (and by nxcreole_out_flush()).
+ * Fixed buffer is provided by caller and never grows; overflowing it is an error.
+ * Counter has no buffer at all: it just counts bytes in total, so running
+ * a serializer into a counter gives exact size of its output.
+ */
+
+typedef int (*nxcreole_sink_fn)(void* sink_data, const char* data, size_t length);
+
+typedef struct nxcreole_out {
+  char* buf;
+  size_t length; // bytes in buf
+  size_t size; // allocated size of buf
+  size_t total; // bytes written so far, including flushed ones
+  nxcreole_sink_fn sink;
+  void* sink_data;
+  int error; // set if allocation or sink failed; further output is dropped
+  unsigned fixed:1; // buf belongs to caller
+  unsigned counting:1; // no buf, only total is updated
+} nxcreole_out;
+
+int nxcreole_out_init(nxcreole_out* out, size_t size, nxcreole_sink_fn sink, void* sink_data);
+void nxcreole_out_init_fixed(nxcreole_out* out, char* buf, size_t size); // buf must have room for size+1 bytes
+void nxcreole_out_init_counter(nxcreole_out* out);
+void nxcreole_out_free(nxcreole_out* out);
+int nxcreole_out_flush(nxcreole_out* out);
+const char* nxcreole_out_cstr(nxcreole_out* out); // NUL-terminates buffer (terminator is not counted)
+
+void nxcreole_out_write(nxcreole_out* out, const char* s, size_t length);
+void nxcreole_out_puts(nxcreole_out* out, const char* s);
+void nxcreole_out_wchars(nxcreole_out* out, const wchar_t* s, size_t length); // UTF-8 encoded
+void nxcreole_out_html(nxcreole_out* out, const wchar_t* s, size_t length); // UTF-8 encoded, HTML-escaped
+size_t nxcreole_out_wchars_size(const wchar_t* s, size_t length); // bytes nxcreole_out_wchars() writes
+size_t nxcreole_out_html_size(const wchar_t* s, size_t length); // bytes nxcreole_out_html() writes
+
+int nxcreole_fd_sink(void* sink_data, const char* data, size_t length); // sink_data is (int*) file descriptor
+int nxcreole_out_sink(void* sink_data, const char* data, size_t length); // sink_data is (nxcreole_out*) to append to
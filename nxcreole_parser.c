@@ -26,566 +26,598 @@
 #include <wchar.h>
 #include <string.h>
 #include <stdlib.h>
+#include <stddef.h>
+#ifdef NXCREOLE_STATS
+#include <time.h>
+#endif
+#if defined(__SSE2__) && __SIZEOF_WCHAR_T__==4
+#include <stdint.h>
+#include <emmintrin.h>
+#endif
 
 #include "nxcreole_parser.h"
+#include "nxcreole_parser_impl.h"
 
-#define SKIP_WS(p) while (*(p)>0 && *(p)<=L' ' && *(p)!=L'\n') (p)++;
+static void* default_alloc(void* alloc_data, size_t size) {
+  return malloc(size);
+}
 
-#define IS_LIST_CHAR(c) ((c)==L'*' || (c)==L'-' || (c)==L'#' || (c)==L'>' || (c)==L':' || (c)==L'!')
-#define IS_FORMAT_CHAR(c) ((c)==L'*' || (c)==L'/' || (c)==L'_' || (c)==L'#')
+static void default_dealloc(void* alloc_data, void* ptr) {
+  free(ptr);
+}
 
-// From MediaWiki: "._\\/~%-+&#?!=()@"
-// From http://www.ietf.org/rfc/rfc2396.txt :
-//   reserved:   ";/?:@&=+$,"
-//   unreserved: "-_.!~*'()"
-//   delim:      "%#"
-// Note: I excluded apostrophe
-#define IS_URL_CHAR(c) (((c)>=L'a' && (c)<=L'z') || ((c)>=L'A' && (c)<=L'Z') || ((c)>=L'0' && (c)<=L'9') \
-        || wcschr(L"/?@&=+,-_.!~()%#;:$*", c))
+void nxcreole_init(nxcreole_parse_ctx* ctx, const wchar_t* text) {
+  memset(ctx, 0, sizeof(nxcreole_parse_ctx));
+  ctx->ptr=text;
+  ctx->text=text;
+  ctx->list_level=-1;
+  ctx->alloc=default_alloc;
+  ctx->dealloc=default_dealloc;
+}
 
-static void close_lists_and_tables(nxcreole_parse_ctx* ctx) {
-  // close unclosed lists
-  while (ctx->list_level>=0) {
-    ctx->append1(ctx, FN_APPEND_LIST_CLOSE, &ctx->list_levels[ctx->list_level--], 1);
-  }
-  // close table
-  if (ctx->in_table) {
-    ctx->append0(ctx, FN_APPEND_TABLE_CLOSE);
-    ctx->in_table=0;
-  }
-  // mediawiki-style tables not closed by this function
+static void scan_links_append0(nxcreole_parse_ctx* ctx, nxcreole_fn_id_t fn) {
 }
 
-static const wchar_t* find_end_of_nowiki(const wchar_t* p) {
-  for (p=wcschr(p, L'}'); p; p=wcschr(p+1, L'}')) {
-    if (p[-1]==L'~') continue;
-    if (p[1]==L'}' && p[2]==L'}') {
-      while (p[3]==L'}') p++; // shift to end of sequence of more than 3x'}' (eg. '}}}}}')
-      return p;
-    }
+static void scan_links_append1(nxcreole_parse_ctx* ctx, nxcreole_fn_id_t fn, const wchar_t* s, size_t length) {
+  // link, image and placeholder payloads always point into source text
+  if (ctx->fn[fn]) ((nxcreole_link_fn)ctx->fn[fn])(ctx->data, fn, s, length, (size_t)(s-ctx->text));
+}
+
+void nxcreole_links_init(nxcreole_parse_ctx* ctx, nxcreole_link_fn fn, void* data) {
+  ctx->append0=scan_links_append0;
+  ctx->append1=scan_links_append1;
+  ctx->fn[FN_APPEND_LINK]=ctx->fn[FN_APPEND_IMAGE]=ctx->fn[FN_APPEND_PLACEHOLDER]=(void*)fn;
+  ctx->data=data;
+}
+
+void nxcreole_scan_links(const wchar_t* text, nxcreole_link_fn fn, void* data) {
+  nxcreole_parse_ctx ctx;
+  nxcreole_init(&ctx, text);
+  nxcreole_links_init(&ctx, fn, data);
+  ctx.links_only=1;
+  nxcreole_parse_links(&ctx);
+}
+
+int nxcreole_is_url(const wchar_t* s, size_t length) {
+  int i, j;
+  for (i=0; i<(int)(sizeof(url_schemes)/sizeof(url_schemes[0])); i++) {
+    const url_scheme_t* scheme=&url_schemes[i];
+    if (length<=scheme->length+scheme->slashes || wmemcmp(s, scheme->name, scheme->length) || s[scheme->length]!=L':') continue;
+    for (j=1; j<=scheme->slashes && s[scheme->length+j]==L'/'; j++);
+    if (j>scheme->slashes) return 1;
   }
   return 0;
 }
 
-static int remove_escapes_from_nowiki(const wchar_t* s, size_t len, const wchar_t** res, size_t* res_len) {
-  const wchar_t* src=s;
-  wchar_t* res_buf=0;
-  wchar_t* res_ptr=0;
-  const wchar_t* end=s+len-3; // account for }}}
-  const wchar_t* p;
-  for (p=wcschr(s, L'~'); p && p<end; p=wcschr(p+1, L'~')) {
-    if (p[1]==L'}' && p[2]==L'}' && p[3]==L'}') {
-      // found escape sequence ~}}}
-      if (!res_ptr) {
-        res_ptr=res_buf=malloc((len-1)*sizeof(wchar_t));
-        if (!res_buf) { // error - should not happen
-          *res=s, *res_len=len; // pass through without processing
-          return 0; // caller must not free(res)
-        }
-      }
-      if (p>src) {
-        size_t cnt=p-src;
-        memcpy(res_ptr, src, cnt*sizeof(wchar_t));
-        res_ptr+=cnt;
-      }
-      src=p+1; // src points to }}}
+#define MIN_SECTIONS 16
+
+static void index_heading(nxcreole_parse_ctx* ctx, const wchar_t* s) {
+  nxcreole_section_index* idx=ctx->data;
+  if (idx->error) return;
+  if (idx->count==idx->capacity) {
+    size_t capacity=idx->capacity? idx->capacity*2 : MIN_SECTIONS;
+    nxcreole_section* sections=realloc(idx->sections, capacity*sizeof(nxcreole_section));
+    if (!sections) {
+      idx->error=1;
+      return;
     }
+    idx->sections=sections;
+    idx->capacity=capacity;
   }
-  if (res_ptr) {
-    // copy remainder
-    size_t cnt=end+3-src;
-    if (cnt) {
-      memcpy(res_ptr, src, cnt*sizeof(wchar_t));
-      res_ptr+=cnt;
+  int depth=ctx->list_level+1;
+  if (idx->lists_length+depth>idx->lists_capacity) {
+    size_t capacity=idx->lists_capacity? idx->lists_capacity*2 : MIN_SECTIONS;
+    if (capacity<idx->lists_length+depth) capacity=idx->lists_length+depth;
+    wchar_t* lists=realloc(idx->lists, capacity*sizeof(wchar_t));
+    if (!lists) {
+      idx->error=1;
+      return;
     }
-    *res_len=res_ptr-res_buf;
-    *res=res_buf;
-    return 1; // caller must free(res)
-  }
-  else { // no ~}}} sequence found
-    *res=s, *res_len=len; // pass through
-    return 0; // caller must not free(res)
+    idx->lists=lists;
+    idx->lists_capacity=capacity;
   }
+  nxcreole_section* sec=&idx->sections[idx->count++];
+  memset(sec, 0, sizeof(nxcreole_section));
+  sec->level=*s-L'0';
+  // ptr is past heading's ='s and whitespace; go back to line start
+  const wchar_t* p=ctx->ptr;
+  sec->title_start=(size_t)(p-ctx->text);
+  while (p>ctx->text && p[-1]!=L'\n') p--;
+  sec->start=(size_t)(p-ctx->text);
+  sec->lists_start=idx->lists_length;
+  sec->list_depth=depth;
+  sec->mediawiki_table_level=ctx->mediawiki_table_level;
+  wmemcpy(idx->lists+idx->lists_length, ctx->list_levels, depth);
+  idx->lists_length+=depth;
 }
 
-static void append_nowiki(nxcreole_parse_ctx* ctx, nxcreole_fn_id_t fn_id, const wchar_t* s, size_t len) {
-  // appending nowiki needs special treatment - removal of tilde in every ~}}}
-  const wchar_t* clean;
-  size_t clean_len;
-  int should_free=remove_escapes_from_nowiki(s, len, &clean, &clean_len);
-  ctx->append1(ctx, fn_id, clean, clean_len);
-  if (should_free) free((void*)clean);
+static void index_heading_end(nxcreole_parse_ctx* ctx) {
+  nxcreole_section_index* idx=ctx->data;
+  if (idx->error) return;
+  nxcreole_section* sec=&idx->sections[idx->count-1];
+  // ptr is at end of heading line; drop trailing whitespace and ='s
+  const wchar_t* title=ctx->text+sec->title_start;
+  const wchar_t* p=ctx->ptr;
+  while (p>title && p[-1]<=L' ') p--;
+  while (p>title && p[-1]==L'=') p--;
+  while (p>title && p[-1]<=L' ') p--;
+  sec->title_length=(size_t)(p-title);
 }
 
-static const wchar_t* find_delimiter(const wchar_t* p, wchar_t c) {
-  for (p=wcschr(p, c); p; p=wcschr(p+1, c)) {
-    if (p[1]==c) return p;
+static void index_append0(nxcreole_parse_ctx* ctx, nxcreole_fn_id_t fn) {
+}
+
+static void index_append1(nxcreole_parse_ctx* ctx, nxcreole_fn_id_t fn, const wchar_t* s, size_t length) {
+  if (fn==FN_APPEND_HEADING_OPEN) index_heading(ctx, s);
+  else if (fn==FN_APPEND_HEADING_CLOSE) index_heading_end(ctx);
+}
+
+int nxcreole_section_index_build(nxcreole_section_index* idx, const wchar_t* text) {
+  memset(idx, 0, sizeof(nxcreole_section_index));
+  nxcreole_parse_ctx ctx;
+  nxcreole_init(&ctx, text);
+  ctx.append0=index_append0;
+  ctx.append1=index_append1;
+  ctx.data=idx;
+  ctx.links_only=1; // no text events needed
+  nxcreole_parse_links(&ctx);
+  if (idx->error) {
+    nxcreole_section_index_free(idx);
+    return -1;
+  }
+  // section ends where next one of the same or higher level starts: stack of open sections
+  size_t* open=malloc((idx->count+1)*sizeof(size_t));
+  if (!open) {
+    nxcreole_section_index_free(idx);
+    return -1;
+  }
+  size_t i, n=0, text_length=(size_t)(ctx.ptr-text)+wcslen(ctx.ptr);
+  for (i=0; i<idx->count; i++) {
+    nxcreole_section* sec=&idx->sections[i];
+    while (n && idx->sections[open[n-1]].level>=sec->level) idx->sections[open[--n]].end=sec->start;
+    open[n++]=i;
   }
+  while (n) idx->sections[open[--n]].end=text_length;
+  free(open);
   return 0;
 }
 
-static const wchar_t* find_triple_delimiter(const wchar_t* p, wchar_t c) {
-  for (p=wcschr(p, c); p; p=wcschr(p+1, c)) {
-    if (p[1]==c && p[2]==c) return p;
+void nxcreole_section_index_free(nxcreole_section_index* idx) {
+  if (idx->sections) free(idx->sections);
+  if (idx->lists) free(idx->lists);
+  memset(idx, 0, sizeof(nxcreole_section_index));
+}
+
+int nxcreole_parse_range(nxcreole_parse_ctx* ctx, size_t start, size_t end,
+                         const wchar_t* lists, int list_depth, int mediawiki_table_level) {
+  if (list_depth>MAX_LIST_LEVELS) list_depth=MAX_LIST_LEVELS;
+  // parser works on NUL-terminated text, so range is copied
+  const wchar_t* text=ctx->text;
+  wchar_t* range=ctx->alloc(ctx->alloc_data, (end-start+1)*sizeof(wchar_t));
+  if (!range) return -1;
+  wmemcpy(range, ctx->text+start, end-start);
+  range[end-start]=L'\0';
+  const nxcreole_line_index* lines=ctx->lines; // it indexes whole text, not range
+  // scan memos and uncached_end point into text being parsed; ones left by parsing
+  // range would point into freed copy, so those of whole text are put back after it
+  nxcreole_scan_memo memos[4]={ctx->nowiki_end, ctx->image_end, ctx->link_end, ctx->placeholder_end};
+  const wchar_t* uncached_end=ctx->uncached_end;
+  ctx->text=ctx->ptr=range;
+  ctx->lines=0;
+  ctx->uncached_end=0;
+  memset(&ctx->nowiki_end, 0, sizeof(nxcreole_scan_memo));
+  memset(&ctx->image_end, 0, sizeof(nxcreole_scan_memo));
+  memset(&ctx->link_end, 0, sizeof(nxcreole_scan_memo));
+  memset(&ctx->placeholder_end, 0, sizeof(nxcreole_scan_memo));
+
+  // reopen enclosing blocks (tables are assumed to be outside of lists)
+  int i;
+  SPAN(range, range);
+  wchar_t one=L'1';
+  for (i=0; i<mediawiki_table_level; i++) {
+    APPEND0(FN_APPEND_TABLE_OPEN);
+    APPEND0(FN_APPEND_TABLE_ROW_OPEN);
+    APPEND1(FN_APPEND_TABLE_CELL_OPEN, &one, 1);
+  }
+  ctx->mediawiki_table_level=mediawiki_table_level;
+  for (i=0; i<list_depth; i++) {
+    ctx->list_levels[i]=lists[i];
+    APPEND1(FN_APPEND_LIST_OPEN, &ctx->list_levels[i], 1);
   }
+  ctx->list_level=list_depth-1;
+  if (list_depth) ctx->blockquote_br=1;
+
+  nxcreole_parse(ctx);
+
+  ctx->dealloc(ctx->alloc_data, range);
+  ctx->lines=lines;
+  ctx->nowiki_end=memos[0];
+  ctx->image_end=memos[1];
+  ctx->link_end=memos[2];
+  ctx->placeholder_end=memos[3];
+  ctx->uncached_end=uncached_end;
+  ctx->text=text;
+  ctx->ptr=text+end;
   return 0;
 }
 
-typedef enum {
-  ITEM_CTX_PARAGRAPH,
-  ITEM_CTX_LIST_ITEM,
-  ITEM_CTX_TABLE_CELL,
-  ITEM_CTX_HEADER
-} item_ctx_t;
+int nxcreole_parse_section(nxcreole_parse_ctx* ctx, const nxcreole_section_index* idx, size_t n) {
+  const nxcreole_section* sec=&idx->sections[n];
+  return nxcreole_parse_range(ctx, sec->start, sec->end, idx->lists+sec->lists_start,
+                              sec->list_depth, sec->mediawiki_table_level);
+}
 
-typedef enum {
-  END_OF_ITEM,
-  END_OF_CELL,
-  END_OF_BLOCK,
-} end_of_context_t;
+#define MIN_LINES 64
 
-#define FLUSH_TB() if (tb_ptr!=tb) {ctx->append1(ctx, FN_APPEND_TEXT, tb, tb_ptr-tb); tb_ptr=tb;}
-#define END_OF_ITEM_CONTEXT(p) {FLUSH_TB(); *end_ptr=(p); return END_OF_ITEM;}
-#define END_OF_CELL_CONTEXT(p) {FLUSH_TB(); *end_ptr=(p); return END_OF_CELL;}
-#define END_OF_BLOCK_CONTEXT(p) {FLUSH_TB(); *end_ptr=(p); return END_OF_BLOCK;}
-#define PROPAGATE_END_OF_CONTEXT(p, r) {*end_ptr=(p); return (r);}
+static int add_line(nxcreole_line_index* idx, const wchar_t* text, const wchar_t* p, int nested) {
+  if (idx->count==idx->capacity) {
+    size_t capacity=idx->capacity? idx->capacity*2 : MIN_LINES;
+    nxcreole_line* lines=realloc(idx->lines, capacity*sizeof(nxcreole_line));
+    if (!lines) return -1;
+    idx->lines=lines;
+    idx->capacity=capacity;
+  }
+  nxcreole_line* line=&idx->lines[idx->count++];
+  const wchar_t* start=p;
+  SKIP_WS(p);
+  line->start=(size_t)(start-text);
+  line->indent=(unsigned)(p-start);
+  line->nested=nested;
+  line->first=*p==L'\n'? 0 : *p;
+  return 0;
+}
 
-#define TMP_BUF_SIZE 1024
+// sweep stops at line ends and at characters that may start a span or escape one
+#define IS_STOP(c) ((c)==L'\n' || !(c) || (c)==L'{' || (c)==L'[' || (c)==L'<' || (c)==L'~')
+
+#if defined(__SSE2__) && __SIZEOF_WCHAR_T__==4
+// next stop, four characters at a time; aligned loads never cross page boundary,
+// so reading past NUL within last vector is safe
+static const wchar_t* find_stop(const wchar_t* p) {
+  while (((uintptr_t)p & 15) && !IS_STOP(*p)) p++;
+  if (((uintptr_t)p & 15) || IS_STOP(*p)) return p;
+  const __m128i nl=_mm_set1_epi32(L'\n');
+  const __m128i nul=_mm_setzero_si128();
+  const __m128i brace=_mm_set1_epi32(L'{');
+  const __m128i bracket=_mm_set1_epi32(L'[');
+  const __m128i lt=_mm_set1_epi32(L'<');
+  const __m128i tilde=_mm_set1_epi32(L'~');
+  for (;; p+=4) {
+    __m128i v=_mm_load_si128((const __m128i*)p);
+    __m128i m=_mm_or_si128(_mm_or_si128(_mm_cmpeq_epi32(v, nl), _mm_cmpeq_epi32(v, nul)),
+                           _mm_or_si128(_mm_cmpeq_epi32(v, brace), _mm_cmpeq_epi32(v, bracket)));
+    m=_mm_or_si128(m, _mm_or_si128(_mm_cmpeq_epi32(v, lt), _mm_cmpeq_epi32(v, tilde)));
+    int mask=_mm_movemask_epi8(m);
+    if (mask) return p+(__builtin_ctz((unsigned)mask)>>2);
+  }
+}
+#else
+static const wchar_t* find_stop(const wchar_t* p) {
+  while (!IS_STOP(*p)) p++;
+  return p;
+}
+#endif
+
+// nowiki (0), image (1), link (2) or placeholder (3) starting at p; -1 if none
+static int span_kind(const wchar_t* p) {
+  if (p[0]==L'{' && p[1]==L'{') return p[2]==L'{'? 0:1;
+  if (p[0]==L'[' && p[1]==L'[') return 2;
+  if (p[0]==L'<' && p[1]==L'<' && p[2]==L'<') return 3;
+  return -1;
+}
 
-static end_of_context_t parse_item(nxcreole_parse_ctx* ctx, const wchar_t* ptr, const wchar_t** end_ptr, wchar_t delimiter, item_ctx_t item_ctx) {
-  wchar_t tb[TMP_BUF_SIZE], *tb_ptr=tb, *tb_end=tb+TMP_BUF_SIZE;
-  // const wchar_t* start_ptr=ptr;
+// end of span by the same rules as parser's scans (0 if it is not closed)
+static const wchar_t* find_span_end(const wchar_t* p, int kind) {
+  static const wchar_t closing[]={L'}', L'}', L']', L'>'};
+  wchar_t c=closing[kind];
+  int width=kind==0 || kind==3? 3:2;
+  const wchar_t* q;
+  for (q=wcschr(p+width, c); q; q=wcschr(q+1, c)) {
+    if (kind==0 && q[-1]==L'~') continue;
+    if (q[1]==c && (width==2 || q[2]==c)) return q+width;
+  }
+  return 0;
+}
 
-  for (;;) {
-    wchar_t c=*ptr;
-    if (!c) END_OF_BLOCK_CONTEXT(ptr); // eot
-    if (c==delimiter && ptr[1]==delimiter) END_OF_ITEM_CONTEXT(ptr+2);
-
-    int at_line_start=0;
-    if (c==L'\n') {
-      at_line_start=1;
-      if (item_ctx==ITEM_CTX_HEADER || item_ctx==ITEM_CTX_TABLE_CELL)
-        END_OF_BLOCK_CONTEXT(ptr);
-      ptr++; SKIP_WS(ptr);
-      c=*ptr;
-      if (!c) END_OF_BLOCK_CONTEXT(ptr); // eot
-      if (c==L'\n') // \n\n => blank line delimits everything
-        END_OF_BLOCK_CONTEXT(ptr); // leave second \n unparsed so parse_block() can close all lists
-
-      // special handling at line start
-      if (IS_LIST_CHAR(c)) { // start of list item?
-        if (!IS_FORMAT_CHAR(c)) END_OF_BLOCK_CONTEXT(ptr);
-        // here we have a list char, which also happen to be a format char
-        if (ptr[1]!=c) END_OF_BLOCK_CONTEXT(ptr); // format chars go in pairs
-        if (ctx->list_level>=0 && c==ctx->list_levels[0])
-          // c matches current list's first level, so it must be new list item
-          END_OF_BLOCK_CONTEXT(ptr);
-        // otherwise it must be just formatting sequence => no break of context
-      }
+static int is_line_end(const wchar_t* p) {
+  SKIP_WS(p);
+  return !*p || *p==L'\n';
+}
 
-      switch (c) {
-        case L'=': // heading
-        case L'|': // table or mediawiki table
-          END_OF_BLOCK_CONTEXT(ptr);
-        case L'{': // start of mediawiki table?
-          if (ptr[1]==L'|') {
-            const wchar_t* p=ptr+2;
-            SKIP_WS(p);
-            if (!*p || *p==L'\n') END_OF_BLOCK_CONTEXT(ptr); // yes, it's start of a table
-          }
-          break;
-/*
-        case L'-': // can be ---- <hr>, but '-' is list char, so it's been handled already
-          if (ptr[1]==L'-' && ptr[2]==L'-' && ptr[3]==L'-') {
-            const wchar_t* p=ptr+4;
-            SKIP_WS(p);
-            if (!*p || *p==L'\n') END_OF_BLOCK_CONTEXT(ptr); // yes, it's <hr>
-          }
-          break;
-*/
-      }
-      // if none matched add '\n' to text buffer
-      *tb_ptr++=L'\n';
-      if (tb_ptr==tb_end) FLUSH_TB();
-      // ptr and c already shifted past the '\n' and whitespace after, so go on
-    }
+// lines inside mediawiki tables are not split points either
+static void mark_tables(nxcreole_line_index* idx, const wchar_t* text) {
+  int table_level=0;
+  size_t n;
+  for (n=0; n<idx->count; n++) {
+    nxcreole_line* line=&idx->lines[n];
+    if (line->nested) continue;
+    if (table_level) line->nested=1;
+    const wchar_t* p=text+line->start+line->indent;
+    if (p[0]==L'{' && p[1]==L'|' && is_line_end(p+2)) table_level++;
+    else if (table_level && p[0]==L'|' && p[1]==L'}' && is_line_end(p+2)) table_level--;
+  }
+}
 
-    if (IS_FORMAT_CHAR(c) && ptr[1]==c) { // double format character
-      FLUSH_TB();
-      ctx->append1(ctx, FN_APPEND_FORMAT_OPEN, &c, 1);
-      end_of_context_t res=parse_item(ctx, ptr+2, &ptr, c, item_ctx);
-      ctx->append1(ctx, FN_APPEND_FORMAT_CLOSE, &c, 1);
-      if (res!=END_OF_ITEM) PROPAGATE_END_OF_CONTEXT(ptr, res); // propagate EOC to the top
-      continue;
+int nxcreole_line_index_build(nxcreole_line_index* idx, const wchar_t* text) {
+  memset(idx, 0, sizeof(nxcreole_line_index));
+  const wchar_t* p=text;
+  const wchar_t* span_end=text; // lines starting before it are inside multiline span
+  int unclosed[4]={0, 0, 0, 0}; // once span is not closed, later ones of that kind are not either
+  for (;;) {
+    if (add_line(idx, text, p, p<span_end)) {
+      nxcreole_line_index_free(idx);
+      return -1;
     }
-
-    switch (c) {
-      case L'|':
-        if (item_ctx==ITEM_CTX_TABLE_CELL) END_OF_CELL_CONTEXT(ptr);
-        break;
-      case L'{':
-        if (ptr[1]==L'{') {
-          if (ptr[2]==L'{') { // inline {{{nowiki}}}
-            const wchar_t* start_of_nowiki=ptr+3;
-            const wchar_t* end_of_nowiki=find_end_of_nowiki(start_of_nowiki);
-            const wchar_t* next_ptr=end_of_nowiki+3;
-            if (end_of_nowiki) {
-              FLUSH_TB();
-              wchar_t* newline=wcschr(start_of_nowiki, L'\n');
-              if (newline && newline<end_of_nowiki) { // block <pre>
-                SKIP_WS(start_of_nowiki);
-                if (start_of_nowiki[0]==L'\n') start_of_nowiki++; // eat first newline
-                if (end_of_nowiki[-1]==L'\n') end_of_nowiki--; // eat last newline
-                if (end_of_nowiki>start_of_nowiki) { // non-empty
-                  if (item_ctx==ITEM_CTX_PARAGRAPH) ctx->append0(ctx, FN_APPEND_PARAGRAPH_CLOSE); // break the paragraph because XHTML does not allow <pre> children of <p>
-                  append_nowiki(ctx, FN_APPEND_NOWIKI_BLOCK, start_of_nowiki, end_of_nowiki-start_of_nowiki);
-                  if (item_ctx==ITEM_CTX_PARAGRAPH) ctx->append0(ctx, FN_APPEND_PARAGRAPH_OPEN);
-                }
-              }
-              else { // inline {{{nowiki}}}
-                append_nowiki(ctx, FN_APPEND_NOWIKI_INLINE, start_of_nowiki, end_of_nowiki-start_of_nowiki);
-              }
-              ptr=next_ptr;
-              continue;
-            }
-          }
-          else { // {{image}}
-            const wchar_t* start_of_image=ptr+2;
-            const wchar_t* end_of_image=find_delimiter(start_of_image, L'}');
-            if (end_of_image) {
-              FLUSH_TB();
-              ptr=end_of_image+2;
-              ctx->append1(ctx, FN_APPEND_IMAGE, start_of_image, end_of_image-start_of_image);
-              continue;
-            }
-          }
-        }
-        break;
-      case L'[':
-        if (ptr[1]==L'[') {
-          const wchar_t* start_of_link=ptr+2;
-          const wchar_t* end_of_link=find_delimiter(start_of_link, L']');
-          if (end_of_link) {
-            FLUSH_TB();
-            ptr=end_of_link+2;
-            ctx->append1(ctx, FN_APPEND_LINK, start_of_link, end_of_link-start_of_link);
-            continue;
-          }
-        }
-        break;
-      case L'\\':
-        if (ptr[1]==L'\\') {
-          FLUSH_TB();
-          ctx->append0(ctx, FN_APPEND_BR);
-          ptr+=2;
-          continue;
-        }
-        break;
-      case L'<':
-        if (ptr[1]==L'<') {
-          if (ptr[2]==L'<') { // <<<placeholder>>>
-            const wchar_t* start_of_placeholder=ptr+3;
-            const wchar_t* end_of_placeholder=find_triple_delimiter(start_of_placeholder, L'>');
-            if (end_of_placeholder) {
-              FLUSH_TB();
-              ptr=end_of_placeholder+3;
-              ctx->append1(ctx, FN_APPEND_PLACEHOLDER, start_of_placeholder, end_of_placeholder-start_of_placeholder);
-              continue;
-            }
-          }
-        }
-        break;
-      case L'=': // heading trailer?
-        if (item_ctx==ITEM_CTX_HEADER) {
-          // check if it is at the end of line
-          const wchar_t* p=ptr+1;
-          while (*p==L'=') p++;
-          SKIP_WS(p);
-          if (!*p || *p==L'\n') { // yes, this is trailer
-            while (tb_ptr>tb && tb_ptr[-1]<=L' ') tb_ptr--; // undo trailing spaces
-            END_OF_BLOCK_CONTEXT(p);
-          }
-        }
-        break;
-      case L'~': // escape
-      { // some escapes are dealt with on a block level
-        wchar_t nc=ptr[1];
-        if ((at_line_start && (IS_LIST_CHAR(nc) || nc==L'=' || nc==L'|' || nc=='{')) // these are escaped at line start only
-            || (IS_FORMAT_CHAR(nc) && ptr[2]==nc) // these are escaped in pairs only
-            || ((nc==L'{' || nc==L'[' || nc==L'\\' || nc==L'<' || nc==L'-') && ptr[2]==nc) // these are escaped in pairs only
-            || nc==L'~') { // escape tilde itself
-          // skip tilde and go ahead
-          c=nc;
-          ptr++;
-        }
-        break;
+    for (;; p++) {
+      p=find_stop(p);
+      if (!*p || *p==L'\n') break;
+      if (p<span_end) continue;
+      if (*p==L'~') { // escaped character
+        if (p[1] && p[1]!=L'\n') p++;
+        continue;
       }
-      case L':': // http://... URL?
-        // examine tb buffer for http
-        if (tb_ptr>=tb+4 && ptr[-4]==L'h' && ptr[-3]==L't' && ptr[-2]==L't' && ptr[-1]==L'p' && ptr[1]==L'/' && ptr[2]==L'/') {
-          // http:// prefix recognized
-          if (tb_ptr>=tb+5 && ptr[-5]==L'~') { // but it is escaped
-            // eat tilde
-            memmove(tb_ptr-5, tb_ptr-4, 4*sizeof(wchar_t));
-            tb_ptr--;
-            // copy '://' straight into tb so it's not considered italics
-            if (tb_ptr+3>=tb_end) FLUSH_TB();
-            *tb_ptr++=L':'; *tb_ptr++=L'/'; *tb_ptr++=L'/';
-            ptr+=3;
-            continue;
-          }
-          else {
-            const wchar_t* start_of_link=ptr-4;
-            const wchar_t* end_of_link=ptr+3;
-            while (IS_URL_CHAR(*end_of_link)) end_of_link++;
-            while (wcschr(L",.;:?!%)", end_of_link[-1])) end_of_link--; // don't want these chars at the end of URI
-            if (end_of_link>start_of_link+7) {
-              tb_ptr-=4; // undo "http" from buffer
-              FLUSH_TB();
-              ptr=end_of_link;
-              ctx->append1(ctx, FN_APPEND_LINK, start_of_link, end_of_link-start_of_link);
-              continue;
-            }
-          }
-        }
-        break;
-      case L'-': // -- dash?
-        if (tb_ptr>tb && tb_ptr[-1]==L' ' && ptr[1]==L'-' && ptr[2]==L' ') {
-          c=L'–'; // &ndash;
-          ptr++; // skip one '-'
-        }
-        break;
+      int kind=span_kind(p);
+      if (kind<0 || unclosed[kind]) continue;
+      const wchar_t* end=find_span_end(p, kind);
+      if (end) span_end=end;
+      else unclosed[kind]=1;
     }
-
-    *tb_ptr++=c;
-    if (tb_ptr==tb_end) FLUSH_TB();
-    ptr++;
+    if (!*p) break;
+    p++;
   }
-  assert(0); // not reachable
+  idx->length=(size_t)(p-text);
+  mark_tables(idx, text);
+  return 0;
 }
 
-static const wchar_t* parse_table_row(nxcreole_parse_ctx* ctx, const wchar_t* ptr) {
-  ctx->append0(ctx, FN_APPEND_TABLE_ROW_OPEN);
-  for (;;) {
-    assert(*ptr==L'|'); // points to opening '|' of the cell
-    int colspan=1, th=0;
-    while (*++ptr==L'|') colspan++;
-    if (*ptr==L'=') {
-      th=1;
-      ptr++;
-    }
-    SKIP_WS(ptr);
-    if (!*ptr) break; // eot
-    if (*ptr==L'\n') { // eat last '|' on the line
-      ptr++;
-      break;
-    }
-    if (colspan>99) colspan=99;
-    wchar_t cs[2];
-    int cs_len;
-    if (colspan<10) { cs[0]=L'0'+colspan; cs_len=1; }
-    else { cs[0]=L'0'+colspan/10; cs[1]=L'0'+colspan%10; cs_len=2; }
-    ctx->append1(ctx, th? FN_APPEND_TABLE_HEAD_CELL_OPEN:FN_APPEND_TABLE_CELL_OPEN, cs, (size_t)cs_len);
-    end_of_context_t res=parse_item(ctx, ptr, &ptr, 0, ITEM_CTX_TABLE_CELL);
-    ctx->append0(ctx, th? FN_APPEND_TABLE_HEAD_CELL_CLOSE:FN_APPEND_TABLE_CELL_CLOSE);
-    if (res==END_OF_BLOCK) break;
+void nxcreole_line_index_free(nxcreole_line_index* idx) {
+  if (idx->lines) free(idx->lines);
+  memset(idx, 0, sizeof(nxcreole_line_index));
+}
+
+size_t nxcreole_line_index_find(const nxcreole_line_index* idx, size_t offset) {
+  size_t lo=0, hi=idx->count;
+  while (hi-lo>1) {
+    size_t mid=lo+(hi-lo)/2;
+    if (idx->lines[mid].start<=offset) lo=mid;
+    else hi=mid;
   }
-  ctx->append0(ctx, FN_APPEND_TABLE_ROW_CLOSE);
-  return ptr;
+  return lo;
 }
 
-static const wchar_t* parse_list_item(nxcreole_parse_ctx* ctx, const wchar_t* ptr) {
-  SKIP_WS(ptr);
-  if (*ptr==L'\n') { // empty line within list (blockquote/div/...)
-    if (!ctx->blockquote_br) {
-      ctx->append1(ctx, FN_APPEND_LIST_BLANK_ITEM, &ctx->list_levels[ctx->list_level], 1);
-      ctx->blockquote_br=1;
-    }
-    return ptr+1;
+size_t nxcreole_line_index_next_blank(const nxcreole_line_index* idx, size_t n) {
+  while (n<idx->count && (idx->lines[n].first || idx->lines[n].nested)) n++;
+  return n;
+}
+
+#define MIN_BLOCK_BUCKETS 64
+#define BLOCK_BUCKET_SIZE 4096 // expected bytes of cache per hash bucket
+#define MAX_BLOCK_SHARE 4 // blocks bigger than max_size/MAX_BLOCK_SHARE are not cached
+#define MIN_BLOCK_EVENTS 64
+#define MIN_BLOCK_PAYLOAD 1024
+
+int nxcreole_block_cache_init(nxcreole_block_cache* cache, size_t max_size) {
+  memset(cache, 0, sizeof(nxcreole_block_cache));
+  size_t n=MIN_BLOCK_BUCKETS;
+  while (n<max_size/BLOCK_BUCKET_SIZE) n*=2;
+  cache->buckets=calloc(n, sizeof(nxcreole_block*));
+  cache->seen=calloc(n, sizeof(size_t));
+  if (!cache->buckets || !cache->seen) {
+    nxcreole_block_cache_free(cache);
+    return -1;
   }
-  else {
-    ctx->blockquote_br=0;
-    const wchar_t* end_ptr;
-    parse_item(ctx, ptr, &end_ptr, 0, ITEM_CTX_LIST_ITEM);
-    return end_ptr;
+  cache->bucket_count=n;
+  cache->max_size=max_size;
+  return 0;
+}
+
+static void free_block(nxcreole_block* b) {
+  if (b->fragment) free(b->fragment);
+  free(b);
+}
+
+void nxcreole_block_cache_free(nxcreole_block_cache* cache) {
+  nxcreole_block* b=cache->lru_first;
+  while (b) {
+    nxcreole_block* next=b->lru_next;
+    free_block(b);
+    b=next;
   }
+  if (cache->buckets) free(cache->buckets);
+  if (cache->seen) free(cache->seen);
+  if (cache->events) free(cache->events);
+  if (cache->payload) free(cache->payload);
+  memset(cache, 0, sizeof(nxcreole_block_cache));
+}
+
+// FNV-1a over block text and state it is parsed in
+static size_t block_hash(const wchar_t* s, size_t length, int mediawiki_table_level, int blockquote_br) {
+  unsigned long long h=14695981039346656037ull;
+  const wchar_t* end=s+length;
+  for (; s<end; s++) h=(h^(unsigned)*s)*1099511628211ull;
+  h=(h^(unsigned)(mediawiki_table_level*2+blockquote_br))*1099511628211ull;
+  return (size_t)(h^h>>32);
+}
+
+static void lru_unlink(nxcreole_block_cache* cache, nxcreole_block* b) {
+  if (b->lru_prev) b->lru_prev->lru_next=b->lru_next;
+  else cache->lru_first=b->lru_next;
+  if (b->lru_next) b->lru_next->lru_prev=b->lru_prev;
+  else cache->lru_last=b->lru_prev;
+}
+
+static void lru_push(nxcreole_block_cache* cache, nxcreole_block* b) {
+  b->lru_prev=0;
+  b->lru_next=cache->lru_first;
+  if (cache->lru_first) cache->lru_first->lru_prev=b;
+  else cache->lru_last=b;
+  cache->lru_first=b;
+}
+
+static void evict_block(nxcreole_block_cache* cache) {
+  nxcreole_block* b=cache->lru_last;
+  nxcreole_block** pb=&cache->buckets[b->hash&(cache->bucket_count-1)];
+  while (*pb!=b) pb=&(*pb)->next;
+  *pb=b->next;
+  lru_unlink(cache, b);
+  cache->size-=b->size;
+  cache->count--;
+  cache->stats.evictions++;
+  free_block(b);
+}
+
+// in characters
+size_t nxcreole_block_max_length(const nxcreole_block_cache* cache) {
+  return cache->max_size/MAX_BLOCK_SHARE/sizeof(wchar_t);
 }
 
-static int parse_block(nxcreole_parse_ctx* ctx) {
-  SKIP_WS(ctx->ptr);
-  wchar_t c=*ctx->ptr;
-  if (!c) return 0; // eot
-  if (c==L'\n') { // blank line => end of list/table; no other meaning
-    close_lists_and_tables(ctx);
-    ctx->ptr++;
-    return 1;
+nxcreole_block* nxcreole_block_find(nxcreole_parse_ctx* ctx, const wchar_t* start, size_t length, int* record) {
+  nxcreole_block_cache* cache=ctx->blocks;
+  *record=0;
+  if (length>nxcreole_block_max_length(cache)) {
+    cache->stats.uncacheable++;
+    return 0;
   }
-  if (c==L'|') { // table
-    if (ctx->mediawiki_table_level>0) {
-      const wchar_t* p=ctx->ptr+1;
-      wchar_t nc=*p;
-      if (nc==L'-' || nc==L'}') p++;
-      SKIP_WS(p);
-      if (!*p) return 0; // table should auto-close on eot
-      if (*p==L'\n') { // nothing else on the line => it's mediawiki-table markup
-        close_lists_and_tables(ctx);
-        ctx->append0(ctx, FN_APPEND_TABLE_CELL_CLOSE);
-        wchar_t one=L'1';
-        if (nc==L'-') { // next row
-          ctx->append0(ctx, FN_APPEND_TABLE_ROW_CLOSE);
-          ctx->append0(ctx, FN_APPEND_TABLE_ROW_OPEN);
-          ctx->append1(ctx, FN_APPEND_TABLE_CELL_OPEN, &one, 1);
-        }
-        else if (nc==L'}') { // end of table
-          ctx->append0(ctx, FN_APPEND_TABLE_ROW_CLOSE);
-          ctx->append0(ctx, FN_APPEND_TABLE_CLOSE);
-          ctx->mediawiki_table_level--;
-        }
-        else { // next cell
-          ctx->append1(ctx, FN_APPEND_TABLE_CELL_OPEN, &one, 1);
-        }
-        ctx->ptr=p+1;
-        return 1;
+  size_t hash=block_hash(start, length, ctx->mediawiki_table_level, ctx->blockquote_br);
+  size_t i=hash&(cache->bucket_count-1);
+  nxcreole_block* b;
+  for (b=cache->buckets[i]; b; b=b->next) {
+    if (b->hash==hash && b->length==length && b->mediawiki_table_level==ctx->mediawiki_table_level
+        && b->blockquote_br==ctx->blockquote_br && !wmemcmp(b->text, start, length)) {
+      if (b!=cache->lru_first) {
+        lru_unlink(cache, b);
+        lru_push(cache, b);
       }
+      cache->stats.hits++;
+      return b;
     }
-    if (!ctx->in_table) {
-      close_lists_and_tables(ctx);
-      ctx->append0(ctx, FN_APPEND_TABLE_OPEN);
-      ctx->in_table=1;
-    }
-    ctx->ptr=parse_table_row(ctx, ctx->ptr);
-    return 1;
-  }
-  else if (ctx->in_table) {
-    close_lists_and_tables(ctx);
   }
+  cache->stats.misses++;
+  // record on second sighting
+  *record=cache->seen[i]==hash;
+  cache->seen[i]=hash;
+  cache->hash=hash;
+  return 0;
+}
 
-  switch (c) {
-    case L'=': // heading
-      {
-        int heading_level=1;
-        while (ctx->ptr[heading_level]==L'=') heading_level++;
-        ctx->ptr+=heading_level;
-        SKIP_WS(ctx->ptr);
-        if (!*ctx->ptr) return 0; // eot
-        wchar_t h=L'0'+heading_level;
-        ctx->append1(ctx, FN_APPEND_HEADING_OPEN, &h, 1);
-        parse_item(ctx, ctx->ptr, &ctx->ptr, 0, ITEM_CTX_HEADER);
-        ctx->append1(ctx, FN_APPEND_HEADING_CLOSE, &h, 1);
-        return 1;
-      }
-    case L'{': // nowiki block?
-      if (ctx->ptr[1]==L'{' && ctx->ptr[2]==L'{') {
-        const wchar_t* start_of_nowiki=ctx->ptr+3;
-        const wchar_t* end_of_nowiki=find_end_of_nowiki(start_of_nowiki);
-        const wchar_t* next_ptr=end_of_nowiki+3;
-        if (end_of_nowiki) {
-          wchar_t* newline=wcschr(start_of_nowiki, L'\n');
-          if (newline && newline<end_of_nowiki) { // block <pre>
-            SKIP_WS(start_of_nowiki);
-            if (start_of_nowiki[0]==L'\n') start_of_nowiki++; // eat first newline
-            if (end_of_nowiki[-1]==L'\n') end_of_nowiki--; // eat last newline
-            if (end_of_nowiki>start_of_nowiki) { // non-empty
-              append_nowiki(ctx, FN_APPEND_NOWIKI_BLOCK, start_of_nowiki, end_of_nowiki-start_of_nowiki);
-            }
-            ctx->ptr=next_ptr;
-            return 1;
-          }
-          // else inline <nowiki> - proceed to regular paragraph handling
-        }
-      }
-      else if (ctx->ptr[1]==L'|') { // mediawiki-table?
-        const wchar_t* p=ctx->ptr+2;
-        SKIP_WS(p);
-        // if (!*p) ... // no point in opening table on eot => treat literally
-        if (*p==L'\n') { // yes, it's start of a table
-          wchar_t one=L'1';
-          ctx->append0(ctx, FN_APPEND_TABLE_OPEN);
-          ctx->append0(ctx, FN_APPEND_TABLE_ROW_OPEN);
-          ctx->append1(ctx, FN_APPEND_TABLE_CELL_OPEN, &one, 1);
-          ctx->mediawiki_table_level++;
-          ctx->ptr=p+1;
-          return 1;
-        }
-      }
-      break;
-    case L'-': // hr?
-      if (ctx->ptr[1]==L'-' && ctx->ptr[2]==L'-' && ctx->ptr[3]==L'-') {
-        const wchar_t* p=ctx->ptr+4;
-        SKIP_WS(p);
-        if (!*p || *p==L'\n') { // yes, it's <hr>
-          ctx->append0(ctx, FN_APPEND_HR);
-          ctx->ptr=p;
-          return 1;
-        }
-      }
-      break;
-    case L'~': // block-level escaping
-      {
-        wchar_t nc=ctx->ptr[1];
-        if (IS_LIST_CHAR(nc) || nc==L'=' || nc==L'|' || nc==L'{') {
-          ctx->ptr++; // skip '~' and proceed to regular paragraph handling
-        }
-        // otherwise escaping will be done at line level
-      }
-      break;
-  }
+void nxcreole_block_record_start(nxcreole_parse_ctx* ctx, const wchar_t* end) {
+  nxcreole_block_cache* cache=ctx->blocks;
+  cache->event_count=cache->payload_length=0;
+  cache->record_error=0;
+  cache->entry_offset=(size_t)(ctx->ptr-ctx->text);
+  cache->entry_mediawiki_table_level=ctx->mediawiki_table_level;
+  cache->entry_blockquote_br=ctx->blockquote_br;
+  ctx->block_end=end;
+  ctx->block_leaked=0;
+  ctx->recording=1;
+}
 
-  if (ctx->list_level>=0 || IS_LIST_CHAR(c)) { // lists
-    int lc;
-    // count list level
-    for (lc=0; lc<=ctx->list_level && ctx->ptr[lc]==ctx->list_levels[lc]; lc++);
-    if (!ctx->ptr[lc]) return 0; // eot
-    if (lc<=ctx->list_level) { // close list block(s)
-      do {
-        ctx->append1(ctx, FN_APPEND_LIST_CLOSE, &ctx->list_levels[ctx->list_level--], 1);
-      } while (lc<=ctx->list_level);
-      // list(s) closed => retry from the same position
-      ctx->blockquote_br=1;
-      return 1;
-    }
-    else {
-      wchar_t cc=ctx->ptr[lc];
-      if (IS_LIST_CHAR(cc) && ctx->ptr[lc+1]!=cc /* not formatting chars */ && ctx->list_level<MAX_LIST_LEVELS) {
-        // new list block
-        ctx->list_levels[++ctx->list_level]=cc;
-        ctx->blockquote_br=1;
-        ctx->append1(ctx, FN_APPEND_LIST_OPEN, &cc, 1);
-        ctx->ptr=parse_list_item(ctx, ctx->ptr+lc+1);
-        return 1;
-      }
-      else if (ctx->list_level>=0) { // list item - same level
-        ctx->append1(ctx, FN_APPEND_LIST_NEXT_ITEM, &ctx->list_levels[ctx->list_level], 1);
-        ctx->ptr=parse_list_item(ctx, ctx->ptr+lc);
-        return 1;
-      }
+void nxcreole_block_record(nxcreole_parse_ctx* ctx, int fn, const wchar_t* s, size_t length) {
+  nxcreole_block_cache* cache=ctx->blocks;
+  if (cache->record_error) return;
+  if (cache->event_count==cache->event_capacity) {
+    size_t capacity=cache->event_capacity? cache->event_capacity*2 : MIN_BLOCK_EVENTS;
+    nxcreole_block_event* events=realloc(cache->events, capacity*sizeof(nxcreole_block_event));
+    if (!events) {
+      cache->record_error=1;
+      return;
     }
+    cache->events=events;
+    cache->event_capacity=capacity;
   }
-
-  { // paragraph handling
-    ctx->append0(ctx, FN_APPEND_PARAGRAPH_OPEN);
-    parse_item(ctx, ctx->ptr, &ctx->ptr, 0, ITEM_CTX_PARAGRAPH);
-    ctx->append0(ctx, FN_APPEND_PARAGRAPH_CLOSE);
-    return 1;
+  if (cache->payload_length+length>cache->payload_capacity) {
+    size_t capacity=cache->payload_capacity? cache->payload_capacity*2 : MIN_BLOCK_PAYLOAD;
+    while (capacity<cache->payload_length+length) capacity*=2;
+    wchar_t* payload=realloc(cache->payload, capacity*sizeof(wchar_t));
+    if (!payload) {
+      cache->record_error=1;
+      return;
+    }
+    cache->payload=payload;
+    cache->payload_capacity=capacity;
   }
+  nxcreole_block_event* e=&cache->events[cache->event_count++];
+  e->fn=fn;
+  e->payload=cache->payload_length;
+  e->length=length;
+  // spans are meaningful only if parser is compiled with NXCREOLE_SPANS; recorded anyway
+  e->span_start=ctx->span_start-cache->entry_offset;
+  e->span_end=ctx->span_end-cache->entry_offset;
+  if (length) wmemcpy(cache->payload+cache->payload_length, s, length);
+  cache->payload_length+=length;
 }
 
-void nxcreole_init(nxcreole_parse_ctx* ctx, const wchar_t* text) {
-  memset(ctx, 0, sizeof(nxcreole_parse_ctx));
-  ctx->ptr=text;
-  ctx->list_level=-1;
+nxcreole_block* nxcreole_block_record_finish(nxcreole_parse_ctx* ctx, const wchar_t* start, size_t length, int more) {
+  nxcreole_block_cache* cache=ctx->blocks;
+  size_t consumed=(size_t)(ctx->ptr-start);
+  int lists=ctx->list_level+1;
+  size_t size=sizeof(nxcreole_block)+cache->event_count*sizeof(nxcreole_block_event)
+              +(length+cache->payload_length+lists)*sizeof(wchar_t);
+  ctx->recording=0;
+  // stopped short of block end only if parsing stopped for good
+  if (cache->record_error || ctx->block_leaked || consumed>length || (consumed<length && more)
+      || size>cache->max_size/MAX_BLOCK_SHARE) {
+    cache->stats.uncacheable++;
+    return 0;
+  }
+  while (cache->size+size>cache->max_size) evict_block(cache);
+  nxcreole_block* b=malloc(size);
+  if (!b) return 0;
+  nxcreole_block_event* events=(nxcreole_block_event*)(b+1);
+  wchar_t* text=(wchar_t*)(events+cache->event_count);
+  wchar_t* payload=text+length;
+  wchar_t* exit_list_levels=payload+cache->payload_length;
+  if (cache->event_count) memcpy(events, cache->events, cache->event_count*sizeof(nxcreole_block_event));
+  wmemcpy(text, start, length);
+  if (cache->payload_length) wmemcpy(payload, cache->payload, cache->payload_length);
+  if (lists) wmemcpy(exit_list_levels, ctx->list_levels, lists);
+  b->hash=cache->hash;
+  b->size=size;
+  b->length=length;
+  b->consumed=consumed;
+  b->text=text;
+  b->events=events;
+  b->event_count=cache->event_count;
+  b->payload=payload;
+  b->fragment=0;
+  b->fragment_length=0;
+  b->fragment_tag=0;
+  b->mediawiki_table_level=cache->entry_mediawiki_table_level;
+  b->blockquote_br=cache->entry_blockquote_br;
+  b->more=more;
+  b->exit_in_table=ctx->in_table;
+  b->exit_blockquote_br=ctx->blockquote_br;
+  b->exit_mediawiki_table_level=ctx->mediawiki_table_level;
+  b->exit_list_level=ctx->list_level;
+  b->exit_list_levels=exit_list_levels;
+  nxcreole_block** bucket=&cache->buckets[b->hash&(cache->bucket_count-1)];
+  b->next=*bucket;
+  *bucket=b;
+  lru_push(cache, b);
+  cache->size+=size;
+  cache->count++;
+  cache->stats.stores++;
+  return b;
 }
 
-void nxcreole_parse(nxcreole_parse_ctx* ctx) {
-
-  while (parse_block(ctx));
-
-  close_lists_and_tables(ctx);
-
-  while (ctx->mediawiki_table_level-->0) {
-    // append("</td></tr></table>\n");
-    ctx->append0(ctx, FN_APPEND_TABLE_CELL_CLOSE);
-    ctx->append0(ctx, FN_APPEND_TABLE_ROW_CLOSE);
-    ctx->append0(ctx, FN_APPEND_TABLE_CLOSE);
+// b is most recently used entry (just found or stored)
+void nxcreole_block_set_fragment(nxcreole_parse_ctx* ctx, nxcreole_block* b, const char* s, size_t length) {
+  nxcreole_block_cache* cache=ctx->blocks;
+  if (b->fragment) {
+    free(b->fragment);
+    b->fragment=0;
+    b->size-=b->fragment_length;
+    cache->size-=b->fragment_length;
   }
+  if (b->size+length>cache->max_size/MAX_BLOCK_SHARE) return;
+  while (cache->size+length>cache->max_size && cache->lru_last!=b) evict_block(cache);
+  if (cache->size+length>cache->max_size) return;
+  char* fragment=malloc(length? length:1);
+  if (!fragment) return;
+  memcpy(fragment, s, length);
+  b->fragment=fragment;
+  b->fragment_length=length;
+  b->fragment_tag=ctx->fragments->tag;
+  b->size+=length;
+  cache->size+=length;
 }
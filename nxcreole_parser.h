@@ -48,25 +48,292 @@ typedef enum {
   FN_APPEND_IMAGE,
   FN_APPEND_LINK,
   FN_APPEND_PLACEHOLDER,
-  FN_COUNT
+  FN_COUNT,
+  // composite events: parser never emits them, fusion layer (see nxcreole_fuse.h)
+  // does so for serializers that ask for them
+  FN_APPEND_TABLE_CELL_NEXT=FN_COUNT, // cell close and next cell open; payload is colspan
+  FN_APPEND_TABLE_HEAD_CELL_NEXT, // same for head cells
+  FN_APPEND_TABLE_ROW_NEXT, // row close and next row open
+  FN_APPEND_LIST_CLOSE_RUN, // several list closes; payload is list kinds, innermost first
+  FN_FUSED_COUNT
 } nxcreole_fn_id_t;
 
 #define MAX_LIST_LEVELS 128
+#define MAX_FORMAT_LEVELS 32
+
+// which work limit was hit (see max_* fields of nxcreole_parse_ctx)
+typedef enum {
+  NXCREOLE_LIMIT_NONE,
+  NXCREOLE_LIMIT_NESTING, // deeper lists and formatting were left as plain text; parsing went on
+  NXCREOLE_LIMIT_SCAN, // these stop parsing: open blocks are closed, rest of text goes as plain text
+  NXCREOLE_LIMIT_EVENTS,
+  NXCREOLE_LIMIT_OUTPUT // same, but rest of text is dropped
+} nxcreole_limit_t;
+
+typedef struct nxcreole_scan_memo {
+  const wchar_t* from; // where last forward scan started (0 if there was none)
+  const wchar_t* found; // what it found (0 if delimiter does not occur till end of text)
+} nxcreole_scan_memo;
+
+/*
+ * Line index: start of every line with its indentation and first non-whitespace
+ * character, built in one (SSE2 where available) sweep over text. Parser given
+ * the index (ctx->lines) uses only start and indent, taking line-start whitespace
+ * skipping from it instead of rescanning. The rest is for callers splitting text into
+ * chunks for nxcreole_parse_range(): blank lines close paragraphs, lists and tables, so
+ * they are split points unless nested, i.e. inside multiline nowiki, link, image or
+ * placeholder, or inside mediawiki table (found by the same rules as parser uses,
+ * erring on nested side). Offsets are in wchar_t units.
+ */
+typedef struct nxcreole_line {
+  size_t start;
+  unsigned indent:31; // whitespace characters before first non-whitespace one
+  unsigned nested:1; // line is inside a span or mediawiki table, see above
+  wchar_t first; // first non-whitespace character; 0 for blank line (and for last line if empty)
+} nxcreole_line;
+
+typedef struct nxcreole_line_index {
+  nxcreole_line* lines;
+  size_t count;
+  size_t capacity;
+  size_t length; // of text
+} nxcreole_line_index;
+
+int nxcreole_line_index_build(nxcreole_line_index* idx, const wchar_t* text); // returns -1 if out of memory
+void nxcreole_line_index_free(nxcreole_line_index* idx);
+size_t nxcreole_line_index_find(const nxcreole_line_index* idx, size_t offset); // line containing offset
+// first blank line at or after line n that is not nested (idx->count if none)
+size_t nxcreole_line_index_next_blank(const nxcreole_line_index* idx, size_t n);
+
+/*
+ * Parse statistics. Collected only if parser is compiled with NXCREOLE_STATS defined
+ * and ctx->stats points to this structure; otherwise it costs nothing.
+ * Counters accumulate over subsequent parses until structure is zeroed.
+ */
+typedef struct nxcreole_stats {
+  size_t bytes_scanned; // size of parsed text (in wchar_t units times sizeof(wchar_t))
+  size_t events[FN_COUNT]; // number of append0/append1 calls per event type
+  size_t text_flushes; // flushes of text buffer (each one is FN_APPEND_TEXT event)
+  size_t full_buffer_flushes; // ... of them caused by text buffer overflow
+  size_t delimiter_scans; // forward scans for closing ]], }}, }}}, >>>
+  size_t delimiter_scan_hits; // scans answered from memo without touching text
+  size_t delimiter_scan_chars; // characters examined by forward scans
+  int max_list_depth;
+  int max_format_depth;
+  double parse_time; // seconds spent in parser itself (callbacks excluded)
+  double callback_time; // seconds spent in append0/append1 callbacks
+} nxcreole_stats;
+
+/*
+ * Block cache: memoizes parser events of blocks (text up to and including next blank line,
+ * parsed from clean state, ie. outside of lists and tables), keyed by block text and parser
+ * state, so that blocks shared by many pages (navigation tables, footers, infoboxes) are
+ * replayed to serializer instead of being parsed again. Events don't depend on serializer,
+ * so one cache serves all of them; serializer that provides ctx->fragments gets its output
+ * of the block stored as well and written at once on next hit. Blocks whose parsing looked
+ * past their end (eg. link closed by ]] after the blank line) are not stored.
+ *
+ * Block is recorded when it is seen second time (so that one-off blocks cost only hashing).
+ * Cache is bounded by total size of entries (max_size bytes), least recently used ones
+ * are evicted; blocks bigger than quarter of max_size are not cached.
+ *
+ * Set ctx->blocks after nxcreole_init() to use it. Cache is ignored by link scans and when
+ * work limits are set. It may not be used by several parses at once. Events written as
+ * fragments are not counted in ctx->events and parse statistics.
+ */
+typedef struct nxcreole_block_event {
+  int fn; // nxcreole_fn_id_t of append1, or -1-fn for append0 (no payload)
+  size_t payload; // offset into block's payload
+  size_t length;
+  size_t span_start, span_end; // relative to block start
+} nxcreole_block_event;
+
+typedef struct nxcreole_block {
+  struct nxcreole_block* next; // in hash chain
+  struct nxcreole_block* lru_prev; // more recently used
+  struct nxcreole_block* lru_next;
+  size_t hash;
+  size_t size; // of this allocation and fragment
+  size_t length; // of block text
+  size_t consumed; // characters parser consumed (length unless parsing stopped inside block)
+  const wchar_t* text; // copy of block text, to compare on lookup
+  const nxcreole_block_event* events;
+  size_t event_count;
+  const wchar_t* payload;
+  char* fragment; // serializer output (separate allocation) or 0
+  size_t fragment_length;
+  int fragment_tag;
+  short mediawiki_table_level; // state at block start
+  unsigned blockquote_br:1;
+  unsigned more:1; // parsing went on after block
+  // state after block
+  unsigned exit_in_table:1;
+  unsigned exit_blockquote_br:1;
+  short exit_mediawiki_table_level;
+  short exit_list_level;
+  const wchar_t* exit_list_levels;
+} nxcreole_block;
+
+typedef struct nxcreole_block_cache_stats {
+  size_t hits;
+  size_t fragment_hits; // ... of them written as serializer output
+  size_t misses;
+  size_t stores;
+  size_t evictions;
+  size_t uncacheable; // blocks depending on text after them, or too big
+} nxcreole_block_cache_stats;
+
+typedef struct nxcreole_block_cache {
+  nxcreole_block** buckets;
+  size_t* seen; // hashes of blocks seen once, per bucket
+  size_t bucket_count; // power of 2
+  nxcreole_block* lru_first; // most recently used
+  nxcreole_block* lru_last;
+  size_t size; // of all entries
+  size_t max_size;
+  size_t count;
+  // block being recorded
+  size_t hash;
+  size_t entry_offset; // in text
+  short entry_mediawiki_table_level;
+  int entry_blockquote_br;
+  nxcreole_block_event* events;
+  size_t event_count, event_capacity;
+  wchar_t* payload;
+  size_t payload_length, payload_capacity;
+  int record_error;
+  nxcreole_block_cache_stats stats;
+} nxcreole_block_cache;
+
+int nxcreole_block_cache_init(nxcreole_block_cache* cache, size_t max_size); // returns -1 if out of memory
+void nxcreole_block_cache_free(nxcreole_block_cache* cache);
+
+struct nxcreole_parse_ctx;
+
+// serializer's output of a block for block cache; set as ctx->fragments by serializer
+// whose output for a block depends on block's events only
+typedef struct nxcreole_fragment_fns {
+  int tag; // fragments are reused only by serializers with the same tag
+  void (*begin)(struct nxcreole_parse_ctx* ctx); // output of block starts here
+  // output since begin, or 0 if it is not available in one piece (eg. flushed to sink)
+  const char* (*end)(struct nxcreole_parse_ctx* ctx, size_t* length);
+  void (*write)(struct nxcreole_parse_ctx* ctx, const char* s, size_t length);
+} nxcreole_fragment_fns;
 
 //typedef void (*append0_t)(struct parse_ctx* ctx, fn_id_t fn);
 //typedef void (*append1_t)(struct parse_ctx* ctx, fn_id_t fn, const wchar_t* u, size_t length);
 
 typedef struct nxcreole_parse_ctx {
   const wchar_t* ptr;
+  const wchar_t* text; // start of text being parsed
   void (*append0)(struct nxcreole_parse_ctx* ctx, nxcreole_fn_id_t fn);
   void (*append1)(struct nxcreole_parse_ctx* ctx, nxcreole_fn_id_t fn, const wchar_t* u, size_t length);
-  void* fn[FN_COUNT];
+  void* fn[FN_FUSED_COUNT];
+  void* data; // serializer's private data
   wchar_t list_levels[MAX_LIST_LEVELS];
   short list_level;
   short mediawiki_table_level;
+  short format_level;
+  // results of last forward scans for closing delimiters; these keep parsing linear
+  // when text contains lots of unclosed markup
+  nxcreole_scan_memo nowiki_end, image_end, link_end, placeholder_end;
+  nxcreole_stats* stats; // set this to collect parse statistics (see nxcreole_stats)
+  const nxcreole_line_index* lines; // set this to line index of text to skip line-start whitespace by it
+  size_t line; // line index cursor (parser only moves forward)
+  nxcreole_block_cache* blocks; // set this to memoize blocks (see nxcreole_block_cache)
+  const nxcreole_fragment_fns* fragments; // set by serializer
+  const wchar_t* block_end; // of block being recorded
+  const wchar_t* uncached_end; // block cache is not used before this (text scanned for too big block)
+  // source range of the construct behind current event, in wchar_t units from text;
+  // set before every append0/append1 call by nxcreole_parse_spans() (or any instance
+  // of parser compiled with NXCREOLE_SPANS).
+  // Container open/close events (paragraphs, lists, tables, etc.) get empty spans at their start/end.
+  size_t span_start, span_end;
+  // work limits for untrusted input (0 means no limit); checked as parsing goes, so
+  // parse time is bounded by them rather than by input
+  size_t max_scan_chars; // characters parsed plus characters examined by forward delimiter scans
+  size_t max_events;
+  size_t max_output; // compared with *output_size, eg. &out.total of serializer's nxcreole_out
+  const size_t* output_size;
+  short max_nesting; // lists and formatting (also capped by MAX_LIST_LEVELS, MAX_FORMAT_LEVELS)
+  nxcreole_limit_t limit_hit; // set by parser
+  size_t scan_chars; // characters examined by forward delimiter scans so far (counted with max_scan_chars only)
+  size_t events; // events emitted so far
+  // allocator for transient buffers; nxcreole_init() sets it to malloc/free (see also nxcreole_arena.h)
+  void* (*alloc)(void* alloc_data, size_t size);
+  void (*dealloc)(void* alloc_data, void* ptr);
+  void* alloc_data;
   unsigned in_table:1;
   unsigned blockquote_br:1;
+  unsigned links_only:1; // don't emit text and nowiki events (nxcreole_parse_links() emits only link ones)
+  unsigned limited:1; // some of max_* limits are set
+  unsigned recording:1; // events go to ctx->blocks as well
+  unsigned block_leaked:1; // forward scan of block being recorded went past its end
 } nxcreole_parse_ctx;
 
 void nxcreole_init(nxcreole_parse_ctx* ctx, const wchar_t* text);
 void nxcreole_parse(nxcreole_parse_ctx* ctx);
+// same, but every event comes with span_start and span_end set (nxcreole_spans.c)
+void nxcreole_parse_spans(nxcreole_parse_ctx* ctx);
+// same for ctx->links_only set, faster: only links, images, placeholders and headings
+// are reported (nxcreole_links.c)
+void nxcreole_parse_links(nxcreole_parse_ctx* ctx);
+
+/*
+ * Link graph extraction. Parses text by regular rules but reports only FN_APPEND_LINK
+ * (both [[links]] and free-standing URLs), FN_APPEND_IMAGE and FN_APPEND_PLACEHOLDER
+ * payloads along with their offsets in text (in wchar_t units); everything else is skipped.
+ */
+typedef void (*nxcreole_link_fn)(void* data, nxcreole_fn_id_t fn, const wchar_t* s, size_t length, size_t offset);
+
+void nxcreole_scan_links(const wchar_t* text, nxcreole_link_fn fn, void* data);
+
+// set up ctx (initialized by nxcreole_init) to report links to fn; eg. as a tee child (see nxcreole_tee.h)
+void nxcreole_links_init(nxcreole_parse_ctx* ctx, nxcreole_link_fn fn, void* data);
+
+// block cache internals used by parser: lookup returns 1 if block should be recorded
+size_t nxcreole_block_max_length(const nxcreole_block_cache* cache);
+nxcreole_block* nxcreole_block_find(nxcreole_parse_ctx* ctx, const wchar_t* start, size_t length, int* record);
+void nxcreole_block_record_start(nxcreole_parse_ctx* ctx, const wchar_t* end);
+void nxcreole_block_record(nxcreole_parse_ctx* ctx, int fn, const wchar_t* s, size_t length);
+nxcreole_block* nxcreole_block_record_finish(nxcreole_parse_ctx* ctx, const wchar_t* start, size_t length, int more);
+void nxcreole_block_set_fragment(nxcreole_parse_ctx* ctx, nxcreole_block* b, const char* s, size_t length);
+
+// link target is URL by parser's rules (http://, https://, ftp://, mailto:), not page name
+int nxcreole_is_url(const wchar_t* s, size_t length);
+
+/*
+ * Section index. Every heading starts a section that lasts until next heading
+ * of the same or higher level (or end of text). Index is built by the regular parser
+ * (without output), so it agrees with full rendering; then any section can be rendered
+ * alone by nxcreole_parse_section(), in time proportional to its size.
+ * Offsets are in wchar_t units.
+ */
+typedef struct nxcreole_section {
+  int level; // 1 for =, 2 for ==, etc.
+  size_t start, end; // source range: from heading line start to next section of same or higher level
+  size_t title_start, title_length; // heading text as is in source
+  // block state at heading (headings can be inside lists and mediawiki tables):
+  size_t lists_start; // open lists' characters in index lists
+  int list_depth;
+  int mediawiki_table_level;
+} nxcreole_section;
+
+typedef struct nxcreole_section_index {
+  nxcreole_section* sections;
+  size_t count;
+  size_t capacity;
+  wchar_t* lists;
+  size_t lists_length;
+  size_t lists_capacity;
+  int error;
+} nxcreole_section_index;
+
+int nxcreole_section_index_build(nxcreole_section_index* idx, const wchar_t* text); // returns -1 if out of memory
+void nxcreole_section_index_free(nxcreole_section_index* idx);
+
+// parse only text[start..end) of ctx->text as if it were inside given open lists and mediawiki tables;
+// ctx is initialized with whole text and set up by serializer; returns -1 if out of memory
+int nxcreole_parse_range(nxcreole_parse_ctx* ctx, size_t start, size_t end,
+                         const wchar_t* lists, int list_depth, int mediawiki_table_level);
+int nxcreole_parse_section(nxcreole_parse_ctx* ctx, const nxcreole_section_index* idx, size_t n);
@@ -0,0 +1,1044 @@
+/*
+ * Copyright (c) 2014 Yaroslav Stavnichiy <yarosla@gmail.com>
+ *
+ * This file is part of NXCREOLE.
+ *
+ * NXCREOLE is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License
+ * as published by the Free Software Foundation, either version 3
+ * of the License, or (at your option) any later version.
+ *
+ * NXCREOLE is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with NXCREOLE. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*
+ * Parser implementation, included by nxcreole_parser.c. It can also be included
+ * by serializer to instantiate parser with serializer's functions called directly
+ * instead of through ctx->append0/append1, so that compiler can inline them:
+ *
+ *   #define NXCREOLE_PARSE_FN my_parse  // name of parse function to define
+ *   #define NXCREOLE_APPEND0(ctx, fn) my_append0((ctx)->data, (fn))
+ *   #define NXCREOLE_APPEND1(ctx, fn, s, length) my_append1((ctx)->data, (fn), (s), (length))
+ *   #include "nxcreole_parser_impl.h"
+ *
+ * my_parse(ctx) then works as nxcreole_parse(ctx) does (ctx initialized by nxcreole_init);
+ * all parser internals are static, so any number of instantiations can coexist.
+ * Event counts and callback time are not collected into parse statistics by such
+ * instantiation. Includer must include what nxcreole_parser.c does beforehand.
+ */
+
+#ifndef NXCREOLE_PARSE_FN
+#define NXCREOLE_PARSE_FN nxcreole_parse
+#endif
+
+#ifdef NXCREOLE_STATS
+static double stats_clock(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec+ts.tv_nsec*1e-9;
+}
+#endif
+
+#if defined(NXCREOLE_APPEND0)
+
+// serializer is inlined: events are counted, but neither per event nor timed
+#define DISPATCH0(fn) NXCREOLE_APPEND0(ctx, (fn))
+#define DISPATCH1(fn, s, length) NXCREOLE_APPEND1(ctx, (fn), (s), (length))
+
+#elif defined(NXCREOLE_STATS)
+
+static void append0_stats(nxcreole_parse_ctx* ctx, nxcreole_fn_id_t fn) {
+  if (!ctx->stats) {
+    ctx->append0(ctx, fn);
+    return;
+  }
+  ctx->stats->events[fn]++;
+  double start=stats_clock();
+  ctx->append0(ctx, fn);
+  ctx->stats->callback_time+=stats_clock()-start;
+}
+
+static void append1_stats(nxcreole_parse_ctx* ctx, nxcreole_fn_id_t fn, const wchar_t* s, size_t length) {
+  if (!ctx->stats) {
+    ctx->append1(ctx, fn, s, length);
+    return;
+  }
+  ctx->stats->events[fn]++;
+  double start=stats_clock();
+  ctx->append1(ctx, fn, s, length);
+  ctx->stats->callback_time+=stats_clock()-start;
+}
+
+#define DISPATCH0(fn) append0_stats(ctx, (fn))
+#define DISPATCH1(fn, s, length) append1_stats(ctx, (fn), (s), (length))
+
+#else
+
+#define DISPATCH0(fn) ctx->append0(ctx, (fn))
+#define DISPATCH1(fn, s, length) ctx->append1(ctx, (fn), (s), (length))
+
+#endif
+
+#ifdef NXCREOLE_LINKS_ONLY
+#define LINKS_ONLY 1
+// events passed on by links-only instance; headings are for nxcreole_section_index_build()
+#define PASSED_ON(fn) ((fn)==FN_APPEND_LINK || (fn)==FN_APPEND_IMAGE || (fn)==FN_APPEND_PLACEHOLDER \
+                       || (fn)==FN_APPEND_HEADING_OPEN || (fn)==FN_APPEND_HEADING_CLOSE)
+#else
+#define LINKS_ONLY ctx->links_only
+#define PASSED_ON(fn) 1
+#endif
+
+// every event is counted and, while block is recorded for block cache, recorded
+static inline void emit0(nxcreole_parse_ctx* ctx, nxcreole_fn_id_t fn) {
+  ctx->events++;
+  if (!PASSED_ON(fn)) return;
+  if (ctx->recording) nxcreole_block_record(ctx, -1-(int)fn, 0, 0);
+  DISPATCH0(fn);
+}
+
+static inline void emit1(nxcreole_parse_ctx* ctx, nxcreole_fn_id_t fn, const wchar_t* s, size_t length) {
+  ctx->events++;
+  if (!PASSED_ON(fn)) return;
+  if (ctx->recording) nxcreole_block_record(ctx, (int)fn, s, length);
+  DISPATCH1(fn, s, length);
+}
+
+#define APPEND0(fn) emit0(ctx, (fn))
+#define APPEND1(fn, s, length) emit1(ctx, (fn), (s), (length))
+
+#ifdef NXCREOLE_STATS
+#define STAT(expr) if (ctx->stats) {expr;}
+#else
+#define STAT(expr)
+#endif
+
+#ifdef NXCREOLE_SPANS
+#define SPAN(start, end) (ctx->span_start=(size_t)((start)-ctx->text), ctx->span_end=(size_t)((end)-ctx->text))
+#else
+#define SPAN(start, end)
+#endif
+
+// character classes of ASCII characters; all other characters belong to none of them
+#define CC_WS 1 // whitespace except '\n', which is significant
+#define CC_LIST 2 // list/blockquote/indent/center markers
+#define CC_FORMAT 4 // format characters (go in pairs)
+#define CC_URL 8 // characters allowed in free-standing URLs
+#define CC_URL_TRAIL 16 // URL characters not wanted at the end of URL
+#define CC_ALNUM 32
+
+#define W CC_WS
+#define L CC_LIST
+#define F CC_FORMAT
+#define U CC_URL
+#define T CC_URL_TRAIL
+#define A (CC_URL|CC_ALNUM)
+
+// From MediaWiki: "._\\/~%-+&#?!=()@"
+// From http://www.ietf.org/rfc/rfc2396.txt :
+//   reserved:   ";/?:@&=+$,"
+//   unreserved: "-_.!~*'()"
+//   delim:      "%#"
+// Note: I excluded apostrophe
+static const unsigned char char_class[128]={
+  0, W, W, W, W, W, W, W, W, W, 0, W, W, W, W, W, // 0x00
+  W, W, W, W, W, W, W, W, W, W, W, W, W, W, W, W, // 0x10
+  W, L|U|T, 0, L|F|U, U, U|T, U, 0, U, U|T, L|F|U, U, U|T, L|U, U|T, F|U, //  !"#$%&'()*+,-./
+  A, A, A, A, A, A, A, A, A, A, L|U|T, U|T, 0, U, L, U|T, // 0123456789:;<=>?
+  U, A, A, A, A, A, A, A, A, A, A, A, A, A, A, A, // @ABCDEFGHIJKLMNO
+  A, A, A, A, A, A, A, A, A, A, A, 0, 0, 0, 0, F|U, // PQRSTUVWXYZ[\]^_
+  0, A, A, A, A, A, A, A, A, A, A, A, A, A, A, A, // `abcdefghijklmno
+  A, A, A, A, A, A, A, A, A, A, A, 0, 0, 0, U, 0, // pqrstuvwxyz{|}~
+};
+
+#undef W
+#undef L
+#undef F
+#undef U
+#undef T
+#undef A
+
+#define CHAR_CLASS(c) ((unsigned)(c)<128? char_class[(unsigned)(c)] : 0)
+
+#define SKIP_WS(p) while (CHAR_CLASS(*(p))&CC_WS) (p)++;
+
+#define IS_LIST_CHAR(c) (CHAR_CLASS(c)&CC_LIST)
+#define IS_FORMAT_CHAR(c) (CHAR_CLASS(c)&CC_FORMAT)
+#define IS_URL_CHAR(c) (CHAR_CLASS(c)&CC_URL)
+#define IS_URL_TRAIL_CHAR(c) (CHAR_CLASS(c)&CC_URL_TRAIL)
+#define IS_ALNUM_CHAR(c) (CHAR_CLASS(c)&CC_ALNUM)
+
+typedef struct {
+  const wchar_t* name;
+  size_t length;
+  int slashes; // number of '/' required after ':'
+} url_scheme_t;
+
+static const url_scheme_t url_schemes[]={
+  {L"http", 4, 2},
+  {L"https", 5, 2},
+  {L"ftp", 3, 2},
+  {L"mailto", 6, 0},
+};
+
+// called on ':'; recognizes scheme name at the end of text buffer
+static const url_scheme_t* match_url_scheme(const wchar_t* tb, const wchar_t* tb_ptr, const wchar_t* colon) {
+  int i, j;
+  if (tb_ptr==tb || !IS_ALNUM_CHAR(tb_ptr[-1])) return 0;
+  for (i=0; i<(int)(sizeof(url_schemes)/sizeof(url_schemes[0])); i++) {
+    const url_scheme_t* scheme=&url_schemes[i];
+    if (tb_ptr[-1]!=scheme->name[scheme->length-1]) continue; // match names backwards
+    if (tb_ptr-tb<(ptrdiff_t)scheme->length) continue;
+    if (wmemcmp(tb_ptr-scheme->length, scheme->name, scheme->length)) continue;
+    if (tb_ptr-tb>(ptrdiff_t)scheme->length && IS_ALNUM_CHAR(tb_ptr[-(ptrdiff_t)scheme->length-1])) continue; // eg. sftp://
+    for (j=1; j<=scheme->slashes && colon[j]==L'/'; j++);
+    if (j>scheme->slashes) return scheme;
+  }
+  return 0;
+}
+
+static void close_lists_and_tables(nxcreole_parse_ctx* ctx) {
+  SPAN(ctx->ptr, ctx->ptr);
+  // close unclosed lists
+  while (ctx->list_level>=0) {
+    APPEND1(FN_APPEND_LIST_CLOSE, &ctx->list_levels[ctx->list_level--], 1);
+  }
+  // close table
+  if (ctx->in_table) {
+    APPEND0(FN_APPEND_TABLE_CLOSE);
+    ctx->in_table=0;
+  }
+  // mediawiki-style tables not closed by this function
+}
+
+static int scan_memo_hit(const nxcreole_scan_memo* memo, const wchar_t* p) {
+  // scans look for the first delimiter at or after p, so previous result holds for any p up to it
+  return memo->from && memo->from<=p && (!memo->found || p<=memo->found);
+}
+
+// SKIP_WS answered from line index when p is at line start
+static const wchar_t* skip_ws(nxcreole_parse_ctx* ctx, const wchar_t* p) {
+  const nxcreole_line_index* idx=ctx->lines;
+  if (idx) {
+    size_t offset=(size_t)(p-ctx->text);
+    while (ctx->line<idx->count && idx->lines[ctx->line].start<offset) ctx->line++;
+    if (ctx->line<idx->count && idx->lines[ctx->line].start==offset) return p+idx->lines[ctx->line].indent;
+  }
+  SKIP_WS(p);
+  return p;
+}
+
+// with scan limit set, forward scans may only go this far from p
+static const wchar_t* scan_bound(nxcreole_parse_ctx* ctx, const wchar_t* p) {
+  if (!ctx->max_scan_chars) return 0;
+  size_t used=(size_t)(p-ctx->text)+ctx->scan_chars;
+  return used<ctx->max_scan_chars? p+(ctx->max_scan_chars-used) : p;
+}
+
+// wcschr() that gives up at bound (unless it is 0) and marks scan limit as hit
+static const wchar_t* find_char(nxcreole_parse_ctx* ctx, const wchar_t* p, wchar_t c, const wchar_t* bound) {
+  if (!bound) return wcschr(p, c);
+  const wchar_t* start=p;
+  for (; *p && *p!=c; p++) {
+    if (p>=bound) {
+      ctx->limit_hit=NXCREOLE_LIMIT_SCAN;
+      p=0;
+      break;
+    }
+  }
+  ctx->scan_chars+=(p? p : bound)-start;
+  return p && *p? p : 0;
+}
+
+#ifdef NXCREOLE_STATS
+static void stat_scan(nxcreole_parse_ctx* ctx, const nxcreole_scan_memo* memo, int hit) {
+  nxcreole_stats* stats=ctx->stats;
+  stats->delimiter_scans++;
+  if (hit) stats->delimiter_scan_hits++;
+  else stats->delimiter_scan_chars+=memo->found? (size_t)(memo->found-memo->from) : wcslen(memo->from);
+}
+#endif
+
+// scan result past end of block being recorded makes block depend on text after it
+static inline const wchar_t* scan_result(nxcreole_parse_ctx* ctx, const wchar_t* found) {
+  if (ctx->recording && (!found || found>=ctx->block_end)) ctx->block_leaked=1;
+  return found;
+}
+
+static const wchar_t* find_end_of_nowiki(nxcreole_parse_ctx* ctx, const wchar_t* p) {
+  nxcreole_scan_memo* memo=&ctx->nowiki_end;
+  if (scan_memo_hit(memo, p)) {
+    p=memo->found;
+    STAT(stat_scan(ctx, memo, 1));
+  }
+  else {
+    memo->from=p;
+    const wchar_t* bound=scan_bound(ctx, p);
+    for (p=find_char(ctx, p, L'}', bound); p; p=find_char(ctx, p+1, L'}', bound)) {
+      if (p[-1]==L'~') continue;
+      if (p[1]==L'}' && p[2]==L'}') break;
+    }
+    memo->found=p;
+    STAT(stat_scan(ctx, memo, 0));
+  }
+  if (scan_result(ctx, p)) {
+    while (p[3]==L'}') p++; // shift to end of sequence of more than 3x'}' (eg. '}}}}}')
+  }
+  return p;
+}
+
+static int remove_escapes_from_nowiki(nxcreole_parse_ctx* ctx, const wchar_t* s, size_t len, const wchar_t** res, size_t* res_len) {
+  const wchar_t* src=s;
+  wchar_t* res_buf=0;
+  wchar_t* res_ptr=0;
+  const wchar_t* end=s+len-3; // account for }}}
+  const wchar_t* p;
+  for (p=len>3? wmemchr(s, L'~', len-3) : 0; p; p=wmemchr(p+1, L'~', end-p-1)) {
+    if (p[1]==L'}' && p[2]==L'}' && p[3]==L'}') {
+      // found escape sequence ~}}}
+      if (!res_ptr) {
+        res_ptr=res_buf=ctx->alloc(ctx->alloc_data, (len-1)*sizeof(wchar_t));
+        if (!res_buf) { // error - should not happen
+          *res=s, *res_len=len; // pass through without processing
+          return 0; // caller must not dealloc(res)
+        }
+      }
+      if (p>src) {
+        size_t cnt=p-src;
+        memcpy(res_ptr, src, cnt*sizeof(wchar_t));
+        res_ptr+=cnt;
+      }
+      src=p+1; // src points to }}}
+    }
+  }
+  if (res_ptr) {
+    // copy remainder
+    size_t cnt=end+3-src;
+    if (cnt) {
+      memcpy(res_ptr, src, cnt*sizeof(wchar_t));
+      res_ptr+=cnt;
+    }
+    *res_len=res_ptr-res_buf;
+    *res=res_buf;
+    return 1; // caller must dealloc(res)
+  }
+  else { // no ~}}} sequence found
+    *res=s, *res_len=len; // pass through
+    return 0; // caller must not dealloc(res)
+  }
+}
+
+static void append_nowiki(nxcreole_parse_ctx* ctx, nxcreole_fn_id_t fn_id, const wchar_t* s, size_t len) {
+  if (LINKS_ONLY) return;
+  // appending nowiki needs special treatment - removal of tilde in every ~}}}
+  const wchar_t* clean;
+  size_t clean_len;
+  int should_free=remove_escapes_from_nowiki(ctx, s, len, &clean, &clean_len);
+  // span is set by caller
+  APPEND1(fn_id, clean, clean_len);
+  if (should_free) ctx->dealloc(ctx->alloc_data, (void*)clean);
+}
+
+static const wchar_t* find_delimiter(nxcreole_parse_ctx* ctx, nxcreole_scan_memo* memo, const wchar_t* p, wchar_t c) {
+  if (scan_memo_hit(memo, p)) {
+    STAT(stat_scan(ctx, memo, 1));
+    return scan_result(ctx, memo->found);
+  }
+  memo->from=p;
+  const wchar_t* bound=scan_bound(ctx, p);
+  for (p=find_char(ctx, p, c, bound); p; p=find_char(ctx, p+1, c, bound)) {
+    if (p[1]==c) break;
+  }
+  memo->found=p;
+  STAT(stat_scan(ctx, memo, 0));
+  return scan_result(ctx, p);
+}
+
+static const wchar_t* find_triple_delimiter(nxcreole_parse_ctx* ctx, nxcreole_scan_memo* memo, const wchar_t* p, wchar_t c) {
+  if (scan_memo_hit(memo, p)) {
+    STAT(stat_scan(ctx, memo, 1));
+    return scan_result(ctx, memo->found);
+  }
+  memo->from=p;
+  const wchar_t* bound=scan_bound(ctx, p);
+  for (p=find_char(ctx, p, c, bound); p; p=find_char(ctx, p+1, c, bound)) {
+    if (p[1]==c && p[2]==c) break;
+  }
+  memo->found=p;
+  STAT(stat_scan(ctx, memo, 0));
+  return scan_result(ctx, p);
+}
+
+// checks limits that stop parsing
+static int limit_reached(nxcreole_parse_ctx* ctx, const wchar_t* ptr) {
+  if (ctx->limit_hit<NXCREOLE_LIMIT_SCAN) {
+    if (ctx->max_scan_chars && (size_t)(ptr-ctx->text)+ctx->scan_chars>ctx->max_scan_chars) ctx->limit_hit=NXCREOLE_LIMIT_SCAN;
+    else if (ctx->max_events && ctx->events>ctx->max_events) ctx->limit_hit=NXCREOLE_LIMIT_EVENTS;
+    else if (ctx->max_output && ctx->output_size && *ctx->output_size>ctx->max_output) ctx->limit_hit=NXCREOLE_LIMIT_OUTPUT;
+  }
+  return ctx->limit_hit>=NXCREOLE_LIMIT_SCAN;
+}
+
+#define LIMITED(p) (ctx->limited && limit_reached(ctx, (p)))
+
+// nesting is allowed below level
+static int nesting_allowed(nxcreole_parse_ctx* ctx, int level, int max_level) {
+  if (level<max_level && (!ctx->max_nesting || level<ctx->max_nesting)) return 1;
+  if (ctx->max_nesting && level>=ctx->max_nesting && !ctx->limit_hit) ctx->limit_hit=NXCREOLE_LIMIT_NESTING;
+  return 0;
+}
+
+typedef enum {
+  ITEM_CTX_PARAGRAPH,
+  ITEM_CTX_LIST_ITEM,
+  ITEM_CTX_TABLE_CELL,
+  ITEM_CTX_HEADER
+} item_ctx_t;
+
+typedef enum {
+  END_OF_ITEM,
+  END_OF_CELL,
+  END_OF_BLOCK,
+} end_of_context_t;
+
+#ifdef NXCREOLE_LINKS_ONLY
+// text is never flushed, so buffer only counts characters (full buffer still splits text
+// as usual); checks looking back at buffered text read the same characters from source
+#define TB_PUT(c) (tb_ptr++)
+#define TB_TAIL ptr
+#else
+#define TB_PUT(c) (*tb_ptr++=(c))
+#define TB_TAIL tb_ptr
+#endif
+#define TB_HEAD (TB_TAIL-(tb_ptr-tb))
+
+#define FLUSH_TB_AT(end) if (tb_ptr!=tb) {if (!LINKS_ONLY) {STAT(ctx->stats->text_flushes++); SPAN(tb_src, (end)); APPEND1(FN_APPEND_TEXT, tb, tb_ptr-tb);} tb_ptr=tb;}
+#define FLUSH_TB() FLUSH_TB_AT(ptr)
+#define FLUSH_FULL_TB() if (tb_ptr==tb_end) {STAT(ctx->stats->full_buffer_flushes++); FLUSH_TB_AT(ptr+1);}
+#define END_OF_ITEM_CONTEXT(p) {FLUSH_TB(); *end_ptr=(p); return END_OF_ITEM;}
+#define END_OF_CELL_CONTEXT(p) {FLUSH_TB(); *end_ptr=(p); return END_OF_CELL;}
+#define END_OF_BLOCK_CONTEXT(p) {FLUSH_TB(); *end_ptr=(p); return END_OF_BLOCK;}
+#define PROPAGATE_END_OF_CONTEXT(p, r) {*end_ptr=(p); return (r);}
+
+#define TMP_BUF_SIZE 1024
+
+static end_of_context_t parse_item(nxcreole_parse_ctx* ctx, const wchar_t* ptr, const wchar_t** end_ptr, wchar_t delimiter, item_ctx_t item_ctx) {
+  wchar_t tb[TMP_BUF_SIZE], *tb_ptr=tb, *tb_end=tb+TMP_BUF_SIZE;
+  int i;
+  // const wchar_t* start_ptr=ptr;
+#ifdef NXCREOLE_SPANS
+  const wchar_t* tb_src=ptr; // source position of text buffer's first character
+#endif
+
+  for (;;) {
+    wchar_t c=*ptr;
+#ifdef NXCREOLE_SPANS
+    if (tb_ptr==tb) tb_src=ptr;
+#endif
+    if (LIMITED(ptr)) END_OF_BLOCK_CONTEXT(ptr); // unwind to parse_block()
+    if (!c) END_OF_BLOCK_CONTEXT(ptr); // eot
+    if (c==delimiter && ptr[1]==delimiter) END_OF_ITEM_CONTEXT(ptr+2);
+
+    int at_line_start=0;
+    if (c==L'\n') {
+      at_line_start=1;
+      if (item_ctx==ITEM_CTX_HEADER || item_ctx==ITEM_CTX_TABLE_CELL)
+        END_OF_BLOCK_CONTEXT(ptr);
+      ptr=skip_ws(ctx, ptr+1);
+      c=*ptr;
+      if (!c) END_OF_BLOCK_CONTEXT(ptr); // eot
+      if (c==L'\n') // \n\n => blank line delimits everything
+        END_OF_BLOCK_CONTEXT(ptr); // leave second \n unparsed so parse_block() can close all lists
+
+      // special handling at line start
+      if (IS_LIST_CHAR(c)) { // start of list item?
+        if (!IS_FORMAT_CHAR(c)) END_OF_BLOCK_CONTEXT(ptr);
+        // here we have a list char, which also happen to be a format char
+        if (ptr[1]!=c) END_OF_BLOCK_CONTEXT(ptr); // format chars go in pairs
+        if (ctx->list_level>=0 && c==ctx->list_levels[0])
+          // c matches current list's first level, so it must be new list item
+          END_OF_BLOCK_CONTEXT(ptr);
+        // otherwise it must be just formatting sequence => no break of context
+      }
+
+      switch (c) {
+        case L'=': // heading
+        case L'|': // table or mediawiki table
+          END_OF_BLOCK_CONTEXT(ptr);
+        case L'{': // start of mediawiki table?
+          if (ptr[1]==L'|') {
+            const wchar_t* p=ptr+2;
+            SKIP_WS(p);
+            if (!*p || *p==L'\n') END_OF_BLOCK_CONTEXT(ptr); // yes, it's start of a table
+          }
+          break;
+/*
+        case L'-': // can be ---- <hr>, but '-' is list char, so it's been handled already
+          if (ptr[1]==L'-' && ptr[2]==L'-' && ptr[3]==L'-') {
+            const wchar_t* p=ptr+4;
+            SKIP_WS(p);
+            if (!*p || *p==L'\n') END_OF_BLOCK_CONTEXT(ptr); // yes, it's <hr>
+          }
+          break;
+*/
+      }
+      // if none matched add '\n' to text buffer
+      TB_PUT(L'\n');
+      FLUSH_FULL_TB();
+      // ptr and c already shifted past the '\n' and whitespace after, so go on
+    }
+
+    if (IS_FORMAT_CHAR(c) && ptr[1]==c && nesting_allowed(ctx, ctx->format_level, MAX_FORMAT_LEVELS)) { // double format character
+      FLUSH_TB();
+      SPAN(ptr, ptr+2);
+      APPEND1(FN_APPEND_FORMAT_OPEN, &c, 1);
+      ctx->format_level++; // alternating **//**//... would nest endlessly otherwise
+      STAT(if (ctx->format_level>ctx->stats->max_format_depth) ctx->stats->max_format_depth=ctx->format_level);
+      end_of_context_t res=parse_item(ctx, ptr+2, &ptr, c, item_ctx);
+      ctx->format_level--;
+      SPAN(res==END_OF_ITEM? ptr-2 : ptr, ptr);
+      APPEND1(FN_APPEND_FORMAT_CLOSE, &c, 1);
+      if (res!=END_OF_ITEM) PROPAGATE_END_OF_CONTEXT(ptr, res); // propagate EOC to the top
+      continue;
+    }
+
+    switch (c) {
+      case L'|':
+        if (item_ctx==ITEM_CTX_TABLE_CELL) END_OF_CELL_CONTEXT(ptr);
+        break;
+      case L'{':
+        if (ptr[1]==L'{') {
+          if (ptr[2]==L'{') { // inline {{{nowiki}}}
+            const wchar_t* start_of_nowiki=ptr+3;
+            const wchar_t* end_of_nowiki=find_end_of_nowiki(ctx, start_of_nowiki);
+            const wchar_t* next_ptr=end_of_nowiki+3;
+            if (end_of_nowiki) {
+              FLUSH_TB();
+              if (wmemchr(start_of_nowiki, L'\n', end_of_nowiki-start_of_nowiki)) { // block <pre>
+                SKIP_WS(start_of_nowiki);
+                if (start_of_nowiki[0]==L'\n') start_of_nowiki++; // eat first newline
+                if (end_of_nowiki[-1]==L'\n') end_of_nowiki--; // eat last newline
+                if (end_of_nowiki>start_of_nowiki) { // non-empty
+                  SPAN(ptr, ptr);
+                  if (item_ctx==ITEM_CTX_PARAGRAPH) APPEND0(FN_APPEND_PARAGRAPH_CLOSE); // break the paragraph because XHTML does not allow <pre> children of <p>
+                  SPAN(ptr, next_ptr);
+                  append_nowiki(ctx, FN_APPEND_NOWIKI_BLOCK, start_of_nowiki, end_of_nowiki-start_of_nowiki);
+                  SPAN(next_ptr, next_ptr);
+                  if (item_ctx==ITEM_CTX_PARAGRAPH) APPEND0(FN_APPEND_PARAGRAPH_OPEN);
+                }
+              }
+              else { // inline {{{nowiki}}}
+                SPAN(ptr, next_ptr);
+                append_nowiki(ctx, FN_APPEND_NOWIKI_INLINE, start_of_nowiki, end_of_nowiki-start_of_nowiki);
+              }
+              ptr=next_ptr;
+              continue;
+            }
+          }
+          else { // {{image}}
+            const wchar_t* start_of_image=ptr+2;
+            const wchar_t* end_of_image=find_delimiter(ctx, &ctx->image_end, start_of_image, L'}');
+            if (end_of_image) {
+              FLUSH_TB();
+              SPAN(ptr, end_of_image+2);
+              ptr=end_of_image+2;
+              APPEND1(FN_APPEND_IMAGE, start_of_image, end_of_image-start_of_image);
+              continue;
+            }
+          }
+        }
+        break;
+      case L'[':
+        if (ptr[1]==L'[') {
+          const wchar_t* start_of_link=ptr+2;
+          const wchar_t* end_of_link=find_delimiter(ctx, &ctx->link_end, start_of_link, L']');
+          if (end_of_link) {
+            FLUSH_TB();
+            SPAN(ptr, end_of_link+2);
+            ptr=end_of_link+2;
+            APPEND1(FN_APPEND_LINK, start_of_link, end_of_link-start_of_link);
+            continue;
+          }
+        }
+        break;
+      case L'\\':
+        if (ptr[1]==L'\\') {
+          FLUSH_TB();
+          SPAN(ptr, ptr+2);
+          APPEND0(FN_APPEND_BR);
+          ptr+=2;
+          continue;
+        }
+        break;
+      case L'<':
+        if (ptr[1]==L'<') {
+          if (ptr[2]==L'<') { // <<<placeholder>>>
+            const wchar_t* start_of_placeholder=ptr+3;
+            const wchar_t* end_of_placeholder=find_triple_delimiter(ctx, &ctx->placeholder_end, start_of_placeholder, L'>');
+            if (end_of_placeholder) {
+              FLUSH_TB();
+              SPAN(ptr, end_of_placeholder+3);
+              ptr=end_of_placeholder+3;
+              APPEND1(FN_APPEND_PLACEHOLDER, start_of_placeholder, end_of_placeholder-start_of_placeholder);
+              continue;
+            }
+          }
+        }
+        break;
+      case L'=': // heading trailer?
+        if (item_ctx==ITEM_CTX_HEADER) {
+          // check if it is at the end of line
+          const wchar_t* p=ptr+1;
+          while (*p==L'=') p++;
+          const wchar_t* end_of_run=p;
+          SKIP_WS(p);
+          if (!*p || *p==L'\n') { // yes, this is trailer
+            if (!LINKS_ONLY) while (tb_ptr>tb && tb_ptr[-1]<=L' ') tb_ptr--; // undo trailing spaces
+            END_OF_BLOCK_CONTEXT(p);
+          }
+          // no => whole run is plain text; don't rescan it from every '='
+          while (ptr<end_of_run-1) {
+            TB_PUT(L'=');
+            FLUSH_FULL_TB();
+            ptr++;
+          }
+        }
+        break;
+      case L'~': // escape
+      { // some escapes are dealt with on a block level
+        wchar_t nc=ptr[1];
+        if ((at_line_start && (IS_LIST_CHAR(nc) || nc==L'=' || nc==L'|' || nc=='{')) // these are escaped at line start only
+            || (IS_FORMAT_CHAR(nc) && ptr[2]==nc) // these are escaped in pairs only
+            || ((nc==L'{' || nc==L'[' || nc==L'\\' || nc==L'<' || nc==L'-') && ptr[2]==nc) // these are escaped in pairs only
+            || nc==L'~') { // escape tilde itself
+          // skip tilde and go ahead
+          c=nc;
+          ptr++;
+        }
+        break;
+      }
+      case L':': // http://, https://, ftp://, mailto: URL?
+      {
+        const url_scheme_t* scheme=match_url_scheme(TB_HEAD, TB_TAIL, ptr);
+        if (scheme) {
+          ptrdiff_t scheme_len=(ptrdiff_t)scheme->length;
+          if (tb_ptr-tb>scheme_len && TB_TAIL[-scheme_len-1]==L'~') { // but it is escaped
+            // eat tilde
+            if (!LINKS_ONLY) memmove(tb_ptr-scheme_len-1, tb_ptr-scheme_len, scheme_len*sizeof(wchar_t));
+            tb_ptr--;
+            // copy '://' straight into tb so it's not considered italics
+            if (tb_ptr+3>=tb_end) FLUSH_TB();
+            TB_PUT(L':');
+            for (i=0; i<scheme->slashes; i++) TB_PUT(L'/');
+            ptr+=1+scheme->slashes;
+            continue;
+          }
+          else {
+            // single pass over URL characters remembering last one allowed to end URL
+            const wchar_t* start_of_link=ptr-scheme_len;
+            const wchar_t* start_of_path=ptr+1+scheme->slashes;
+            const wchar_t* end_of_link=start_of_path;
+            const wchar_t* p;
+            for (p=start_of_path; IS_URL_CHAR(*p); p++) {
+              if (!IS_URL_TRAIL_CHAR(*p)) end_of_link=p+1; // don't want ,.;:?!%) at the end of URI
+            }
+            if (end_of_link>start_of_path) {
+              tb_ptr-=scheme_len; // undo scheme name from buffer
+              FLUSH_TB_AT(start_of_link);
+              SPAN(start_of_link, end_of_link);
+              ptr=end_of_link;
+              APPEND1(FN_APPEND_LINK, start_of_link, end_of_link-start_of_link);
+              continue;
+            }
+          }
+        }
+        break;
+      }
+      case L'-': // -- dash?
+        if (!at_line_start && tb_ptr>tb && TB_TAIL[-1]==L' ' && ptr[1]==L'-' && ptr[2]==L' ') {
+          c=L'–'; // &ndash;
+          ptr++; // skip one '-'
+        }
+        break;
+    }
+
+    TB_PUT(c);
+    FLUSH_FULL_TB();
+    ptr++;
+  }
+  assert(0); // not reachable
+}
+
+static const wchar_t* parse_table_row(nxcreole_parse_ctx* ctx, const wchar_t* ptr) {
+  SPAN(ptr, ptr);
+  APPEND0(FN_APPEND_TABLE_ROW_OPEN);
+  for (;;) {
+    assert(*ptr==L'|'); // points to opening '|' of the cell
+#ifdef NXCREOLE_SPANS
+    const wchar_t* start_of_cell=ptr;
+#endif
+    int colspan=1, th=0;
+    while (*++ptr==L'|') colspan++;
+    if (*ptr==L'=') {
+      th=1;
+      ptr++;
+    }
+    SKIP_WS(ptr);
+    if (!*ptr) break; // eot
+    if (*ptr==L'\n') { // eat last '|' on the line
+      ptr++;
+      break;
+    }
+    if (colspan>99) colspan=99;
+    wchar_t cs[2];
+    int cs_len;
+    if (colspan<10) { cs[0]=L'0'+colspan; cs_len=1; }
+    else { cs[0]=L'0'+colspan/10; cs[1]=L'0'+colspan%10; cs_len=2; }
+    SPAN(start_of_cell, ptr);
+    APPEND1(th? FN_APPEND_TABLE_HEAD_CELL_OPEN:FN_APPEND_TABLE_CELL_OPEN, cs, (size_t)cs_len);
+    end_of_context_t res=parse_item(ctx, ptr, &ptr, 0, ITEM_CTX_TABLE_CELL);
+    SPAN(ptr, ptr);
+    APPEND0(th? FN_APPEND_TABLE_HEAD_CELL_CLOSE:FN_APPEND_TABLE_CELL_CLOSE);
+    if (res==END_OF_BLOCK) break;
+  }
+  SPAN(ptr, ptr);
+  APPEND0(FN_APPEND_TABLE_ROW_CLOSE);
+  return ptr;
+}
+
+static const wchar_t* parse_list_item(nxcreole_parse_ctx* ctx, const wchar_t* ptr) {
+  SKIP_WS(ptr);
+  if (*ptr==L'\n') { // empty line within list (blockquote/div/...)
+    if (!ctx->blockquote_br) {
+      SPAN(ptr, ptr+1);
+      APPEND1(FN_APPEND_LIST_BLANK_ITEM, &ctx->list_levels[ctx->list_level], 1);
+      ctx->blockquote_br=1;
+    }
+    return ptr+1;
+  }
+  else {
+    ctx->blockquote_br=0;
+    const wchar_t* end_ptr;
+    parse_item(ctx, ptr, &end_ptr, 0, ITEM_CTX_LIST_ITEM);
+    return end_ptr;
+  }
+}
+
+// limit was hit: close what's open, pass rest of text as is
+static void degrade(nxcreole_parse_ctx* ctx) {
+  close_lists_and_tables(ctx);
+  if (ctx->limit_hit==NXCREOLE_LIMIT_OUTPUT || LINKS_ONLY || !*ctx->ptr) return;
+  size_t length=wcslen(ctx->ptr);
+  SPAN(ctx->ptr, ctx->ptr);
+  APPEND0(FN_APPEND_PARAGRAPH_OPEN);
+  SPAN(ctx->ptr, ctx->ptr+length);
+  APPEND1(FN_APPEND_TEXT, ctx->ptr, length);
+  ctx->ptr+=length;
+  SPAN(ctx->ptr, ctx->ptr);
+  APPEND0(FN_APPEND_PARAGRAPH_CLOSE);
+}
+
+static int parse_block(nxcreole_parse_ctx* ctx) {
+  if (LIMITED(ctx->ptr)) {
+    degrade(ctx);
+    return 0;
+  }
+  ctx->ptr=skip_ws(ctx, ctx->ptr);
+  wchar_t c=*ctx->ptr;
+  if (!c) return 0; // eot
+  if (c==L'\n') { // blank line => end of list/table; no other meaning
+    close_lists_and_tables(ctx);
+    ctx->ptr++;
+    return 1;
+  }
+  if (c==L'|') { // table
+    if (ctx->mediawiki_table_level>0) {
+      const wchar_t* p=ctx->ptr+1;
+      wchar_t nc=*p;
+      if (nc==L'-' || nc==L'}') p++;
+      SKIP_WS(p);
+      if (!*p) return 0; // table should auto-close on eot
+      if (*p==L'\n') { // nothing else on the line => it's mediawiki-table markup
+        close_lists_and_tables(ctx);
+        SPAN(ctx->ptr, p+1);
+        APPEND0(FN_APPEND_TABLE_CELL_CLOSE);
+        wchar_t one=L'1';
+        if (nc==L'-') { // next row
+          APPEND0(FN_APPEND_TABLE_ROW_CLOSE);
+          APPEND0(FN_APPEND_TABLE_ROW_OPEN);
+          APPEND1(FN_APPEND_TABLE_CELL_OPEN, &one, 1);
+        }
+        else if (nc==L'}') { // end of table
+          APPEND0(FN_APPEND_TABLE_ROW_CLOSE);
+          APPEND0(FN_APPEND_TABLE_CLOSE);
+          ctx->mediawiki_table_level--;
+        }
+        else { // next cell
+          APPEND1(FN_APPEND_TABLE_CELL_OPEN, &one, 1);
+        }
+        ctx->ptr=p+1;
+        return 1;
+      }
+    }
+    if (!ctx->in_table) {
+      close_lists_and_tables(ctx);
+      SPAN(ctx->ptr, ctx->ptr);
+      APPEND0(FN_APPEND_TABLE_OPEN);
+      ctx->in_table=1;
+    }
+    ctx->ptr=parse_table_row(ctx, ctx->ptr);
+    return 1;
+  }
+  else if (ctx->in_table) {
+    close_lists_and_tables(ctx);
+  }
+
+  switch (c) {
+    case L'=': // heading
+      {
+        int heading_level=1;
+#ifdef NXCREOLE_SPANS
+        const wchar_t* start_of_heading=ctx->ptr;
+#endif
+        while (ctx->ptr[heading_level]==L'=') heading_level++;
+        ctx->ptr+=heading_level;
+        SKIP_WS(ctx->ptr);
+        if (!*ctx->ptr) return 0; // eot
+        wchar_t h=L'0'+heading_level;
+        SPAN(start_of_heading, ctx->ptr);
+        APPEND1(FN_APPEND_HEADING_OPEN, &h, 1);
+        parse_item(ctx, ctx->ptr, &ctx->ptr, 0, ITEM_CTX_HEADER);
+        SPAN(ctx->ptr, ctx->ptr);
+        APPEND1(FN_APPEND_HEADING_CLOSE, &h, 1);
+        return 1;
+      }
+    case L'{': // nowiki block?
+      if (ctx->ptr[1]==L'{' && ctx->ptr[2]==L'{') {
+        const wchar_t* start_of_nowiki=ctx->ptr+3;
+        const wchar_t* end_of_nowiki=find_end_of_nowiki(ctx, start_of_nowiki);
+        const wchar_t* next_ptr=end_of_nowiki+3;
+        if (end_of_nowiki) {
+          if (wmemchr(start_of_nowiki, L'\n', end_of_nowiki-start_of_nowiki)) { // block <pre>
+            SKIP_WS(start_of_nowiki);
+            if (start_of_nowiki[0]==L'\n') start_of_nowiki++; // eat first newline
+            if (end_of_nowiki[-1]==L'\n') end_of_nowiki--; // eat last newline
+            if (end_of_nowiki>start_of_nowiki) { // non-empty
+              SPAN(ctx->ptr, next_ptr);
+              append_nowiki(ctx, FN_APPEND_NOWIKI_BLOCK, start_of_nowiki, end_of_nowiki-start_of_nowiki);
+            }
+            ctx->ptr=next_ptr;
+            return 1;
+          }
+          // else inline <nowiki> - proceed to regular paragraph handling
+        }
+      }
+      else if (ctx->ptr[1]==L'|') { // mediawiki-table?
+        const wchar_t* p=ctx->ptr+2;
+        SKIP_WS(p);
+        // if (!*p) ... // no point in opening table on eot => treat literally
+        if (*p==L'\n') { // yes, it's start of a table
+          wchar_t one=L'1';
+          SPAN(ctx->ptr, p+1);
+          APPEND0(FN_APPEND_TABLE_OPEN);
+          APPEND0(FN_APPEND_TABLE_ROW_OPEN);
+          APPEND1(FN_APPEND_TABLE_CELL_OPEN, &one, 1);
+          ctx->mediawiki_table_level++;
+          ctx->ptr=p+1;
+          return 1;
+        }
+      }
+      break;
+    case L'-': // hr?
+      if (ctx->ptr[1]==L'-' && ctx->ptr[2]==L'-' && ctx->ptr[3]==L'-') {
+        const wchar_t* p=ctx->ptr+4;
+        SKIP_WS(p);
+        if (!*p || *p==L'\n') { // yes, it's <hr>
+          SPAN(ctx->ptr, p);
+          APPEND0(FN_APPEND_HR);
+          ctx->ptr=p;
+          return 1;
+        }
+      }
+      break;
+    case L'~': // block-level escaping
+      {
+        wchar_t nc=ctx->ptr[1];
+        if (IS_LIST_CHAR(nc) || nc==L'=' || nc==L'|' || nc==L'{') {
+          ctx->ptr++; // skip '~' and proceed to regular paragraph handling
+        }
+        // otherwise escaping will be done at line level
+      }
+      break;
+  }
+
+  if (ctx->list_level>=0 || IS_LIST_CHAR(c)) { // lists
+    int lc;
+    // count list level
+    for (lc=0; lc<=ctx->list_level && ctx->ptr[lc]==ctx->list_levels[lc]; lc++);
+    if (!ctx->ptr[lc]) return 0; // eot
+    if (lc<=ctx->list_level) { // close list block(s)
+      SPAN(ctx->ptr, ctx->ptr);
+      do {
+        APPEND1(FN_APPEND_LIST_CLOSE, &ctx->list_levels[ctx->list_level--], 1);
+      } while (lc<=ctx->list_level);
+      // list(s) closed => retry from the same position
+      ctx->blockquote_br=1;
+      return 1;
+    }
+    else {
+      wchar_t cc=ctx->ptr[lc];
+      if (IS_LIST_CHAR(cc) && ctx->ptr[lc+1]!=cc /* not formatting chars */ && nesting_allowed(ctx, ctx->list_level+1, MAX_LIST_LEVELS)) {
+        // new list block
+        ctx->list_levels[++ctx->list_level]=cc;
+        STAT(if (ctx->list_level>=ctx->stats->max_list_depth) ctx->stats->max_list_depth=ctx->list_level+1);
+        ctx->blockquote_br=1;
+        SPAN(ctx->ptr, ctx->ptr+lc+1);
+        APPEND1(FN_APPEND_LIST_OPEN, &cc, 1);
+        ctx->ptr=parse_list_item(ctx, ctx->ptr+lc+1);
+        return 1;
+      }
+      else if (ctx->list_level>=0) { // list item - same level
+        SPAN(ctx->ptr, ctx->ptr+lc);
+        APPEND1(FN_APPEND_LIST_NEXT_ITEM, &ctx->list_levels[ctx->list_level], 1);
+        ctx->ptr=parse_list_item(ctx, ctx->ptr+lc);
+        return 1;
+      }
+    }
+  }
+
+  { // paragraph handling
+    SPAN(ctx->ptr, ctx->ptr);
+    APPEND0(FN_APPEND_PARAGRAPH_OPEN);
+    parse_item(ctx, ctx->ptr, &ctx->ptr, 0, ITEM_CTX_PARAGRAPH);
+    SPAN(ctx->ptr, ctx->ptr);
+    APPEND0(FN_APPEND_PARAGRAPH_CLOSE);
+    return 1;
+  }
+}
+
+// end of block starting at p: just after next blank line, or end of text;
+// 0 if block is longer than limit
+static const wchar_t* find_block_end(const wchar_t* p, size_t limit) {
+  const wchar_t* stop=p+limit;
+  for (;;) {
+    SKIP_WS(p);
+    if (*p==L'\n') return p+1;
+    const wchar_t* eol=wcschr(p, L'\n');
+    if (!eol) return p+wcslen(p);
+    if (eol>=stop) return 0;
+    p=eol+1;
+  }
+}
+
+static void leave_block(nxcreole_parse_ctx* ctx, const nxcreole_block* b) {
+  ctx->ptr+=b->consumed;
+  ctx->in_table=b->exit_in_table;
+  ctx->blockquote_br=b->exit_blockquote_br;
+  ctx->mediawiki_table_level=b->exit_mediawiki_table_level;
+  ctx->list_level=b->exit_list_level;
+  if (b->exit_list_level>=0) wmemcpy(ctx->list_levels, b->exit_list_levels, b->exit_list_level+1);
+}
+
+static void replay_block(nxcreole_parse_ctx* ctx, const nxcreole_block* b) {
+#ifdef NXCREOLE_SPANS
+  size_t base=(size_t)(ctx->ptr-ctx->text);
+#endif
+  size_t i;
+  for (i=0; i<b->event_count; i++) {
+    const nxcreole_block_event* e=&b->events[i];
+#ifdef NXCREOLE_SPANS
+    ctx->span_start=base+e->span_start;
+    ctx->span_end=base+e->span_end;
+#endif
+    if (e->fn<0) APPEND0((nxcreole_fn_id_t)(-1-e->fn));
+    else APPEND1((nxcreole_fn_id_t)e->fn, b->payload+e->payload, e->length);
+  }
+}
+
+static void store_fragment(nxcreole_parse_ctx* ctx, nxcreole_block* b) {
+  size_t length;
+  const char* s=ctx->fragments->end(ctx, &length);
+  if (s) nxcreole_block_set_fragment(ctx, b, s, length);
+}
+
+// parse_block() through block cache: at clean state replays or records whole block
+static int parse_cached_block(nxcreole_parse_ctx* ctx) {
+  if (ctx->list_level>=0 || ctx->in_table || !*ctx->ptr || ctx->ptr<ctx->uncached_end) return parse_block(ctx);
+  const wchar_t* start=ctx->ptr;
+  size_t limit=nxcreole_block_max_length(ctx->blocks);
+  const wchar_t* end=find_block_end(start, limit);
+  if (!end) { // too big to cache; don't look up blocks in what has been scanned
+    ctx->blocks->stats.uncacheable++;
+    ctx->uncached_end=start+limit;
+    return parse_block(ctx);
+  }
+  int record;
+  nxcreole_block* b=nxcreole_block_find(ctx, start, end-start, &record);
+  if (b) {
+    if (ctx->fragments && b->fragment && b->fragment_tag==ctx->fragments->tag) {
+      ctx->blocks->stats.fragment_hits++;
+      ctx->fragments->write(ctx, b->fragment, b->fragment_length);
+    }
+    else {
+      if (ctx->fragments) ctx->fragments->begin(ctx);
+      replay_block(ctx, b);
+      if (ctx->fragments) store_fragment(ctx, b);
+    }
+    leave_block(ctx, b);
+    return b->more;
+  }
+  int more;
+  if (!record) { // first sighting (or too big): parse as is
+    do {
+      more=parse_block(ctx);
+    } while (more && ctx->ptr<end);
+    return more;
+  }
+  if (ctx->fragments) ctx->fragments->begin(ctx);
+  nxcreole_block_record_start(ctx, end);
+  do {
+    more=parse_block(ctx);
+  } while (more && ctx->ptr<end);
+  b=nxcreole_block_record_finish(ctx, start, end-start, more);
+  if (b && ctx->fragments) store_fragment(ctx, b);
+  return more;
+}
+
+void NXCREOLE_PARSE_FN(nxcreole_parse_ctx* ctx) {
+#ifdef NXCREOLE_STATS
+  const wchar_t* text=ctx->ptr;
+  double start=ctx->stats? stats_clock() : 0;
+  double callback_time=ctx->stats? ctx->stats->callback_time : 0;
+#endif
+
+  ctx->limited=ctx->max_scan_chars || ctx->max_events || ctx->max_output;
+  if (ctx->blocks && !ctx->limited && !LINKS_ONLY) {
+    while (parse_cached_block(ctx));
+  }
+  else {
+    while (parse_block(ctx));
+  }
+
+  close_lists_and_tables(ctx);
+
+  while (ctx->mediawiki_table_level-->0) {
+    SPAN(ctx->ptr, ctx->ptr);
+    // append("</td></tr></table>\n");
+    APPEND0(FN_APPEND_TABLE_CELL_CLOSE);
+    APPEND0(FN_APPEND_TABLE_ROW_CLOSE);
+    APPEND0(FN_APPEND_TABLE_CLOSE);
+  }
+
+#ifdef NXCREOLE_STATS
+  if (ctx->stats) {
+    ctx->stats->bytes_scanned+=(ctx->ptr-text+wcslen(ctx->ptr))*sizeof(wchar_t);
+    ctx->stats->parse_time+=stats_clock()-start-(ctx->stats->callback_time-callback_time);
+  }
+#endif
+}
@@ -0,0 +1,137 @@
+/*
+ * Copyright (c) 2014 Yaroslav Stavnichiy <yarosla@gmail.com>
+ *
+ * This file is part of NXCREOLE.
+ *
+ * NXCREOLE is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License
+ * as published by the Free Software Foundation, either version 3
+ * of the License, or (at your option) any later version.
+ *
+ * NXCREOLE is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with NXCREOLE. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <wchar.h>
+#include <string.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <pthread.h>
+
+#include "nxcreole_parser.h"
+#include "nxcreole_out.h"
+#include "nxcreole_xhtml.h"
+#include "nxcreole_pool.h"
+
+static void* worker(void* arg) {
+  nxcreole_pool* pool=arg;
+  for (;;) {
+    pthread_mutex_lock(&pool->lock);
+    while (!pool->queue && !pool->stopping) pthread_cond_wait(&pool->cond, &pool->lock);
+    nxcreole_pool_job* job=pool->queue;
+    if (job) {
+      pool->queue=job->next;
+      if (!pool->queue) pool->queue_tail=0;
+    }
+    pthread_mutex_unlock(&pool->lock);
+    if (!job) break; // stopping and nothing left
+
+    if (!nxcreole_out_init(&job->out, wcslen(job->text)*2, 0, 0)) nxcreole_render_xhtml(job->text, &job->out);
+
+    pthread_mutex_lock(&pool->lock);
+    job->next=pool->done;
+    pool->done=job;
+    pthread_mutex_unlock(&pool->lock);
+    char c=0;
+    while (write(pool->pipe[1], &c, 1)==-1 && errno==EINTR); // EAGAIN: pipe full, reader is signalled already
+  }
+  return 0;
+}
+
+int nxcreole_pool_start(nxcreole_pool* pool, int threads) {
+  memset(pool, 0, sizeof(nxcreole_pool));
+  if (threads<=0) threads=(int)sysconf(_SC_NPROCESSORS_ONLN);
+  if (threads<1) threads=1;
+  if (pipe(pool->pipe)) return -1;
+  int i;
+  for (i=0; i<2; i++) {
+    fcntl(pool->pipe[i], F_SETFL, fcntl(pool->pipe[i], F_GETFL)|O_NONBLOCK);
+    fcntl(pool->pipe[i], F_SETFD, FD_CLOEXEC);
+  }
+  pool->threads=malloc(threads*sizeof(pthread_t));
+  if (!pool->threads) {
+    close(pool->pipe[0]);
+    close(pool->pipe[1]);
+    errno=ENOMEM;
+    return -1;
+  }
+  pthread_mutex_init(&pool->lock, 0);
+  pthread_cond_init(&pool->cond, 0);
+  for (i=0; i<threads; i++) {
+    int e=pthread_create(&pool->threads[i], 0, worker, pool);
+    if (e) {
+      pool->thread_count=i;
+      nxcreole_pool_stop(pool);
+      errno=e;
+      return -1;
+    }
+  }
+  pool->thread_count=threads;
+  return 0;
+}
+
+void nxcreole_pool_stop(nxcreole_pool* pool) {
+  if (!pool->threads) return;
+  pthread_mutex_lock(&pool->lock);
+  pool->stopping=1;
+  pthread_cond_broadcast(&pool->cond);
+  pthread_mutex_unlock(&pool->lock);
+  int i;
+  for (i=0; i<pool->thread_count; i++) pthread_join(pool->threads[i], 0);
+  free(pool->threads);
+  pool->threads=0;
+  close(pool->pipe[0]);
+  close(pool->pipe[1]);
+  pthread_mutex_destroy(&pool->lock);
+  pthread_cond_destroy(&pool->cond);
+}
+
+void nxcreole_pool_submit(nxcreole_pool* pool, nxcreole_pool_job* job) {
+  job->next=0;
+  memset(&job->out, 0, sizeof(nxcreole_out));
+  pthread_mutex_lock(&pool->lock);
+  if (pool->queue_tail) pool->queue_tail->next=job;
+  else pool->queue=job;
+  pool->queue_tail=job;
+  pthread_cond_signal(&pool->cond);
+  pthread_mutex_unlock(&pool->lock);
+}
+
+int nxcreole_pool_fd(const nxcreole_pool* pool) {
+  return pool->pipe[0];
+}
+
+nxcreole_pool_job* nxcreole_pool_collect(nxcreole_pool* pool) {
+  // drain signals first: jobs finishing after that signal again
+  char buf[256];
+  while (read(pool->pipe[0], buf, sizeof(buf))>0);
+  pthread_mutex_lock(&pool->lock);
+  nxcreole_pool_job* job=pool->done;
+  pool->done=0;
+  pthread_mutex_unlock(&pool->lock);
+  nxcreole_pool_job* list=0;
+  while (job) { // reverse into completion order
+    nxcreole_pool_job* next=job->next;
+    job->next=list;
+    list=job;
+    job=next;
+  }
+  return list;
+}
@@ -0,0 +1,53 @@
+/*
+ * Copyright (c) 2014 Yaroslav Stavnichiy <yarosla@gmail.com>
+ *
+ * This file is part of NXCREOLE.
+ *
+ * NXCREOLE is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License
+ * as published by the Free Software Foundation, either version 3
+ * of the License, or (at your option) any later version.
+ *
+ * NXCREOLE is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with NXCREOLE. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*
+ * Render pool: worker threads rendering XHTML off caller's thread, eg. for event
+ * loop servers. Caller allocates job, sets text (must stay valid until job is collected)
+ * and submits it; finished jobs are queued and signalled through a pipe, so that loop
+ * can wait for nxcreole_pool_fd() to become readable along with its sockets and then
+ * take them all by nxcreole_pool_collect().
+ *
+ * Include <pthread.h> and nxcreole_out.h before this header.
+ */
+
+typedef struct nxcreole_pool_job {
+  const wchar_t* text;
+  void* data; // caller's
+  nxcreole_out out; // rendered UTF-8 XHTML; out.error is set if it failed
+  struct nxcreole_pool_job* next;
+} nxcreole_pool_job;
+
+typedef struct nxcreole_pool {
+  pthread_t* threads;
+  int thread_count;
+  pthread_mutex_t lock;
+  pthread_cond_t cond; // signalled when job is queued or pool is stopping
+  nxcreole_pool_job* queue; // waiting jobs, oldest first
+  nxcreole_pool_job* queue_tail;
+  nxcreole_pool_job* done; // finished jobs, newest first
+  int pipe[2]; // byte is written to pipe[1] for finished jobs
+  int stopping;
+} nxcreole_pool;
+
+int nxcreole_pool_start(nxcreole_pool* pool, int threads); // threads<=0 means one per online CPU; returns -1 on error (errno set)
+void nxcreole_pool_stop(nxcreole_pool* pool); // finishes queued jobs first; uncollected jobs stay with caller
+void nxcreole_pool_submit(nxcreole_pool* pool, nxcreole_pool_job* job);
+int nxcreole_pool_fd(const nxcreole_pool* pool); // readable when there are jobs to collect
+nxcreole_pool_job* nxcreole_pool_collect(nxcreole_pool* pool); // finished jobs linked by next, in order of completion; 0 if none
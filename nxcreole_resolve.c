@@ -0,0 +1,133 @@
+/*
+ * Copyright (c) 2014 Yaroslav Stavnichiy <yarosla@gmail.com>
+ *
+ * This file is part of NXCREOLE.
+ *
+ * NXCREOLE is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License
+ * as published by the Free Software Foundation, either version 3
+ * of the License, or (at your option) any later version.
+ *
+ * NXCREOLE is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with NXCREOLE. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <wchar.h>
+#include <string.h>
+#include <stdlib.h>
+
+#include "nxcreole_parser.h"
+#include "nxcreole_out.h"
+#include "nxcreole_xhtml.h"
+#include "nxcreole_resolve.h"
+
+#define MIN_SLOTS 64
+
+static size_t hash_target(nxcreole_fn_id_t fn, const wchar_t* s, size_t length) {
+  size_t h=2166136261u^(size_t)fn;
+  while (length--) h=(h^(size_t)*s++)*16777619u;
+  return h;
+}
+
+// returns slot holding target or empty slot where it belongs
+static size_t* find_slot(size_t* slots, size_t slot_count, const nxcreole_link_target* targets,
+                         nxcreole_fn_id_t fn, const wchar_t* s, size_t length) {
+  size_t mask=slot_count-1;
+  size_t i=hash_target(fn, s, length)&mask;
+  for (;; i=(i+1)&mask) {
+    if (!slots[i]) return &slots[i];
+    const nxcreole_link_target* t=&targets[slots[i]-1];
+    if (t->fn==fn && t->length==length && !wmemcmp(t->target, s, length)) return &slots[i];
+  }
+}
+
+static int grow(nxcreole_link_table* table) {
+  if (table->count==table->capacity) {
+    size_t capacity=table->capacity? table->capacity*2 : MIN_SLOTS/2;
+    nxcreole_link_target* targets=realloc(table->targets, capacity*sizeof(nxcreole_link_target));
+    if (!targets) return -1;
+    table->targets=targets;
+    table->capacity=capacity;
+  }
+  if ((table->count+1)*2>table->slot_count) { // keep load factor under 1/2
+    size_t slot_count=table->slot_count? table->slot_count*2 : MIN_SLOTS;
+    size_t* slots=calloc(slot_count, sizeof(size_t));
+    if (!slots) return -1;
+    size_t i;
+    for (i=0; i<table->count; i++) {
+      const nxcreole_link_target* t=&table->targets[i];
+      *find_slot(slots, slot_count, table->targets, t->fn, t->target, t->length)=i+1;
+    }
+    if (table->slots) free(table->slots);
+    table->slots=slots;
+    table->slot_count=slot_count;
+  }
+  return 0;
+}
+
+static void collect_target(void* data, nxcreole_fn_id_t fn, const wchar_t* s, size_t length, size_t offset) {
+  nxcreole_link_table* table=data;
+  if (table->error || fn==FN_APPEND_PLACEHOLDER) return;
+  const wchar_t* title=wmemchr(s, L'|', length);
+  if (title) length=title-s;
+  if (table->slot_count) {
+    if (*find_slot(table->slots, table->slot_count, table->targets, fn, s, length)) return; // seen already
+  }
+  if (grow(table)) {
+    table->error=1;
+    return;
+  }
+  nxcreole_link_target* t=&table->targets[table->count];
+  memset(t, 0, sizeof(nxcreole_link_target));
+  t->fn=fn;
+  t->target=s;
+  t->length=length;
+  *find_slot(table->slots, table->slot_count, table->targets, fn, s, length)=++table->count;
+}
+
+int nxcreole_link_table_collect(nxcreole_link_table* table, const wchar_t* text) {
+  memset(table, 0, sizeof(nxcreole_link_table));
+  nxcreole_scan_links(text, collect_target, table);
+  if (table->error) {
+    nxcreole_link_table_free(table);
+    return -1;
+  }
+  return 0;
+}
+
+const nxcreole_link_target* nxcreole_link_table_find(const nxcreole_link_table* table, nxcreole_fn_id_t fn, const wchar_t* target, size_t length) {
+  if (!table->slot_count) return 0;
+  size_t slot=*find_slot(table->slots, table->slot_count, table->targets, fn, target, length);
+  return slot? &table->targets[slot-1] : 0;
+}
+
+void nxcreole_link_table_free(nxcreole_link_table* table) {
+  if (table->targets) free(table->targets);
+  if (table->slots) free(table->slots);
+  table->targets=0;
+  table->slots=0;
+  table->count=table->capacity=table->slot_count=0;
+}
+
+int nxcreole_render_xhtml_resolved(const wchar_t* text, nxcreole_resolve_fn fn, void* data, nxcreole_out* out) {
+  nxcreole_link_table table;
+  if (nxcreole_link_table_collect(&table, text)) return -1;
+  if (table.count && fn(data, table.targets, table.count)) {
+    nxcreole_link_table_free(&table);
+    return -1;
+  }
+  nxcreole_parse_ctx ctx;
+  nxcreole_xhtml_serializer xs;
+  nxcreole_init(&ctx, text);
+  nxcreole_xhtml_init(&ctx, &xs, out);
+  xs.links=&table;
+  ctx.fragments=0;
+  nxcreole_xhtml_parse(&ctx);
+  nxcreole_link_table_free(&table);
+  return out->error? -1:0;
+}
@@ -0,0 +1,55 @@
+/*
+ * Copyright (c) 2014 Yaroslav Stavnichiy <yarosla@gmail.com>
+ *
+ * This file is part of NXCREOLE.
+ *
+ * NXCREOLE is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License
+ * as published by the Free Software Foundation, either version 3
+ * of the License, or (at your option) any later version.
+ *
+ * NXCREOLE is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with NXCREOLE. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*
+ * Batched link resolution for two-phase rendering. First phase collects every
+ * distinct link and image target of the text; then single resolver call marks missing
+ * ones and rewrites URLs for all of them at once (eg. with one database query);
+ * second phase renders XHTML using the resolved table. Missing targets are rendered
+ * with class="missing".
+ */
+
+typedef struct nxcreole_link_target {
+  nxcreole_fn_id_t fn; // FN_APPEND_LINK or FN_APPEND_IMAGE
+  const wchar_t* target; // points into source text (part before |)
+  size_t length;
+  // set by resolver:
+  int missing; // target does not exist
+  const wchar_t* url; // replaces target in href/src unless 0; must stay valid until rendered
+  size_t url_length;
+} nxcreole_link_target;
+
+typedef struct nxcreole_link_table {
+  nxcreole_link_target* targets;
+  size_t count;
+  size_t capacity;
+  size_t* slots; // open addressing hash: target index+1 or 0 for empty
+  size_t slot_count; // power of two
+  int error;
+} nxcreole_link_table;
+
+// returns nonzero to abort rendering
+typedef int (*nxcreole_resolve_fn)(void* data, nxcreole_link_target* targets, size_t count);
+
+int nxcreole_link_table_collect(nxcreole_link_table* table, const wchar_t* text); // returns -1 if out of memory
+const nxcreole_link_target* nxcreole_link_table_find(const nxcreole_link_table* table, nxcreole_fn_id_t fn, const wchar_t* target, size_t length);
+void nxcreole_link_table_free(nxcreole_link_table* table);
+
+// all three phases; returns -1 if out of memory or resolver failed
+int nxcreole_render_xhtml_resolved(const wchar_t* text, nxcreole_resolve_fn fn, void* data, nxcreole_out* out);
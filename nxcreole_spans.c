@@ -0,0 +1,40 @@
+/*
+ * Copyright (c) 2014 Yaroslav Stavnichiy <yarosla@gmail.com>
+ *
+ * This file is part of NXCREOLE.
+ *
+ * NXCREOLE is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License
+ * as published by the Free Software Foundation, either version 3
+ * of the License, or (at your option) any later version.
+ *
+ * NXCREOLE is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with NXCREOLE. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*
+ * Parser instance that tracks source spans of events (see span_start/span_end of
+ * nxcreole_parse_ctx). Spans are compiled into this instance only, so that
+ * nxcreole_parse() and serializers' inlined instances do not pay for span stores.
+ */
+
+#include <assert.h>
+#include <stdio.h>
+#include <wchar.h>
+#include <string.h>
+#include <stdlib.h>
+#include <stddef.h>
+#ifdef NXCREOLE_STATS
+#include <time.h>
+#endif
+
+#include "nxcreole_parser.h"
+
+#define NXCREOLE_SPANS
+#define NXCREOLE_PARSE_FN nxcreole_parse_spans
+#include "nxcreole_parser_impl.h"
@@ -0,0 +1,61 @@
+/*
+ * Copyright (c) 2014 Yaroslav Stavnichiy <yarosla@gmail.com>
+ *
+ * This file is part of NXCREOLE.
+ *
+ * NXCREOLE is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License
+ * as published by the Free Software Foundation, either version 3
+ * of the License, or (at your option) any later version.
+ *
+ * NXCREOLE is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with NXCREOLE. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <wchar.h>
+#include <string.h>
+
+#include "nxcreole_parser.h"
+#include "nxcreole_tee.h"
+
+static void append0(nxcreole_parse_ctx* ctx, nxcreole_fn_id_t fn) {
+  nxcreole_tee* tee=ctx->data;
+  const unsigned char* sub=tee->subscribers[fn];
+  int i, n=tee->subscriber_count[fn];
+  for (i=0; i<n; i++) {
+    nxcreole_parse_ctx* child=tee->children[sub[i]];
+    child->append0(child, fn);
+  }
+}
+
+static void append1(nxcreole_parse_ctx* ctx, nxcreole_fn_id_t fn, const wchar_t* s, size_t len) {
+  nxcreole_tee* tee=ctx->data;
+  const unsigned char* sub=tee->subscribers[fn];
+  int i, n=tee->subscriber_count[fn];
+  for (i=0; i<n; i++) {
+    nxcreole_parse_ctx* child=tee->children[sub[i]];
+    child->append1(child, fn, s, len);
+  }
+}
+
+void nxcreole_tee_init(nxcreole_parse_ctx* ctx, nxcreole_tee* tee) {
+  memset(tee, 0, sizeof(nxcreole_tee));
+  ctx->append0=append0;
+  ctx->append1=append1;
+  ctx->data=tee;
+}
+
+int nxcreole_tee_add(nxcreole_tee* tee, nxcreole_parse_ctx* child, unsigned events) {
+  if (tee->child_count>=NXCREOLE_TEE_MAX_CHILDREN) return -1;
+  int i, idx=tee->child_count++;
+  tee->children[idx]=child;
+  for (i=0; i<FN_COUNT; i++) {
+    if (events & NXCREOLE_EVENT(i)) tee->subscribers[i][tee->subscriber_count[i]++]=(unsigned char)idx;
+  }
+  return 0;
+}
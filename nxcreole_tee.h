@@ -0,0 +1,47 @@
+/*
+ * Copyright (c) 2014 Yaroslav Stavnichiy <yarosla@gmail.com>
+ *
+ * This file is part of NXCREOLE.
+ *
+ * NXCREOLE is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License
+ * as published by the Free Software Foundation, either version 3
+ * of the License, or (at your option) any later version.
+ *
+ * NXCREOLE is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with NXCREOLE. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*
+ * Fan-out serializer. Parses text once and forwards every event to several
+ * child contexts (eg. XHTML, plain text and link collector at the same time).
+ * Payload pointers are passed through as is, nothing is copied. Each child
+ * subscribes to a set of events; others are never dispatched to it.
+ *
+ * Children must be initialized by nxcreole_init with the same text
+ * and set up by their serializers' init functions; they are never parsed themselves.
+ */
+
+#define NXCREOLE_TEE_MAX_CHILDREN 8
+
+#define NXCREOLE_EVENT(fn) (1u<<(fn))
+#define NXCREOLE_ALL_EVENTS ((1u<<FN_COUNT)-1)
+
+typedef struct nxcreole_tee {
+  nxcreole_parse_ctx* children[NXCREOLE_TEE_MAX_CHILDREN];
+  int child_count;
+  // per event: indexes of subscribed children in order they were added
+  unsigned char subscribers[FN_COUNT][NXCREOLE_TEE_MAX_CHILDREN];
+  unsigned char subscriber_count[FN_COUNT];
+} nxcreole_tee;
+
+// set up ctx (initialized by nxcreole_init) to fan out events via tee
+void nxcreole_tee_init(nxcreole_parse_ctx* ctx, nxcreole_tee* tee);
+
+// subscribe child to events (mask of NXCREOLE_EVENT bits); returns -1 if there are too many children
+int nxcreole_tee_add(nxcreole_tee* tee, nxcreole_parse_ctx* child, unsigned events);
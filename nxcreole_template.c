@@ -0,0 +1,107 @@
+/*
+ * Copyright (c) 2014 Yaroslav Stavnichiy <yarosla@gmail.com>
+ *
+ * This file is part of NXCREOLE.
+ *
+ * NXCREOLE is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License
+ * as published by the Free Software Foundation, either version 3
+ * of the License, or (at your option) any later version.
+ *
+ * NXCREOLE is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with NXCREOLE. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <wchar.h>
+#include <string.h>
+#include <stdlib.h>
+
+#include "nxcreole_parser.h"
+#include "nxcreole_out.h"
+#include "nxcreole_xhtml.h"
+#include "nxcreole_template.h"
+
+#define MIN_HOLES 16
+
+typedef void (*placeholder_fn)(nxcreole_xhtml_serializer* xs, const wchar_t* s, size_t len);
+
+typedef struct {
+  nxcreole_xhtml_serializer xs; // must be first: XHTML serializer's functions get pointer to it
+  nxcreole_template* tpl;
+  placeholder_fn append_placeholder; // XHTML serializer's own one
+} compiler_t;
+
+static void append_hole(nxcreole_xhtml_serializer* xs, const wchar_t* s, size_t len) {
+  compiler_t* c=(compiler_t*)xs;
+  nxcreole_template* tpl=c->tpl;
+  if (tpl->error) return;
+  if (tpl->hole_count==tpl->hole_capacity) {
+    size_t capacity=tpl->hole_capacity? tpl->hole_capacity*2 : MIN_HOLES;
+    nxcreole_template_hole* holes=realloc(tpl->holes, capacity*sizeof(nxcreole_template_hole));
+    if (!holes) {
+      tpl->error=1;
+      return;
+    }
+    tpl->holes=holes;
+    tpl->hole_capacity=capacity;
+  }
+  nxcreole_template_hole* hole=&tpl->holes[tpl->hole_count++];
+  hole->offset=tpl->xhtml.length;
+  hole->name_offset=tpl->strings.length;
+  nxcreole_out_wchars(&tpl->strings, s, len);
+  hole->name_length=tpl->strings.length-hole->name_offset;
+  hole->default_offset=tpl->strings.length;
+  xs->out=&tpl->strings;
+  c->append_placeholder(xs, s, len);
+  xs->out=&tpl->xhtml;
+  hole->default_length=tpl->strings.length-hole->default_offset;
+}
+
+int nxcreole_template_compile(nxcreole_template* tpl, const wchar_t* text) {
+  memset(tpl, 0, sizeof(nxcreole_template));
+  if (nxcreole_out_init(&tpl->xhtml, wcslen(text)*2, 0, 0)
+      || nxcreole_out_init(&tpl->strings, 0, 0, 0)) {
+    nxcreole_template_free(tpl);
+    return -1;
+  }
+  nxcreole_parse_ctx ctx;
+  compiler_t c;
+  nxcreole_init(&ctx, text);
+  nxcreole_xhtml_init(&ctx, &c.xs, &tpl->xhtml);
+  c.tpl=tpl;
+  c.append_placeholder=(placeholder_fn)ctx.fn[FN_APPEND_PLACEHOLDER];
+  ctx.fn[FN_APPEND_PLACEHOLDER]=(void*)&append_hole;
+  ctx.fragments=0;
+  nxcreole_parse(&ctx);
+  if (tpl->error || tpl->xhtml.error || tpl->strings.error) {
+    nxcreole_template_free(tpl);
+    return -1;
+  }
+  return 0;
+}
+
+void nxcreole_template_free(nxcreole_template* tpl) {
+  nxcreole_out_free(&tpl->xhtml);
+  nxcreole_out_free(&tpl->strings);
+  if (tpl->holes) free(tpl->holes);
+  tpl->holes=0;
+  tpl->hole_count=tpl->hole_capacity=0;
+}
+
+void nxcreole_template_splice(const nxcreole_template* tpl, nxcreole_hole_fn fn, void* data, nxcreole_out* out) {
+  size_t pos=0, i;
+  for (i=0; i<tpl->hole_count; i++) {
+    const nxcreole_template_hole* hole=&tpl->holes[i];
+    nxcreole_out_write(out, tpl->xhtml.buf+pos, hole->offset-pos);
+    pos=hole->offset;
+    if (!fn || fn(data, tpl->strings.buf+hole->name_offset, hole->name_length, out)) {
+      nxcreole_out_write(out, tpl->strings.buf+hole->default_offset, hole->default_length);
+    }
+  }
+  nxcreole_out_write(out, tpl->xhtml.buf+pos, tpl->xhtml.length-pos);
+}
@@ -0,0 +1,47 @@
+/*
+ * Copyright (c) 2014 Yaroslav Stavnichiy <yarosla@gmail.com>
+ *
+ * This file is part of NXCREOLE.
+ *
+ * NXCREOLE is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License
+ * as published by the Free Software Foundation, either version 3
+ * of the License, or (at your option) any later version.
+ *
+ * NXCREOLE is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with NXCREOLE. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*
+ * Compiled XHTML templates. Page is parsed and serialized once into static XHTML
+ * with holes in place of <<<placeholders>>>; then it can be spliced any number
+ * of times with different placeholder contents, without re-parsing.
+ */
+
+typedef struct nxcreole_template_hole {
+  size_t offset; // position in static XHTML
+  size_t name_offset, name_length; // UTF-8 placeholder text in strings
+  size_t default_offset, default_length; // XHTML serializer's rendering of placeholder in strings
+} nxcreole_template_hole;
+
+typedef struct nxcreole_template {
+  nxcreole_out xhtml; // static XHTML with holes cut out
+  nxcreole_out strings; // hole names and default renderings
+  nxcreole_template_hole* holes;
+  size_t hole_count;
+  size_t hole_capacity;
+  int error;
+} nxcreole_template;
+
+// fills hole named name into out; returns nonzero to leave default rendering of placeholder
+typedef int (*nxcreole_hole_fn)(void* data, const char* name, size_t name_length, nxcreole_out* out);
+
+int nxcreole_template_compile(nxcreole_template* tpl, const wchar_t* text); // returns -1 if out of memory
+void nxcreole_template_free(nxcreole_template* tpl);
+
+void nxcreole_template_splice(const nxcreole_template* tpl, nxcreole_hole_fn fn, void* data, nxcreole_out* out);
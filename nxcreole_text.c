@@ -0,0 +1,124 @@
+/*
+ * Copyright (c) 2014 Yaroslav Stavnichiy <yarosla@gmail.com>
+ *
+ * This file is part of NXCREOLE.
+ *
+ * NXCREOLE is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License
+ * as published by the Free Software Foundation, either version 3
+ * of the License, or (at your option) any later version.
+ *
+ * NXCREOLE is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with NXCREOLE. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <wchar.h>
+#include <string.h>
+
+#include "nxcreole_parser.h"
+#include "nxcreole_out.h"
+#include "nxcreole_text.h"
+
+static void write_text(nxcreole_text_serializer* ts, const wchar_t* s, size_t len) {
+  if (!len) return;
+  nxcreole_out_wchars(ts->out, s, len);
+  ts->at_line_start=s[len-1]==L'\n';
+}
+
+static void end_line(nxcreole_text_serializer* ts) {
+  if (!ts->at_line_start) {
+    nxcreole_out_write(ts->out, "\n", 1);
+    ts->at_line_start=1;
+  }
+}
+
+static void append0(nxcreole_parse_ctx* ctx, nxcreole_fn_id_t fn) {
+  nxcreole_text_serializer* ts=ctx->data;
+  switch (fn) {
+    case FN_APPEND_TABLE_ROW_OPEN:
+      ts->need_cell_sep=0;
+      break;
+    case FN_APPEND_TABLE_HEAD_CELL_CLOSE:
+    case FN_APPEND_TABLE_CELL_CLOSE:
+      ts->need_cell_sep=1;
+      break;
+    case FN_APPEND_BR:
+      nxcreole_out_write(ts->out, "\n", 1);
+      ts->at_line_start=1;
+      break;
+    case FN_APPEND_TABLE_OPEN:
+    case FN_APPEND_TABLE_ROW_CLOSE:
+    case FN_APPEND_TABLE_CLOSE:
+    case FN_APPEND_PARAGRAPH_OPEN:
+    case FN_APPEND_PARAGRAPH_CLOSE:
+    case FN_APPEND_HR:
+      end_line(ts);
+      break;
+    default:
+      break;
+  }
+}
+
+static void append1(nxcreole_parse_ctx* ctx, nxcreole_fn_id_t fn, const wchar_t* s, size_t len) {
+  nxcreole_text_serializer* ts=ctx->data;
+  const wchar_t* title;
+  switch (fn) {
+    case FN_APPEND_TEXT:
+    case FN_APPEND_NOWIKI_INLINE:
+      write_text(ts, s, len);
+      break;
+    case FN_APPEND_TABLE_HEAD_CELL_OPEN:
+    case FN_APPEND_TABLE_CELL_OPEN:
+      if (ts->need_cell_sep) {
+        nxcreole_out_write(ts->out, "\t", 1);
+        ts->at_line_start=0;
+      }
+      break;
+    case FN_APPEND_LIST_OPEN:
+    case FN_APPEND_LIST_NEXT_ITEM:
+    case FN_APPEND_LIST_BLANK_ITEM:
+    case FN_APPEND_LIST_CLOSE:
+    case FN_APPEND_HEADING_OPEN:
+    case FN_APPEND_HEADING_CLOSE:
+      end_line(ts);
+      break;
+    case FN_APPEND_NOWIKI_BLOCK:
+      end_line(ts);
+      write_text(ts, s, len);
+      end_line(ts);
+      break;
+    case FN_APPEND_IMAGE: // alt text only
+      title=wmemchr(s, L'|', len);
+      if (title) write_text(ts, title+1, len-(title-s)-1);
+      break;
+    case FN_APPEND_LINK: // title or target if no title
+      title=wmemchr(s, L'|', len);
+      if (title) write_text(ts, title+1, len-(title-s)-1);
+      else write_text(ts, s, len);
+      break;
+    default: // placeholders are not text
+      break;
+  }
+}
+
+void nxcreole_text_init(nxcreole_parse_ctx* ctx, nxcreole_text_serializer* ts, nxcreole_out* out) {
+  memset(ts, 0, sizeof(nxcreole_text_serializer));
+  ts->out=out;
+  ts->at_line_start=1;
+  ctx->append0=append0;
+  ctx->append1=append1;
+  ctx->data=ts;
+}
+
+void nxcreole_render_text(const wchar_t* text, nxcreole_out* out) {
+  nxcreole_parse_ctx ctx;
+  nxcreole_text_serializer ts;
+  nxcreole_init(&ctx, text);
+  nxcreole_text_init(&ctx, &ts, out);
+  nxcreole_parse(&ctx);
+}
@@ -0,0 +1,38 @@
+/*
+ * Copyright (c) 2014 Yaroslav Stavnichiy <yarosla@gmail.com>
+ *
+ * This file is part of NXCREOLE.
+ *
+ * NXCREOLE is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License
+ * as published by the Free Software Foundation, either version 3
+ * of the License, or (at your option) any later version.
+ *
+ * NXCREOLE is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with NXCREOLE. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*
+ * Plain text serializer (eg. for search indexing).
+ *
+ * Drops all markup but keeps text, nowiki, link titles (or targets if untitled)
+ * and image alt texts. Blocks (paragraphs, headings, list items, table rows, etc.)
+ * are separated by newlines, table cells by tabs. Output is UTF-8.
+ */
+
+typedef struct nxcreole_text_serializer {
+  nxcreole_out* out;
+  unsigned at_line_start:1;
+  unsigned need_cell_sep:1;
+} nxcreole_text_serializer;
+
+// set up ctx (initialized by nxcreole_init) to serialize into out
+void nxcreole_text_init(nxcreole_parse_ctx* ctx, nxcreole_text_serializer* ts, nxcreole_out* out);
+
+// shortcut: parse text and append plain text to out
+void nxcreole_render_text(const wchar_t* text, nxcreole_out* out);
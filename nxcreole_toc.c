@@ -0,0 +1,265 @@
+/*
+ * Copyright (c) 2014 Yaroslav Stavnichiy <yarosla@gmail.com>
+ *
+ * This file is part of NXCREOLE.
+ *
+ * NXCREOLE is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License
+ * as published by the Free Software Foundation, either version 3
+ * of the License, or (at your option) any later version.
+ *
+ * NXCREOLE is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with NXCREOLE. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <stdio.h>
+#include <wchar.h>
+#include <string.h>
+#include <stdlib.h>
+
+#include "nxcreole_out.h"
+#include "nxcreole_toc.h"
+
+#define MIN_ID_TABLE_SIZE 64
+#define MIN_TITLE_CAPACITY 64
+#define MAX_TOC_DEPTH ((int)(sizeof(((nxcreole_toc*)0)->levels)/sizeof(int)))
+
+int nxcreole_toc_init(nxcreole_toc* toc) {
+  memset(toc, 0, sizeof(nxcreole_toc));
+  if (nxcreole_out_init(&toc->out, 1024, 0, 0) || nxcreole_out_init(&toc->heading, 256, 0, 0)
+      || nxcreole_out_init(&toc->ids, 1024, 0, 0)
+      || !(toc->id_table=calloc(MIN_ID_TABLE_SIZE, sizeof(nxcreole_toc_id)))) {
+    nxcreole_toc_free(toc);
+    return -1;
+  }
+  toc->id_table_size=MIN_ID_TABLE_SIZE;
+  return 0;
+}
+
+void nxcreole_toc_free(nxcreole_toc* toc) {
+  nxcreole_out_free(&toc->out);
+  nxcreole_out_free(&toc->heading);
+  nxcreole_out_free(&toc->ids);
+  if (toc->title) free(toc->title);
+  if (toc->id_table) free(toc->id_table);
+  toc->title=0;
+  toc->id_table=0;
+}
+
+void nxcreole_toc_begin(nxcreole_toc* toc, nxcreole_out* page, wchar_t level) {
+  toc->page=page;
+  toc->heading_level=level;
+  toc->heading.length=0;
+  toc->title_length=0;
+  toc->in_heading=1;
+}
+
+void nxcreole_toc_title(nxcreole_toc* toc, const wchar_t* s, size_t length) {
+  if (toc->title_length+length>toc->title_capacity) {
+    size_t capacity=toc->title_capacity? toc->title_capacity*2 : MIN_TITLE_CAPACITY;
+    while (capacity<toc->title_length+length) capacity*=2;
+    wchar_t* title=realloc(toc->title, capacity*sizeof(wchar_t));
+    if (!title) {
+      toc->error=1;
+      return;
+    }
+    toc->title=title;
+    toc->title_capacity=capacity;
+  }
+  wmemcpy(toc->title+toc->title_length, s, length);
+  toc->title_length+=length;
+}
+
+// FNV-1a
+static size_t id_hash(const char* s, size_t length) {
+  size_t h=2166136261u;
+  const char* end=s+length;
+  for (; s<end; s++) h=(h^(unsigned char)*s)*16777619u;
+  return h;
+}
+
+// slot of id in table: where it is or where it goes
+static nxcreole_toc_id* id_slot(nxcreole_toc* toc, const char* s, size_t length) {
+  size_t mask=toc->id_table_size-1;
+  size_t i=id_hash(s, length)&mask;
+  for (; toc->id_table[i].offset; i=(i+1)&mask) {
+    const char* id=toc->ids.buf+toc->id_table[i].offset-1;
+    if (!strncmp(id, s, length) && !id[length]) break;
+  }
+  return &toc->id_table[i];
+}
+
+static int grow_id_table(nxcreole_toc* toc) {
+  nxcreole_toc_id* old=toc->id_table;
+  size_t i, old_size=toc->id_table_size;
+  toc->id_table=calloc(old_size*2, sizeof(nxcreole_toc_id));
+  if (!toc->id_table) {
+    toc->id_table=old;
+    return -1;
+  }
+  toc->id_table_size=old_size*2;
+  for (i=0; i<old_size; i++) {
+    if (!old[i].offset) continue;
+    const char* id=toc->ids.buf+old[i].offset-1;
+    *id_slot(toc, id, strlen(id))=old[i];
+  }
+  free(old);
+  return 0;
+}
+
+static int is_ascii_alnum(wchar_t c) {
+  return (c>=L'a' && c<=L'z') || (c>=L'A' && c<=L'Z') || (c>=L'0' && c<=L'9');
+}
+
+static int is_space(wchar_t c) {
+  return c==L' ' || c==L'\t' || c==L'\n' || c==L'\r' || c==0xa0 || (c>=0x2000 && c<=0x200b) || c==0x3000;
+}
+
+// letters and digits of any script, as far as it can be told without locale
+static int is_id_char(wchar_t c) {
+  if (c<0x80) return is_ascii_alnum(c);
+  if (c<0xc0) return 0; // Latin-1 punctuation and symbols
+  if (c==0xd7 || c==0xf7) return 0; // multiplication and division signs
+  if (c>=0x2000 && c<=0x206f) return 0; // general punctuation (dashes, quotes, spaces)
+  return c!=0x3000;
+}
+
+// id made of title at the end of toc->ids (not terminated)
+static void write_slug(nxcreole_toc* toc) {
+  size_t i, n=0;
+  int dash=0;
+  for (i=0; i<toc->title_length; i++) {
+    wchar_t c=toc->title[i];
+    if (is_id_char(c)) {
+      if (dash && n) nxcreole_out_write(&toc->ids, "-", 1);
+      dash=0;
+      if ((c>=L'A' && c<=L'Z') || (c>=0xc0 && c<=0xde)) c+=L'a'-L'A'; // ASCII and Latin-1
+      nxcreole_out_wchars(&toc->ids, &c, 1);
+      n++;
+    }
+    else {
+      dash=1;
+    }
+  }
+  if (!n) nxcreole_out_puts(&toc->ids, "section");
+}
+
+static void add_entry(nxcreole_toc* toc, int level, const char* id) {
+  nxcreole_out* out=&toc->out;
+  if (!toc->depth) {
+    nxcreole_out_puts(out, "<ul class=\"toc\">\n<li>");
+    toc->levels[toc->depth++]=level;
+  }
+  else if (level>toc->levels[toc->depth-1] && toc->depth<MAX_TOC_DEPTH) {
+    nxcreole_out_puts(out, "\n<ul>\n<li>");
+    toc->levels[toc->depth++]=level;
+  }
+  else {
+    while (toc->depth>1 && level<=toc->levels[toc->depth-2]) {
+      nxcreole_out_puts(out, "</li>\n</ul>");
+      toc->depth--;
+    }
+    nxcreole_out_puts(out, "</li>\n<li>");
+    toc->levels[toc->depth-1]=level;
+  }
+  const wchar_t* title=toc->title;
+  const wchar_t* end=title+toc->title_length;
+  while (title<end && is_space(*title)) title++;
+  while (end>title && is_space(end[-1])) end--;
+  nxcreole_out_puts(out, "<a href=\"#");
+  nxcreole_out_puts(out, id);
+  nxcreole_out_puts(out, "\">");
+  nxcreole_out_html(out, title, end-title);
+  nxcreole_out_puts(out, "</a>");
+}
+
+const char* nxcreole_toc_add(nxcreole_toc* toc) {
+  nxcreole_out* ids=&toc->ids;
+  size_t start=ids->length;
+  toc->in_heading=0;
+  if ((toc->count+1)*2>toc->id_table_size && grow_id_table(toc) && toc->count+1>=toc->id_table_size) {
+    toc->error=1; // table must keep an empty slot
+    return "section";
+  }
+  write_slug(toc);
+  size_t slug_length=ids->length-start;
+  nxcreole_toc_id* slot=ids->error? 0 : id_slot(toc, ids->buf+start, slug_length);
+  if (slot && slot->offset) { // repeated: first free suffix from where previous repeat stopped
+    nxcreole_toc_id* base=slot;
+    size_t n=base->next? base->next : 2;
+    for (; slot && slot->offset; n++) {
+      char suffix[24];
+      ids->length=start+slug_length;
+      ids->total=ids->length;
+      sprintf(suffix, "-%zu", n);
+      nxcreole_out_puts(ids, suffix);
+      slot=ids->error? 0 : id_slot(toc, ids->buf+start, ids->length-start);
+    }
+    base->next=n;
+  }
+  nxcreole_out_write(ids, "", 1); // NUL
+  if (!slot || ids->error) {
+    toc->error=1;
+    return "section";
+  }
+  slot->offset=start+1;
+  slot->next=0;
+  toc->count++;
+  const char* id=ids->buf+start;
+  add_entry(toc, toc->heading_level-L'0', id);
+  return id;
+}
+
+int nxcreole_toc_finish(nxcreole_toc* toc, nxcreole_out* page) {
+  if (toc->in_heading) { // heading was not closed: write it out without id
+    wchar_t h=toc->heading_level;
+    toc->in_heading=0;
+    nxcreole_out_puts(page, "<h");
+    nxcreole_out_wchars(page, &h, 1);
+    nxcreole_out_puts(page, ">");
+    nxcreole_out_write(page, toc->heading.buf, toc->heading.length);
+  }
+  if (toc->depth) {
+    while (toc->depth) {
+      nxcreole_out_puts(&toc->out, "</li>\n</ul>");
+      toc->depth--;
+    }
+    nxcreole_out_puts(&toc->out, "\n");
+  }
+  if (toc->error || toc->out.error || toc->heading.error) return -1;
+  if (!toc->has_slot || toc->placed) return 0;
+  size_t n=toc->out.length;
+  if (page->counting) {
+    page->total+=n;
+    toc->placed=1;
+    return 0;
+  }
+  size_t flushed=page->total-page->length;
+  // growing page must not flush it
+  if (toc->slot<flushed || (page->sink && page->size-page->length<n)) return -1;
+  size_t pos=toc->slot-flushed;
+  size_t cut=0;
+  // placeholder alone in paragraph: TOC replaces the paragraph
+  if (pos>=3 && !memcmp(page->buf+pos-3, "<p>", 3) && page->length-pos>=5 && !memcmp(page->buf+pos, "</p>\n", 5)) {
+    pos-=3;
+    cut=8;
+  }
+  size_t tail=page->length-pos; // including cut
+  if (n>cut) {
+    nxcreole_out_write(page, toc->out.buf, n-cut);
+    if (page->error) return -1;
+  }
+  else {
+    page->length-=cut-n;
+    page->total-=cut-n;
+  }
+  memmove(page->buf+pos+n, page->buf+pos+cut, tail-cut);
+  memcpy(page->buf+pos, toc->out.buf, n);
+  toc->placed=1;
+  return 0;
+}
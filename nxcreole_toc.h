@@ -0,0 +1,71 @@
+/*
+ * Copyright (c) 2014 Yaroslav Stavnichiy <yarosla@gmail.com>
+ *
+ * This file is part of NXCREOLE.
+ *
+ * NXCREOLE is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License
+ * as published by the Free Software Foundation, either version 3
+ * of the License, or (at your option) any later version.
+ *
+ * NXCREOLE is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with NXCREOLE. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*
+ * Table of contents collected by XHTML serializer while it renders the page
+ * (see nxcreole_xhtml_use_toc()), so that page with TOC is parsed once.
+ *
+ * Every heading gets id attribute made of its text: ASCII letters and digits
+ * lowercased, other ASCII characters collapsed into single dashes, non-ASCII
+ * characters kept ("section" if nothing is left); repeated ids get -2, -3, ...
+ * appended. Ids depend only on heading texts in order, so they are stable
+ * between renders of the same text.
+ *
+ * TOC is nested <ul class="toc"> list of links to headings, following heading
+ * levels. It is left in toc->out and also inserted into page output in place of
+ * the first <<<toc>>> placeholder, if any, when rendering finishes.
+ */
+
+typedef struct nxcreole_toc_id {
+  size_t offset; // of id in ids, +1 (0 for empty slot)
+  size_t next; // suffix to try first when id is repeated
+} nxcreole_toc_id;
+
+typedef struct nxcreole_toc {
+  nxcreole_out out; // TOC fragment (UTF-8), empty if there are no headings
+  size_t count; // headings
+  int placed; // TOC was inserted into page output
+  int error; // out of memory
+  // used while rendering
+  nxcreole_out heading; // XHTML of heading being rendered, written to page when it closes
+  nxcreole_out* page; // page output while heading is rendered
+  wchar_t heading_level;
+  unsigned in_heading:1;
+  unsigned has_slot:1; // <<<toc>>> seen
+  size_t slot; // its offset in page output (counting flushed bytes)
+  wchar_t* title; // heading text
+  size_t title_length, title_capacity;
+  nxcreole_out ids; // NUL-terminated ids given so far
+  nxcreole_toc_id* id_table; // open addressing hash of ids
+  size_t id_table_size; // power of 2
+  int levels[16]; // heading levels of open TOC lists
+  int depth;
+} nxcreole_toc;
+
+int nxcreole_toc_init(nxcreole_toc* toc); // returns -1 if out of memory
+void nxcreole_toc_free(nxcreole_toc* toc);
+
+// used by XHTML serializer: heading text is collected between begin and add;
+// add returns unique id (NUL-terminated, valid until next add) and adds TOC entry
+void nxcreole_toc_begin(nxcreole_toc* toc, nxcreole_out* page, wchar_t level);
+void nxcreole_toc_title(nxcreole_toc* toc, const wchar_t* s, size_t length);
+const char* nxcreole_toc_add(nxcreole_toc* toc);
+// closes TOC lists and inserts TOC at <<<toc>>> slot of page; returns -1 if slot
+// is already flushed to sink or out of memory
+int nxcreole_toc_finish(nxcreole_toc* toc, nxcreole_out* page);
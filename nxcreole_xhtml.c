@@ -0,0 +1,613 @@
+/*
+ * Copyright (c) 2014 Yaroslav Stavnichiy <yarosla@gmail.com>
+ *
+ * This file is part of NXCREOLE.
+ *
+ * NXCREOLE is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License
+ * as published by the Free Software Foundation, either version 3
+ * of the License, or (at your option) any later version.
+ *
+ * NXCREOLE is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with NXCREOLE. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <assert.h>
+#include <stdio.h>
+#include <wchar.h>
+#include <string.h>
+#include <stdlib.h>
+#include <stddef.h>
+#ifdef NXCREOLE_STATS
+#include <time.h>
+#endif
+
+#include "nxcreole_parser.h"
+#include "nxcreole_out.h"
+#include "nxcreole_xhtml.h"
+#include "nxcreole_resolve.h"
+#include "nxcreole_toc.h"
+
+static void append_text(nxcreole_xhtml_serializer* xs, const wchar_t* s, size_t len) {
+  if (xs->toc && xs->toc->in_heading) nxcreole_toc_title(xs->toc, s, len);
+  nxcreole_out_html(xs->out, s, len);
+}
+
+static void append_table_open(nxcreole_xhtml_serializer* xs) {
+  nxcreole_out_puts(xs->out, "<table>");
+}
+
+static void append_table_row_open(nxcreole_xhtml_serializer* xs) {
+  nxcreole_out_puts(xs->out, "<tr>");
+}
+
+static void append_table_head_cell_open(nxcreole_xhtml_serializer* xs, const wchar_t* s, size_t len) {
+  if (len==1 && *s==L'1') {
+    nxcreole_out_puts(xs->out, "<th>");
+  }
+  else {
+    nxcreole_out_puts(xs->out, "<th colspan=\"");
+    nxcreole_out_wchars(xs->out, s, len);
+    nxcreole_out_puts(xs->out, "\">");
+  }
+}
+
+static void append_table_head_cell_close(nxcreole_xhtml_serializer* xs) {
+  nxcreole_out_puts(xs->out, "</th>");
+}
+
+static void append_table_cell_open(nxcreole_xhtml_serializer* xs, const wchar_t* s, size_t len) {
+  if (len==1 && *s==L'1') {
+    nxcreole_out_puts(xs->out, "<td>");
+  }
+  else {
+    nxcreole_out_puts(xs->out, "<td colspan=\"");
+    nxcreole_out_wchars(xs->out, s, len);
+    nxcreole_out_puts(xs->out, "\">");
+  }
+}
+
+static void append_table_cell_close(nxcreole_xhtml_serializer* xs) {
+  nxcreole_out_puts(xs->out, "</td>");
+}
+
+static void append_table_row_close(nxcreole_xhtml_serializer* xs) {
+  nxcreole_out_puts(xs->out, "</tr>");
+}
+
+static void append_table_close(nxcreole_xhtml_serializer* xs) {
+  nxcreole_out_puts(xs->out, "</table>");
+}
+
+// tags of list and formatting events by their kind; shared with event_size()
+static const char* list_open_tag(wchar_t c) {
+  switch (c) {
+    case L'*': return "<ul><li>";
+    case L'-': return "<ul><li>";
+    case L'#': return "<ol><li>";
+    case L'>': return "<blockquote>";
+    case L':': return "<div class=\"indent\">";
+    case L'!': return "<div class=\"center\">";
+  }
+  return "?";
+}
+
+static const char* list_next_item_tag(wchar_t c) {
+  switch (c) {
+    case L'*': return "</li>\n<li>";
+    case L'-': return "</li>\n<li>";
+    case L'#': return "</li>\n<li>";
+    case L'!': return "</div>\n<div class=\"center\">";
+  }
+  return 0;
+}
+
+static const char* list_blank_item_tag(wchar_t c) {
+  switch (c) {
+    case L'*': return "&nbsp;";
+    case L'-': return "&nbsp;";
+    case L'#': return "&nbsp;";
+    case L'>': return "<br/><br/>\n";
+    case L':': return "<br/><br/>\n";
+    case L'!': return "&nbsp;";
+  }
+  return 0;
+}
+
+static const char* list_close_tag(wchar_t c) {
+  switch (c) {
+    case L'*': return "</li></ul>\n";
+    case L'-': return "</li></ul>\n";
+    case L'#': return "</li></ol>\n";
+    case L'>': return "</blockquote>\n";
+    case L':': return "</div>\n";
+    case L'!': return "</div>\n";
+  }
+  return 0;
+}
+
+static const char* format_open_tag(wchar_t c) {
+  switch (c) {
+    case L'*': return "<strong>";
+    case L'/': return "<em>";
+    case L'_': return "<span class=\"underline\">";
+    case L'#': return "<code>";
+  }
+  return 0;
+}
+
+static const char* format_close_tag(wchar_t c) {
+  switch (c) {
+    case L'*': return "</strong>";
+    case L'/': return "</em>";
+    case L'_': return "</span>";
+    case L'#': return "</code>";
+  }
+  return 0;
+}
+
+static void append_tag(nxcreole_xhtml_serializer* xs, const char* r) {
+  if (r) nxcreole_out_puts(xs->out, r);
+}
+
+static void append_list_open(nxcreole_xhtml_serializer* xs, const wchar_t* s, size_t len) {
+  assert(len==1);
+  append_tag(xs, list_open_tag(*s));
+}
+
+static void append_list_next_item(nxcreole_xhtml_serializer* xs, const wchar_t* s, size_t len) {
+  assert(len==1);
+  append_tag(xs, list_next_item_tag(*s));
+}
+
+static void append_list_blank_item(nxcreole_xhtml_serializer* xs, const wchar_t* s, size_t len) {
+  assert(len==1);
+  append_tag(xs, list_blank_item_tag(*s));
+}
+
+static void append_list_close(nxcreole_xhtml_serializer* xs, const wchar_t* s, size_t len) {
+  assert(len==1);
+  append_tag(xs, list_close_tag(*s));
+}
+
+static void append_paragraph_open(nxcreole_xhtml_serializer* xs) {
+  nxcreole_out_puts(xs->out, "<p>");
+}
+
+static void append_paragraph_close(nxcreole_xhtml_serializer* xs) {
+  nxcreole_out_puts(xs->out, "</p>\n");
+}
+
+// with TOC heading is rendered aside until its text (and so its id) is known
+static void append_heading_open(nxcreole_xhtml_serializer* xs, const wchar_t* s, size_t len) {
+  if (xs->toc) {
+    nxcreole_toc_begin(xs->toc, xs->out, *s);
+    xs->out=&xs->toc->heading;
+    return;
+  }
+  nxcreole_out_puts(xs->out, "<h");
+  nxcreole_out_wchars(xs->out, s, len);
+  nxcreole_out_puts(xs->out, ">");
+}
+
+static void append_heading_close(nxcreole_xhtml_serializer* xs, const wchar_t* s, size_t len) {
+  if (xs->toc && xs->toc->in_heading) {
+    const char* id=nxcreole_toc_add(xs->toc);
+    xs->out=xs->toc->page;
+    nxcreole_out_puts(xs->out, "<h");
+    nxcreole_out_wchars(xs->out, s, len);
+    nxcreole_out_puts(xs->out, " id=\"");
+    nxcreole_out_puts(xs->out, id);
+    nxcreole_out_puts(xs->out, "\">");
+    nxcreole_out_write(xs->out, xs->toc->heading.buf, xs->toc->heading.length);
+  }
+  nxcreole_out_puts(xs->out, "</h");
+  nxcreole_out_wchars(xs->out, s, len);
+  nxcreole_out_puts(xs->out, ">\n");
+}
+
+static void append_format_open(nxcreole_xhtml_serializer* xs, const wchar_t* s, size_t len) {
+  assert(len==1);
+  append_tag(xs, format_open_tag(*s));
+}
+
+static void append_format_close(nxcreole_xhtml_serializer* xs, const wchar_t* s, size_t len) {
+  assert(len==1);
+  append_tag(xs, format_close_tag(*s));
+}
+
+static void append_hr(nxcreole_xhtml_serializer* xs) {
+  nxcreole_out_puts(xs->out, "\n<hr/>\n");
+}
+
+static void append_br(nxcreole_xhtml_serializer* xs) {
+  nxcreole_out_puts(xs->out, "<br/>\n");
+}
+
+static void append_nowiki_block(nxcreole_xhtml_serializer* xs, const wchar_t* s, size_t len) {
+  nxcreole_out_puts(xs->out, "<pre>");
+  nxcreole_out_html(xs->out, s, len);
+  nxcreole_out_puts(xs->out, "</pre>\n");
+}
+
+static void append_nowiki_inline(nxcreole_xhtml_serializer* xs, const wchar_t* s, size_t len) {
+  if (xs->toc && xs->toc->in_heading) nxcreole_toc_title(xs->toc, s, len);
+  nxcreole_out_puts(xs->out, "<span class=\"nowiki\">");
+  nxcreole_out_html(xs->out, s, len);
+  nxcreole_out_puts(xs->out, "</span>");
+}
+
+// writes href/src value and closing quote, plus class for missing target
+static void append_target(nxcreole_xhtml_serializer* xs, nxcreole_fn_id_t fn, const wchar_t* s, size_t len) {
+  const nxcreole_link_target* t=xs->links? nxcreole_link_table_find(xs->links, fn, s, len) : 0;
+  if (t && t->url) nxcreole_out_html(xs->out, t->url, t->url_length);
+  else nxcreole_out_html(xs->out, s, len);
+  nxcreole_out_puts(xs->out, t && t->missing? "\" class=\"missing\"" : "\"");
+}
+
+static void append_image(nxcreole_xhtml_serializer* xs, const wchar_t* s, size_t len) {
+  const wchar_t* title=wmemchr(s, L'|', len);
+  nxcreole_out_puts(xs->out, "<img src=\"");
+  append_target(xs, FN_APPEND_IMAGE, s, title?title-s : len);
+  if (title) {
+    nxcreole_out_puts(xs->out, " alt=\"");
+    nxcreole_out_html(xs->out, title+1, len-(title-s)-1);
+    nxcreole_out_puts(xs->out, "\"");
+  }
+  nxcreole_out_puts(xs->out, " />");
+}
+
+static void append_link(nxcreole_xhtml_serializer* xs, const wchar_t* s, size_t len) {
+  const wchar_t* title=wmemchr(s, L'|', len);
+  if (xs->toc && xs->toc->in_heading) {
+    if (title) nxcreole_toc_title(xs->toc, title+1, len-(title-s)-1);
+    else nxcreole_toc_title(xs->toc, s, len);
+  }
+  nxcreole_out_puts(xs->out, "<a href=\"");
+  append_target(xs, FN_APPEND_LINK, s, title?title-s : len);
+  nxcreole_out_puts(xs->out, ">");
+  if (title)
+    nxcreole_out_html(xs->out, title+1, len-(title-s)-1);
+  else
+    nxcreole_out_html(xs->out, s, len);
+  nxcreole_out_puts(xs->out, "</a>");
+}
+
+static void append_placeholder(nxcreole_xhtml_serializer* xs, const wchar_t* s, size_t len) {
+  if (xs->toc && !xs->toc->in_heading && !xs->toc->has_slot && len==3 && !wmemcmp(s, L"toc", 3)) {
+    xs->toc->has_slot=1;
+    xs->toc->slot=xs->out->total;
+    return;
+  }
+  nxcreole_out_puts(xs->out, "&lt;&lt;&lt;Placeholder:");
+  nxcreole_out_html(xs->out, s, len);
+  nxcreole_out_puts(xs->out, "&gt;&gt;&gt;");
+}
+
+static void append_table_cell_next(nxcreole_xhtml_serializer* xs, const wchar_t* s, size_t len) {
+  append_table_cell_close(xs);
+  append_table_cell_open(xs, s, len);
+}
+
+static void append_table_head_cell_next(nxcreole_xhtml_serializer* xs, const wchar_t* s, size_t len) {
+  append_table_head_cell_close(xs);
+  append_table_head_cell_open(xs, s, len);
+}
+
+static void append_table_row_next(nxcreole_xhtml_serializer* xs) {
+  nxcreole_out_puts(xs->out, "</tr><tr>");
+}
+
+static void append_list_close_run(nxcreole_xhtml_serializer* xs, const wchar_t* s, size_t len) {
+  size_t i;
+  for (i=0; i<len; i++) append_list_close(xs, s+i, 1);
+}
+
+
+typedef void (*append0_sig)(nxcreole_xhtml_serializer* xs);
+typedef void (*append1_sig)(nxcreole_xhtml_serializer* xs, const wchar_t* s, size_t len);
+
+static void append0(nxcreole_parse_ctx* ctx, nxcreole_fn_id_t fn) {
+  ((append0_sig)ctx->fn[fn])(ctx->data);
+}
+
+static void append1(nxcreole_parse_ctx* ctx, nxcreole_fn_id_t fn, const wchar_t* s, size_t len) {
+  ((append1_sig)ctx->fn[fn])(ctx->data, s, len);
+}
+
+static void* fns[FN_FUSED_COUNT]={
+    &append_text,
+    &append_table_open,
+    &append_table_row_open,
+    &append_table_head_cell_open,
+    &append_table_head_cell_close,
+    &append_table_cell_open,
+    &append_table_cell_close,
+    &append_table_row_close,
+    &append_table_close,
+    &append_list_open,
+    &append_list_next_item,
+    &append_list_blank_item,
+    &append_list_close,
+    &append_paragraph_open,
+    &append_paragraph_close,
+    &append_heading_open,
+    &append_heading_close,
+    &append_format_open,
+    &append_format_close,
+    &append_hr,
+    &append_br,
+    &append_nowiki_block,
+    &append_nowiki_inline,
+    &append_image,
+    &append_link,
+    &append_placeholder,
+    &append_table_cell_next,
+    &append_table_head_cell_next,
+    &append_table_row_next,
+    &append_list_close_run,
+};
+
+// block output is reused only if it is in the buffer as a whole (not flushed to sink)
+static void fragment_begin(nxcreole_parse_ctx* ctx) {
+  nxcreole_xhtml_serializer* xs=(nxcreole_xhtml_serializer*)ctx->data;
+  xs->fragment_total=xs->out->total;
+  xs->fragment_length=xs->out->length;
+}
+
+static const char* fragment_end(nxcreole_parse_ctx* ctx, size_t* length) {
+  nxcreole_xhtml_serializer* xs=(nxcreole_xhtml_serializer*)ctx->data;
+  nxcreole_out* out=xs->out;
+  if (out->error || out->counting || out->length<xs->fragment_length
+      || out->total-xs->fragment_total!=out->length-xs->fragment_length) return 0;
+  *length=out->length-xs->fragment_length;
+  return out->buf+xs->fragment_length;
+}
+
+static void fragment_write(nxcreole_parse_ctx* ctx, const char* s, size_t length) {
+  nxcreole_out_write(((nxcreole_xhtml_serializer*)ctx->data)->out, s, length);
+}
+
+static const nxcreole_fragment_fns fragment_fns={1, fragment_begin, fragment_end, fragment_write};
+
+void nxcreole_xhtml_init(nxcreole_parse_ctx* ctx, nxcreole_xhtml_serializer* xs, nxcreole_out* out) {
+  memset(xs, 0, sizeof(nxcreole_xhtml_serializer));
+  xs->out=out;
+  ctx->append0=append0;
+  ctx->append1=append1;
+  memcpy(ctx->fn, fns, sizeof(ctx->fn));
+  ctx->data=xs;
+  ctx->fragments=&fragment_fns;
+}
+
+void nxcreole_xhtml_use_toc(nxcreole_parse_ctx* ctx, nxcreole_xhtml_serializer* xs, nxcreole_toc* toc) {
+  xs->toc=toc;
+  ctx->fragments=0; // heading output depends on headings before it
+}
+
+// direct calls for parser instantiated below; fn is constant at every call site,
+// so switch folds away and serializer functions get inlined into parser
+static inline void inline_append0(nxcreole_xhtml_serializer* xs, nxcreole_fn_id_t fn) {
+  switch (fn) {
+    case FN_APPEND_TABLE_OPEN: append_table_open(xs); break;
+    case FN_APPEND_TABLE_ROW_OPEN: append_table_row_open(xs); break;
+    case FN_APPEND_TABLE_HEAD_CELL_CLOSE: append_table_head_cell_close(xs); break;
+    case FN_APPEND_TABLE_CELL_CLOSE: append_table_cell_close(xs); break;
+    case FN_APPEND_TABLE_ROW_CLOSE: append_table_row_close(xs); break;
+    case FN_APPEND_TABLE_CLOSE: append_table_close(xs); break;
+    case FN_APPEND_PARAGRAPH_OPEN: append_paragraph_open(xs); break;
+    case FN_APPEND_PARAGRAPH_CLOSE: append_paragraph_close(xs); break;
+    case FN_APPEND_HR: append_hr(xs); break;
+    case FN_APPEND_BR: append_br(xs); break;
+    default: break;
+  }
+}
+
+static inline void inline_append1(nxcreole_xhtml_serializer* xs, nxcreole_fn_id_t fn, const wchar_t* s, size_t len) {
+  switch (fn) {
+    case FN_APPEND_TEXT: append_text(xs, s, len); break;
+    case FN_APPEND_TABLE_HEAD_CELL_OPEN: append_table_head_cell_open(xs, s, len); break;
+    case FN_APPEND_TABLE_CELL_OPEN: append_table_cell_open(xs, s, len); break;
+    case FN_APPEND_LIST_OPEN: append_list_open(xs, s, len); break;
+    case FN_APPEND_LIST_NEXT_ITEM: append_list_next_item(xs, s, len); break;
+    case FN_APPEND_LIST_BLANK_ITEM: append_list_blank_item(xs, s, len); break;
+    case FN_APPEND_LIST_CLOSE: append_list_close(xs, s, len); break;
+    case FN_APPEND_HEADING_OPEN: append_heading_open(xs, s, len); break;
+    case FN_APPEND_HEADING_CLOSE: append_heading_close(xs, s, len); break;
+    case FN_APPEND_FORMAT_OPEN: append_format_open(xs, s, len); break;
+    case FN_APPEND_FORMAT_CLOSE: append_format_close(xs, s, len); break;
+    case FN_APPEND_NOWIKI_BLOCK: append_nowiki_block(xs, s, len); break;
+    case FN_APPEND_NOWIKI_INLINE: append_nowiki_inline(xs, s, len); break;
+    case FN_APPEND_IMAGE: append_image(xs, s, len); break;
+    case FN_APPEND_LINK: append_link(xs, s, len); break;
+    case FN_APPEND_PLACEHOLDER: append_placeholder(xs, s, len); break;
+    default: break;
+  }
+}
+
+#define NXCREOLE_PARSE_FN nxcreole_xhtml_parse
+#define NXCREOLE_APPEND0(ctx, fn) inline_append0((nxcreole_xhtml_serializer*)(ctx)->data, (fn))
+#define NXCREOLE_APPEND1(ctx, fn, s, length) inline_append1((nxcreole_xhtml_serializer*)(ctx)->data, (fn), (s), (length))
+#include "nxcreole_parser_impl.h"
+
+void nxcreole_render_xhtml(const wchar_t* text, nxcreole_out* out) {
+  nxcreole_parse_ctx ctx;
+  nxcreole_xhtml_serializer xs;
+  nxcreole_init(&ctx, text);
+  nxcreole_xhtml_init(&ctx, &xs, out);
+  nxcreole_xhtml_parse(&ctx);
+}
+
+int nxcreole_render_xhtml_toc(const wchar_t* text, nxcreole_out* out, nxcreole_toc* toc) {
+  nxcreole_parse_ctx ctx;
+  nxcreole_xhtml_serializer xs;
+  nxcreole_init(&ctx, text);
+  nxcreole_xhtml_init(&ctx, &xs, out);
+  nxcreole_xhtml_use_toc(&ctx, &xs, toc);
+  nxcreole_xhtml_parse(&ctx);
+  return nxcreole_toc_finish(toc, out) || out->error? -1:0;
+}
+
+#define LITERAL_SIZE(s) (sizeof(s)-1)
+
+static size_t tag_size(const char* r) {
+  return r? strlen(r) : 0;
+}
+
+// bytes written for event by functions above without links and TOC; payload is
+// only measured (UTF-8 length plus entity lengths), tags are looked up, not written
+static size_t event_size(nxcreole_fn_id_t fn, const wchar_t* s, size_t len) {
+  const wchar_t* title;
+  size_t i, n;
+  switch (fn) {
+    case FN_APPEND_TEXT: return nxcreole_out_html_size(s, len);
+    case FN_APPEND_TABLE_OPEN: return LITERAL_SIZE("<table>");
+    case FN_APPEND_TABLE_ROW_OPEN: return LITERAL_SIZE("<tr>");
+    case FN_APPEND_TABLE_HEAD_CELL_OPEN:
+    case FN_APPEND_TABLE_CELL_OPEN:
+      if (len==1 && *s==L'1') return LITERAL_SIZE("<td>");
+      return LITERAL_SIZE("<td colspan=\"\">")+nxcreole_out_wchars_size(s, len);
+    case FN_APPEND_TABLE_HEAD_CELL_CLOSE:
+    case FN_APPEND_TABLE_CELL_CLOSE: return LITERAL_SIZE("</td>");
+    case FN_APPEND_TABLE_ROW_CLOSE: return LITERAL_SIZE("</tr>");
+    case FN_APPEND_TABLE_CLOSE: return LITERAL_SIZE("</table>");
+    case FN_APPEND_LIST_OPEN: return tag_size(list_open_tag(*s));
+    case FN_APPEND_LIST_NEXT_ITEM: return tag_size(list_next_item_tag(*s));
+    case FN_APPEND_LIST_BLANK_ITEM: return tag_size(list_blank_item_tag(*s));
+    case FN_APPEND_LIST_CLOSE: return tag_size(list_close_tag(*s));
+    case FN_APPEND_PARAGRAPH_OPEN: return LITERAL_SIZE("<p>");
+    case FN_APPEND_PARAGRAPH_CLOSE: return LITERAL_SIZE("</p>\n");
+    case FN_APPEND_HEADING_OPEN: return LITERAL_SIZE("<h>")+nxcreole_out_wchars_size(s, len);
+    case FN_APPEND_HEADING_CLOSE: return LITERAL_SIZE("</h>\n")+nxcreole_out_wchars_size(s, len);
+    case FN_APPEND_FORMAT_OPEN: return tag_size(format_open_tag(*s));
+    case FN_APPEND_FORMAT_CLOSE: return tag_size(format_close_tag(*s));
+    case FN_APPEND_HR: return LITERAL_SIZE("\n<hr/>\n");
+    case FN_APPEND_BR: return LITERAL_SIZE("<br/>\n");
+    case FN_APPEND_NOWIKI_BLOCK: return LITERAL_SIZE("<pre></pre>\n")+nxcreole_out_html_size(s, len);
+    case FN_APPEND_NOWIKI_INLINE: return LITERAL_SIZE("<span class=\"nowiki\"></span>")+nxcreole_out_html_size(s, len);
+    case FN_APPEND_IMAGE:
+      if (!(title=wmemchr(s, L'|', len))) return LITERAL_SIZE("<img src=\"\" />")+nxcreole_out_html_size(s, len);
+      return LITERAL_SIZE("<img src=\"\" alt=\"\" />")+nxcreole_out_html_size(s, title-s)
+             +nxcreole_out_html_size(title+1, len-(title-s)-1);
+    case FN_APPEND_LINK:
+      if (!(title=wmemchr(s, L'|', len))) return LITERAL_SIZE("<a href=\"\"></a>")+2*nxcreole_out_html_size(s, len);
+      return LITERAL_SIZE("<a href=\"\"></a>")+nxcreole_out_html_size(s, title-s)
+             +nxcreole_out_html_size(title+1, len-(title-s)-1);
+    case FN_APPEND_PLACEHOLDER: return LITERAL_SIZE("&lt;&lt;&lt;Placeholder:&gt;&gt;&gt;")+nxcreole_out_html_size(s, len);
+    case FN_APPEND_TABLE_CELL_NEXT:
+    case FN_APPEND_TABLE_HEAD_CELL_NEXT:
+      return event_size(FN_APPEND_TABLE_CELL_CLOSE, 0, 0)+event_size(FN_APPEND_TABLE_CELL_OPEN, s, len);
+    case FN_APPEND_TABLE_ROW_NEXT: return LITERAL_SIZE("</tr><tr>");
+    case FN_APPEND_LIST_CLOSE_RUN:
+      for (i=n=0; i<len; i++) n+=tag_size(list_close_tag(s[i]));
+      return n;
+    default: return 0;
+  }
+}
+
+static void size_append0(nxcreole_parse_ctx* ctx, nxcreole_fn_id_t fn) {
+  *(size_t*)ctx->data+=event_size(fn, 0, 0);
+}
+
+static void size_append1(nxcreole_parse_ctx* ctx, nxcreole_fn_id_t fn, const wchar_t* s, size_t len) {
+  *(size_t*)ctx->data+=event_size(fn, s, len);
+}
+
+size_t nxcreole_xhtml_size(const wchar_t* text) {
+  nxcreole_parse_ctx ctx;
+  size_t size=0;
+  nxcreole_init(&ctx, text);
+  ctx.append0=size_append0;
+  ctx.append1=size_append1;
+  ctx.data=&size;
+  nxcreole_parse(&ctx);
+  return size;
+}
+
+#define MIN_TAPE_EVENTS 256
+#define MIN_TAPE_PAYLOAD 4096
+
+static void tape_add(nxcreole_xhtml_tape* tape, int fn, const wchar_t* s, size_t length) {
+  if (tape->error) return;
+  if (tape->count==tape->capacity) {
+    size_t capacity=tape->capacity? tape->capacity*2 : MIN_TAPE_EVENTS;
+    nxcreole_xhtml_tape_event* events=realloc(tape->events, capacity*sizeof(nxcreole_xhtml_tape_event));
+    if (!events) {
+      tape->error=1;
+      return;
+    }
+    tape->events=events;
+    tape->capacity=capacity;
+  }
+  nxcreole_xhtml_tape_event* e=&tape->events[tape->count++];
+  e->fn=fn;
+  e->length=length;
+  e->in_text=s>=tape->text && s+length<=tape->text+tape->text_length;
+  if (e->in_text) {
+    e->payload=s-tape->text;
+    return;
+  }
+  // text buffer flushes: payload is parser's scratch buffer, so it is copied
+  if (tape->payload_length+length>tape->payload_capacity) {
+    size_t capacity=tape->payload_capacity? tape->payload_capacity*2 : MIN_TAPE_PAYLOAD;
+    while (capacity<tape->payload_length+length) capacity*=2;
+    wchar_t* payload=realloc(tape->payload, capacity*sizeof(wchar_t));
+    if (!payload) {
+      tape->error=1;
+      return;
+    }
+    tape->payload=payload;
+    tape->payload_capacity=capacity;
+  }
+  e->payload=tape->payload_length;
+  if (length) wmemcpy(tape->payload+tape->payload_length, s, length);
+  tape->payload_length+=length;
+}
+
+static void tape_append0(nxcreole_parse_ctx* ctx, nxcreole_fn_id_t fn) {
+  nxcreole_xhtml_tape* tape=ctx->data;
+  tape->size+=event_size(fn, 0, 0);
+  tape_add(tape, -1-(int)fn, 0, 0);
+}
+
+static void tape_append1(nxcreole_parse_ctx* ctx, nxcreole_fn_id_t fn, const wchar_t* s, size_t len) {
+  nxcreole_xhtml_tape* tape=ctx->data;
+  tape->size+=event_size(fn, s, len);
+  tape_add(tape, (int)fn, s, len);
+}
+
+int nxcreole_xhtml_tape_record(nxcreole_xhtml_tape* tape, const wchar_t* text) {
+  nxcreole_parse_ctx ctx;
+  memset(tape, 0, sizeof(nxcreole_xhtml_tape));
+  tape->text=text;
+  tape->text_length=wcslen(text);
+  nxcreole_init(&ctx, text);
+  ctx.append0=tape_append0;
+  ctx.append1=tape_append1;
+  ctx.data=tape;
+  nxcreole_parse(&ctx);
+  return tape->error? -1:0;
+}
+
+void nxcreole_xhtml_tape_render(const nxcreole_xhtml_tape* tape, nxcreole_out* out) {
+  nxcreole_xhtml_serializer xs;
+  size_t i;
+  memset(&xs, 0, sizeof(xs));
+  xs.out=out;
+  for (i=0; i<tape->count; i++) {
+    const nxcreole_xhtml_tape_event* e=&tape->events[i];
+    if (e->fn<0) ((append0_sig)fns[-1-e->fn])(&xs);
+    else ((append1_sig)fns[e->fn])(&xs, (e->in_text? tape->text : tape->payload)+e->payload, e->length);
+  }
+}
+
+void nxcreole_xhtml_tape_free(nxcreole_xhtml_tape* tape) {
+  free(tape->events);
+  free(tape->payload);
+  memset(tape, 0, sizeof(nxcreole_xhtml_tape));
+}
@@ -0,0 +1,87 @@
+/*
+ * Copyright (c) 2014 Yaroslav Stavnichiy <yarosla@gmail.com>
+ *
+ * This file is part of NXCREOLE.
+ *
+ * NXCREOLE is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License
+ * as published by the Free Software Foundation, either version 3
+ * of the License, or (at your option) any later version.
+ *
+ * NXCREOLE is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with NXCREOLE. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*
+ * XHTML serializer.
+ */
+
+struct nxcreole_link_table;
+struct nxcreole_toc;
+
+typedef struct nxcreole_xhtml_serializer {
+  nxcreole_out* out;
+  const struct nxcreole_link_table* links; // resolved link targets (see nxcreole_resolve.h) or 0
+  struct nxcreole_toc* toc; // heading ids and table of contents (see nxcreole_toc.h) or 0
+  size_t fragment_total, fragment_length; // out->total and out->length where block cache fragment starts
+} nxcreole_xhtml_serializer;
+
+// set up ctx (initialized by nxcreole_init) to serialize into out; this also sets ctx->fragments,
+// so that block cache stores XHTML of blocks: clear it if links are set or functions replaced
+void nxcreole_xhtml_init(nxcreole_parse_ctx* ctx, nxcreole_xhtml_serializer* xs, nxcreole_out* out);
+
+// give headings id attributes and collect table of contents into toc (initialized by nxcreole_toc_init)
+// while rendering; call nxcreole_toc_finish(toc, out) after parsing. Block cache fragments are not used
+void nxcreole_xhtml_use_toc(nxcreole_parse_ctx* ctx, nxcreole_xhtml_serializer* xs, struct nxcreole_toc* toc);
+
+// nxcreole_parse() specialized for this serializer: calls its functions directly, so they
+// get inlined into parser; ctx must be set up by nxcreole_xhtml_init, and ctx->fn overrides are ignored
+void nxcreole_xhtml_parse(nxcreole_parse_ctx* ctx);
+
+// shortcut: parse text and append XHTML to out (by nxcreole_xhtml_parse)
+void nxcreole_render_xhtml(const wchar_t* text, nxcreole_out* out);
+
+// shortcut: parse text once and append XHTML with heading ids to out, TOC is put in place
+// of <<<toc>>> placeholder and left in toc->out; returns -1 if out of memory
+int nxcreole_render_xhtml_toc(const wchar_t* text, nxcreole_out* out, struct nxcreole_toc* toc);
+
+// exact size of nxcreole_render_xhtml() output in bytes (not counting NUL terminator),
+// summed per parser event from tag lengths and payload lengths; nothing is formatted
+// or encoded. Still a parse of text, so to render as well use the tape below
+size_t nxcreole_xhtml_size(const wchar_t* text);
+
+/*
+ * Event tape: events of one parse of text kept for serializing later, with exact size
+ * of their XHTML summed as they are recorded (as by nxcreole_xhtml_size()). This lets
+ * caller allocate output buffer once at its final size (see nxcreole_out_init_fixed())
+ * and fill it without parsing text again. Output is that of nxcreole_render_xhtml().
+ * Payloads pointing into text are not copied, so text must outlive the tape.
+ */
+typedef struct nxcreole_xhtml_tape_event {
+  int fn; // nxcreole_fn_id_t of append1, or -1-fn for append0 (no payload)
+  int in_text; // payload is offset into text rather than into tape's payload
+  size_t payload;
+  size_t length;
+} nxcreole_xhtml_tape_event;
+
+typedef struct nxcreole_xhtml_tape {
+  const wchar_t* text;
+  size_t text_length;
+  nxcreole_xhtml_tape_event* events;
+  size_t count;
+  size_t capacity;
+  wchar_t* payload; // copies of payloads not found in text (flushed text buffer)
+  size_t payload_length;
+  size_t payload_capacity;
+  size_t size; // of XHTML in bytes (not counting NUL terminator)
+  int error; // out of memory
+} nxcreole_xhtml_tape;
+
+int nxcreole_xhtml_tape_record(nxcreole_xhtml_tape* tape, const wchar_t* text); // returns -1 if out of memory
+void nxcreole_xhtml_tape_render(const nxcreole_xhtml_tape* tape, nxcreole_out* out);
+void nxcreole_xhtml_tape_free(nxcreole_xhtml_tape* tape);
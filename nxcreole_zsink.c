@@ -0,0 +1,91 @@
+/*
+ * Copyright (c) 2014 Yaroslav Stavnichiy <yarosla@gmail.com>
+ *
+ * This file is part of NXCREOLE.
+ *
+ * NXCREOLE is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License
+ * as published by the Free Software Foundation, either version 3
+ * of the License, or (at your option) any later version.
+ *
+ * NXCREOLE is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with NXCREOLE. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <string.h>
+#include <zlib.h>
+
+#include "nxcreole_out.h"
+#include "nxcreole_zsink.h"
+
+#define GZIP_WINDOW_BITS (MAX_WBITS+16) // zlib adds gzip header and trailer
+#define MEM_LEVEL 8 // zlib's default
+
+int nxcreole_zsink_init(nxcreole_zsink* zs, int format, int level, nxcreole_sink_fn sink, void* sink_data) {
+  memset(&zs->z, 0, sizeof(z_stream)); // buf needs no clearing
+  zs->sink=sink;
+  zs->sink_data=sink_data;
+  zs->error=0;
+  zs->open=0;
+  if (format!=NXCREOLE_GZIP && format!=NXCREOLE_DEFLATE) {
+    zs->error=1;
+    return -1;
+  }
+  if (deflateInit2(&zs->z, level, Z_DEFLATED, format==NXCREOLE_GZIP? GZIP_WINDOW_BITS : MAX_WBITS,
+                   MEM_LEVEL, Z_DEFAULT_STRATEGY)!=Z_OK) {
+    zs->error=1;
+    return -1;
+  }
+  zs->open=1;
+  return 0;
+}
+
+// compresses avail_in bytes, passing every full output buffer on to sink
+static int deflate_to_sink(nxcreole_zsink* zs, int flush) {
+  int res;
+  do {
+    zs->z.next_out=zs->buf;
+    zs->z.avail_out=NXCREOLE_ZSINK_BUF_SIZE;
+    res=deflate(&zs->z, flush);
+    if (res==Z_STREAM_ERROR) return -1;
+    size_t n=NXCREOLE_ZSINK_BUF_SIZE-zs->z.avail_out;
+    if (n && zs->sink(zs->sink_data, (const char*)zs->buf, n)) return -1;
+  } while (!zs->z.avail_out || (flush==Z_FINISH && res!=Z_STREAM_END));
+  return 0;
+}
+
+int nxcreole_zsink_write(void* sink_data, const char* data, size_t length) {
+  nxcreole_zsink* zs=sink_data;
+  if (zs->error || !zs->open) return -1;
+  while (length) {
+    uInt n=length>(uInt)-1? (uInt)-1 : (uInt)length;
+    zs->z.next_in=(Bytef*)data;
+    zs->z.avail_in=n;
+    if (deflate_to_sink(zs, Z_NO_FLUSH)) {
+      zs->error=1;
+      return -1;
+    }
+    data+=n;
+    length-=n;
+  }
+  return 0;
+}
+
+int nxcreole_zsink_finish(nxcreole_zsink* zs) {
+  if (!zs->open) return -1;
+  zs->z.next_in=0;
+  zs->z.avail_in=0;
+  if (!zs->error && deflate_to_sink(zs, Z_FINISH)) zs->error=1;
+  nxcreole_zsink_free(zs);
+  return zs->error? -1:0;
+}
+
+void nxcreole_zsink_free(nxcreole_zsink* zs) {
+  if (zs->open) deflateEnd(&zs->z);
+  zs->open=0;
+}
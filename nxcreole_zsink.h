@@ -0,0 +1,54 @@
+/*
+ * Copyright (c) 2014 Yaroslav Stavnichiy <yarosla@gmail.com>
+ *
+ * This file is part of NXCREOLE.
+ *
+ * NXCREOLE is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License
+ * as published by the Free Software Foundation, either version 3
+ * of the License, or (at your option) any later version.
+ *
+ * NXCREOLE is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with NXCREOLE. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*
+ * Compressing sink (zlib). Set it as sink of nxcreole_out and serializer output is
+ * deflated every time the buffer is flushed, with compressed data passed on to next
+ * sink (eg. nxcreole_fd_sink), so page goes from parser to .html.gz file in one pass
+ * and memory bounded by out buffer, NXCREOLE_ZSINK_BUF_SIZE and zlib state.
+ *
+ *   nxcreole_zsink_init(&zs, NXCREOLE_GZIP, Z_DEFAULT_COMPRESSION, nxcreole_fd_sink, &fd);
+ *   nxcreole_out_init(&out, 65536, nxcreole_zsink_write, &zs);
+ *   ... render into out ...
+ *   nxcreole_out_flush(&out);
+ *   nxcreole_zsink_finish(&zs); // writes compressed tail and frees zlib state
+ *
+ * Include <zlib.h> and nxcreole_out.h before this header.
+ */
+
+#define NXCREOLE_ZSINK_BUF_SIZE 16384
+
+// stream formats
+#define NXCREOLE_GZIP 1 // gzip wrapper: .gz files, Content-Encoding: gzip
+#define NXCREOLE_DEFLATE 2 // zlib wrapper: Content-Encoding: deflate
+
+typedef struct nxcreole_zsink {
+  z_stream z;
+  nxcreole_sink_fn sink;
+  void* sink_data;
+  int error; // zlib or next sink failed; further output is dropped
+  unsigned open:1; // zlib state allocated
+  unsigned char buf[NXCREOLE_ZSINK_BUF_SIZE]; // compressed data on its way to sink
+} nxcreole_zsink;
+
+// level is zlib's 0-9 or Z_DEFAULT_COMPRESSION; returns -1 on bad arguments or out of memory
+int nxcreole_zsink_init(nxcreole_zsink* zs, int format, int level, nxcreole_sink_fn sink, void* sink_data);
+int nxcreole_zsink_write(void* sink_data, const char* data, size_t length); // sink_data is (nxcreole_zsink*)
+int nxcreole_zsink_finish(nxcreole_zsink* zs); // ends stream; returns -1 if anything failed
+void nxcreole_zsink_free(nxcreole_zsink* zs); // abandons stream without finishing it
@@ -1,6 +1,8 @@
 from distutils.core import setup, Extension
 
-ext = Extension('nxcreole._ext', sources = ['nxcreole_parser.c', 'nxcreole_ext.c'])
+ext = Extension('nxcreole._ext', sources = ['nxcreole_parser.c', 'nxcreole_spans.c', 'nxcreole_links.c', 'nxcreole_out.c', 'nxcreole_text.c', 'nxcreole_xhtml.c', 'nxcreole_tee.c', 'nxcreole_fuse.c', 'nxcreole_markup.c', 'nxcreole_template.c', 'nxcreole_resolve.c', 'nxcreole_cache.c', 'nxcreole_zsink.c', 'nxcreole_pool.c', 'nxcreole_json.c', 'nxcreole_toc.c', 'nxcreole_ext.c'],
+                define_macros = [('NXCREOLE_STATS', None)],
+                libraries = ['rt', 'z', 'pthread'])
 
 setup(name = 'nxcreole',
       version = '1.0',
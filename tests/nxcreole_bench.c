@@ -0,0 +1,296 @@
+/*
+ * Copyright (c) 2014 Yaroslav Stavnichiy <yarosla@gmail.com>
+ *
+ * This file is part of NXCREOLE.
+ *
+ * NXCREOLE is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License
+ * as published by the Free Software Foundation, either version 3
+ * of the License, or (at your option) any later version.
+ *
+ * NXCREOLE is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with NXCREOLE. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*
+ * XHTML rendering benchmark: serializer called through ctx->append0/append1 function
+ * pointers (nxcreole_parse) against parser instantiated with serializer inlined
+ * (nxcreole_xhtml_parse), on typical page mix and on markup-dense text where
+ * events are most frequent. Both must produce identical output. Line index pre-pass
+ * (nxcreole_line_index_build) is timed on its own and with inlined parser using it.
+ * JSON AST serializer (nxcreole_json_parse) is timed for comparison with XHTML,
+ * and so is XHTML with heading ids and table of contents (nxcreole_render_xhtml_toc).
+ * Block cache (nxcreole_block_cache) is timed warm, where XHTML of corpus blocks is reused,
+ * and cold, emptied before every render (blocks repeated within corpus still hit).
+ * Links-only scan (nxcreole_scan_links) is timed against plain scan for [[ and {{.
+ *
+ * Usage: nxcreole_bench [size [repeats]]
+ */
+
+#include <stdio.h>
+#include <wchar.h>
+#include <string.h>
+#include <stdlib.h>
+#include <time.h>
+
+#include "../nxcreole_parser.h"
+#include "../nxcreole_out.h"
+#include "../nxcreole_xhtml.h"
+#include "../nxcreole_json.h"
+#include "../nxcreole_toc.h"
+
+#define DEFAULT_SIZE (4*1024*1024)
+#define DEFAULT_REPEATS 10
+#define CACHE_SIZE (16*1024*1024)
+
+typedef struct {
+  const char* name;
+  const wchar_t* unit; // repeated to fill requested size
+} corpus_t;
+
+static const corpus_t corpora[]={
+  {"page", L"== Section heading ==\n"
+           L"Some **bold** and //italic// text with a [[Page name|link]] and http://example.com/ URL,\n"
+           L"continued on next line with ##mono## and {{{nowiki}}} bits.\n\n"
+           L"* first item\n** nested item with [[link]]\n* second item\n# numbered\n\n"
+           L"|=Name|=Value|\n|alpha|1|\n|beta|2|\n|gamma|3|\n\n"
+           L"> quoted text\n\n"},
+  {"dense", L"|a|b|**c**|//d//|\n* x\n** y\n"},
+};
+
+static wchar_t* generate(const wchar_t* unit, size_t size) {
+  size_t unit_len=wcslen(unit);
+  wchar_t* text=malloc((size+1)*sizeof(wchar_t));
+  if (!text) return 0;
+  wchar_t* p=text;
+  while (p+unit_len<=text+size) {
+    wmemcpy(p, unit, unit_len);
+    p+=unit_len;
+  }
+  *p=L'\0';
+  return text;
+}
+
+static double now() {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec+ts.tv_nsec*1e-9;
+}
+
+static nxcreole_block_cache* blocks; // used by render() if set
+
+static void render(const wchar_t* text, nxcreole_out* out, int inlined, const nxcreole_line_index* idx) {
+  nxcreole_parse_ctx ctx;
+  nxcreole_xhtml_serializer xs;
+  out->length=0;
+  nxcreole_init(&ctx, text);
+  nxcreole_xhtml_init(&ctx, &xs, out);
+  ctx.lines=idx;
+  ctx.blocks=blocks;
+  if (inlined) nxcreole_xhtml_parse(&ctx);
+  else nxcreole_parse(&ctx);
+}
+
+static void count_link(void* data, nxcreole_fn_id_t fn, const wchar_t* s, size_t length, size_t offset) {
+  (*(size_t*)data)++;
+}
+
+// links-only parse (nxcreole_scan_links); best time of repeats
+static double time_links(const wchar_t* text, int repeats, size_t* links) {
+  double best=-1;
+  int i;
+  for (i=0; i<repeats; i++) {
+    double start=now();
+    *links=0;
+    nxcreole_scan_links(text, count_link, links);
+    double t=now()-start;
+    if (best<0 || t<best) best=t;
+  }
+  return best;
+}
+
+// plain scan for [[ and {{ openers: lower bound for any link extraction
+static double time_plain_scan(const wchar_t* text, int repeats, size_t* openers) {
+  double best=-1;
+  int i;
+  for (i=0; i<repeats; i++) {
+    double start=now();
+    const wchar_t* p;
+    *openers=0;
+    for (p=wcspbrk(text, L"[{"); p; p=wcspbrk(p+1, L"[{")) {
+      if (p[1]==p[0]) (*openers)++, p++;
+    }
+    double t=now()-start;
+    if (best<0 || t<best) best=t;
+  }
+  return best;
+}
+
+static double time_json(const wchar_t* text, nxcreole_out* out, int repeats) {
+  double best=-1;
+  int i;
+  for (i=0; i<repeats; i++) {
+    nxcreole_parse_ctx ctx;
+    nxcreole_json_serializer js;
+    double start=now();
+    out->length=0;
+    nxcreole_init(&ctx, text);
+    nxcreole_json_init(&ctx, &js, out);
+    nxcreole_json_parse(&ctx);
+    nxcreole_json_finish(&js);
+    double t=now()-start;
+    if (best<0 || t<best) best=t;
+  }
+  return best;
+}
+
+// XHTML with heading ids and table of contents, in one parse
+static double time_toc(const wchar_t* text, nxcreole_out* out, int repeats, size_t* headings) {
+  double best=-1;
+  int i;
+  for (i=0; i<repeats; i++) {
+    nxcreole_toc toc;
+    if (nxcreole_toc_init(&toc)) {
+      fprintf(stderr, "out of memory\n");
+      exit(EXIT_FAILURE);
+    }
+    double start=now();
+    out->length=0;
+    nxcreole_render_xhtml_toc(text, out, &toc);
+    double t=now()-start;
+    if (best<0 || t<best) best=t;
+    *headings=toc.count;
+    nxcreole_toc_free(&toc);
+  }
+  return best;
+}
+
+// cold cache: every block is seen for the first time
+static double time_cold(const wchar_t* text, nxcreole_out* out, int repeats) {
+  double best=-1;
+  int i;
+  for (i=0; i<repeats; i++) {
+    nxcreole_block_cache cold;
+    if (nxcreole_block_cache_init(&cold, CACHE_SIZE)) {
+      fprintf(stderr, "out of memory\n");
+      exit(EXIT_FAILURE);
+    }
+    blocks=&cold;
+    double start=now();
+    render(text, out, 1, 0);
+    double t=now()-start;
+    if (best<0 || t<best) best=t;
+    blocks=0;
+    }
+  return best;
+}
+
+// best time of repeats
+static double time_render(const wchar_t* text, nxcreole_out* out, int inlined, const nxcreole_line_index* idx, int repeats) {
+  double best=-1;
+  int i;
+  for (i=0; i<repeats; i++) {
+    double start=now();
+    render(text, out, inlined, idx);
+    double t=now()-start;
+    if (best<0 || t<best) best=t;
+  }
+  return best;
+}
+
+static int run_corpus(const corpus_t* c, size_t size, int repeats) {
+  wchar_t* text=generate(c->unit, size);
+  nxcreole_out out1, out2;
+  if (!text || nxcreole_out_init(&out1, size*2, 0, 0) || nxcreole_out_init(&out2, size*2, 0, 0)) {
+    fprintf(stderr, "out of memory\n");
+    exit(EXIT_FAILURE);
+  }
+  size=wcslen(text);
+
+  nxcreole_line_index idx;
+  double t_index=-1;
+  int i;
+  for (i=0; i<repeats; i++) {
+    double start=now();
+    if (nxcreole_line_index_build(&idx, text)) {
+      fprintf(stderr, "out of memory\n");
+      exit(EXIT_FAILURE);
+    }
+    double t=now()-start;
+    if (t_index<0 || t<t_index) t_index=t;
+    if (i<repeats-1) nxcreole_line_index_free(&idx);
+  }
+
+  render(text, &out1, 0, 0);
+  render(text, &out2, 1, 0);
+  int same=out1.length==out2.length && !memcmp(out1.buf, out2.buf, out1.length);
+  render(text, &out2, 1, &idx);
+  same=same && out1.length==out2.length && !memcmp(out1.buf, out2.buf, out1.length);
+
+  double t_fn=time_render(text, &out1, 0, 0, repeats);
+  double t_inline=time_render(text, &out2, 1, 0, repeats);
+  double t_indexed=time_render(text, &out2, 1, &idx, repeats);
+  double t_json=time_json(text, &out2, repeats);
+  size_t json_length=out2.length;
+  size_t headings=0;
+  double t_toc=time_toc(text, &out2, repeats, &headings);
+  size_t links=0, openers=0;
+  double t_links=time_links(text, repeats, &links);
+  double t_scan=time_plain_scan(text, repeats, &openers);
+
+  nxcreole_block_cache warm;
+  if (nxcreole_block_cache_init(&warm, CACHE_SIZE)) {
+    fprintf(stderr, "out of memory\n");
+    exit(EXIT_FAILURE);
+  }
+  double t_cold=time_cold(text, &out2, repeats);
+  same=same && out1.length==out2.length && !memcmp(out1.buf, out2.buf, out1.length);
+  blocks=&warm;
+  render(text, &out2, 1, 0);
+  same=same && out1.length==out2.length && !memcmp(out1.buf, out2.buf, out1.length);
+  double t_warm=time_render(text, &out2, 1, 0, repeats);
+  same=same && out1.length==out2.length && !memcmp(out1.buf, out2.buf, out1.length);
+  blocks=0;
+  printf("%s: %zu chars, %zu bytes of XHTML, best of %d\n", c->name, size, out1.length, repeats);
+  printf("function pointers  %8.3f ms  %7.2f MB/s\n", t_fn*1e3, size*sizeof(wchar_t)/t_fn/1e6);
+  printf("inlined            %8.3f ms  %7.2f MB/s  (%+.1f%%)\n", t_inline*1e3, size*sizeof(wchar_t)/t_inline/1e6,
+         (t_fn/t_inline-1)*100);
+  printf("line index         %8.3f ms  %7.2f MB/s  (%zu lines)\n", t_index*1e3, size*sizeof(wchar_t)/t_index/1e6, idx.count);
+  printf("inlined, indexed   %8.3f ms  %7.2f MB/s  (%+.1f%%, %+.1f%% with index build)\n", t_indexed*1e3,
+         size*sizeof(wchar_t)/t_indexed/1e6, (t_fn/t_indexed-1)*100, (t_fn/(t_indexed+t_index)-1)*100);
+  printf("JSON, inlined      %8.3f ms  %7.2f MB/s  (%+.1f%% against inlined XHTML, %zu bytes)\n", t_json*1e3,
+         size*sizeof(wchar_t)/t_json/1e6, (t_inline/t_json-1)*100, json_length);
+  printf("XHTML with TOC     %8.3f ms  %7.2f MB/s  (%+.1f%% against inlined, %zu headings)\n", t_toc*1e3,
+         size*sizeof(wchar_t)/t_toc/1e6, (t_inline/t_toc-1)*100, headings);
+  printf("links only         %8.3f ms  %7.2f MB/s  (%zu links; plain scan for [[ and {{ %.3f ms, %zu found)\n",
+         t_links*1e3, size*sizeof(wchar_t)/t_links/1e6, links, t_scan*1e3, openers);
+  printf("block cache, warm   %8.3f ms  %7.2f MB/s  (%+.1f%% against inlined, %zu hits, %zu as XHTML, %zu misses)\n",
+         t_warm*1e3, size*sizeof(wchar_t)/t_warm/1e6, (t_inline/t_warm-1)*100, warm.stats.hits,
+         warm.stats.fragment_hits, warm.stats.misses);
+  printf("block cache, cold   %8.3f ms  %7.2f MB/s  (%+.1f%% against inlined)\n", t_cold*1e3,
+         size*sizeof(wchar_t)/t_cold/1e6, (t_inline/t_cold-1)*100);
+  printf("outputs %s\n\n", same? "identical":"DIFFER");
+
+  nxcreole_block_cache_free(&warm);
+  nxcreole_line_index_free(&idx);
+  nxcreole_out_free(&out1);
+  nxcreole_out_free(&out2);
+  free(text);
+  return same;
+}
+
+int main(int argc, char** argv) {
+  size_t size=argc>1? (size_t)strtoul(argv[1], 0, 10) : DEFAULT_SIZE;
+  int repeats=argc>2? atoi(argv[2]) : DEFAULT_REPEATS;
+  if (repeats<1) repeats=1;
+  int i, same=1;
+  for (i=0; i<(int)(sizeof(corpora)/sizeof(corpora[0])); i++) {
+    same&=run_corpus(&corpora[i], size, repeats);
+  }
+  return same? EXIT_SUCCESS:EXIT_FAILURE;
+}
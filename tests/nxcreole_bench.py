@@ -0,0 +1,195 @@
+# coding=utf-8
+
+# Python-level benchmarks: what the extension costs per callback and per call,
+# and how Python serializer compares with C paths. Results are written as JSON.
+#
+# Every measurement is warmed up, then timed in samples of enough loops to take
+# at least MIN_SAMPLE_TIME; min, median, mean and standard deviation are reported
+# per single call (seconds), per event or per character where it applies.
+#
+# NOTE: run this script from project root directory:
+#       python tests/nxcreole_bench.py [--quick] [--output results.json]
+
+import os, glob, gc, json, math, argparse, platform, timeit, StringIO
+from nxcreole import CreoleParser, render_xhtml, render_xhtml_utf8, html_escape
+
+PATH_TO_TESTS='tests/'
+MIN_SAMPLE_TIME=0.05
+WARMUP_TIME=0.1
+
+PAGE_UNIT=(u'== Section heading ==\n'
+           u'Some **bold** and //italic// text with a [[Page name|link]] and http://example.com/ URL,\n'
+           u'continued on next line with ##mono## and {{{nowiki}}} bits.\n\n'
+           u'* first item\n** nested item with [[link]]\n* second item\n# numbered\n\n'
+           u'|=Name|=Value|\n|alpha|1|\n|beta|2|\n|gamma|3|\n\n'
+           u'> quoted text\n\n')
+APPEND0_UNIT=u'----\n' # append_hr only
+APPEND1_UNIT=u'{{{x}}} ' # append_nowiki_inline and append_text
+
+timer=timeit.default_timer
+
+
+class NullSerializer(CreoleParser):
+  """
+  Serializer doing nothing, so that parse() time is parser plus callback dispatch.
+  """
+  def __init__(self):
+    CreoleParser.__init__(self, None)
+
+for _name in dir(CreoleParser):
+  if _name.startswith('append_'):
+    setattr(NullSerializer, _name, lambda self, *args: None)
+
+
+def _py_html_escape(s):
+  return unicode(s).replace('&', '&amp;').replace('<', '&lt;').replace('>', '&gt;').replace('"', '&quot;').replace('\'', '&#39;')
+
+def _stats(samples):
+  samples=sorted(samples)
+  n=len(samples)
+  mean=sum(samples)/n
+  median=samples[n//2] if n%2 else (samples[n//2-1]+samples[n//2])/2
+  stdev=math.sqrt(sum((x-mean)**2 for x in samples)/(n-1)) if n>1 else 0.0
+  return {'min': samples[0], 'median': median, 'mean': mean, 'stdev': stdev, 'samples': n}
+
+def measure(fn, repeats):
+  """
+  Time fn() repeats times after warmup; returns statistics of seconds per call.
+  """
+  loops=1
+  start=timer()
+  while True: # warmup, also finds number of loops per sample
+    t=timer()
+    for _ in xrange(loops):
+      fn()
+    t=timer()-t
+    if t>=MIN_SAMPLE_TIME:
+      break
+    loops=max(loops*2, int(loops*MIN_SAMPLE_TIME*1.2/t)) if t>0 else loops*10
+  while timer()-start<WARMUP_TIME:
+    fn()
+  samples=[]
+  gc_enabled=gc.isenabled()
+  gc.disable()
+  try:
+    for _ in xrange(repeats):
+      t=timer()
+      for _ in xrange(loops):
+        fn()
+      samples.append((timer()-t)/loops)
+  finally:
+    if gc_enabled:
+      gc.enable()
+  result=_stats(samples)
+  result['loops']=loops
+  return result
+
+def scaled(result, divisor, key):
+  """
+  Adds per-unit figures (eg. per event) to result.
+  """
+  result[key]=dict((k, result[k]/divisor) for k in ('min', 'median', 'mean', 'stdev'))
+  return result
+
+def count_events(text, fuse=False):
+  stats=NullSerializer().parse(text, stats=True, fuse=fuse)
+  return sum(stats['events'].values())
+
+def bench_callbacks(repeats, size):
+  # per-event cost of append0 (no payload) and append1 (unicode payload) dispatch
+  results={}
+  serializer=NullSerializer()
+  for name, unit in (('append0', APPEND0_UNIT), ('append1', APPEND1_UNIT)):
+    text=unit*(size//len(unit))
+    events=count_events(text)
+    r=measure(lambda: serializer.parse(text), repeats)
+    r['events']=events
+    results[name]=scaled(r, events, 'per_event')
+  return results
+
+def bench_init(repeats):
+  # fixed cost of parse() call: method lookup (init_fns, init_fused_fns) and release
+  serializer=NullSerializer()
+  return {
+    'parse_empty': measure(lambda: serializer.parse(u''), repeats),
+    'parse_empty_fused': measure(lambda: serializer.parse(u'', fuse=True), repeats),
+  }
+
+def render_python(text):
+  out=StringIO.StringIO()
+  CreoleParser(out).parse(text)
+  return out.getvalue()
+
+def bench_render(text, repeats):
+  # Python serializer (raw and fused events) against C one
+  chars=len(text)
+  return {
+    'chars': chars,
+    'events': count_events(text),
+    'fused_events': count_events(text, fuse=True),
+    'python': scaled(measure(lambda: render_python(text), repeats), chars, 'per_char'),
+    'python_fused': scaled(measure(lambda: render_xhtml(text), repeats), chars, 'per_char'),
+    'c_utf8': scaled(measure(lambda: render_xhtml_utf8(text), repeats), chars, 'per_char'),
+  }
+
+def bench_files(repeats):
+  results={}
+  for fname in sorted(glob.glob(PATH_TO_TESTS+'[0-9][0-9][0-9].creole')):
+    with open(fname, 'r') as f:
+      text=f.read().decode('utf-8')
+    results[os.path.basename(fname)]=bench_render(text, repeats)
+  return results
+
+def bench_synthetic(repeats, sizes):
+  return dict(('page_%d' % size, bench_render(PAGE_UNIT*(size//len(PAGE_UNIT)), repeats)) for size in sizes)
+
+def bench_html_escape(repeats):
+  results={}
+  for name, sample in (('plain', u'plain text '*1000), ('markup', u'<a>"'*1000)):
+    assert html_escape(sample)==_py_html_escape(sample)
+    results[name]={
+      'chars': len(sample),
+      'c': scaled(measure(lambda: html_escape(sample), repeats), len(sample), 'per_char'),
+      'python': scaled(measure(lambda: _py_html_escape(sample), repeats), len(sample), 'per_char'),
+    }
+  return results
+
+def main():
+  ap=argparse.ArgumentParser(description='Benchmark nxcreole Python extension; writes JSON results.')
+  ap.add_argument('--quick', action='store_true', help='few repeats and small inputs (smoke run)')
+  ap.add_argument('--repeats', type=int, default=None, help='timed samples per measurement')
+  ap.add_argument('--output', '-o', default='-', help='JSON file (default stdout)')
+  args=ap.parse_args()
+  global MIN_SAMPLE_TIME, WARMUP_TIME
+  if args.quick:
+    MIN_SAMPLE_TIME, WARMUP_TIME=0.005, 0.01
+  repeats=args.repeats or (3 if args.quick else 15)
+  sizes=[16*1024] if args.quick else [64*1024, 1024*1024]
+
+  results={
+    'environment': {
+      'python': platform.python_version(),
+      'implementation': platform.python_implementation(),
+      'platform': platform.platform(),
+      'repeats': repeats,
+      'min_sample_time': MIN_SAMPLE_TIME,
+    },
+    'callbacks': bench_callbacks(repeats, sizes[0]),
+    'init': bench_init(repeats),
+    'files': bench_files(repeats),
+    'synthetic': bench_synthetic(repeats, sizes),
+    'html_escape': bench_html_escape(repeats),
+  }
+  data=json.dumps(results, indent=2, sort_keys=True)
+  if args.output=='-':
+    print data
+  else:
+    with open(args.output, 'w') as f:
+      f.write(data+'\n')
+    cb=results['callbacks']
+    print 'append0 %.0f ns/event, append1 %.0f ns/event, parse() fixed cost %.1f us; written to %s' % (
+      cb['append0']['per_event']['median']*1e9, cb['append1']['per_event']['median']*1e9,
+      results['init']['parse_empty']['median']*1e6, args.output)
+
+if __name__=='__main__':
+  main()
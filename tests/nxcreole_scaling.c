@@ -0,0 +1,253 @@
+/*
+ * Copyright (c) 2014 Yaroslav Stavnichiy <yarosla@gmail.com>
+ *
+ * This file is part of NXCREOLE.
+ *
+ * NXCREOLE is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License
+ * as published by the Free Software Foundation, either version 3
+ * of the License, or (at your option) any later version.
+ *
+ * NXCREOLE is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with NXCREOLE. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*
+ * Complexity-scaling regression test.
+ *
+ * Every construct family is rendered at geometrically growing input sizes
+ * (1K to 64M characters by default), then growth exponent is fitted
+ * by least squares on log(time)/log(size), both for bare parse (null callbacks)
+ * and for XHTML serializer writing through a small flushed buffer. Test fails
+ * if any family scales worse than linear. Family over the bound is measured again
+ * (up to MAX_ATTEMPTS times): superlinear code fails every time, a stall of
+ * a loaded machine during one size doesn't. Parse statistics of the largest input are checked
+ * as well: forward delimiter scans must examine O(1) characters per input character.
+ *
+ * Usage: nxcreole_scaling [max_size [family ...]]
+ */
+
+#include <stdio.h>
+#include <wchar.h>
+#include <string.h>
+#include <stdlib.h>
+#include <math.h>
+#include <time.h>
+
+#include "../nxcreole_parser.h"
+#include "../nxcreole_out.h"
+#include "../nxcreole_xhtml.h"
+
+#define MIN_SIZE 1024
+#define DEFAULT_MAX_SIZE (64*1024*1024)
+#define SIZE_STEP 4
+#define MAX_POINTS 16
+#define MIN_SAMPLE_TIME 0.02 // repeat small runs until this many seconds are spent
+#define MAX_REPEATS 50
+#define MIN_FIT_TIME 0.0001 // ignore points too short to measure reliably
+#define TIME_BUDGET 2.0 // don't grow input if next run is expected to take longer than that
+#define MAX_EXPONENT 1.1
+#define MAX_ATTEMPTS 3
+#define XHTML_BUFFER_SIZE 65536 // flushed to null sink, so memory use doesn't grow with output
+#define MAX_SCAN_RATIO 4.0 // characters examined by delimiter scans per input character
+#define MAX_SCAN_RATIO_SIZE (1024*1024) // ratio is exact, so no need to check it on larger inputs
+
+typedef struct {
+  const char* name;
+  const wchar_t* prefix;
+  const wchar_t* unit; // repeated to fill requested size
+  const wchar_t* suffix;
+} family_t;
+
+static const family_t families[]={
+  {"paragraphs", L"", L"Some plain text with a few words.\n\n", L""},
+  {"long_paragraph", L"", L"plain text continues ", L""},
+  {"headings", L"", L"== Heading ==\n", L""},
+  {"heading_equals", L"= heading ", L"=", L"x"},
+  {"formatting", L"", L"**bold** //italic// __under__ ##mono## ", L""},
+  {"unclosed_formatting", L"", L"** a // b ", L""},
+  {"lists", L"", L"* item\n** nested\n# numbered\n> quote\n", L""},
+  {"tables", L"", L"|=head|a||b|\n|c|d|\n", L""},
+  {"mediawiki_tables", L"", L"{|\n| a\n|-\n| b\n|}\n", L""},
+  {"links", L"", L"[[Page name|title]] ", L""},
+  {"unclosed_links", L"", L"[[ ", L""},
+  {"images", L"", L"{{image.png|alt}} ", L""},
+  {"unclosed_images", L"", L"{{ ", L""},
+  {"nowiki_inline", L"", L"{{{code}}} ", L""},
+  {"nowiki_block", L"", L"{{{\ncode\n}}}\n", L""},
+  {"nowiki_escapes", L"", L"{{{a ~}}} b}}} ", L""},
+  {"unclosed_nowiki", L"", L"{{{ ", L""},
+  {"placeholders", L"", L"<<<widget>>> ", L""},
+  {"unclosed_placeholders", L"", L"<<< ", L""},
+  {"urls", L"", L"see http://example.com/a?b=c, ", L""},
+  {"escaped_urls", L"", L"~http://example.com ", L""},
+  {"colons", L"", L"a:b ", L""},
+  {"line_breaks", L"", L"a\\\\b ", L""},
+  {"dashes", L"", L"a -- b ", L""},
+  {"escapes", L"", L"~** ~[[ ~~ ", L""},
+};
+
+static volatile size_t sink; // keeps payload reads from being optimized out
+
+static void null_append0(nxcreole_parse_ctx* ctx, nxcreole_fn_id_t fn) {
+  sink+=fn;
+}
+
+static void null_append1(nxcreole_parse_ctx* ctx, nxcreole_fn_id_t fn, const wchar_t* s, size_t length) {
+  sink+=fn+length+(length? (size_t)s[length-1] : 0);
+}
+
+static int null_sink(void* sink_data, const char* data, size_t length) {
+  sink+=length+(length? (size_t)data[length-1] : 0);
+  return 0;
+}
+
+static wchar_t* generate(const family_t* f, size_t size) {
+  size_t prefix_len=wcslen(f->prefix), unit_len=wcslen(f->unit), suffix_len=wcslen(f->suffix);
+  wchar_t* text=malloc((size+1)*sizeof(wchar_t));
+  if (!text) return 0;
+  wchar_t* p=text;
+  wchar_t* end=text+size-suffix_len;
+  wmemcpy(p, f->prefix, prefix_len);
+  p+=prefix_len;
+  while (p+unit_len<=end) {
+    wmemcpy(p, f->unit, unit_len);
+    p+=unit_len;
+  }
+  while (p<end) *p++=L' ';
+  wmemcpy(p, f->suffix, suffix_len);
+  p+=suffix_len;
+  *p=L'\0';
+  return text;
+}
+
+static double now() {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec+ts.tv_nsec*1e-9;
+}
+
+static double scan_ratio(const wchar_t* text, size_t size) {
+  nxcreole_parse_ctx ctx;
+  nxcreole_stats stats;
+  memset(&stats, 0, sizeof(stats));
+  nxcreole_init(&ctx, text);
+  ctx.append0=null_append0;
+  ctx.append1=null_append1;
+  ctx.stats=&stats;
+  nxcreole_parse(&ctx);
+  return (double)stats.delimiter_scan_chars/size;
+}
+
+static void parse_null(const wchar_t* text, nxcreole_out* out) {
+  nxcreole_parse_ctx ctx;
+  nxcreole_init(&ctx, text);
+  ctx.append0=null_append0;
+  ctx.append1=null_append1;
+  nxcreole_parse(&ctx);
+}
+
+static void parse_xhtml(const wchar_t* text, nxcreole_out* out) {
+  nxcreole_parse_ctx ctx;
+  nxcreole_xhtml_serializer xs;
+  nxcreole_init(&ctx, text);
+  nxcreole_xhtml_init(&ctx, &xs, out);
+  nxcreole_xhtml_parse(&ctx);
+  nxcreole_out_flush(out);
+}
+
+// best time of repeated fn(text, out) or -1 if out of memory
+static double time_parse(const wchar_t* text, void (*fn)(const wchar_t*, nxcreole_out*)) {
+  double best=-1, spent=0;
+  int i;
+  nxcreole_out out;
+  if (nxcreole_out_init(&out, XHTML_BUFFER_SIZE, null_sink, 0)) return -1;
+  for (i=0; i<MAX_REPEATS && spent<MIN_SAMPLE_TIME; i++) {
+    double start=now();
+    fn(text, &out);
+    double t=now()-start;
+    if (best<0 || t<best) best=t;
+    spent+=t;
+  }
+  nxcreole_out_free(&out);
+  return out.error? -1 : best;
+}
+
+// returns fitted exponent or -1 if not enough data
+static double fit_exponent(const double* sizes, const double* times, int n) {
+  double sx=0, sy=0, sxx=0, sxy=0;
+  int i, k=0;
+  for (i=0; i<n; i++) {
+    if (times[i]<MIN_FIT_TIME) continue;
+    double x=log(sizes[i]), y=log(times[i]);
+    sx+=x; sy+=y; sxx+=x*x; sxy+=x*y;
+    k++;
+  }
+  if (k<3) return -1;
+  return (k*sxy-sx*sy)/(k*sxx-sx*sx);
+}
+
+static int run_family_once(const family_t* f, size_t max_size, int last_attempt) {
+  double sizes[MAX_POINTS], times[MAX_POINTS], xhtml_times[MAX_POINTS];
+  int n=0, cut_short=0;
+  double ratio=0;
+  size_t size;
+  for (size=MIN_SIZE; size<=max_size && n<MAX_POINTS; size*=SIZE_STEP) {
+    wchar_t* text=generate(f, size);
+    if (!text) {
+      fprintf(stderr, "out of memory generating %s at %zu\n", f->name, size);
+      break;
+    }
+    double t=time_parse(text, parse_null), xt=time_parse(text, parse_xhtml);
+    if (size<=MAX_SCAN_RATIO_SIZE) ratio=scan_ratio(text, size);
+    free(text);
+    if (t<0 || xt<0) {
+      fprintf(stderr, "out of memory rendering %s at %zu\n", f->name, size);
+      break;
+    }
+    sizes[n]=(double)size;
+    times[n]=t;
+    xhtml_times[n]=xt;
+    n++;
+    if ((t>xt? t:xt)*SIZE_STEP>TIME_BUDGET) { // no point growing further; the fit will show why
+      cut_short=size*SIZE_STEP<=max_size;
+      break;
+    }
+  }
+  if (!n) return 0;
+  double e=fit_exponent(sizes, times, n), xe=fit_exponent(sizes, xhtml_times, n);
+  int passed=(e<0 || xe<0? !cut_short : e<=MAX_EXPONENT && xe<=MAX_EXPONENT) && ratio<=MAX_SCAN_RATIO;
+  printf("%-24s %2d sizes up to %10.0f chars, %8.3f ms max, %7.2f MB/s, exponent %5.2f, xhtml %8.3f ms max, exponent %5.2f, scans/char %5.2f  %s\n",
+         f->name, n, sizes[n-1], times[n-1]*1e3, sizes[n-1]*sizeof(wchar_t)/times[n-1]/1e6,
+         e, xhtml_times[n-1]*1e3, xe, ratio, passed? "PASSED" : last_attempt? "FAILED":"RETRYING");
+  return passed;
+}
+
+static int run_family(const family_t* f, size_t max_size) {
+  int attempt;
+  for (attempt=1; attempt<MAX_ATTEMPTS; attempt++) {
+    if (run_family_once(f, max_size, 0)) return 1;
+  }
+  return run_family_once(f, max_size, 1);
+}
+
+int main(int argc, char** argv) {
+  size_t max_size=DEFAULT_MAX_SIZE;
+  if (argc>1) max_size=(size_t)strtoul(argv[1], 0, 10);
+  int i, j, total=0, passed=0;
+  for (i=0; i<(int)(sizeof(families)/sizeof(families[0])); i++) {
+    if (argc>2) { // run only families named on command line
+      for (j=2; j<argc && strcmp(argv[j], families[i].name); j++);
+      if (j==argc) continue;
+    }
+    passed+=run_family(&families[i], max_size);
+    total++;
+  }
+  printf("\nPASSED %d OUT OF %d\n", passed, total);
+  return passed==total? EXIT_SUCCESS:EXIT_FAILURE;
+}
@@ -1,8 +1,13 @@
 # coding=utf-8
 
-import StringIO, time, gc
-from nxcreole import CreoleParser, render_xhtml
-from nxcreole import html_escape
+import StringIO, sys, time, gc, os, signal, zlib, gzip, tempfile, select, json
+from nxcreole import CreoleParser, render_xhtml, render_xhtml_async, Template, Markup, markup_defaults
+from nxcreole import enable_cache, disable_cache, cache_stats
+from nxcreole import html_escape, extract_links, render_text, render_all
+from nxcreole import render_xhtml_utf8, xhtml_size, render_xhtml_resolved, render_xhtml_bounded
+from nxcreole import render_xhtml_compressed, render_json, render_xhtml_toc
+from nxcreole import sections, render_section, parse_events
+import nxcreole.parser
 
 # NOTE: run this script from project root directory:
 #       python tests/nxcreole_test.py
@@ -38,6 +43,467 @@ def run_all_tests():
     else:
       print '%03d FAILED' % i
 
+    expected=file_read(PATH_TO_TESTS+'%03d.expected.txt' % i)
+    if expected is not None:
+      if render_text(text).decode('utf-8')==expected:
+        print '%03d TEXT PASSED' % i
+      else:
+        print '%03d TEXT FAILED' % i
+
+class CallCounter(CreoleParser):
+  def __init__(self, out, composites):
+    CreoleParser.__init__(self, out)
+    self.calls=0
+    self.depth=0
+    if not composites: # pretend to be serializer written before composite methods
+      for name in ('append_table_cell_next', 'append_table_head_cell_next', 'append_table_row_next', 'append_list_close_run'):
+        setattr(self, name, None)
+
+  def __getattribute__(self, name):
+    attr=CreoleParser.__getattribute__(self, name)
+    if name.startswith('append_') and attr is not None:
+      def counted(*args):
+        if not self.depth: # calls from parser only, not from composite methods
+          self.calls+=1
+        self.depth+=1
+        try:
+          return attr(*args)
+        finally:
+          self.depth-=1
+      return counted
+    return attr
+
+def run_fused_tests():
+  # fused events render same as raw ones, with fewer calls
+  for i in xrange(1, 100):
+    text=file_read(PATH_TO_TESTS+'%03d.creole' % i)
+    if text is None:
+      break
+    expected=file_read(PATH_TO_TESTS+'%03d.expected' % i)
+    results=[]
+    for fuse, composites in ((False, True), (True, False), (True, True)):
+      out=StringIO.StringIO()
+      parser=CallCounter(out, composites)
+      parser.parse(text, fuse=fuse)
+      results.append((out.getvalue(), parser.calls))
+    (raw, raw_calls), (text_only, text_only_calls), (fused, fused_calls)=results
+    if raw==text_only==fused==expected and raw_calls>=text_only_calls>=fused_calls:
+      print '%03d FUSED PASSED (%d/%d/%d calls)' % (i, raw_calls, text_only_calls, fused_calls)
+    else:
+      print '%03d FUSED FAILED' % i
+
+class ClassedCells(CreoleParser):
+  # overrides raw method only; inherited composite must not bypass it
+  def append_table_cell_open(self, colspan):
+    self.out.write('<td class="x">')
+
+def run_fused_override_tests():
+  out=StringIO.StringIO()
+  ClassedCells(out).parse(u'|a|b|c|', fuse=True)
+  if out.getvalue().count('<td class="x">')==3:
+    print 'FUSED OVERRIDE PASSED'
+  else:
+    print 'FUSED OVERRIDE FAILED'
+
+STATS_KEYS=set(['events', 'bytes_scanned', 'text_flushes', 'full_buffer_flushes', 'delimiter_scans',
+                 'delimiter_scan_hits', 'delimiter_scan_chars', 'max_list_depth', 'max_format_depth',
+                 'parse_time', 'callback_time'])
+
+def nonzero_events(stats):
+  return dict((name, n) for name, n in stats['events'].items() if n)
+
+def run_stats_tests():
+  wchar_size=4 if sys.maxunicode>0xffff else 2
+  text=file_read(PATH_TO_TESTS+'001.creole')
+  stats=CreoleParser(StringIO.StringIO()).parse(text, stats=True)
+  counter=CallCounter(StringIO.StringIO(), True)
+  counter.parse(text)
+  ok=set(stats)==STATS_KEYS and len(stats['events'])==26 and all(name.startswith('append_') for name in stats['events'])
+  ok=ok and sum(stats['events'].values())==counter.calls==14 and stats['bytes_scanned']==len(text)*wchar_size
+  ok=ok and nonzero_events(stats)=={'append_paragraph_open': 2, 'append_paragraph_close': 2, 'append_text': 6,
+                                    'append_format_open': 2, 'append_format_close': 2}
+  ok=ok and stats['text_flushes']==6 and stats['full_buffer_flushes']==0 and stats['max_format_depth']==2
+  ok=ok and stats['parse_time']>0 and stats['callback_time']>0
+  # depths and delimiter scans
+  stats=CreoleParser(StringIO.StringIO()).parse(u'* a\n** b //c **d**//\n*** e\n', stats=True)
+  ok=ok and stats['max_list_depth']==3 and stats['max_format_depth']==2 and stats['events']['append_list_open']==3
+  stats=CreoleParser(StringIO.StringIO()).parse(u'[[a [[b]] {{c}} [[d', stats=True)
+  ok=ok and stats['delimiter_scans']==3 and stats['delimiter_scan_chars']==7
+  ok=ok and nonzero_events(stats)=={'append_paragraph_open': 1, 'append_paragraph_close': 1, 'append_text': 2,
+                                    'append_link': 1, 'append_image': 1}
+  parser=CreoleParser(StringIO.StringIO())
+  ok=ok and parser.parse(text, stats=False) is None and parser.parse(text) is None
+  print 'STATS %s' % ('PASSED' if ok else 'FAILED')
+
+class LinkCollector(CreoleParser):
+  def __init__(self):
+    CreoleParser.__init__(self, StringIO.StringIO())
+    self.links=[]
+
+  def append_link(self, s):
+    self.links.append(('link', s))
+
+  def append_image(self, s):
+    self.links.append(('image', s))
+
+  def append_placeholder(self, s):
+    self.links.append(('placeholder', s))
+
+def run_links_tests():
+  # extract_links() must find exactly what full parse does
+  for i in xrange(1, 100):
+    text=file_read(PATH_TO_TESTS+'%03d.creole' % i)
+    if text is None:
+      break
+    collector=LinkCollector()
+    collector.parse(text)
+    links=extract_links(text)
+    if [(kind, target) for kind, target, offset in links]==collector.links \
+        and all(text[offset:offset+len(target)]==target for kind, target, offset in links):
+      print '%03d LINKS PASSED' % i
+    else:
+      print '%03d LINKS FAILED' % i
+
+def run_render_all_tests():
+  # render_all() must produce the same as separate passes
+  for i in xrange(1, 100):
+    text=file_read(PATH_TO_TESTS+'%03d.creole' % i)
+    if text is None:
+      break
+    expected=file_read(PATH_TO_TESTS+'%03d.expected' % i)
+    xhtml, plain, links=render_all(text)
+    if xhtml.decode('utf-8')==expected and plain==render_text(text) and links==extract_links(text) \
+        and render_xhtml_utf8(text)==xhtml and xhtml_size(text)==len(xhtml):
+      print '%03d ALL PASSED' % i
+    else:
+      print '%03d ALL FAILED' % i
+
+def run_template_tests():
+  # default splice is regular rendering; holes are filled from map
+  for i in xrange(1, 100):
+    text=file_read(PATH_TO_TESTS+'%03d.creole' % i)
+    if text is None:
+      break
+    expected=file_read(PATH_TO_TESTS+'%03d.expected' % i)
+    tpl=Template(text)
+    filled=tpl.splice(dict((name, '<hole/>') for name in tpl.names))
+    if tpl.splice({}).decode('utf-8')==expected and filled.count('<hole/>')==len(tpl.names) \
+        and filled.replace('<hole/>', '')==''.join(tpl.fragments):
+      print '%03d TEMPLATE PASSED' % i
+    else:
+      print '%03d TEMPLATE FAILED' % i
+
+def resolve_links(targets):
+  # same as test resolver in main.c
+  return [(not target.startswith('Missing'), None if ':' in target else u'/wiki/'+target)
+          for kind, target in targets]
+
+def run_resolved_tests():
+  for i in xrange(1, 100):
+    text=file_read(PATH_TO_TESTS+'%03d.creole' % i)
+    if text is None:
+      break
+    expected=file_read(PATH_TO_TESTS+'%03d.expected.resolved' % i)
+    if expected is None:
+      continue
+    calls=[]
+    result=render_xhtml_resolved(text, lambda targets: calls.append(targets) or resolve_links(targets))
+    targets=calls[0] if calls else []
+    if result.decode('utf-8')==expected and len(calls)==1 and len(set(targets))==len(targets):
+      print '%03d RESOLVED PASSED' % i
+    else:
+      print '%03d RESOLVED FAILED' % i
+
+def run_cache_tests():
+  # pages rendered by forked child must be served from cache to parent
+  enable_cache(1024*1024, 65536)
+  for i in xrange(1, 100):
+    text=file_read(PATH_TO_TESTS+'%03d.creole' % i)
+    if text is None:
+      break
+    expected=file_read(PATH_TO_TESTS+'%03d.expected' % i)
+    pid=os.fork()
+    if not pid:
+      os._exit(0 if render_xhtml(text)==expected else 1)
+    child_ok=os.waitpid(pid, 0)[1]==0
+    hits=cache_stats()['hits']
+    if child_ok and render_xhtml(text)==expected and cache_stats()['hits']==hits+1:
+      print '%03d CACHE PASSED' % i
+    else:
+      print '%03d CACHE FAILED' % i
+  disable_cache()
+
+def run_sections_tests():
+  # same dump as in main.c
+  for i in xrange(1, 100):
+    text=file_read(PATH_TO_TESTS+'%03d.creole' % i)
+    if text is None:
+      break
+    expected=file_read(PATH_TO_TESTS+'%03d.expected.sections' % i)
+    if expected is None:
+      continue
+    result=u''
+    for section in sections(text):
+      level, title, start, end, lists, tables=section
+      result+=u'--- %d [%d:%d] lists:%d tables:%d title:%s\n' % (level, start, end, len(lists), tables, title)
+      result+=render_section(text, section).decode('utf-8')+u'\n'
+    if result==expected:
+      print '%03d SECTIONS PASSED' % i
+    else:
+      print '%03d SECTIONS FAILED' % i
+  # table level that no text before section could give is rejected
+  text=u'{|\n= A =\ncell\n|}\n'
+  ok=True
+  section=sections(text)[0]
+  for tables in (-1, 2, 1<<30):
+    try:
+      render_section(text, section[:5]+(tables,))
+      ok=False
+    except ValueError:
+      pass
+  ok=ok and section[4]==u'' and '<table>' in render_section(text, section)
+  print 'SECTIONS TABLE LEVEL %s' % ('PASSED' if ok else 'FAILED')
+
+def run_spans_tests():
+  # spans go forward through source; links and such are found right where they say
+  for i in xrange(1, 100):
+    text=file_read(PATH_TO_TESTS+'%03d.creole' % i)
+    if text is None:
+      break
+    ok=True
+    last=0
+    for name, payload, start, end in parse_events(text):
+      ok=ok and last<=start<=end<=len(text)
+      if name in ('append_link', 'append_image', 'append_placeholder'):
+        ok=ok and payload in text[start:end]
+      last=start
+    if ok:
+      print '%03d SPANS PASSED' % i
+    else:
+      print '%03d SPANS FAILED' % i
+
+def run_limited_tests():
+  # same limits as in main.c; without limits output is not affected
+  for i in xrange(1, 100):
+    text=file_read(PATH_TO_TESTS+'%03d.creole' % i)
+    if text is None:
+      break
+    expected=file_read(PATH_TO_TESTS+'%03d.expected' % i)
+    ok=expected is None or render_xhtml_bounded(text)==(expected.encode('utf-8'), None)
+    expected=file_read(PATH_TO_TESTS+'%03d.expected.limited' % i)
+    if expected is not None:
+      ok=ok and render_xhtml_bounded(text, max_scan_chars=200, max_nesting=3)==(expected.encode('utf-8'), 'scan')
+    if ok:
+      print '%03d LIMITED PASSED' % i
+    else:
+      print '%03d LIMITED FAILED' % i
+  # runaway input is cut short: events and output limits
+  text=u'**a //b '*100000
+  xhtml, limit=render_xhtml_bounded(text, max_events=1000)
+  ok=limit=='events' and xhtml.endswith(text.encode('utf-8')[-100:]+'</p>\n') # rest of text passed as is
+  print 'EVENTS LIMIT %s' % ('PASSED' if ok else 'FAILED')
+  xhtml, limit=render_xhtml_bounded(text, max_output=10000)
+  print 'OUTPUT LIMIT %s' % ('PASSED' if limit=='output' and len(xhtml)<11000 else 'FAILED')
+
+def run_compressed_tests():
+  # gzip and deflate streams decompress to regular rendering, in memory and written to file
+  for i in xrange(1, 100):
+    text=file_read(PATH_TO_TESTS+'%03d.creole' % i)
+    if text is None:
+      break
+    expected=render_xhtml_utf8(text)
+    ok=zlib.decompress(render_xhtml_compressed(text, 'deflate'))==expected
+    ok=ok and gzip.GzipFile(fileobj=StringIO.StringIO(render_xhtml_compressed(text, level=9)), mode='rb').read()==expected
+    with tempfile.TemporaryFile() as f:
+      ok=ok and render_xhtml_compressed(text, format='gzip', fd=f.fileno()) is None
+      f.seek(0)
+      ok=ok and gzip.GzipFile(fileobj=f, mode='rb').read()==expected
+    if ok:
+      print '%03d COMPRESSED PASSED' % i
+    else:
+      print '%03d COMPRESSED FAILED' % i
+  try:
+    render_xhtml_compressed(u'x', 'zip')
+    ok=False
+  except ValueError:
+    ok=True
+  print 'COMPRESSED ERRORS %s' % ('PASSED' if ok else 'FAILED')
+
+def run_json_tests():
+  # valid JSON for every test, matching expected tree where there is one
+  for i in xrange(1, 100):
+    text=file_read(PATH_TO_TESTS+'%03d.creole' % i)
+    if text is None:
+      break
+    try:
+      tree=json.loads(render_json(text))
+      ok=isinstance(tree, list) and all(isinstance(n, list) for n in tree)
+    except ValueError:
+      ok=False
+    expected=file_read(PATH_TO_TESTS+'%03d.expected.json' % i)
+    if expected is not None:
+      ok=ok and render_json(text).decode('utf-8')==expected
+    if ok:
+      print '%03d JSON PASSED' % i
+    else:
+      print '%03d JSON FAILED' % i
+  text=u'a "b" \\\\ c</script>\u2028 d \x01 [[x|t\u00e9]]'
+  tree=json.loads(render_json(text))
+  ok=tree==[[u'p', u'a "b" ', [u'br'], u' c</script>\u2028 d \x01 ', [u'link', {u'target': u'x', u'title': u't\u00e9'}]]]
+  ok=ok and '</' not in render_json(text) and u'\u2028' not in render_json(text).decode('utf-8')
+  print 'JSON ESCAPES %s' % ('PASSED' if ok else 'FAILED')
+
+def run_toc_tests():
+  for i in xrange(1, 100):
+    text=file_read(PATH_TO_TESTS+'%03d.creole' % i)
+    if text is None:
+      break
+    expected=file_read(PATH_TO_TESTS+'%03d.expected.toc' % i)
+    if expected is None:
+      continue
+    xhtml, toc=render_xhtml_toc(text)
+    if (xhtml+'--- toc\n'+toc).decode('utf-8')==expected:
+      print '%03d TOC PASSED' % i
+    else:
+      print '%03d TOC FAILED' % i
+  # ids stay unique when titles collide with suffixed ones
+  xhtml, toc=render_xhtml_toc(u'= a =\n= a =\n= a 2 =\n= a =\n')
+  ids=[s.split('"')[0] for s in xhtml.split(' id="')[1:]]
+  ok=ids==['a', 'a-2', 'a-2-2', 'a-3'] and toc.count('<li>')==4 and render_xhtml_toc(u'no headings')==('<p>no headings</p>\n', '')
+  print 'TOC IDS %s' % ('PASSED' if ok else 'FAILED')
+
+class MiniFuture(object):
+  def __init__(self):
+    self.value=self.error=None
+    self.finished=False
+  def cancelled(self):
+    return False
+  def set_result(self, value):
+    self.value, self.finished=value, True
+  def set_exception(self, error):
+    self.error, self.finished=error, True
+
+class MiniLoop(object):
+  """
+  Just enough of asyncio event loop for render_xhtml_async(): readers and futures.
+  """
+  def __init__(self):
+    self.readers={}
+  def create_future(self):
+    return MiniFuture()
+  def add_reader(self, fd, callback, *args):
+    self.readers[fd]=(callback, args)
+  def remove_reader(self, fd):
+    return self.readers.pop(fd, None) is not None
+  def run_until_done(self, futures, timeout=30):
+    deadline=time.time()+timeout
+    while not all(f.finished for f in futures) and time.time()<deadline:
+      ready, _, _=select.select(self.readers.keys(), [], [], 1)
+      for fd in ready:
+        callback, args=self.readers[fd]
+        callback(*args)
+
+def run_async_tests():
+  # all test files at once, and big page; loop is not blocked while it renders
+  loop=MiniLoop()
+  texts=[]
+  for i in xrange(1, 100):
+    text=file_read(PATH_TO_TESTS+'%03d.creole' % i)
+    if text is None:
+      break
+    texts.append(text)
+  futures=[render_xhtml_async(text, loop=loop) for text in texts]
+  loop.run_until_done(futures)
+  for i, (text, future) in enumerate(zip(texts, futures)):
+    if future.finished and future.value==render_xhtml(text):
+      print '%03d ASYNC PASSED' % (i+1)
+    else:
+      print '%03d ASYNC FAILED' % (i+1)
+  big=u''.join(texts)*200
+  tm=time.time()
+  render_xhtml_utf8(big)
+  sync_time=time.time()-tm
+  tm=time.time()
+  future=render_xhtml_async(big, loop=loop)
+  submit_time=time.time()-tm
+  loop.run_until_done([future])
+  ok=future.finished and future.value==render_xhtml_utf8(big).decode('utf-8') and submit_time<sync_time/10
+  ok=ok and not loop.readers # nothing to wait for
+  print 'ASYNC BIG PAGE %s' % ('PASSED' if ok else 'FAILED')
+  # forked child gets its own pool; job submitted before fork is parent's business
+  future=render_xhtml_async(big, loop=loop)
+  pid=os.fork()
+  if not pid:
+    signal.alarm(10) # don't hang if child's pool never completes
+    child_future=render_xhtml_async(texts[0], loop=loop)
+    loop.run_until_done([child_future])
+    os._exit(0 if child_future.value==render_xhtml(texts[0]) else 1)
+  _, status=os.waitpid(pid, 0)
+  loop.run_until_done([future])
+  ok=status==0 and future.value==render_xhtml_utf8(big).decode('utf-8')
+  print 'ASYNC AFTER FORK %s' % ('PASSED' if ok else 'FAILED')
+
+def run_async_loop_tests():
+  # real event loops: asyncio, or trollius on Python 2
+  try:
+    import asyncio
+  except ImportError:
+    try:
+      import trollius as asyncio
+    except ImportError:
+      print 'ASYNC EVENT LOOP SKIPPED (trollius not installed)'
+      return
+  texts=[]
+  for i in xrange(1, 100):
+    text=file_read(PATH_TO_TESTS+'%03d.creole' % i)
+    if text is None:
+      break
+    texts.append(text)
+  bigs=[text*2000 for text in texts[:4]]
+  loop, other_loop=asyncio.new_event_loop(), asyncio.new_event_loop()
+  try:
+    # other loop's jobs go first, so they complete while only loop runs: its reader
+    # collects them and hands results over by other_loop.call_soon_threadsafe()
+    other_futures=[render_xhtml_async(text, loop=other_loop) for text in texts]
+    futures=[render_xhtml_async(big, loop=loop) for big in bigs]
+    loop.run_until_complete(asyncio.wait(futures, loop=loop, timeout=30))
+    ok=all(f.done() and f.result()==render_xhtml(big) for f, big in zip(futures, bigs))
+    ok=ok and not any(f.done() for f in other_futures) # set only when other loop runs
+    other_loop.run_until_complete(asyncio.wait(other_futures, loop=other_loop, timeout=30))
+    ok=ok and all(f.done() and f.result()==render_xhtml(text) for f, text in zip(other_futures, texts))
+    ok=ok and loop not in nxcreole.parser._async_loops and other_loop not in nxcreole.parser._async_loops
+  finally:
+    loop.close()
+    other_loop.close()
+  print 'ASYNC EVENT LOOP %s' % ('PASSED' if ok else 'FAILED')
+
+def run_markup_tests():
+  # built-in table renders same as XHTML; same configs as in main.c
+  default_markup=Markup()
+  for i in xrange(1, 100):
+    text=file_read(PATH_TO_TESTS+'%03d.creole' % i)
+    if text is None:
+      break
+    expected=file_read(PATH_TO_TESTS+'%03d.expected' % i)
+    ok=expected is None or default_markup.render(text).decode('utf-8')==expected
+    config=file_read(PATH_TO_TESTS+'%03d.markup' % i)
+    if config is not None:
+      expected=file_read(PATH_TO_TESTS+'%03d.expected.markup' % i)
+      ok=ok and Markup(config=config).render(text).decode('utf-8')==expected
+    if ok:
+      print '%03d MARKUP PASSED' % i
+    else:
+      print '%03d MARKUP FAILED' % i
+  ok=Markup(markup_defaults()).render(u'**a**')==default_markup.render(u'**a**')
+  ok=ok and Markup({'format_open.*': u'<b \u2605>'}).render(u'**a**')==u'<p><b \u2605>a</strong></p>\n'.encode('utf-8')
+  for bad in ({'no_such_key': ''}, {'link': '<a href="{url}">'}):
+    try:
+      Markup(bad)
+      ok=False
+    except (KeyError, ValueError):
+      pass
+  print 'MARKUP ERRORS %s' % ('PASSED' if ok else 'FAILED')
+
 def long_run(num_iterations):
   # C version is 30 times faster than https://pypi.python.org/pypi/creole in this test
   text=file_read(PATH_TO_TESTS+'006.creole')
@@ -73,3 +539,20 @@ def test_html_escape(num_iterations):
 #test_html_escape(500000)
 #long_run(50000)
 run_all_tests()
+run_links_tests()
+run_render_all_tests()
+run_template_tests()
+run_resolved_tests()
+run_cache_tests()
+run_sections_tests()
+run_spans_tests()
+run_limited_tests()
+run_compressed_tests()
+run_json_tests()
+run_toc_tests()
+run_async_tests()
+run_async_loop_tests()
+run_fused_tests()
+run_fused_override_tests()
+run_stats_tests()
+run_markup_tests()